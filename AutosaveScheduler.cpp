@@ -0,0 +1,210 @@
+#include "AutosaveScheduler.h"
+#include "EditJournal.h"
+#include <QtCore/QDebug>
+#include <QtConcurrent/QtConcurrentRun>
+
+AutosaveScheduler::AutosaveScheduler(QObject *parent)
+    : QObject(parent), m_isRichText(false), m_dirty(false), m_flushQueued(false), m_pendingEdits(0), m_saveInFlight(false),
+      m_writeQueued(false), m_saveSerial(0), m_inFlightDocument(nullptr), m_inFlightEdits(0), m_inFlightDirtyMs(0), m_totalSaves(0), m_totalEdits(0)
+{
+  // Save once typing pauses...
+  m_idleTimer.setSingleShot(true);
+  m_idleTimer.setInterval(750);
+  connect(&m_idleTimer, &QTimer::timeout, this, &AutosaveScheduler::flush);
+
+  // ...but never let a continuous burst of typing go unsaved for too long
+  m_maxLatencyTimer.setSingleShot(true);
+  m_maxLatencyTimer.setInterval(5000);
+  connect(&m_maxLatencyTimer, &QTimer::timeout, this, &AutosaveScheduler::flush);
+
+  connect(&m_watcher, &QFutureWatcher<Serialized>::finished, this, &AutosaveScheduler::onSerialized);
+}
+
+AutosaveScheduler::~AutosaveScheduler()
+{
+  flushNow();
+}
+
+void AutosaveScheduler::setDocument(QTextDocument *document, const QString &filePath, bool isRichText)
+{
+  // Whatever is loaded into the document now is what is on disk
+  m_idleTimer.stop();
+  m_maxLatencyTimer.stop();
+  m_document = document;
+  m_filePath = filePath;
+  m_isRichText = isRichText;
+  m_dirty = false;
+  m_flushQueued = false;
+  m_pendingEdits = 0;
+}
+
+void AutosaveScheduler::setFilePath(const QString &filePath)
+{
+  m_filePath = filePath;
+}
+
+void AutosaveScheduler::setIdleInterval(int msec)
+{
+  m_idleTimer.setInterval(msec);
+}
+
+void AutosaveScheduler::setMaxLatency(int msec)
+{
+  m_maxLatencyTimer.setInterval(msec);
+}
+
+void AutosaveScheduler::markDirty()
+{
+  if (!m_document || m_filePath.isEmpty())
+    return;
+
+  if (!m_dirty)
+  {
+    m_dirty = true;
+    m_dirtySince.start();
+    m_maxLatencyTimer.start();
+  }
+  m_pendingEdits++;
+  m_idleTimer.start();
+}
+
+void AutosaveScheduler::flush()
+{
+  if (!m_dirty)
+    return;
+
+  // Only one save in flight at a time; pick up the rest when it lands
+  if (m_saveInFlight)
+  {
+    m_flushQueued = true;
+    return;
+  }
+
+  Snapshot snapshot = takeSnapshot();
+  if (snapshot.filePath.isEmpty())
+    return;
+
+  m_saveInFlight = true;
+  m_writeQueued = false;
+  m_saveSerial++;
+  m_inFlightPath = snapshot.filePath;
+  m_inFlightDocument = snapshot.richDocument;
+  m_inFlightTimer.start();
+  m_watcher.setFuture(QtConcurrent::run(&AutosaveScheduler::serialize, snapshot));
+}
+
+void AutosaveScheduler::flushNow()
+{
+  m_flushQueued = false;
+  if (m_saveInFlight)
+  {
+    // Let the older snapshot land first so writes stay ordered. Only the
+    // worker's and the writer's own futures are waited on here; the
+    // continuation that would have reaped the save runs on this thread
+    m_watcher.waitForFinished();
+    onSerialized();
+    m_inFlightWrite.waitForFinished();
+    onSaveFinished(m_saveSerial, m_inFlightWrite.result().ok);
+  }
+
+  if (!m_dirty)
+    return;
+
+  Snapshot snapshot = takeSnapshot();
+  if (snapshot.filePath.isEmpty())
+    return;
+
+  m_inFlightTimer.start();
+  Serialized serialized = serialize(snapshot);
+  delete snapshot.richDocument;
+  bool ok = DocumentWriter::instance().write(snapshot.filePath, serialized.data).result().ok;
+
+  qint64 latency = m_inFlightDirtyMs + m_inFlightTimer.elapsed();
+  m_totalSaves++;
+  qDebug() << "Autosave (sync):" << snapshot.filePath << "ok =" << ok << "latency =" << latency << "ms"
+           << "coalesced edits =" << m_inFlightEdits;
+  emit saveCompleted(snapshot.filePath, ok, latency, m_inFlightEdits, serialized.checksum);
+}
+
+AutosaveScheduler::Snapshot AutosaveScheduler::takeSnapshot()
+{
+  Snapshot snapshot;
+  if (!m_document || m_filePath.isEmpty())
+    return snapshot;
+
+  snapshot.filePath = m_filePath;
+  if (m_isRichText)
+  {
+    // Cloning copies the document's internal buffers; the expensive HTML
+    // serialization then runs on the worker against the private copy
+    snapshot.richDocument = m_document->clone();
+  }
+  else
+  {
+    snapshot.text = m_document->toPlainText();
+  }
+
+  m_inFlightEdits = m_pendingEdits;
+  m_inFlightDirtyMs = m_dirtySince.elapsed();
+  m_totalEdits += m_pendingEdits;
+
+  m_dirty = false;
+  m_pendingEdits = 0;
+  m_idleTimer.stop();
+  m_maxLatencyTimer.stop();
+
+  emit snapshotTaken(snapshot.filePath);
+  return snapshot;
+}
+
+AutosaveScheduler::Serialized AutosaveScheduler::serialize(const Snapshot &snapshot)
+{
+  Serialized serialized;
+  QString content = snapshot.richDocument ? snapshot.richDocument->toHtml() : snapshot.text;
+  serialized.data = content.toUtf8();
+
+  // Lets the edit journal verify which file contents its records apply to
+  serialized.checksum = EditJournal::checksum(serialized.data);
+  return serialized;
+}
+
+void AutosaveScheduler::onSerialized()
+{
+  // flushNow() may already have queued this write
+  if (!m_saveInFlight || m_writeQueued)
+    return;
+  m_writeQueued = true;
+
+  Serialized serialized = m_watcher.result();
+  delete m_inFlightDocument;
+  m_inFlightDocument = nullptr;
+  m_inFlightChecksum = serialized.checksum;
+
+  // The save stays in flight until the data is on disk, so the journal is
+  // never compacted early
+  quint64 serial = m_saveSerial;
+  m_inFlightWrite = DocumentWriter::instance().write(m_inFlightPath, serialized.data);
+  m_inFlightWrite.then(this, [this, serial](const DocumentWriter::Result &result)
+                       { onSaveFinished(serial, result.ok); });
+}
+
+void AutosaveScheduler::onSaveFinished(quint64 serial, bool ok)
+{
+  // flushNow() may already have reaped this save
+  if (!m_saveInFlight || serial != m_saveSerial)
+    return;
+  m_saveInFlight = false;
+
+  qint64 latency = m_inFlightDirtyMs + m_inFlightTimer.elapsed();
+  m_totalSaves++;
+  qDebug() << "Autosave:" << m_inFlightPath << "ok =" << ok << "latency =" << latency << "ms"
+           << "coalesced edits =" << m_inFlightEdits
+           << "(" << m_totalEdits << "edits in" << m_totalSaves << "saves )";
+  emit saveCompleted(m_inFlightPath, ok, latency, m_inFlightEdits, m_inFlightChecksum);
+
+  if (m_flushQueued)
+  {
+    m_flushQueued = false;
+    flush();
+  }
+}
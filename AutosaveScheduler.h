@@ -0,0 +1,85 @@
+#pragma once
+
+#include <QtCore/QObject>
+#include <QtCore/QTimer>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFutureWatcher>
+#include <QtCore/QPointer>
+#include <QtGui/QTextDocument>
+#include "DocumentWriter.h"
+
+// Coalesces edits to the open document into idle-time or max-latency saves.
+// Serialization happens on a worker thread and the write on DocumentWriter's,
+// with nothing waiting on either; flushNow() is the only blocking path and is
+// meant for file switches and quit.
+class AutosaveScheduler : public QObject
+{
+  Q_OBJECT
+
+public:
+  explicit AutosaveScheduler(QObject *parent = nullptr);
+  ~AutosaveScheduler();
+
+  void setDocument(QTextDocument *document, const QString &filePath, bool isRichText);
+  void setFilePath(const QString &filePath);
+  void setIdleInterval(int msec);
+  void setMaxLatency(int msec);
+  bool isDirty() const { return m_dirty; }
+
+public slots:
+  void markDirty();
+  void flush();
+  void flushNow();
+
+signals:
+  void snapshotTaken(const QString &filePath);
+  void saveCompleted(const QString &filePath, bool ok, qint64 latencyMs, int coalescedEdits, const QByteArray &checksum);
+
+private slots:
+  void onSerialized();
+
+private:
+  struct Snapshot
+  {
+    QString filePath;
+    QString text;
+    QTextDocument *richDocument = nullptr;
+  };
+
+  struct Serialized
+  {
+    QByteArray data;
+    QByteArray checksum;
+  };
+
+  Snapshot takeSnapshot();
+  static Serialized serialize(const Snapshot &snapshot);
+  void onSaveFinished(quint64 serial, bool ok);
+
+  QPointer<QTextDocument> m_document;
+  QString m_filePath;
+  bool m_isRichText;
+
+  bool m_dirty;
+  bool m_flushQueued;
+  int m_pendingEdits;
+  QElapsedTimer m_dirtySince;
+  QTimer m_idleTimer;
+  QTimer m_maxLatencyTimer;
+
+  // State of the save currently being serialized or written
+  QFutureWatcher<Serialized> m_watcher;
+  QFuture<DocumentWriter::Result> m_inFlightWrite;
+  bool m_saveInFlight;
+  bool m_writeQueued;
+  quint64 m_saveSerial;
+  QByteArray m_inFlightChecksum;
+  QString m_inFlightPath;
+  QTextDocument *m_inFlightDocument;
+  int m_inFlightEdits;
+  qint64 m_inFlightDirtyMs;
+  QElapsedTimer m_inFlightTimer;
+
+  quint64 m_totalSaves;
+  quint64 m_totalEdits;
+};
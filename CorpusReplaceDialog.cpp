@@ -0,0 +1,184 @@
+#include "CorpusReplaceDialog.h"
+#include <QtCore/QFileInfo>
+#include <QtWidgets/QFormLayout>
+#include <QtWidgets/QHBoxLayout>
+#include <QtWidgets/QVBoxLayout>
+
+CorpusReplaceDialog::CorpusReplaceDialog(FileTreeWidget *fileTree, QWidget *parent)
+    : QDialog(parent), m_fileTree(fileTree), m_search(new CorpusSearch(this)), m_scope(new QComboBox(this)),
+      m_find(new QLineEdit(this)), m_replace(new QLineEdit(this)), m_regex(new QCheckBox("Regex", this)),
+      m_findButton(new QPushButton("Find", this)), m_replaceButton(new QPushButton("Replace Selected", this)),
+      m_results(new QTreeWidget(this)), m_status(new QLabel(this))
+{
+  setWindowTitle("Replace in Documents");
+  resize(640, 520);
+
+  QFormLayout *form = new QFormLayout();
+  form->addRow("In:", m_scope);
+  form->addRow("Find:", m_find);
+  form->addRow("Replace:", m_replace);
+
+  QHBoxLayout *buttons = new QHBoxLayout();
+  buttons->addWidget(m_regex);
+  buttons->addStretch();
+  buttons->addWidget(m_findButton);
+  buttons->addWidget(m_replaceButton);
+
+  QVBoxLayout *layout = new QVBoxLayout(this);
+  layout->addLayout(form);
+  layout->addLayout(buttons);
+  layout->addWidget(m_results);
+  layout->addWidget(m_status);
+
+  m_results->setHeaderHidden(true);
+  m_results->setUniformRowHeights(true);
+  m_findButton->setDefault(true);
+  m_replaceButton->setEnabled(false);
+
+  connect(m_findButton, &QPushButton::clicked, this, &CorpusReplaceDialog::find);
+  connect(m_find, &QLineEdit::returnPressed, this, &CorpusReplaceDialog::find);
+  connect(m_replaceButton, &QPushButton::clicked, this, &CorpusReplaceDialog::replaceSelected);
+  connect(m_results, &QTreeWidget::itemDoubleClicked, this, [this](QTreeWidgetItem *item)
+          {
+    QTreeWidgetItem *fileItem = item->parent() ? item->parent() : item;
+    emit fileSelected(m_files.at(fileItem->data(0, Qt::UserRole).toInt()).path); });
+
+  connect(m_search, &CorpusSearch::fileMatched, this, &CorpusReplaceDialog::onFileMatched);
+  connect(m_search, &CorpusSearch::progress, this, [this](int done, int total)
+          { m_status->setText(QString("Searching %1 of %2 files...").arg(done).arg(total)); });
+  connect(m_search, &CorpusSearch::finished, this, &CorpusReplaceDialog::onFinished);
+  connect(m_search, &CorpusSearch::committed, this, &CorpusReplaceDialog::onCommitted);
+}
+
+void CorpusReplaceDialog::setOpenDocument(const QString &filePath, QTextDocument *document)
+{
+  m_search->setOpenDocument(filePath, document);
+}
+
+void CorpusReplaceDialog::showEvent(QShowEvent *event)
+{
+  // Locations and smart folders can change between uses
+  QString current = m_scope->currentText();
+  m_scope->clear();
+  m_scope->addItems(m_fileTree->searchScopes());
+  int index = m_scope->findText(current);
+  if (index >= 0)
+    m_scope->setCurrentIndex(index);
+
+  QDialog::showEvent(event);
+  m_find->setFocus();
+  m_find->selectAll();
+}
+
+void CorpusReplaceDialog::find()
+{
+  m_results->clear();
+  m_files.clear();
+  m_replaceButton->setEnabled(false);
+
+  ReplaceEngine::Mode mode = m_regex->isChecked() ? ReplaceEngine::Regex : ReplaceEngine::Literal;
+  QStringList files = m_fileTree->filesInScope(m_scope->currentText());
+  if (!m_search->start(files, m_find->text(), m_replace->text(), mode))
+  {
+    m_status->setText(m_search->errorString());
+    return;
+  }
+  m_findButton->setEnabled(false);
+}
+
+void CorpusReplaceDialog::onFileMatched(const CorpusSearch::FileResult &result)
+{
+  QTreeWidgetItem *fileItem = new QTreeWidgetItem(m_results);
+  fileItem->setText(0, QString("%1 (%2)").arg(QFileInfo(result.path).fileName()).arg(result.hits.size()));
+  fileItem->setToolTip(0, result.path);
+  fileItem->setData(0, Qt::UserRole, int(m_files.size()));
+  fileItem->setFlags(fileItem->flags() | Qt::ItemIsUserCheckable | Qt::ItemIsAutoTristate);
+  fileItem->setCheckState(0, Qt::Checked);
+
+  for (int i = 0; i < result.hits.size(); ++i)
+  {
+    const CorpusSearch::Hit &hit = result.hits.at(i);
+    // The line as it will read after the replacement
+    QString before = hit.context.left(hit.contextStart);
+    QString match = hit.context.mid(hit.contextStart, hit.edit.length);
+    QString after = hit.context.mid(hit.contextStart + hit.edit.length);
+    QString preview = QString("%1: %2[%3 → %4]%5").arg(hit.line).arg(before, match, hit.edit.replacement, after);
+
+    QTreeWidgetItem *hitItem = new QTreeWidgetItem(fileItem);
+    hitItem->setText(0, preview.simplified());
+    // The lines around it, as they read now
+    QStringList lines;
+    if (!hit.linesBefore.isEmpty())
+      lines.append(hit.linesBefore);
+    lines.append(hit.context);
+    if (!hit.linesAfter.isEmpty())
+      lines.append(hit.linesAfter);
+    hitItem->setToolTip(0, Qt::convertFromPlainText(lines.join(u'\n'), Qt::WhiteSpaceNormal));
+    hitItem->setData(0, Qt::UserRole, i);
+    hitItem->setFlags(hitItem->flags() | Qt::ItemIsUserCheckable);
+    hitItem->setCheckState(0, Qt::Checked);
+  }
+  m_files.append(result);
+}
+
+void CorpusReplaceDialog::onFinished(int files, int hits, qint64 elapsedMs)
+{
+  m_findButton->setEnabled(true);
+  m_replaceButton->setEnabled(hits > 0);
+  m_status->setText(QString("%1 matches in %2 files (%3 ms)").arg(hits).arg(files).arg(elapsedMs));
+}
+
+void CorpusReplaceDialog::replaceSelected()
+{
+  QVector<CorpusSearch::FileResult> selected;
+  for (int i = 0; i < m_results->topLevelItemCount(); ++i)
+  {
+    QTreeWidgetItem *fileItem = m_results->topLevelItem(i);
+    if (fileItem->checkState(0) == Qt::Unchecked)
+      continue;
+
+    CorpusSearch::FileResult file = m_files.at(fileItem->data(0, Qt::UserRole).toInt());
+    QVector<CorpusSearch::Hit> hits;
+    for (int j = 0; j < fileItem->childCount(); ++j)
+    {
+      QTreeWidgetItem *hitItem = fileItem->child(j);
+      if (hitItem->checkState(0) == Qt::Checked)
+        hits.append(file.hits.at(hitItem->data(0, Qt::UserRole).toInt()));
+    }
+    file.hits = hits;
+    selected.append(file);
+  }
+  if (selected.isEmpty())
+    return;
+
+  setBusy(true);
+  m_status->setText("Replacing...");
+  m_search->commit(selected);
+}
+
+void CorpusReplaceDialog::onCommitted(const CorpusSearch::CommitResult &result)
+{
+  setBusy(false);
+  m_results->clear();
+  m_files.clear();
+  m_replaceButton->setEnabled(false);
+
+  QString status;
+  if (!result.error.isEmpty())
+    status = QString("Nothing was replaced: %1").arg(result.error);
+  else
+    status = QString("%1 replacements made").arg(result.replacements);
+  if (!result.skipped.isEmpty())
+    status += QString("; %1 files changed since the search and were left alone").arg(result.skipped.size());
+  m_status->setText(status);
+
+  if (!result.written.isEmpty())
+    emit filesReplaced(result.written);
+}
+
+void CorpusReplaceDialog::setBusy(bool busy)
+{
+  m_findButton->setEnabled(!busy);
+  m_replaceButton->setEnabled(!busy);
+  m_results->setEnabled(!busy);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <QtWidgets/QDialog>
+#include <QtWidgets/QCheckBox>
+#include <QtWidgets/QComboBox>
+#include <QtWidgets/QLabel>
+#include <QtWidgets/QLineEdit>
+#include <QtWidgets/QPushButton>
+#include <QtWidgets/QTreeWidget>
+#include "CorpusSearch.h"
+#include "FileTreeWidget.h"
+
+// Find and replace across a location or smart folder. Hits are listed
+// under their file as they are found, each showing its line with the
+// replacement spliced in and the lines around it in its tooltip, and only
+// the checked ones are replaced.
+class CorpusReplaceDialog : public QDialog
+{
+  Q_OBJECT
+
+public:
+  CorpusReplaceDialog(FileTreeWidget *fileTree, QWidget *parent = nullptr);
+
+  // The document in the editor, replaced in memory rather than on disk
+  void setOpenDocument(const QString &filePath, QTextDocument *document);
+
+protected:
+  void showEvent(QShowEvent *event) override;
+
+signals:
+  void fileSelected(const QString &filePath);
+  // Files rewritten on disk
+  void filesReplaced(const QStringList &filePaths);
+
+private slots:
+  void find();
+  void replaceSelected();
+  void onFileMatched(const CorpusSearch::FileResult &result);
+  void onFinished(int files, int hits, qint64 elapsedMs);
+  void onCommitted(const CorpusSearch::CommitResult &result);
+
+private:
+  void setBusy(bool busy);
+
+  FileTreeWidget *m_fileTree;
+  CorpusSearch *m_search;
+  QComboBox *m_scope;
+  QLineEdit *m_find;
+  QLineEdit *m_replace;
+  QCheckBox *m_regex;
+  QPushButton *m_findButton;
+  QPushButton *m_replaceButton;
+  QTreeWidget *m_results;
+  QLabel *m_status;
+  // Indexed by the top-level items' UserRole
+  QVector<CorpusSearch::FileResult> m_files;
+};
@@ -0,0 +1,468 @@
+#include "CorpusSearch.h"
+#include "DocumentWriter.h"
+#include <QtConcurrent/QtConcurrentMap>
+#include <QtConcurrent/QtConcurrentRun>
+#include <QtCore/QDateTime>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QStringConverter>
+#include <QtCore/QDebug>
+
+namespace
+{
+  // Longer lines are cut down to this much text either side of the match
+  const int ContextChars = 60;
+  // Lines shown either side of the matching one, and how much of each
+  const int ContextLines = 2;
+  const int ContextLineChars = 2 * ContextChars;
+
+  struct SourceText
+  {
+    QByteArray bytes;
+    // As stored; HTML for rich text
+    QString source;
+    // What is searched
+    QString text;
+    QStringConverter::Encoding encoding = QStringConverter::Utf8;
+    bool bom = false;
+    bool richText = false;
+    qint64 size = 0;
+    qint64 modified = 0;
+  };
+
+  bool startsWithBom(const QByteArray &bytes, QStringConverter::Encoding encoding)
+  {
+    const QByteArray utf16LE("\xFF\xFE", 2);
+    const QByteArray utf16BE("\xFE\xFF", 2);
+    const QByteArray utf32LE("\xFF\xFE\x00\x00", 4);
+    const QByteArray utf32BE("\x00\x00\xFE\xFF", 4);
+    switch (encoding)
+    {
+    case QStringConverter::Utf8:
+      return bytes.startsWith("\xEF\xBB\xBF");
+    case QStringConverter::Utf16:
+      return bytes.startsWith(utf16LE) || bytes.startsWith(utf16BE);
+    case QStringConverter::Utf16LE:
+      return bytes.startsWith(utf16LE);
+    case QStringConverter::Utf16BE:
+      return bytes.startsWith(utf16BE);
+    case QStringConverter::Utf32:
+      return bytes.startsWith(utf32LE) || bytes.startsWith(utf32BE);
+    case QStringConverter::Utf32LE:
+      return bytes.startsWith(utf32LE);
+    case QStringConverter::Utf32BE:
+      return bytes.startsWith(utf32BE);
+    default:
+      return false;
+    }
+  }
+
+  // Decodes straight from a mapping of the file; the bytes are only copied
+  // when they are needed to undo a write
+  bool readSource(const QString &filePath, SourceText *out, bool keepBytes)
+  {
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly))
+      return false;
+
+    QFileInfo info(file);
+    out->size = info.size();
+    out->modified = info.lastModified().toMSecsSinceEpoch();
+    out->richText = filePath.endsWith(".rtf", Qt::CaseInsensitive);
+
+    uchar *mapped = out->size > 0 ? file.map(0, out->size) : nullptr;
+    QByteArray bytes = mapped ? QByteArray::fromRawData(reinterpret_cast<const char *>(mapped), out->size)
+                              : file.readAll();
+
+    out->encoding = QStringConverter::encodingForData(bytes).value_or(QStringConverter::Utf8);
+    // Written back only if the file had one
+    out->bom = startsWithBom(bytes, out->encoding);
+    QStringDecoder decoder(out->encoding);
+    out->source = decoder(bytes);
+    if (keepBytes)
+      out->bytes = QByteArray(bytes.constData(), bytes.size());
+    if (mapped)
+      file.unmap(mapped);
+
+    if (out->richText)
+    {
+      QTextDocument document;
+      document.setHtml(out->source);
+      out->text = document.toPlainText();
+    }
+    else
+    {
+      out->text = out->source;
+    }
+    return true;
+  }
+
+  QString clipLines(QStringView lines)
+  {
+    QStringList clipped;
+    for (QStringView line : lines.split(u'\n'))
+    {
+      if (line.endsWith(u'\r'))
+        line.chop(1);
+      clipped.append(line.left(ContextLineChars).toString());
+    }
+    return clipped.join(u'\n');
+  }
+
+  QByteArray encode(const QString &text, const SourceText &source)
+  {
+    QStringEncoder encoder(source.encoding, source.bom ? QStringConverter::Flag::WriteBom : QStringConverter::Flag::Default);
+    return encoder(text);
+  }
+}
+
+CorpusSearch::CorpusSearch(QObject *parent)
+    : QObject(parent), m_committing(false), m_writing(false), m_restoring(false), m_openRevision(-1), m_files(0), m_hits(0)
+{
+  connect(&m_scan, &QFutureWatcher<FileResult>::resultReadyAt, this, &CorpusSearch::onResultReady);
+  connect(&m_scan, &QFutureWatcher<FileResult>::progressValueChanged, this, [this](int value)
+          { emit progress(value, m_scan.progressMaximum()); });
+  connect(&m_scan, &QFutureWatcher<FileResult>::finished, this, &CorpusSearch::onScanFinished);
+  connect(&m_commit, &QFutureWatcher<Staging>::finished, this, &CorpusSearch::onStaged);
+}
+
+CorpusSearch::~CorpusSearch()
+{
+  m_scan.cancel();
+  m_scan.waitForFinished();
+  // Half a commit is worse than a slow exit. Continuations don't run once
+  // this is gone, so a group write that failed is put back from here
+  m_commit.waitForFinished();
+  if (m_committing && m_writing)
+  {
+    m_write.waitForFinished();
+    DocumentWriter::Result written = m_write.result();
+    QList<DocumentWriter::File> originals = m_restoring ? QList<DocumentWriter::File>() : originalsOf(written);
+    if (!written.ok && !originals.isEmpty())
+      DocumentWriter::instance().write(originals).waitForFinished();
+  }
+}
+
+void CorpusSearch::setOpenDocument(const QString &filePath, QTextDocument *document)
+{
+  m_openPath = document ? filePath : QString();
+  m_openDocument = document;
+}
+
+bool CorpusSearch::start(const QStringList &files, const QString &pattern, const QString &replacement,
+                         ReplaceEngine::Mode mode)
+{
+  cancel();
+  m_error.clear();
+  if (pattern.isEmpty())
+  {
+    m_error = "Nothing to find";
+    return false;
+  }
+  if (mode == ReplaceEngine::Regex)
+  {
+    RegexSearcher searcher(pattern);
+    if (!searcher.isValid())
+    {
+      m_error = searcher.errorString();
+      return false;
+    }
+  }
+
+  m_timer.start();
+  m_files = 0;
+  m_hits = 0;
+
+  // The open document is searched as it is in the editor, not on disk
+  QStringList onDisk = files;
+  if (m_openDocument && onDisk.removeAll(m_openPath) > 0)
+  {
+    FileResult result;
+    result.path = m_openPath;
+    result.revision = m_openDocument->revision();
+    result.hits = findHits(m_openDocument->toPlainText(), pattern, replacement, mode);
+    if (!result.hits.isEmpty())
+    {
+      m_files++;
+      m_hits += int(result.hits.size());
+      emit fileMatched(result);
+    }
+  }
+
+  // One task per file, so a few big files do not hold up the rest
+  m_scan.setFuture(QtConcurrent::mapped(onDisk, [pattern, replacement, mode](const QString &filePath)
+                                        { return scanFile(filePath, pattern, replacement, mode); }));
+  return true;
+}
+
+void CorpusSearch::cancel()
+{
+  m_scan.cancel();
+}
+
+void CorpusSearch::onResultReady(int index)
+{
+  FileResult result = m_scan.resultAt(index);
+  if (result.hits.isEmpty())
+    return;
+  m_files++;
+  m_hits += int(result.hits.size());
+  emit fileMatched(result);
+}
+
+void CorpusSearch::onScanFinished()
+{
+  if (m_scan.isCanceled())
+    return;
+  qint64 elapsed = m_timer.elapsed();
+  qDebug() << "Corpus search:" << m_hits << "hits in" << m_files << "of" << m_scan.progressMaximum() << "files in"
+           << elapsed << "ms";
+  emit finished(m_files, m_hits, elapsed);
+}
+
+CorpusSearch::FileResult CorpusSearch::scanFile(const QString &filePath, const QString &pattern,
+                                                const QString &replacement, ReplaceEngine::Mode mode)
+{
+  FileResult result;
+  SourceText source;
+  if (!readSource(filePath, &source, false))
+    return result;
+
+  result.path = filePath;
+  result.size = source.size;
+  result.modified = source.modified;
+  result.hits = findHits(source.text, pattern, replacement, mode);
+  return result;
+}
+
+QVector<CorpusSearch::Hit> CorpusSearch::findHits(const QString &text, const QString &pattern,
+                                                  const QString &replacement, ReplaceEngine::Mode mode)
+{
+  ReplaceEngine::Result found = ReplaceEngine::computeEdits(text, pattern, replacement, mode);
+
+  QVector<Hit> hits;
+  hits.reserve(found.edits.size());
+  int line = 1;
+  qsizetype counted = 0;
+  for (const ReplaceEngine::Edit &edit : found.edits)
+  {
+    // Edits come in order, so lines are only counted once
+    for (; counted < edit.position; ++counted)
+    {
+      if (text.at(counted) == u'\n')
+        ++line;
+    }
+
+    qsizetype lineStart = edit.position > 0 ? text.lastIndexOf(u'\n', edit.position - 1) + 1 : 0;
+    qsizetype lineEnd = text.indexOf(u'\n', edit.position + edit.length);
+    if (lineEnd < 0)
+      lineEnd = text.size();
+
+    qsizetype from = qMax<qsizetype>(lineStart, edit.position - ContextChars);
+    qsizetype to = qMin<qsizetype>(lineEnd, edit.position + edit.length + ContextChars);
+
+    // Whole lines either side, back to the start of the first and on to
+    // the end of the last
+    qsizetype before = lineStart;
+    for (int i = 0; i < ContextLines && before > 0; ++i)
+      before = before >= 2 ? text.lastIndexOf(u'\n', before - 2) + 1 : 0;
+    qsizetype after = lineEnd;
+    for (int i = 0; i < ContextLines && after < text.size(); ++i)
+    {
+      after = text.indexOf(u'\n', after + 1);
+      if (after < 0)
+        after = text.size();
+    }
+
+    Hit hit;
+    hit.edit = edit;
+    hit.line = line;
+    hit.context = text.mid(from, to - from);
+    hit.contextStart = int(edit.position - from);
+    if (before < lineStart)
+      hit.linesBefore = clipLines(QStringView(text).mid(before, lineStart - 1 - before));
+    if (after > lineEnd)
+      hit.linesAfter = clipLines(QStringView(text).mid(lineEnd + 1, after - lineEnd - 1));
+    hits.append(hit);
+  }
+  return hits;
+}
+
+void CorpusSearch::commit(const QVector<FileResult> &files)
+{
+  if (m_committing)
+    return;
+
+  // The open document is replaced on this thread, through its own undo
+  // stack, but only once the rest are on disk; everything else is staged
+  // on the worker
+  m_openEdits.clear();
+  m_openSkipped.clear();
+  m_openRevision = -1;
+  QVector<FileResult> onDisk;
+  for (const FileResult &file : files)
+  {
+    if (file.hits.isEmpty())
+      continue;
+    if (!m_openDocument || file.path != m_openPath)
+    {
+      onDisk.append(file);
+      continue;
+    }
+    if (file.revision != m_openDocument->revision())
+    {
+      m_openSkipped.append(file.path);
+      continue;
+    }
+
+    m_openRevision = file.revision;
+    for (const Hit &hit : file.hits)
+      m_openEdits.append(hit.edit);
+  }
+
+  m_committing = true;
+  m_writing = false;
+  m_restoring = false;
+  m_staging = Staging();
+  m_timer.start();
+  m_commit.setFuture(QtConcurrent::run(&CorpusSearch::stageFiles, onDisk));
+}
+
+void CorpusSearch::onStaged()
+{
+  m_staging = m_commit.result();
+  if (m_staging.files.isEmpty())
+  {
+    finishCommit(QString());
+    return;
+  }
+
+  // One group, so nothing is renamed into place until every file is on disk
+  QList<DocumentWriter::File> replaced;
+  for (const Staged &entry : m_staging.files)
+    replaced.append(DocumentWriter::File(entry.path, entry.replaced));
+  m_writing = true;
+  m_write = DocumentWriter::instance().write(replaced);
+  m_write.then(this, [this](const DocumentWriter::Result &written) { onWritten(written); });
+}
+
+void CorpusSearch::onWritten(const DocumentWriter::Result &written)
+{
+  if (written.ok)
+  {
+    finishCommit(QString());
+    return;
+  }
+
+  // Put back whatever was already replaced, so it is all or nothing
+  QList<DocumentWriter::File> originals = originalsOf(written);
+  if (originals.isEmpty())
+  {
+    finishCommit(written.error);
+    return;
+  }
+  m_restoring = true;
+  m_write = DocumentWriter::instance().write(originals);
+  m_write.then(this, [this, error = written.error](const DocumentWriter::Result &restored)
+               {
+                 if (!restored.ok)
+                   qWarning().noquote() << "Could not restore" << restored.error;
+                 finishCommit(error);
+               });
+}
+
+QList<DocumentWriter::File> CorpusSearch::originalsOf(const DocumentWriter::Result &written) const
+{
+  QList<DocumentWriter::File> originals;
+  for (const Staged &entry : m_staging.files)
+  {
+    if (written.written.contains(entry.path))
+      originals.append(DocumentWriter::File(entry.path, entry.original));
+  }
+  return originals;
+}
+
+void CorpusSearch::finishCommit(const QString &error)
+{
+  CommitResult result;
+  result.error = error;
+  result.skipped = m_staging.skipped + m_openSkipped;
+  if (error.isEmpty())
+  {
+    for (const Staged &entry : m_staging.files)
+    {
+      result.written.append(entry.path);
+      result.replacements += entry.replacements;
+    }
+
+    if (!m_openEdits.isEmpty())
+    {
+      // Typing while the files were written moves the hits
+      if (m_openDocument && m_openDocument->revision() == m_openRevision)
+      {
+        ReplaceEngine::apply(m_openDocument, m_openEdits);
+        result.replacements += int(m_openEdits.size());
+      }
+      else
+      {
+        result.skipped.append(m_openPath);
+      }
+    }
+  }
+
+  m_committing = false;
+  m_writing = false;
+  m_restoring = false;
+  m_staging = Staging();
+  m_openEdits.clear();
+  qDebug() << "Corpus replace:" << result.replacements << "replacements in" << result.written.size() << "files,"
+           << result.skipped.size() << "skipped, in" << m_timer.elapsed() << "ms";
+  emit committed(result);
+}
+
+CorpusSearch::Staging CorpusSearch::stageFiles(QVector<FileResult> files)
+{
+  Staging staging;
+
+  // Everything is read and replaced before the first file is written
+  for (const FileResult &file : files)
+  {
+    SourceText source;
+    if (!readSource(file.path, &source, true) || source.size != file.size || source.modified != file.modified)
+    {
+      staging.skipped.append(file.path);
+      continue;
+    }
+
+    QString replaced;
+    if (source.richText)
+    {
+      // Hits are positions in the plain text, which don't map back onto
+      // the HTML source, so the whole file is serialised again
+      QTextDocument document;
+      document.setHtml(source.source);
+      QVector<ReplaceEngine::Edit> edits;
+      for (const Hit &hit : file.hits)
+        edits.append(hit.edit);
+      ReplaceEngine::apply(&document, edits);
+      replaced = document.toHtml();
+    }
+    else
+    {
+      replaced = source.text;
+      for (int i = int(file.hits.size()) - 1; i >= 0; --i)
+      {
+        const ReplaceEngine::Edit &edit = file.hits.at(i).edit;
+        replaced.replace(edit.position, edit.length, edit.replacement);
+      }
+    }
+
+    Staged entry;
+    entry.path = file.path;
+    entry.original = source.bytes;
+    entry.replaced = encode(replaced, source);
+    entry.replacements = int(file.hits.size());
+    staging.files.append(entry);
+  }
+  return staging;
+}
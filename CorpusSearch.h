@@ -0,0 +1,129 @@
+#pragma once
+
+#include <QtCore/QObject>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFutureWatcher>
+#include <QtCore/QPointer>
+#include <QtCore/QStringList>
+#include <QtGui/QTextDocument>
+#include "DocumentWriter.h"
+#include "ReplaceEngine.h"
+
+// Find and replace across many documents. Searching maps each file and
+// runs ReplaceEngine on it as its own task on the thread pool, reporting
+// each file with hits as soon as it is done. Committing rewrites the chosen
+// hits on a worker: a file that changed since it was searched is left
+// alone, and every other file is read and replaced in memory there. The
+// results go to DocumentWriter as one group, and if one of them cannot be
+// written the ones already written are put back. Plain files keep
+// their encoding and byte order mark; rich ones are written back as
+// QTextDocument's HTML, which may differ from how they were stored. The document
+// open in the editor is searched and replaced in memory, as one undo step,
+// so it never goes stale against its file; that happens only once the
+// files on disk are written, so a failed commit changes nothing at all.
+class CorpusSearch : public QObject
+{
+  Q_OBJECT
+
+public:
+  struct Hit
+  {
+    ReplaceEngine::Edit edit;
+    // 1-based
+    int line = 0;
+    // The line around the match, and where the match starts in it
+    QString context;
+    int contextStart = 0;
+    // Whole lines before and after that one, each cut to a preview's width
+    QString linesBefore;
+    QString linesAfter;
+  };
+
+  struct FileResult
+  {
+    QString path;
+    qint64 size = 0;
+    qint64 modified = 0;
+    // Revision of the open document that was searched, or -1 for the file
+    int revision = -1;
+    QVector<Hit> hits;
+  };
+
+  struct CommitResult
+  {
+    QStringList written;
+    // Changed after they were searched
+    QStringList skipped;
+    QString error;
+    int replacements = 0;
+  };
+
+  explicit CorpusSearch(QObject *parent = nullptr);
+  ~CorpusSearch();
+
+  void setOpenDocument(const QString &filePath, QTextDocument *document);
+
+  // False if the pattern is not usable; see errorString()
+  bool start(const QStringList &files, const QString &pattern, const QString &replacement, ReplaceEngine::Mode mode);
+  void cancel();
+  bool isRunning() const { return m_scan.isRunning(); }
+  bool isCommitting() const { return m_committing; }
+  QString errorString() const { return m_error; }
+
+  // Replaces exactly the hits given
+  void commit(const QVector<FileResult> &files);
+
+signals:
+  void fileMatched(const CorpusSearch::FileResult &result);
+  void progress(int done, int total);
+  void finished(int files, int hits, qint64 elapsedMs);
+  void committed(const CorpusSearch::CommitResult &result);
+
+private slots:
+  void onResultReady(int index);
+  void onScanFinished();
+  void onStaged();
+
+private:
+  struct Staged
+  {
+    QString path;
+    QByteArray original;
+    QByteArray replaced;
+    int replacements = 0;
+  };
+
+  struct Staging
+  {
+    QVector<Staged> files;
+    // Changed after they were searched
+    QStringList skipped;
+  };
+
+  static FileResult scanFile(const QString &filePath, const QString &pattern, const QString &replacement,
+                             ReplaceEngine::Mode mode);
+  static QVector<Hit> findHits(const QString &text, const QString &pattern, const QString &replacement,
+                               ReplaceEngine::Mode mode);
+  static Staging stageFiles(QVector<FileResult> files);
+  void onWritten(const DocumentWriter::Result &written);
+  QList<DocumentWriter::File> originalsOf(const DocumentWriter::Result &written) const;
+  void finishCommit(const QString &error);
+
+  QString m_openPath;
+  QPointer<QTextDocument> m_openDocument;
+  QFutureWatcher<FileResult> m_scan;
+  QFutureWatcher<Staging> m_commit;
+  QFuture<DocumentWriter::Result> m_write;
+  bool m_committing;
+  bool m_writing;
+  bool m_restoring;
+  Staging m_staging;
+  // Applied to the open document once the files on disk are written
+  QVector<ReplaceEngine::Edit> m_openEdits;
+  int m_openRevision;
+  QStringList m_openSkipped;
+  QElapsedTimer m_timer;
+  int m_files;
+  int m_hits;
+  QString m_error;
+};
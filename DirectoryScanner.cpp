@@ -0,0 +1,213 @@
+#include "DirectoryScanner.h"
+#include <QtConcurrent/QtConcurrentRun>
+#include <QtCore/QDir>
+#include <QtCore/QDirIterator>
+#include <QtCore/QThread>
+#include <QtCore/QDebug>
+
+namespace
+{
+  // Files a walker collects before handing them over
+  const int DeliveryBatch = 256;
+}
+
+DirectoryScanner::DirectoryScanner(QObject *parent)
+    : QObject(parent), m_workerCount(qBound(2, QThread::idealThreadCount(), 8))
+{
+  m_pool.setMaxThreadCount(m_workerCount);
+
+  // Results reach the view a few times a second rather than per directory
+  m_deliveryTimer.setInterval(100);
+  connect(&m_deliveryTimer, &QTimer::timeout, this, &DirectoryScanner::deliverResults);
+}
+
+DirectoryScanner::~DirectoryScanner()
+{
+  cancel();
+  m_pool.waitForDone();
+}
+
+void DirectoryScanner::setWorkerCount(int count)
+{
+  m_workerCount = qMax(1, count);
+  m_pool.setMaxThreadCount(m_workerCount);
+}
+
+void DirectoryScanner::scan(const QString &root, const QStringList &nameFilters, const QStringList &excludedDirectories,
+                            bool includeRootFiles)
+{
+  cancel();
+
+  m_job = QSharedPointer<Job>::create();
+  m_job->root = root;
+  m_job->nameFilters = nameFilters;
+  m_job->excluded = QSet<QString>(excludedDirectories.begin(), excludedDirectories.end());
+  m_job->includeRootFiles = includeRootFiles;
+  for (int i = 0; i < m_workerCount; ++i)
+    m_job->workers.push_back(std::make_unique<Worker>());
+  m_job->running = m_workerCount;
+  m_job->timer.start();
+  pushDirectory(*m_job, 0, root);
+
+  for (int i = 0; i < m_workerCount; ++i)
+    QtConcurrent::run(&m_pool, &DirectoryScanner::walk, this, m_job, i);
+  m_deliveryTimer.start();
+}
+
+void DirectoryScanner::cancel()
+{
+  // Walkers stop at the next entry; anything they still post is dropped
+  if (m_job)
+  {
+    m_job->canceled = true;
+    wakeWalkers(*m_job);
+    m_job.reset();
+  }
+  m_deliveryTimer.stop();
+}
+
+void DirectoryScanner::walk(QSharedPointer<Job> job, int self)
+{
+  QVector<FileMetadata> found;
+  QString directory;
+  while (!job->canceled && job->pending.load() > 0)
+  {
+    if (!takeDirectory(*job, self, &directory))
+    {
+      // Someone is still listing a directory that may yield more work
+      waitForWork(*job);
+      continue;
+    }
+
+    bool listFiles = job->includeRootFiles || directory != job->root;
+    QDirIterator it(directory, QDir::Files | QDir::AllDirs | QDir::NoDotAndDotDot | QDir::NoSymLinks);
+    while (it.hasNext() && !job->canceled)
+    {
+      it.next();
+      // The entry type comes from readdir; only matching files get stat'ed
+      QFileInfo info = it.fileInfo();
+      if (info.isDir())
+      {
+        if (!job->excluded.contains(info.filePath()))
+          pushDirectory(*job, self, info.filePath());
+      }
+      else if (listFiles && QDir::match(job->nameFilters, info.fileName()))
+      {
+        found.append(FileMetadata::fromFileInfo(info));
+      }
+    }
+
+    job->directories++;
+    if (found.size() >= DeliveryBatch)
+      deliver(*job, found);
+
+    // Children were queued above, so this only reaches zero at the very end
+    if (--job->pending == 0)
+      wakeWalkers(*job);
+  }
+  deliver(*job, found);
+
+  if (job->running.fetch_sub(1) != 1 || job->canceled)
+    return;
+
+  QMetaObject::invokeMethod(this, [this, job]()
+                            {
+    if (job != m_job)
+      return;
+    deliverResults();
+    m_deliveryTimer.stop();
+    m_job.reset();
+    emit finished(job->root, job->directories, job->files, job->timer.elapsed()); }, Qt::QueuedConnection);
+}
+
+bool DirectoryScanner::takeDirectory(Job &job, int self, QString *directory)
+{
+  {
+    Worker &own = *job.workers[self];
+    QMutexLocker locker(&own.mutex);
+    if (!own.directories.empty())
+    {
+      *directory = std::move(own.directories.back());
+      own.directories.pop_back();
+      job.queued--;
+      return true;
+    }
+  }
+
+  int count = int(job.workers.size());
+  for (int i = 1; i < count; ++i)
+  {
+    Worker &victim = *job.workers[(self + i) % count];
+    QMutexLocker locker(&victim.mutex);
+    if (!victim.directories.empty())
+    {
+      *directory = std::move(victim.directories.front());
+      victim.directories.pop_front();
+      job.queued--;
+      return true;
+    }
+  }
+  return false;
+}
+
+void DirectoryScanner::pushDirectory(Job &job, int self, const QString &directory)
+{
+  job.pending++;
+  {
+    Worker &own = *job.workers[self];
+    QMutexLocker locker(&own.mutex);
+    own.directories.push_back(directory);
+  }
+  job.queued++;
+
+  // An idle walker counts itself before checking queued, so one of the
+  // two sides always sees the other
+  if (job.idle.load() > 0)
+  {
+    QMutexLocker locker(&job.idleMutex);
+    job.workAvailable.wakeOne();
+  }
+}
+
+void DirectoryScanner::waitForWork(Job &job)
+{
+  QMutexLocker locker(&job.idleMutex);
+  job.idle++;
+  while (!job.canceled && job.pending.load() > 0 && job.queued.load() == 0)
+    job.workAvailable.wait(&job.idleMutex);
+  job.idle--;
+}
+
+void DirectoryScanner::wakeWalkers(Job &job)
+{
+  // Taking the lock means no walker is between its check and its wait
+  QMutexLocker locker(&job.idleMutex);
+  job.workAvailable.wakeAll();
+}
+
+void DirectoryScanner::deliver(Job &job, QVector<FileMetadata> &found)
+{
+  if (found.isEmpty())
+    return;
+
+  job.files += int(found.size());
+  QMutexLocker locker(&job.resultsMutex);
+  job.results += found;
+  found.clear();
+}
+
+void DirectoryScanner::deliverResults()
+{
+  if (!m_job)
+    return;
+
+  QVector<FileMetadata> files;
+  {
+    QMutexLocker locker(&m_job->resultsMutex);
+    files.swap(m_job->results);
+  }
+
+  if (!files.isEmpty())
+    emit filesFound(m_job->root, files);
+  emit progress(m_job->root, m_job->directories, m_job->files);
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <QtCore/QObject>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QMutex>
+#include <QtCore/QSet>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QThreadPool>
+#include <QtCore/QTimer>
+#include <QtCore/QVector>
+#include <QtCore/QWaitCondition>
+#include "MetadataIndex.h"
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+
+// Walks a directory tree on a pool of threads. Each walker has its own deque
+// of directories: it takes the newest one from the back, so it goes depth
+// first through what it just listed, and when it runs dry it steals the
+// oldest one from the front of another walker's deque, which is usually the
+// top of a large subtree nobody has started on. Found files are collected
+// and handed to the GUI thread in batches. Starting another scan cancels the
+// previous one.
+class DirectoryScanner : public QObject
+{
+  Q_OBJECT
+
+public:
+  explicit DirectoryScanner(QObject *parent = nullptr);
+  ~DirectoryScanner();
+
+  // Hidden entries, symlinks and the excluded directories are skipped.
+  // Files directly in root are left out when the caller already lists them.
+  void scan(const QString &root, const QStringList &nameFilters, const QStringList &excludedDirectories,
+            bool includeRootFiles = true);
+  void cancel();
+  bool isScanning() const { return !m_job.isNull(); }
+  void setWorkerCount(int count);
+
+signals:
+  void filesFound(const QString &root, const QVector<FileMetadata> &files);
+  void progress(const QString &root, int directories, int files);
+  void finished(const QString &root, int directories, int files, qint64 elapsedMs);
+
+private:
+  struct Worker
+  {
+    QMutex mutex;
+    std::deque<QString> directories;
+  };
+
+  struct Job
+  {
+    QString root;
+    QStringList nameFilters;
+    QSet<QString> excluded;
+    bool includeRootFiles = true;
+    std::vector<std::unique_ptr<Worker>> workers;
+    // Directories queued or being walked; the scan is done at zero
+    std::atomic<int> pending{0};
+    std::atomic<int> running{0};
+    std::atomic<int> directories{0};
+    std::atomic<int> files{0};
+    std::atomic<bool> canceled{false};
+    // Directories sitting in a deque, not yet taken by a walker
+    std::atomic<int> queued{0};
+    // Walkers with nothing to take sleep here until a push or the end
+    QMutex idleMutex;
+    QWaitCondition workAvailable;
+    std::atomic<int> idle{0};
+    QMutex resultsMutex;
+    QVector<FileMetadata> results;
+    QElapsedTimer timer;
+  };
+
+  void walk(QSharedPointer<Job> job, int self);
+  static bool takeDirectory(Job &job, int self, QString *directory);
+  static void pushDirectory(Job &job, int self, const QString &directory);
+  static void waitForWork(Job &job);
+  static void wakeWalkers(Job &job);
+  static void deliver(Job &job, QVector<FileMetadata> &found);
+  void deliverResults();
+
+  QThreadPool m_pool;
+  QSharedPointer<Job> m_job;
+  QTimer m_deliveryTimer;
+  int m_workerCount;
+};
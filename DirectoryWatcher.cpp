@@ -0,0 +1,209 @@
+#include "DirectoryWatcher.h"
+#include <QtCore/QDir>
+#include <QtCore/QSocketNotifier>
+#include <QtCore/QDebug>
+
+#ifdef Q_OS_LINUX
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+DirectoryWatcher::DirectoryWatcher(QObject *parent)
+    : QObject(parent), m_inotifyFd(-1), m_notifier(nullptr)
+{
+  // Reports at most this long after the first event of a burst
+  m_debounce.setSingleShot(true);
+  m_debounce.setInterval(100);
+  connect(&m_debounce, &QTimer::timeout, this, &DirectoryWatcher::flush);
+
+#ifdef Q_OS_LINUX
+  m_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (m_inotifyFd >= 0)
+  {
+    m_notifier = new QSocketNotifier(m_inotifyFd, QSocketNotifier::Read, this);
+    connect(m_notifier, &QSocketNotifier::activated, this, &DirectoryWatcher::readInotifyEvents);
+  }
+  else
+  {
+    qWarning() << "inotify unavailable, falling back to QFileSystemWatcher";
+  }
+#endif
+
+  connect(&m_fallback, &QFileSystemWatcher::directoryChanged, this, &DirectoryWatcher::onDirectoryChanged);
+}
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+#ifdef Q_OS_LINUX
+  if (m_inotifyFd >= 0)
+    close(m_inotifyFd);
+#endif
+}
+
+bool DirectoryWatcher::watch(const QString &directory)
+{
+  if (m_known.contains(directory))
+    return true;
+  if (!QFileInfo(directory).isDir())
+    return false;
+
+#ifdef Q_OS_LINUX
+  if (m_inotifyFd >= 0)
+  {
+    int wd = inotify_add_watch(m_inotifyFd, QFile::encodeName(directory).constData(),
+                               IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | IN_ATTRIB | IN_ONLYDIR);
+    if (wd < 0)
+      return false;
+    m_watchDescriptors.insert(wd, directory);
+    m_known.insert(directory, listFiles(directory));
+    return true;
+  }
+#endif
+
+  if (!m_fallback.addPath(directory))
+    return false;
+  m_known.insert(directory, listFiles(directory));
+  return true;
+}
+
+void DirectoryWatcher::unwatch(const QString &directory)
+{
+  if (!m_known.remove(directory))
+    return;
+  m_touched.remove(directory);
+
+#ifdef Q_OS_LINUX
+  for (auto it = m_watchDescriptors.begin(); it != m_watchDescriptors.end(); ++it)
+  {
+    if (it.value() == directory)
+    {
+      inotify_rm_watch(m_inotifyFd, it.key());
+      m_watchDescriptors.erase(it);
+      return;
+    }
+  }
+#endif
+  m_fallback.removePath(directory);
+}
+
+void DirectoryWatcher::onDirectoryChanged(const QString &directory)
+{
+  resync(directory);
+}
+
+void DirectoryWatcher::touch(const QString &directory, const QString &name)
+{
+  m_touched[directory].insert(name);
+  if (!m_debounce.isActive())
+    m_debounce.start();
+}
+
+void DirectoryWatcher::resync(const QString &directory)
+{
+  auto known = m_known.constFind(directory);
+  if (known == m_known.constEnd())
+    return;
+
+  // Names only, unsorted and without stat'ing every entry
+  QSet<QString> current = listFiles(directory);
+  for (const QString &name : current)
+  {
+    if (!known->contains(name))
+      touch(directory, name);
+  }
+  for (const QString &name : *known)
+  {
+    if (!current.contains(name))
+      touch(directory, name);
+  }
+}
+
+QSet<QString> DirectoryWatcher::listFiles(const QString &directory)
+{
+  QStringList names = QDir(directory).entryList(QDir::Files | QDir::Hidden, QDir::Unsorted);
+  return QSet<QString>(names.begin(), names.end());
+}
+
+void DirectoryWatcher::flush()
+{
+  QHash<QString, QSet<QString>> touched;
+  touched.swap(m_touched);
+
+  for (auto it = touched.constBegin(); it != touched.constEnd(); ++it)
+  {
+    const QString &directory = it.key();
+    auto known = m_known.find(directory);
+    if (known == m_known.end())
+      continue;
+
+    // Whatever the events were, the file's state now decides what changed;
+    // a file created and deleted within one burst is never reported
+    QFileInfoList added;
+    QFileInfoList modified;
+    QStringList removed;
+    for (const QString &name : it.value())
+    {
+      QFileInfo info(directory + "/" + name);
+      bool exists = info.isFile();
+      bool wasKnown = known->contains(name);
+      if (exists && wasKnown)
+      {
+        modified.append(info);
+      }
+      else if (exists)
+      {
+        known->insert(name);
+        added.append(info);
+      }
+      else if (wasKnown)
+      {
+        known->remove(name);
+        removed.append(info.filePath());
+      }
+    }
+
+    if (!added.isEmpty() || !modified.isEmpty() || !removed.isEmpty())
+      emit directoryChanged(directory, added, modified, removed);
+  }
+}
+
+#ifdef Q_OS_LINUX
+void DirectoryWatcher::readInotifyEvents()
+{
+  alignas(inotify_event) char buffer[16 * 1024];
+  while (true)
+  {
+    ssize_t length = read(m_inotifyFd, buffer, sizeof(buffer));
+    if (length <= 0)
+      break;
+
+    for (char *ptr = buffer; ptr < buffer + length;)
+    {
+      const inotify_event *event = reinterpret_cast<const inotify_event *>(ptr);
+      ptr += sizeof(inotify_event) + event->len;
+
+      // The kernel dropped events, so the name lists can't be trusted
+      if (event->mask & IN_Q_OVERFLOW)
+      {
+        for (auto it = m_known.constBegin(); it != m_known.constEnd(); ++it)
+          resync(it.key());
+        continue;
+      }
+
+      if (event->mask & IN_IGNORED)
+      {
+        m_known.remove(m_watchDescriptors.value(event->wd));
+        m_watchDescriptors.remove(event->wd);
+        continue;
+      }
+
+      if ((event->mask & IN_ISDIR) || event->len == 0)
+        continue;
+
+      auto directory = m_watchDescriptors.constFind(event->wd);
+      if (directory != m_watchDescriptors.constEnd())
+        touch(directory.value(), QFile::decodeName(event->name));
+    }
+  }
+}
+#endif
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <QtCore/QObject>
+#include <QtCore/QFileInfo>
+#include <QtCore/QFileSystemWatcher>
+#include <QtCore/QHash>
+#include <QtCore/QSet>
+#include <QtCore/QTimer>
+
+class QSocketNotifier;
+
+// Reports files added to, modified in or removed from watched directories.
+// On Linux inotify names the entries that changed, so only those get
+// stat'ed; elsewhere QFileSystemWatcher only says that a directory changed,
+// and its name list is diffed against the last one (which misses in-place
+// modifications). Bursts of events are coalesced into one report per
+// directory.
+class DirectoryWatcher : public QObject
+{
+  Q_OBJECT
+
+public:
+  explicit DirectoryWatcher(QObject *parent = nullptr);
+  ~DirectoryWatcher();
+
+  bool watch(const QString &directory);
+  void unwatch(const QString &directory);
+  void setDebounceInterval(int msec) { m_debounce.setInterval(msec); }
+
+signals:
+  void directoryChanged(const QString &directory, const QFileInfoList &added, const QFileInfoList &modified,
+                        const QStringList &removedPaths);
+
+private slots:
+  void onDirectoryChanged(const QString &directory);
+  void flush();
+
+private:
+  void touch(const QString &directory, const QString &name);
+  void resync(const QString &directory);
+  static QSet<QString> listFiles(const QString &directory);
+#ifdef Q_OS_LINUX
+  void readInotifyEvents();
+#endif
+
+  // File names last seen in each watched directory
+  QHash<QString, QSet<QString>> m_known;
+  // Names touched since the last flush
+  QHash<QString, QSet<QString>> m_touched;
+  QTimer m_debounce;
+
+  QFileSystemWatcher m_fallback;
+  int m_inotifyFd;
+  QSocketNotifier *m_notifier;
+  QHash<int, QString> m_watchDescriptors;
+};
@@ -0,0 +1,148 @@
+#include "DocumentCache.h"
+#include "UndoHistory.h"
+#include <QtCore/QFileInfo>
+#include <QtCore/QDebug>
+
+DocumentCache::DocumentCache(QObject *parent)
+    : QObject(parent), m_budget(64 * 1024 * 1024), m_totalCost(0), m_maxDocuments(8)
+{
+  connect(&m_watcher, &QFileSystemWatcher::fileChanged, this, &DocumentCache::onFileChanged);
+}
+
+DocumentCache::~DocumentCache()
+{
+  clear();
+}
+
+void DocumentCache::setBudget(qint64 bytes)
+{
+  m_budget = bytes;
+  trim();
+}
+
+void DocumentCache::setMaxDocuments(int count)
+{
+  m_maxDocuments = count;
+  trim();
+}
+
+void DocumentCache::insert(const QString &filePath, const Entry &entry)
+{
+  remove(filePath);
+
+  QFileInfo info(filePath);
+  Item item;
+  item.entry = entry;
+  item.lastModified = info.lastModified();
+  item.size = info.size();
+  item.cost = estimateCost(entry.document);
+
+  entry.document->setParent(this);
+  m_items.insert(filePath, item);
+  m_order.append(filePath);
+  m_totalCost += item.cost;
+  m_watcher.addPath(filePath);
+
+  trim();
+}
+
+DocumentCache::Entry DocumentCache::take(const QString &filePath)
+{
+  auto it = m_items.find(filePath);
+  if (it == m_items.end())
+    return Entry();
+
+  // The watcher can miss changes, e.g. while the app was suspended
+  if (isStale(filePath, *it))
+  {
+    remove(filePath);
+    return Entry();
+  }
+
+  Entry entry = it->entry;
+  m_totalCost -= it->cost;
+  m_items.erase(it);
+  m_order.removeOne(filePath);
+  m_watcher.removePath(filePath);
+
+  entry.document->setParent(nullptr);
+  return entry;
+}
+
+void DocumentCache::rename(const QString &oldPath, const QString &newPath)
+{
+  auto it = m_items.find(oldPath);
+  if (it == m_items.end())
+    return;
+
+  Item item = *it;
+  m_items.erase(it);
+  m_order.removeOne(oldPath);
+  m_watcher.removePath(oldPath);
+
+  // A rename keeps the modification time, so the entry stays valid
+  m_items.insert(newPath, item);
+  m_order.append(newPath);
+  m_watcher.addPath(newPath);
+}
+
+void DocumentCache::remove(const QString &filePath)
+{
+  auto it = m_items.find(filePath);
+  if (it == m_items.end())
+    return;
+
+  // Deferred, as a document evicted on insert is still in the editor until
+  // the caller swaps in the next one
+  m_totalCost -= it->cost;
+  it->entry.document->deleteLater();
+  m_items.erase(it);
+  m_order.removeOne(filePath);
+  m_watcher.removePath(filePath);
+}
+
+void DocumentCache::clear()
+{
+  while (!m_order.isEmpty())
+    remove(m_order.first());
+}
+
+void DocumentCache::onFileChanged(const QString &filePath)
+{
+  auto it = m_items.find(filePath);
+  if (it == m_items.end())
+    return;
+
+  if (isStale(filePath, *it))
+  {
+    qDebug() << "Document cache: dropping" << filePath << "after it changed on disk";
+    remove(filePath);
+    return;
+  }
+
+  // Atomic replaces swap the inode, which stops the watcher following it
+  if (!m_watcher.files().contains(filePath))
+    m_watcher.addPath(filePath);
+}
+
+qint64 DocumentCache::estimateCost(const QTextDocument *document)
+{
+  // UTF-16 text plus roughly as much again for formats and layout, and
+  // whatever undo history the document holds in memory
+  qint64 cost = qint64(document->characterCount()) * qint64(sizeof(QChar)) * 4;
+  if (const UndoHistory *history = document->findChild<UndoHistory *>(QString(), Qt::FindDirectChildrenOnly))
+    cost += history->memoryUsage();
+  return cost;
+}
+
+bool DocumentCache::isStale(const QString &filePath, const Item &item) const
+{
+  QFileInfo info(filePath);
+  return !info.exists() || info.lastModified() != item.lastModified || info.size() != item.size;
+}
+
+void DocumentCache::trim()
+{
+  while (!m_order.isEmpty() && (m_totalCost > m_budget || m_order.size() > m_maxDocuments))
+    remove(m_order.first());
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <QtCore/QObject>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QDateTime>
+#include <QtCore/QFileSystemWatcher>
+#include <QtGui/QTextDocument>
+#include <QtGui/QTextCursor>
+
+// Keeps recently edited documents alive, with their undo history, cursor
+// and scroll position, so switching back to a file skips reading and
+// parsing it. Bounded by an estimated memory budget; an entry is dropped
+// as soon as its file changes on disk.
+class DocumentCache : public QObject
+{
+  Q_OBJECT
+
+public:
+  struct Entry
+  {
+    QTextDocument *document = nullptr;
+    QByteArray checksum;
+    QTextCursor cursor;
+    int scrollValue = 0;
+  };
+
+  explicit DocumentCache(QObject *parent = nullptr);
+  ~DocumentCache();
+
+  void setBudget(qint64 bytes);
+  void setMaxDocuments(int count);
+
+  // Takes ownership of entry.document; filePath must be saved to disk
+  void insert(const QString &filePath, const Entry &entry);
+  // Hands the document back to the caller, or returns an empty entry when
+  // there is none or the file changed since it was cached
+  Entry take(const QString &filePath);
+
+  void rename(const QString &oldPath, const QString &newPath);
+  void remove(const QString &filePath);
+  void clear();
+
+private slots:
+  void onFileChanged(const QString &filePath);
+
+private:
+  struct Item
+  {
+    Entry entry;
+    QDateTime lastModified;
+    qint64 size = 0;
+    qint64 cost = 0;
+  };
+
+  static qint64 estimateCost(const QTextDocument *document);
+  bool isStale(const QString &filePath, const Item &item) const;
+  void trim();
+
+  QHash<QString, Item> m_items;
+  // Least recently used first
+  QList<QString> m_order;
+  QFileSystemWatcher m_watcher;
+  qint64 m_budget;
+  qint64 m_totalCost;
+  int m_maxDocuments;
+};
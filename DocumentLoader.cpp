@@ -0,0 +1,136 @@
+#include "DocumentLoader.h"
+#include "EditJournal.h"
+#include <QtConcurrent/QtConcurrentRun>
+#include <QtCore/QFile>
+#include <QtCore/QStringDecoder>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QDebug>
+
+namespace
+{
+  // Enough text to fill the first screen
+  const qint64 PreviewBytes = 64 * 1024;
+  const qint64 ChunkBytes = 1024 * 1024;
+}
+
+DocumentLoader::DocumentLoader(QObject *parent)
+    : QObject(parent)
+{
+}
+
+DocumentLoader::~DocumentLoader()
+{
+  cancel();
+  m_pool.waitForDone();
+}
+
+void DocumentLoader::load(const QString &filePath, bool isRichText)
+{
+  cancel();
+
+  m_job = QSharedPointer<Job>::create();
+  m_job->filePath = filePath;
+  m_job->isRichText = isRichText;
+  QtConcurrent::run(&m_pool, &DocumentLoader::run, this, m_job);
+}
+
+void DocumentLoader::cancel()
+{
+  // The worker notices between chunks; anything it still posts is dropped
+  if (m_job)
+  {
+    m_job->canceled = true;
+    m_job.reset();
+  }
+}
+
+void DocumentLoader::run(QSharedPointer<Job> job)
+{
+  QElapsedTimer timer;
+  timer.start();
+
+  QFile file(job->filePath);
+  if (!file.open(QIODevice::ReadOnly))
+  {
+    QString error = file.errorString();
+    QMetaObject::invokeMethod(this, [this, job, error]()
+                              {
+      if (job != m_job)
+        return;
+      m_job.reset();
+      emit failed(job->filePath, error); }, Qt::QueuedConnection);
+    return;
+  }
+
+  QByteArray data;
+  data.reserve(file.size());
+  QString text;
+  QStringDecoder decoder;
+
+  while (!file.atEnd())
+  {
+    if (job->canceled)
+      return;
+
+    QByteArray chunk = file.read(data.isEmpty() ? PreviewBytes : ChunkBytes);
+    if (chunk.isEmpty())
+      break;
+
+    // UTF-8 unless a byte order mark says otherwise, like QTextStream
+    if (!decoder.isValid())
+      decoder = QStringDecoder(QStringConverter::encodingForData(chunk).value_or(QStringConverter::Utf8));
+
+    bool first = data.isEmpty();
+    data += chunk;
+    text += decoder.decode(chunk);
+
+    // A truncated HTML document could render a half-parsed tag, so only
+    // plain text gets a preview
+    if (first && !job->isRichText && !file.atEnd())
+    {
+      QString preview = text;
+      QMetaObject::invokeMethod(this, [this, job, preview]()
+                                {
+        if (job == m_job)
+          emit previewReady(job->filePath, preview); }, Qt::QueuedConnection);
+    }
+  }
+
+  if (file.error() != QFileDevice::NoError)
+  {
+    QString error = file.errorString();
+    QMetaObject::invokeMethod(this, [this, job, error]()
+                              {
+      if (job != m_job)
+        return;
+      m_job.reset();
+      emit failed(job->filePath, error); }, Qt::QueuedConnection);
+    return;
+  }
+
+  if (job->canceled)
+    return;
+
+  // QTextDocument is reentrant, so the expensive build happens here and
+  // the finished document moves over to the GUI thread
+  QTextDocument *document = new QTextDocument;
+  if (job->isRichText)
+    document->setHtml(text);
+  else
+    document->setPlainText(text);
+  document->moveToThread(thread());
+
+  QByteArray checksum = EditJournal::checksum(data);
+  qint64 elapsed = timer.elapsed();
+
+  QMetaObject::invokeMethod(this, [this, job, document, checksum, elapsed]()
+                            {
+    if (job != m_job)
+    {
+      delete document;
+      return;
+    }
+    m_job.reset();
+    qDebug() << "Loaded" << job->filePath << "in" << elapsed << "ms";
+    emit loaded(job->filePath, document, checksum); }, Qt::QueuedConnection);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <QtCore/QObject>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QThreadPool>
+#include <QtGui/QTextDocument>
+#include <atomic>
+
+// Reads, decodes and builds the QTextDocument for a file on a worker thread.
+// The first screenful is handed back as soon as it is decoded so the editor
+// can show it while the rest loads. Starting another load cancels the
+// previous one.
+class DocumentLoader : public QObject
+{
+  Q_OBJECT
+
+public:
+  explicit DocumentLoader(QObject *parent = nullptr);
+  ~DocumentLoader();
+
+  void load(const QString &filePath, bool isRichText);
+  void cancel();
+  bool isLoading() const { return !m_job.isNull(); }
+
+signals:
+  void previewReady(const QString &filePath, const QString &text);
+  // The receiver takes ownership of the document
+  void loaded(const QString &filePath, QTextDocument *document, const QByteArray &checksum);
+  void failed(const QString &filePath, const QString &error);
+
+private:
+  struct Job
+  {
+    QString filePath;
+    bool isRichText = false;
+    std::atomic<bool> canceled{false};
+  };
+
+  void run(QSharedPointer<Job> job);
+
+  QThreadPool m_pool;
+  QSharedPointer<Job> m_job;
+};
@@ -0,0 +1,212 @@
+#include "DocumentStats.h"
+#include <QtGui/QTextBlock>
+
+// WRITEHAND_NO_SIMD leaves only the scalar path, so tests can check it too
+#if (defined(__SSE2__) || defined(_M_X64)) && !defined(WRITEHAND_NO_SIMD)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+  inline bool isTerminator(char16_t c)
+  {
+    return c == u'.' || c == u'!' || c == u'?';
+  }
+
+  // Walks a paragraph keeping the state that crosses from one character,
+  // or one 8-character chunk, to the next
+  struct Counter
+  {
+    qint64 words = 0;
+    qint64 sentences = 0;
+    bool previousSpace = true;
+    bool previousTerminator = false;
+    bool wordSinceEnd = false;
+
+    void step(char16_t c)
+    {
+      bool space = QChar(c).isSpace();
+      if (space && previousTerminator && wordSinceEnd)
+      {
+        ++sentences;
+        wordSinceEnd = false;
+      }
+      else if (!space && previousSpace)
+      {
+        ++words;
+        wordSinceEnd = true;
+      }
+      previousSpace = space;
+      previousTerminator = isTerminator(c);
+    }
+
+    // Bit i of each mask is character i of the chunk
+    void chunk(unsigned spaces, unsigned terminators)
+    {
+      unsigned starts = ~spaces & ((spaces << 1) | unsigned(previousSpace)) & 0xFF;
+      unsigned ends = spaces & ((terminators << 1) | unsigned(previousTerminator));
+      words += qPopulationCount(starts);
+      if (!ends)
+      {
+        wordSinceEnd = wordSinceEnd || starts;
+      }
+      else
+      {
+        // Starts and ends never share a bit, so take them in order
+        for (unsigned events = starts | ends; events; events &= events - 1)
+        {
+          unsigned bit = events & (0u - events);
+          if (starts & bit)
+          {
+            wordSinceEnd = true;
+          }
+          else if (wordSinceEnd)
+          {
+            ++sentences;
+            wordSinceEnd = false;
+          }
+        }
+      }
+      previousSpace = spaces & 0x80;
+      previousTerminator = terminators & 0x80;
+    }
+  };
+}
+
+DocumentStats::DocumentStats(QObject *parent)
+    : QObject(parent)
+{
+  m_notifyTimer.setSingleShot(true);
+  m_notifyTimer.setInterval(0);
+  connect(&m_notifyTimer, &QTimer::timeout, this, &DocumentStats::changed);
+}
+
+DocumentStats::Counts DocumentStats::count(QStringView text)
+{
+  const char16_t *data = text.utf16();
+  const int size = int(text.size());
+  Counter counter;
+  int pos = 0;
+#if (defined(__SSE2__) || defined(_M_X64)) && !defined(WRITEHAND_NO_SIMD)
+  // ASCII chunks are classified eight characters at a time; a chunk with
+  // anything else in it takes the QChar path
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i space = _mm_set1_epi16(u' ');
+  const __m128i controlLow = _mm_set1_epi16(u'\t' - 1);
+  const __m128i controlHigh = _mm_set1_epi16(u'\r' + 1);
+  const __m128i period = _mm_set1_epi16(u'.');
+  const __m128i exclamation = _mm_set1_epi16(u'!');
+  const __m128i question = _mm_set1_epi16(u'?');
+  for (; pos + 8 <= size; pos += 8)
+  {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_srli_epi16(x, 7), zero)) != 0xFFFF)
+    {
+      for (int i = pos; i < pos + 8; ++i)
+        counter.step(data[i]);
+      continue;
+    }
+
+    __m128i spaces = _mm_or_si128(_mm_cmpeq_epi16(x, space),
+                                  _mm_and_si128(_mm_cmpgt_epi16(x, controlLow), _mm_cmplt_epi16(x, controlHigh)));
+    __m128i terminators = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi16(x, period), _mm_cmpeq_epi16(x, exclamation)),
+                                       _mm_cmpeq_epi16(x, question));
+    // Packing narrows each 16-bit lane to a byte, so one mask bit per character
+    counter.chunk(unsigned(_mm_movemask_epi8(_mm_packs_epi16(spaces, zero))),
+                  unsigned(_mm_movemask_epi8(_mm_packs_epi16(terminators, zero))));
+  }
+#endif
+  for (; pos < size; ++pos)
+    counter.step(data[pos]);
+
+  Counts counts;
+  counts.words = counter.words;
+  counts.characters = size;
+  // A paragraph's last sentence needs no terminator
+  counts.sentences = counter.sentences + (counter.wordSinceEnd ? 1 : 0);
+  counts.paragraphs = counter.words > 0 ? 1 : 0;
+  return counts;
+}
+
+void DocumentStats::setDocument(QTextDocument *document)
+{
+  disconnect(m_connection);
+  m_document = document;
+  if (m_document)
+    m_connection = connect(m_document, &QTextDocument::contentsChange, this, &DocumentStats::onContentsChange);
+  recountAll();
+}
+
+void DocumentStats::recountAll()
+{
+  m_blocks.clear();
+  m_totals = Counts();
+  if (m_document)
+  {
+    m_blocks.reserve(m_document->blockCount());
+    for (QTextBlock block = m_document->begin(); block.isValid(); block = block.next())
+    {
+      m_blocks.append(countBlock(block));
+      add(m_blocks.last(), 1);
+    }
+  }
+  notify();
+}
+
+void DocumentStats::onContentsChange(int position, int charsRemoved, int charsAdded)
+{
+  Q_UNUSED(charsRemoved);
+  int count = m_document->blockCount();
+  QTextBlock block = m_document->findBlock(position);
+  QTextBlock last = m_document->findBlock(position + charsAdded);
+  int first = block.isValid() ? block.blockNumber() : count - 1;
+  int lastNumber = last.isValid() ? last.blockNumber() : count - 1;
+
+  // The edited blocks replace as many old ones, less however many blocks
+  // the edit added
+  int newSpan = lastNumber - first + 1;
+  int oldSpan = newSpan - (count - int(m_blocks.size()));
+  if (first < 0 || oldSpan < 1 || first + oldSpan > m_blocks.size())
+  {
+    recountAll();
+    return;
+  }
+
+  for (int i = first; i < first + oldSpan; ++i)
+    add(m_blocks.at(i), -1);
+  if (newSpan > oldSpan)
+    m_blocks.insert(first, newSpan - oldSpan, BlockCounts());
+  else if (newSpan < oldSpan)
+    m_blocks.remove(first, oldSpan - newSpan);
+
+  for (int i = first; i <= lastNumber && block.isValid(); ++i, block = block.next())
+  {
+    m_blocks[i] = countBlock(block);
+    add(m_blocks.at(i), 1);
+  }
+  notify();
+}
+
+DocumentStats::BlockCounts DocumentStats::countBlock(const QTextBlock &block) const
+{
+  Counts counts = count(block.text());
+  BlockCounts result;
+  result.words = int(counts.words);
+  result.characters = int(counts.characters);
+  result.sentences = int(counts.sentences);
+  return result;
+}
+
+void DocumentStats::add(const BlockCounts &block, int sign)
+{
+  m_totals.words += sign * block.words;
+  m_totals.characters += sign * block.characters;
+  m_totals.sentences += sign * block.sentences;
+  m_totals.paragraphs += block.words > 0 ? sign : 0;
+}
+
+void DocumentStats::notify()
+{
+  if (!m_notifyTimer.isActive())
+    m_notifyTimer.start();
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <QtCore/QObject>
+#include <QtCore/QPointer>
+#include <QtCore/QStringView>
+#include <QtCore/QTimer>
+#include <QtCore/QVector>
+#include <QtGui/QTextDocument>
+
+// Word, character, sentence and paragraph counts for the open document.
+// Every block keeps its own counts and the totals are their running sum,
+// so an edit recounts only the blocks contentsChange says it touched.
+//
+// A word is a run of non-space characters, as in MetadataIndex. A sentence
+// ends at '.', '!' or '?' followed by a space or the end of the paragraph,
+// and a paragraph is a block with at least one word.
+class DocumentStats : public QObject
+{
+  Q_OBJECT
+
+public:
+  struct Counts
+  {
+    qint64 words = 0;
+    qint64 characters = 0;
+    qint64 sentences = 0;
+    qint64 paragraphs = 0;
+  };
+
+  explicit DocumentStats(QObject *parent = nullptr);
+
+  // Counts all of document up front; nullptr detaches
+  void setDocument(QTextDocument *document);
+  QTextDocument *document() const { return m_document; }
+  const Counts &counts() const { return m_totals; }
+
+  // Counts for one paragraph of text
+  static Counts count(QStringView text);
+
+signals:
+  // Once per event loop pass, however many edits it held
+  void changed();
+
+private:
+  struct BlockCounts
+  {
+    int words = 0;
+    int characters = 0;
+    int sentences = 0;
+  };
+
+  void onContentsChange(int position, int charsRemoved, int charsAdded);
+  void recountAll();
+  BlockCounts countBlock(const QTextBlock &block) const;
+  void add(const BlockCounts &block, int sign);
+  void notify();
+
+  QPointer<QTextDocument> m_document;
+  QMetaObject::Connection m_connection;
+  QVector<BlockCounts> m_blocks;
+  Counts m_totals;
+  QTimer m_notifyTimer;
+};
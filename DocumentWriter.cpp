@@ -0,0 +1,281 @@
+#include "DocumentWriter.h"
+#include <QtCore/QDebug>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QHash>
+#include <QtCore/QSaveFile>
+#include <QtCore/QSet>
+#include <memory>
+#include <vector>
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+  // Temporaries stay open from write to rename, so bigger batches go in
+  // rounds of this many files to keep clear of descriptor limits
+  const int MaxOpenFiles = 64;
+
+  QString describe(const QString &filePath, const QString &error)
+  {
+    return QString("%1: %2").arg(QFileInfo(filePath).fileName(), error);
+  }
+}
+
+DocumentWriter &DocumentWriter::instance()
+{
+  static DocumentWriter instance;
+  return instance;
+}
+
+DocumentWriter::DocumentWriter()
+    : m_running(false), m_stopped(false), m_writer(nullptr)
+{
+}
+
+DocumentWriter::~DocumentWriter()
+{
+  shutdown();
+}
+
+bool DocumentWriter::syncFile(QFileDevice &file)
+{
+  if (!file.flush())
+    return false;
+#if defined(Q_OS_WIN)
+  return _commit(file.handle()) == 0;
+#elif defined(Q_OS_MACOS)
+  // Plain fsync() on macOS leaves the data in the drive's cache
+  return ::fcntl(file.handle(), F_FULLFSYNC) != -1 || ::fsync(file.handle()) == 0;
+#else
+  return ::fsync(file.handle()) == 0;
+#endif
+}
+
+QFuture<DocumentWriter::Result> DocumentWriter::write(const QString &filePath, const QByteArray &data)
+{
+  return write(QList<File>() << File(filePath, data));
+}
+
+QFuture<DocumentWriter::Result> DocumentWriter::write(const QString &filePath, const Producer &producer)
+{
+  return write(QList<File>() << File(filePath, producer));
+}
+
+QFuture<DocumentWriter::Result> DocumentWriter::write(const QList<File> &files)
+{
+  Batch batch;
+  batch.files = files;
+  batch.promise = QSharedPointer<QPromise<Result>>::create();
+  batch.promise->start();
+  QFuture<Result> future = batch.promise->future();
+
+  QMutexLocker locker(&m_mutex);
+  if (m_stopped)
+  {
+    locker.unlock();
+    QList<Batch> batches;
+    batches.append(batch);
+    writeBatches(batches);
+    return future;
+  }
+
+  m_queue.append(batch);
+  if (!m_writer)
+  {
+    m_running = true;
+    m_writer = QThread::create([this]()
+                               { writerLoop(); });
+    m_writer->setObjectName("DocumentWriter");
+    m_writer->start();
+  }
+  m_wakeup.wakeOne();
+  return future;
+}
+
+void DocumentWriter::shutdown()
+{
+  {
+    QMutexLocker locker(&m_mutex);
+    if (m_stopped)
+      return;
+    m_running = false;
+    m_wakeup.wakeOne();
+  }
+
+  if (m_writer)
+  {
+    m_writer->wait();
+    delete m_writer;
+    m_writer = nullptr;
+  }
+
+  // Anything queued while the thread was on its way out
+  QList<Batch> rest;
+  {
+    QMutexLocker locker(&m_mutex);
+    m_stopped = true;
+    rest.swap(m_queue);
+  }
+  writeBatches(rest);
+}
+
+void DocumentWriter::writerLoop()
+{
+  while (true)
+  {
+    QList<Batch> batches;
+    {
+      QMutexLocker locker(&m_mutex);
+      while (m_queue.isEmpty() && m_running)
+        m_wakeup.wait(&m_mutex);
+      // Whatever was queued before shutdown() still gets written
+      if (m_queue.isEmpty())
+        return;
+      batches.swap(m_queue);
+    }
+    writeBatches(batches);
+  }
+}
+
+void DocumentWriter::writeBatches(QList<Batch> &batches)
+{
+  if (batches.isEmpty())
+    return;
+
+  QElapsedTimer timer;
+  timer.start();
+
+  // A file saved on its own and then again before its turn only needs the
+  // newer contents; the older save finishes with the newer one's result
+  QHash<QString, int> lastBatch;
+  for (int i = 0; i < batches.size(); ++i)
+  {
+    for (const File &file : batches.at(i).files)
+      lastBatch.insert(QFileInfo(file.path).absoluteFilePath(), i);
+  }
+  QList<int> supersededBy(batches.size(), -1);
+  for (int i = 0; i < batches.size(); ++i)
+  {
+    if (batches.at(i).files.size() != 1)
+      continue;
+    int last = lastBatch.value(QFileInfo(batches.at(i).files.first().path).absoluteFilePath());
+    if (last != i && batches.at(last).files.size() == 1)
+      supersededBy[i] = last;
+  }
+
+  struct Entry
+  {
+    int batch;
+    const File *file;
+    std::unique_ptr<QSaveFile> output;
+  };
+  std::vector<Entry> entries;
+  QList<Result> results(batches.size());
+  for (int i = 0; i < batches.size(); ++i)
+  {
+    if (supersededBy.at(i) >= 0)
+      continue;
+    results[i].ok = true;
+    for (const File &file : batches.at(i).files)
+      entries.push_back(Entry{i, &file, nullptr});
+  }
+
+  auto fail = [&results](int batch, const QString &error)
+  {
+    if (!results.at(batch).ok)
+      return;
+    results[batch].ok = false;
+    results[batch].error = error;
+  };
+
+  int files = 0;
+  for (size_t start = 0; start < entries.size(); start += MaxOpenFiles)
+  {
+    size_t end = qMin(entries.size(), start + MaxOpenFiles);
+
+    // Every temporary is written first...
+    for (size_t i = start; i < end; ++i)
+    {
+      Entry &entry = entries[i];
+      if (!results.at(entry.batch).ok)
+        continue;
+      entry.output.reset(new QSaveFile(entry.file->path));
+      const QByteArray &data = entry.file->data;
+      QString error;
+      if (!entry.output->open(QIODevice::WriteOnly))
+        fail(entry.batch, describe(entry.file->path, entry.output->errorString()));
+      else if (entry.file->producer && !entry.file->producer(*entry.output, &error))
+        fail(entry.batch, describe(entry.file->path, error.isEmpty() ? entry.output->errorString() : error));
+      else if (!entry.file->producer && entry.output->write(data) != data.size())
+        fail(entry.batch, describe(entry.file->path, entry.output->errorString()));
+    }
+
+    // ...then synced back to back...
+    for (size_t i = start; i < end; ++i)
+    {
+      Entry &entry = entries[i];
+      if (results.at(entry.batch).ok && !syncFile(*entry.output))
+        fail(entry.batch, describe(entry.file->path, entry.output->errorString()));
+    }
+
+    // ...and only then renamed over the originals, which are intact until here
+    QSet<QString> directories;
+    for (size_t i = start; i < end; ++i)
+    {
+      Entry &entry = entries[i];
+      if (!entry.output)
+        continue;
+      if (!results.at(entry.batch).ok)
+      {
+        entry.output->cancelWriting();
+      }
+      else if (!entry.output->commit())
+      {
+        fail(entry.batch, describe(entry.file->path, entry.output->errorString()));
+      }
+      else
+      {
+        results[entry.batch].written.append(entry.file->path);
+        directories.insert(QFileInfo(entry.file->path).absolutePath());
+        files++;
+      }
+      entry.output.reset();
+    }
+
+    // A rename is only durable once its directory is
+    for (const QString &directory : directories)
+      syncDirectory(directory);
+  }
+
+  for (int i = 0; i < batches.size(); ++i)
+  {
+    const Result &result = results.at(supersededBy.at(i) >= 0 ? supersededBy.at(i) : i);
+    if (!result.ok && supersededBy.at(i) < 0)
+      qWarning().noquote() << "Could not write" << result.error;
+    batches[i].promise->addResult(result);
+    batches[i].promise->finish();
+  }
+
+  qDebug() << "DocumentWriter:" << files << "files from" << batches.size() << "saves in" << timer.elapsed() << "ms";
+}
+
+void DocumentWriter::syncDirectory(const QString &path)
+{
+#ifndef Q_OS_WIN
+  int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY);
+  if (fd < 0)
+    return;
+  ::fsync(fd);
+  ::close(fd);
+#else
+  // NTFS journals renames with the rename itself
+  Q_UNUSED(path);
+#endif
+}
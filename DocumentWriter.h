@@ -0,0 +1,89 @@
+#pragma once
+
+#include <QtCore/QByteArray>
+#include <QtCore/QFileDevice>
+#include <QtCore/QFuture>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QPromise>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QStringList>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+#include <functional>
+
+// Process-wide service every document save goes through. Files are
+// replaced the QSaveFile way - written to a temporary next to the
+// destination, synced, then renamed over it - so a crash or a full disk
+// leaves either the old contents or the new ones, never half of each.
+//
+// Writes run on one thread in the order they were queued. Whatever has
+// queued up by the time the thread gets to it is handled together: a
+// file saved again before its turn is only written once, and all the
+// temporaries are written before any is synced and synced before any is
+// renamed, so the disk sees one burst of flushes rather than one per file.
+class DocumentWriter
+{
+public:
+  struct Result
+  {
+    bool ok = false;
+    QString error;
+    QStringList written; // Files replaced, in order, even when a later one failed
+  };
+
+  // Streams the new contents into the temporary file, on the writer thread
+  using Producer = std::function<bool(QFileDevice &file, QString *error)>;
+
+  struct File
+  {
+    File() = default;
+    File(const QString &path, const QByteArray &data) : path(path), data(data) {}
+    File(const QString &path, const Producer &producer) : path(path), producer(producer) {}
+
+    QString path;
+    QByteArray data;
+    Producer producer; // In place of data when set
+  };
+
+  static DocumentWriter &instance();
+  static bool syncFile(QFileDevice &file);
+
+  // The future finishes once the new contents are on disk
+  QFuture<Result> write(const QString &filePath, const QByteArray &data);
+  // For contents too big to copy out first; whatever producer reads from
+  // must stay valid, and unchanged, until the future finishes
+  QFuture<Result> write(const QString &filePath, const Producer &producer);
+  // A group of files that stand or fall together: none is renamed into
+  // place unless all of them were written and synced. Groups of more than
+  // a few dozen files go in rounds, so a failure can come after earlier
+  // rounds were renamed; Result::written says which to put back.
+  QFuture<Result> write(const QList<File> &files);
+
+  // Drains everything queued so far and stops the writer thread; later
+  // writes run on the caller's thread
+  void shutdown();
+
+private:
+  DocumentWriter();
+  ~DocumentWriter();
+  DocumentWriter(const DocumentWriter &) = delete;
+  DocumentWriter &operator=(const DocumentWriter &) = delete;
+
+  struct Batch
+  {
+    QList<File> files;
+    QSharedPointer<QPromise<Result>> promise;
+  };
+
+  void writerLoop();
+  static void writeBatches(QList<Batch> &batches);
+  static void syncDirectory(const QString &path);
+
+  QMutex m_mutex;
+  QWaitCondition m_wakeup;
+  QList<Batch> m_queue;
+  bool m_running;
+  bool m_stopped;
+  QThread *m_writer;
+};
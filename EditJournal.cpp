@@ -0,0 +1,431 @@
+#include "EditJournal.h"
+#include "DocumentWriter.h"
+#include <QtCore/QFile>
+#include <QtCore/QSaveFile>
+#include <QtCore/QDir>
+#include <QtCore/QDataStream>
+#include <QtCore/QTextStream>
+#include <QtCore/QStandardPaths>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDebug>
+#include <QtGui/QTextCursor>
+#include <QtGui/QTextDocumentFragment>
+
+namespace
+{
+  const quint32 JournalMagic = 0x57484A31; // "WHJ1"
+  const quint32 JournalVersion = 2;
+  const int BatchInterval = 200;
+  const int BatchLimit = 64 * 1024;
+  const qint64 CompactionThreshold = 1024 * 1024;
+}
+
+// Lives on the journal thread; only ever touched through queued calls
+class JournalWriter : public QObject
+{
+public:
+  void append(const QString &path, const QByteArray &data, bool truncate)
+  {
+    if (truncate || m_file.fileName() != path || !m_file.isOpen())
+    {
+      m_file.close();
+      m_file.setFileName(path);
+      QIODevice::OpenMode mode = QIODevice::WriteOnly | (truncate ? QIODevice::Truncate : QIODevice::Append);
+      if (!m_file.open(mode))
+      {
+        qWarning() << "Could not open edit journal" << path << m_file.errorString();
+        return;
+      }
+    }
+
+    if (m_file.write(data) != data.size() || !DocumentWriter::syncFile(m_file))
+      qWarning() << "Could not append to edit journal" << path << m_file.errorString();
+  }
+
+  void rewrite(const QString &path, const QByteArray &data)
+  {
+    if (m_file.fileName() == path)
+      m_file.close();
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !DocumentWriter::syncFile(file) || !file.commit())
+      qWarning() << "Could not compact edit journal" << path << file.errorString();
+  }
+
+  void remove(const QString &path)
+  {
+    if (m_file.fileName() == path)
+      m_file.close();
+    QFile::remove(path);
+  }
+
+private:
+  QFile m_file;
+};
+
+EditJournal::EditJournal(QObject *parent)
+    : QObject(parent), m_isRichText(false), m_batchTruncates(false), m_fileStarted(false), m_journalBytes(0),
+      m_writer(new JournalWriter)
+{
+  m_batchTimer.setSingleShot(true);
+  m_batchTimer.setInterval(BatchInterval);
+  connect(&m_batchTimer, &QTimer::timeout, this, &EditJournal::flushBatch);
+
+  m_thread.setObjectName("EditJournal");
+  m_writer->moveToThread(&m_thread);
+  m_thread.start(QThread::LowPriority);
+}
+
+EditJournal::~EditJournal()
+{
+  release();
+  m_thread.quit();
+  m_thread.wait();
+  delete m_writer;
+}
+
+QByteArray EditJournal::checksum(const QByteArray &data)
+{
+  return QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+}
+
+QString EditJournal::journalDirectory()
+{
+  QString path = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/journal";
+  QDir().mkpath(path);
+  return path;
+}
+
+QString EditJournal::journalPath(const QString &filePath)
+{
+  QByteArray key = QCryptographicHash::hash(filePath.toUtf8(), QCryptographicHash::Md5).toHex();
+  return journalDirectory() + "/" + QString::fromLatin1(key) + ".wal";
+}
+
+void EditJournal::attach(QTextDocument *document, const QString &filePath, bool isRichText, const QByteArray &baseChecksum)
+{
+  release();
+
+  m_document = document;
+  m_filePath = filePath;
+  m_journalPath = filePath.isEmpty() ? QString() : journalPath(filePath);
+  m_isRichText = isRichText;
+  m_baseChecksum = baseChecksum;
+
+  if (m_document && !m_filePath.isEmpty())
+  {
+    m_connection = connect(m_document, &QTextDocument::contentsChange, this, &EditJournal::onContentsChange);
+  }
+}
+
+void EditJournal::release()
+{
+  // Records that never made it into a save stay on disk for recovery
+  flushBatch();
+  disconnect(m_connection);
+  m_document = nullptr;
+  m_records.clear();
+  m_checkpoints.clear();
+  m_fileStarted = false;
+  m_journalBytes = 0;
+}
+
+void EditJournal::discard()
+{
+  m_batchTimer.stop();
+  m_batch.clear();
+  if (m_fileStarted)
+  {
+    QString path = m_journalPath;
+    QMetaObject::invokeMethod(m_writer, [writer = m_writer, path]()
+                              { writer->remove(path); }, Qt::QueuedConnection);
+  }
+  m_fileStarted = false;
+  release();
+  m_filePath.clear();
+  m_journalPath.clear();
+}
+
+void EditJournal::setFilePath(const QString &filePath)
+{
+  // The journal file keeps its name; the record tells recovery where the document went
+  QByteArray payload;
+  QDataStream out(&payload, QIODevice::WriteOnly);
+  out.setVersion(QDataStream::Qt_6_0);
+  out << filePath;
+  m_filePath = filePath;
+  if (m_fileStarted || !m_records.isEmpty())
+    appendRecord(RenameRecord, payload);
+}
+
+QByteArray EditJournal::header() const
+{
+  QByteArray data;
+  QDataStream out(&data, QIODevice::WriteOnly);
+  out.setVersion(QDataStream::Qt_6_0);
+  out << JournalMagic << JournalVersion << m_filePath << m_isRichText << m_baseChecksum;
+  return data;
+}
+
+void EditJournal::onContentsChange(int position, int charsRemoved, int charsAdded)
+{
+  if (!m_document)
+    return;
+
+  QString inserted;
+  if (charsAdded > 0)
+  {
+    // The document always ends in an implicit block separator we never store
+    int end = qMin(position + charsAdded, m_document->characterCount() - 1);
+    QTextCursor cursor(m_document);
+    cursor.setPosition(position);
+    cursor.setPosition(end, QTextCursor::KeepAnchor);
+    if (m_isRichText)
+    {
+      // Formatting changes arrive as a same-length replacement, so the
+      // fragment carries them as well as what was typed
+      inserted = QTextDocumentFragment(cursor).toHtml();
+    }
+    else
+    {
+      inserted = cursor.selectedText();
+      inserted.replace(QChar::ParagraphSeparator, '\n');
+    }
+  }
+
+  QByteArray payload;
+  QDataStream out(&payload, QIODevice::WriteOnly);
+  out.setVersion(QDataStream::Qt_6_0);
+  out << qint32(position) << qint32(charsRemoved) << inserted;
+  appendRecord(EditRecord, payload);
+}
+
+void EditJournal::appendRecord(RecordType type, const QByteArray &payload)
+{
+  if (m_journalPath.isEmpty())
+    return;
+
+  QByteArray record;
+  QDataStream out(&record, QIODevice::WriteOnly);
+  out.setVersion(QDataStream::Qt_6_0);
+  out << quint8(type) << payload << qChecksum(payload);
+
+  if (!m_fileStarted)
+  {
+    m_batch = header();
+    m_batchTruncates = true;
+    m_fileStarted = true;
+    m_journalBytes = m_batch.size();
+  }
+
+  m_records.append(record);
+  m_batch.append(record);
+  m_journalBytes += record.size();
+
+  if (m_batch.size() >= BatchLimit)
+    flushBatch();
+  else if (!m_batchTimer.isActive())
+    m_batchTimer.start();
+
+  if (m_journalBytes >= CompactionThreshold)
+    emit compactionRequested();
+}
+
+void EditJournal::flushBatch()
+{
+  m_batchTimer.stop();
+  if (m_batch.isEmpty())
+    return;
+
+  QString path = m_journalPath;
+  QByteArray data = m_batch;
+  bool truncate = m_batchTruncates;
+  m_batch.clear();
+  m_batchTruncates = false;
+
+  QMetaObject::invokeMethod(m_writer, [writer = m_writer, path, data, truncate]()
+                            { writer->append(path, data, truncate); }, Qt::QueuedConnection);
+}
+
+void EditJournal::checkpoint()
+{
+  m_checkpoints.enqueue(m_records.size());
+}
+
+void EditJournal::compact(bool saved, const QByteArray &checksum)
+{
+  if (m_checkpoints.isEmpty())
+    return;
+
+  int covered = m_checkpoints.dequeue();
+  if (!saved)
+    return;
+
+  m_records.erase(m_records.begin(), m_records.begin() + covered);
+  for (int &checkpoint : m_checkpoints)
+    checkpoint -= covered;
+  m_baseChecksum = checksum;
+
+  m_batchTimer.stop();
+  m_batch.clear();
+  m_batchTruncates = false;
+
+  QString path = m_journalPath;
+  if (m_records.isEmpty())
+  {
+    // Nothing left that isn't already in the real file
+    m_journalBytes = 0;
+    if (m_fileStarted)
+    {
+      QMetaObject::invokeMethod(m_writer, [writer = m_writer, path]()
+                                { writer->remove(path); }, Qt::QueuedConnection);
+    }
+    m_fileStarted = false;
+    return;
+  }
+
+  QByteArray data = header();
+  for (const QByteArray &record : m_records)
+    data.append(record);
+  m_journalBytes = data.size();
+  m_fileStarted = true;
+
+  QMetaObject::invokeMethod(m_writer, [writer = m_writer, path, data]()
+                            { writer->rewrite(path, data); }, Qt::QueuedConnection);
+}
+
+QStringList EditJournal::recover()
+{
+  QStringList recovered;
+  QDir dir(journalDirectory());
+
+  for (const QFileInfo &journalInfo : dir.entryInfoList(QStringList() << "*.wal", QDir::Files))
+  {
+    QFile journal(journalInfo.filePath());
+    if (!journal.open(QIODevice::ReadOnly))
+      continue;
+
+    QDataStream in(&journal);
+    in.setVersion(QDataStream::Qt_6_0);
+
+    quint32 magic = 0;
+    quint32 version = 0;
+    QString filePath;
+    bool isRichText = false;
+    QByteArray baseChecksum;
+    in >> magic >> version >> filePath >> isRichText >> baseChecksum;
+    if (in.status() != QDataStream::Ok || magic != JournalMagic || version != JournalVersion)
+    {
+      qWarning() << "Ignoring unreadable edit journal" << journalInfo.filePath();
+      continue;
+    }
+
+    // A torn write at the tail just ends the log early
+    QList<QPair<quint8, QByteArray>> records;
+    while (!in.atEnd())
+    {
+      quint8 type = 0;
+      QByteArray payload;
+      quint16 crc = 0;
+      in >> type >> payload >> crc;
+      if (in.status() != QDataStream::Ok || crc != qChecksum(payload))
+        break;
+      records.append(qMakePair(type, payload));
+    }
+    journal.close();
+
+    for (const auto &record : records)
+    {
+      if (record.first == RenameRecord)
+      {
+        QDataStream payload(record.second);
+        payload.setVersion(QDataStream::Qt_6_0);
+        payload >> filePath;
+      }
+    }
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+      qWarning() << "Edit journal target is gone:" << filePath;
+      QFile::remove(journalInfo.filePath());
+      continue;
+    }
+    QByteArray base = file.readAll();
+    file.close();
+
+    if (checksum(base) != baseChecksum)
+    {
+      // The file changed underneath the journal; keep it aside rather than guess
+      qWarning() << "Edit journal does not match" << filePath << "- keeping it as .orphan";
+      QFile::rename(journalInfo.filePath(), journalInfo.filePath() + ".orphan");
+      continue;
+    }
+
+    QTextDocument document;
+    QTextStream baseStream(&base, QIODevice::ReadOnly);
+    if (isRichText)
+      document.setHtml(baseStream.readAll());
+    else
+      document.setPlainText(baseStream.readAll());
+
+    bool ok = true;
+    int applied = 0;
+    for (const auto &record : records)
+    {
+      if (record.first != EditRecord)
+        continue;
+
+      QDataStream payload(record.second);
+      payload.setVersion(QDataStream::Qt_6_0);
+      qint32 position = 0;
+      qint32 removed = 0;
+      QString inserted;
+      payload >> position >> removed >> inserted;
+
+      int length = document.characterCount() - 1;
+      if (position < 0 || removed < 0 || position > length)
+      {
+        ok = false;
+        break;
+      }
+
+      QTextCursor cursor(&document);
+      cursor.setPosition(position);
+      cursor.setPosition(qMin(position + removed, length), QTextCursor::KeepAnchor);
+      if (isRichText)
+      {
+        cursor.removeSelectedText();
+        if (!inserted.isEmpty())
+          cursor.insertFragment(QTextDocumentFragment::fromHtml(inserted));
+      }
+      else
+      {
+        cursor.insertText(inserted);
+      }
+      applied++;
+    }
+
+    if (!ok)
+    {
+      qWarning() << "Edit journal for" << filePath << "is inconsistent - keeping it as .orphan";
+      QFile::rename(journalInfo.filePath(), journalInfo.filePath() + ".orphan");
+      continue;
+    }
+
+    QByteArray data = (isRichText ? document.toHtml() : document.toPlainText()).toUtf8();
+    DocumentWriter::Result written = DocumentWriter::instance().write(filePath, data).result();
+    if (written.ok)
+    {
+      qDebug() << "Recovered" << applied << "journaled edits into" << filePath;
+      QFile::remove(journalInfo.filePath());
+      recovered << filePath;
+    }
+    else
+    {
+      qWarning() << "Could not write recovered document" << written.error;
+    }
+  }
+
+  return recovered;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <QtCore/QObject>
+#include <QtCore/QPointer>
+#include <QtCore/QTimer>
+#include <QtCore/QThread>
+#include <QtCore/QQueue>
+#include <QtCore/QStringList>
+#include <QtGui/QTextDocument>
+
+class JournalWriter;
+
+// Append-only write-ahead log of the edits made to the open document.
+// Records are fsync'd in small batches on a writer thread so the cost of an
+// edit on disk is proportional to what was typed. Autosaves compact the
+// journal: once a snapshot is on disk, the records it covers are dropped.
+// Rich documents journal what each edit inserted as an HTML fragment, so
+// recovery brings back its formatting along with the text.
+class EditJournal : public QObject
+{
+  Q_OBJECT
+
+public:
+  explicit EditJournal(QObject *parent = nullptr);
+  ~EditJournal();
+
+  void attach(QTextDocument *document, const QString &filePath, bool isRichText, const QByteArray &baseChecksum);
+  void discard();
+  void setFilePath(const QString &filePath);
+
+  // Bracket an autosave: checkpoint() when its snapshot is taken,
+  // compact() once it has been written
+  void checkpoint();
+  void compact(bool saved, const QByteArray &checksum);
+
+  // Replays journals left behind by a crash; returns the recovered files
+  static QStringList recover();
+  static QByteArray checksum(const QByteArray &data);
+
+signals:
+  void compactionRequested();
+
+private slots:
+  void onContentsChange(int position, int charsRemoved, int charsAdded);
+  void flushBatch();
+
+private:
+  enum RecordType : quint8
+  {
+    EditRecord = 'E',
+    RenameRecord = 'R'
+  };
+
+  static QString journalDirectory();
+  static QString journalPath(const QString &filePath);
+  QByteArray header() const;
+  void appendRecord(RecordType type, const QByteArray &payload);
+  void release();
+
+  QPointer<QTextDocument> m_document;
+  QMetaObject::Connection m_connection;
+  QString m_filePath;
+  QString m_journalPath;
+  bool m_isRichText;
+  QByteArray m_baseChecksum;
+
+  QList<QByteArray> m_records; // Encoded records not yet covered by a save
+  QByteArray m_batch;          // Encoded bytes not yet handed to the writer
+  bool m_batchTruncates;
+  bool m_fileStarted;
+  qint64 m_journalBytes;
+  QQueue<int> m_checkpoints;
+  QTimer m_batchTimer;
+
+  QThread m_thread;
+  JournalWriter *m_writer;
+};
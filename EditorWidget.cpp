@@ -5,13 +5,30 @@
 #include <QtGui/QFont>
 #include <QtCore/QRegularExpression>
 #include "ThemeManager.h"
+#include "LazyDocumentLayout.h"
 #include <QtGui/QTextCharFormat>
 #include <QtGui/QTextDocument>
 #include <QtGui/QTextCursor>
 #include <QtCore/QDebug>
+#include <QtWidgets/QScrollBar>
+#include <QtGui/QAbstractTextDocumentLayout>
+#include <QtGui/QTextBlock>
+#include <QtConcurrent/QtConcurrentRun>
+#include <QtCore/QFileInfo>
+#include <QtGui/QFontDatabase>
+#include <QtGui/QKeyEvent>
+
+namespace
+{
+  // Past this QTextDocument's block structure costs many times the file size
+  const qint64 LargeFileThreshold = 8 * 1024 * 1024;
+  const qint64 DefaultUndoBudget = 16 * 1024 * 1024;
+  // Redrawing the overview strip is O(matches), too much for every keystroke
+  const int OverviewDelayMs = 150;
+}
 
 EditorWidget::EditorWidget(QWidget *parent)
-    : QWidget(parent), m_editor(new QTextEdit(this)), m_currentMatch(0), m_totalMatches(0)
+    : QWidget(parent), m_editor(new QTextEdit(this)), m_largeView(new LargeFileView(this)), m_markdown(new MarkdownHighlighter(this)), m_undoBudget(DefaultUndoBudget), m_undoSpillToDisk(true), m_overviewBar(new SearchOverviewBar(this)), m_currentMatch(0), m_totalMatches(0), m_replaceRevision(0)
 {
   QVBoxLayout *layout = new QVBoxLayout(this);
   layout->setContentsMargins(0, 0, 0, 0);
@@ -24,8 +41,33 @@ EditorWidget::EditorWidget(QWidget *parent)
   setupFindReplaceWidget();
   layout->addWidget(m_findReplaceWidget);
 
-  // Add editor
-  layout->addWidget(m_editor);
+  // Add editor, with the match overview strip along its right edge
+  QHBoxLayout *editorLayout = new QHBoxLayout();
+  editorLayout->setContentsMargins(0, 0, 0, 0);
+  editorLayout->setSpacing(0);
+  editorLayout->addWidget(m_editor);
+  editorLayout->addWidget(m_largeView);
+  editorLayout->addWidget(m_overviewBar);
+  m_largeView->hide();
+  m_overviewBar->hide();
+  layout->addLayout(editorLayout);
+
+  // Search highlights only cover the visible part of the document, so
+  // they follow the viewport around
+  connect(m_editor->verticalScrollBar(), &QScrollBar::valueChanged, this, &EditorWidget::refreshHighlights);
+  connect(m_editor->verticalScrollBar(), &QScrollBar::valueChanged, this, &EditorWidget::syncLayoutViewport);
+  m_editor->viewport()->installEventFilter(this);
+  // For the undo and redo keys, which QTextEdit would send to the document
+  m_editor->installEventFilter(this);
+  connect(m_overviewBar, &SearchOverviewBar::positionRequested, this, &EditorWidget::scrollToFraction);
+  m_overviewTimer.setSingleShot(true);
+  m_overviewTimer.setInterval(OverviewDelayMs);
+  connect(&m_overviewTimer, &QTimer::timeout, this, &EditorWidget::refreshOverview);
+
+  connect(&m_replaceWatcher, &QFutureWatcher<ReplaceEngine::Result>::finished, this, &EditorWidget::onReplaceAllFinished);
+
+  // Keep the find index in step with edits
+  connect(m_editor->document(), &QTextDocument::contentsChange, this, &EditorWidget::onContentsChange);
 
   // Connect editor signals
   connect(m_editor, &QTextEdit::textChanged, this, [this]()
@@ -41,6 +83,10 @@ EditorWidget::EditorWidget(QWidget *parent)
   QFont font = m_editor->font();
   font.setPointSize(14);
   m_editor->setFont(font);
+  QFont fixedFont = QFontDatabase::systemFont(QFontDatabase::FixedFont);
+  fixedFont.setPointSize(font.pointSize());
+  m_largeView->setFont(fixedFont);
+  connect(m_largeView, &LargeFileView::contentChanged, this, &EditorWidget::contentChanged);
 
   // Ensure editor uses our highlight colors
   QPalette p = m_editor->palette();
@@ -62,6 +108,10 @@ void EditorWidget::setupFindReplaceWidget()
   connect(m_findLineEdit, &QLineEdit::textChanged, this, &EditorWidget::updateSearch);
   connect(m_findLineEdit, &QLineEdit::returnPressed, this, &EditorWidget::findNext);
 
+  m_regexCheckBox = new QCheckBox("Regex", m_findReplaceWidget);
+  m_regexCheckBox->setToolTip("Treat the search as a regular expression; use \\1 or $1 in the replacement");
+  connect(m_regexCheckBox, &QCheckBox::toggled, this, &EditorWidget::updateSearch);
+
   m_findPrevButton = new QPushButton("Previous", m_findReplaceWidget);
   m_findNextButton = new QPushButton("Next", m_findReplaceWidget);
   m_closeButton = new QPushButton("×", m_findReplaceWidget);
@@ -72,6 +122,7 @@ void EditorWidget::setupFindReplaceWidget()
   connect(m_closeButton, &QPushButton::clicked, this, &EditorWidget::hideFindReplace);
 
   findLayout->addWidget(m_findLineEdit);
+  findLayout->addWidget(m_regexCheckBox);
   findLayout->addWidget(m_findPrevButton);
   findLayout->addWidget(m_findNextButton);
   findLayout->addWidget(m_closeButton);
@@ -104,6 +155,9 @@ void EditorWidget::setupFindReplaceWidget()
 
 void EditorWidget::showFindReplace()
 {
+  // Find works on the QTextDocument, which a large file doesn't have
+  if (isLargeFileMode())
+    return;
   m_findReplaceWidget->show();
   m_findLineEdit->setFocus();
   m_findLineEdit->selectAll();
@@ -113,6 +167,8 @@ void EditorWidget::showFindReplace()
 void EditorWidget::hideFindReplace()
 {
   clearHighlights();
+  m_overviewTimer.stop();
+  m_overviewBar->hide();
   m_findLineEdit->clear();
   m_findReplaceWidget->hide();
   m_editor->setFocus();
@@ -134,7 +190,10 @@ void EditorWidget::updateSearch()
   QString searchText = m_findLineEdit->text();
   if (searchText.isEmpty())
   {
+    m_matchIndex.clear();
     m_editor->setExtraSelections(QList<QTextEdit::ExtraSelection>());
+    m_overviewTimer.stop();
+    m_overviewBar->clearMatches();
     m_matchLabel->clear();
     m_currentMatch = 0;
     m_totalMatches = 0;
@@ -142,124 +201,195 @@ void EditorWidget::updateSearch()
     return;
   }
 
-  // First pass: count matches
-  QTextCursor cursor = QTextCursor(m_editor->document());
-  m_totalMatches = 0;
-  cursor.setPosition(0);
-  QTextCursor firstMatch;
-
-  while (!cursor.isNull() && !cursor.atEnd())
+  // Only a new query scans the whole document; edits patch the index
+  bool regex = m_regexCheckBox->isChecked();
+  bool queryChanged = searchText != m_matchIndex.pattern() || regex != m_matchIndex.isRegex();
+  if (queryChanged)
   {
-    cursor = m_editor->document()->find(searchText, cursor);
-    if (!cursor.isNull())
-    {
-      if (m_totalMatches == 0)
-      {
-        firstMatch = cursor;
-      }
-      m_totalMatches++;
-    }
+    m_matchIndex.build(m_editor->document(), searchText, LiteralSearcher::CaseInsensitive, regex);
   }
+  m_totalMatches = m_matchIndex.count();
 
   if (m_totalMatches == 0)
   {
     m_editor->setExtraSelections(QList<QTextEdit::ExtraSelection>());
-    m_matchLabel->setText("No matches");
+    m_overviewTimer.stop();
+    m_overviewBar->clearMatches();
+    m_matchLabel->setText(m_matchIndex.isActive() ? QString("No matches") : m_matchIndex.errorString());
     isUpdating = false;
     return;
   }
 
-  // Get current selection or use first match
+  // Work out the current match from the selection with a binary search
   QTextCursor currentCursor = m_editor->textCursor();
-  bool hasSelection = currentCursor.hasSelection();
-
-  if (!hasSelection && m_totalMatches > 0)
+  int current = -1;
+  if (currentCursor.hasSelection())
   {
-    currentCursor = firstMatch;
-    m_currentMatch = 0;
+    current = m_matchIndex.indexOf(currentCursor.selectionStart());
+    if (current >= 0 && currentCursor.selectionEnd() - currentCursor.selectionStart() != m_matchIndex.lengthAt(current))
+      current = -1;
   }
 
-  // Apply formatting to all matches
-  QList<QTextEdit::ExtraSelection> extraSelections;
-  cursor = QTextCursor(m_editor->document());
-  cursor.setPosition(0);
-
-  while (!cursor.isNull() && !cursor.atEnd())
+  if (current < 0)
   {
-    cursor = m_editor->document()->find(searchText, cursor);
-    if (!cursor.isNull())
+    current = m_matchIndex.lowerBound(currentCursor.selectionStart());
+    if (current >= m_totalMatches)
+      current = queryChanged ? 0 : m_totalMatches - 1;
+
+    // Typing a query jumps to the nearest match, typing in the document doesn't
+    if (queryChanged)
     {
-      QTextEdit::ExtraSelection selection;
-      selection.cursor = cursor;
-      QTextCharFormat format;
-
-      // If this is the current match
-      if (cursor.selectionStart() == currentCursor.selectionStart() &&
-          cursor.selectionEnd() == currentCursor.selectionEnd())
-      {
-        format.setBackground(m_editor->palette().color(QPalette::Highlight));
-        format.setForeground(m_editor->palette().color(QPalette::HighlightedText));
-      }
-      else
-      {
-        format.setBackground(Qt::transparent);
-        format.setUnderlineStyle(QTextCharFormat::SingleUnderline);
-        format.setUnderlineColor(QColor(255, 255, 0));
-      }
-
-      selection.format = format;
-      extraSelections.append(selection);
+      selectMatch(current);
     }
   }
+  m_currentMatch = current;
 
   // Update match label
   m_matchLabel->setText(QString("%1 of %2 matches").arg(m_currentMatch + 1).arg(m_totalMatches));
 
-  // Apply all formatting at once
-  m_editor->setExtraSelections(extraSelections);
+  refreshHighlights();
+  // A new query shows at once; edits to the document are batched
+  if (queryChanged || m_overviewBar->isHidden())
+    refreshOverview();
+  else if (!m_overviewTimer.isActive())
+    m_overviewTimer.start();
+
+  isUpdating = false;
+}
+
+void EditorWidget::refreshOverview()
+{
+  m_overviewTimer.stop();
+  if (m_findReplaceWidget->isHidden() || !m_matchIndex.isActive() || m_matchIndex.count() == 0)
+    return;
+  m_overviewBar->setMatches(m_matchIndex.matches(), m_editor->document()->characterCount(), m_currentMatch);
+  m_overviewBar->show();
+}
+
+void EditorWidget::refreshHighlights()
+{
+  if (!m_matchIndex.isActive() || m_matchIndex.count() == 0)
+    return;
+
+  // Materialize selections for the matches on screen plus a screen's worth
+  // above and below; everything else is only shown in the overview strip
+  QRect viewport = m_editor->viewport()->rect();
+  int margin = viewport.height();
+  int first = m_editor->cursorForPosition(QPoint(0, -margin)).position();
+  int last = m_editor->cursorForPosition(QPoint(viewport.width(), viewport.bottom() + margin)).position();
+
+  int begin = m_matchIndex.lowerBound(first - m_matchIndex.maxLength() + 1);
+  int end = m_matchIndex.lowerBound(last + 1);
 
-  // Set cursor position without selection to avoid Qt's native highlighting
-  if (!hasSelection)
+  QTextCharFormat currentFormat;
+  currentFormat.setBackground(m_editor->palette().color(QPalette::Highlight));
+  currentFormat.setForeground(m_editor->palette().color(QPalette::HighlightedText));
+
+  QTextCharFormat matchFormat;
+  matchFormat.setBackground(Qt::transparent);
+  matchFormat.setUnderlineStyle(QTextCharFormat::SingleUnderline);
+  matchFormat.setUnderlineColor(QColor(255, 255, 0));
+
+  QList<QTextEdit::ExtraSelection> extraSelections;
+  extraSelections.reserve(end - begin);
+  for (int i = begin; i < end; ++i)
   {
-    m_editor->setTextCursor(currentCursor);
+    QTextEdit::ExtraSelection selection;
+    selection.cursor = QTextCursor(m_editor->document());
+    selection.cursor.setPosition(m_matchIndex.at(i));
+    selection.cursor.setPosition(m_matchIndex.at(i) + m_matchIndex.lengthAt(i), QTextCursor::KeepAnchor);
+    selection.format = (i == m_currentMatch) ? currentFormat : matchFormat;
+    extraSelections.append(selection);
   }
 
-  isUpdating = false;
+  m_editor->setExtraSelections(extraSelections);
 }
 
-bool EditorWidget::findText(const QString &text, QTextDocument::FindFlags flags)
+void EditorWidget::scrollToFraction(double fraction)
 {
-  if (text.isEmpty())
-    return false;
+  QTextDocument *document = m_editor->document();
+  QTextBlock block = document->findBlock(int(fraction * (document->characterCount() - 1)));
+  QRectF rect = document->documentLayout()->blockBoundingRect(block);
+  QScrollBar *scrollBar = m_editor->verticalScrollBar();
+  scrollBar->setValue(int(rect.top()) - m_editor->viewport()->height() / 2);
+}
+
+void EditorWidget::syncLayoutViewport()
+{
+  if (auto *layout = qobject_cast<LazyDocumentLayout *>(m_editor->document()->documentLayout()))
+    layout->setViewportTop(m_editor->verticalScrollBar()->value());
+}
 
-  bool found = m_editor->find(text, flags);
+void EditorWidget::adjustScroll(qreal delta)
+{
+  // Text above the viewport was laid out and changed height
+  QScrollBar *scrollBar = m_editor->verticalScrollBar();
+  scrollBar->setValue(scrollBar->value() + qRound(delta));
+}
 
-  if (found)
+bool EditorWidget::eventFilter(QObject *obj, QEvent *event)
+{
+  if (obj == m_editor->viewport() && event->type() == QEvent::Resize)
   {
-    // Update current match number
-    QTextCursor cursor = m_editor->textCursor();
-    int position = cursor.position();
-    cursor.setPosition(0);
-    m_currentMatch = 0;
-    while (cursor.position() < position)
+    refreshHighlights();
+  }
+  else if (obj == m_editor && event->type() == QEvent::KeyPress && m_undo)
+  {
+    QKeyEvent *keyEvent = static_cast<QKeyEvent *>(event);
+    if (keyEvent->matches(QKeySequence::Undo))
     {
-      cursor = m_editor->document()->find(text, cursor);
-      if (cursor.isNull())
-        break;
-      m_currentMatch++;
+      undo();
+      return true;
     }
-
-    // Only update the underlines, don't reset the selection
-    static bool isUpdating = false;
-    if (!isUpdating)
+    if (keyEvent->matches(QKeySequence::Redo))
     {
-      isUpdating = true;
-      updateSearch();
-      isUpdating = false;
+      redo();
+      return true;
     }
   }
+  return QWidget::eventFilter(obj, event);
+}
+
+void EditorWidget::onContentsChange(int position, int charsRemoved, int charsAdded)
+{
+  if (m_matchIndex.isActive())
+  {
+    m_matchIndex.update(m_editor->document(), position, charsRemoved, charsAdded);
+  }
+}
+
+void EditorWidget::selectMatch(int index)
+{
+  int start = m_matchIndex.at(index);
+  QTextCursor cursor(m_editor->document());
+  cursor.setPosition(start);
+  cursor.setPosition(start + m_matchIndex.lengthAt(index), QTextCursor::KeepAnchor);
+  m_editor->setTextCursor(cursor);
+  m_currentMatch = index;
+}
+
+bool EditorWidget::findText(const QString &text, QTextDocument::FindFlags flags)
+{
+  if (text.isEmpty())
+    return false;
+
+  bool regex = m_regexCheckBox->isChecked();
+  if (text != m_matchIndex.pattern() || regex != m_matchIndex.isRegex())
+  {
+    m_matchIndex.build(m_editor->document(), text, LiteralSearcher::CaseInsensitive, regex);
+  }
+
+  // Next match after the selection, or the last one before it
+  QTextCursor cursor = m_editor->textCursor();
+  int index = (flags & QTextDocument::FindBackward)
+                  ? m_matchIndex.lowerBound(cursor.selectionStart()) - 1
+                  : m_matchIndex.lowerBound(cursor.selectionEnd());
+  if (index < 0 || index >= m_matchIndex.count())
+    return false;
 
-  return found;
+  selectMatch(index);
+  updateSearch();
+  return true;
 }
 
 void EditorWidget::findNext()
@@ -296,21 +426,17 @@ void EditorWidget::replace()
   if (findText.isEmpty())
     return;
 
+  // Only replace the selection if it is one of the matches
   QTextCursor cursor = m_editor->textCursor();
-  if (cursor.hasSelection())
-  {
-    QString selectedText = cursor.selectedText();
-    if (selectedText == findText)
-    {
-      cursor.insertText(replaceText);
-      updateSearch();
-    }
-    findNext();
-  }
-  else
+  int index = cursor.hasSelection() ? m_matchIndex.indexOf(cursor.selectionStart()) : -1;
+  if (index >= 0 && cursor.selectionEnd() - cursor.selectionStart() == m_matchIndex.lengthAt(index))
   {
-    findNext();
+    if (m_matchIndex.isRegex())
+      replaceText = ReplaceEngine::expand(replaceText, m_matchIndex.regexMatch(m_editor->document(), index));
+    cursor.insertText(replaceText);
+    updateSearch();
   }
+  findNext();
 }
 
 void EditorWidget::replaceAll()
@@ -318,28 +444,49 @@ void EditorWidget::replaceAll()
   QString findText = m_findLineEdit->text();
   QString replaceText = m_replaceLineEdit->text();
 
-  if (findText.isEmpty())
+  if (findText.isEmpty() || m_replaceWatcher.isRunning())
     return;
 
-  QTextCursor cursor = m_editor->textCursor();
-  cursor.beginEditBlock();
+  // Matching runs on a worker against a snapshot of the text; the document
+  // is only touched again once the finished patch list comes back
+  ReplaceEngine::Mode mode = m_regexCheckBox->isChecked() ? ReplaceEngine::Regex : ReplaceEngine::Literal;
+  m_replaceRevision = m_editor->document()->revision();
+  m_replaceTimer.start();
+  m_replaceAllButton->setEnabled(false);
+  m_matchLabel->setText("Replacing...");
+
+  m_replaceWatcher.setFuture(QtConcurrent::run(&ReplaceEngine::computeEdits, m_editor->document()->toPlainText(),
+                                               findText, replaceText, mode,
+                                               LiteralSearcher::Options(LiteralSearcher::CaseInsensitive)));
+}
 
-  cursor.movePosition(QTextCursor::Start);
-  m_editor->setTextCursor(cursor);
+void EditorWidget::onReplaceAllFinished()
+{
+  m_replaceAllButton->setEnabled(true);
+  if (m_replaceRevision < 0)
+    return;
+  ReplaceEngine::Result result = m_replaceWatcher.result();
 
-  int replacements = 0;
-  QTextDocument::FindFlags flags = QTextDocument::FindWholeWords;
-  while (m_editor->find(findText, flags))
+  if (!result.error.isEmpty())
   {
-    cursor = m_editor->textCursor();
-    cursor.insertText(replaceText);
-    replacements++;
+    m_matchLabel->setText(result.error);
+    return;
   }
 
-  cursor.endEditBlock();
+  // The text changed while we were matching, so the offsets are stale
+  if (m_editor->document()->revision() != m_replaceRevision)
+  {
+    replaceAll();
+    return;
+  }
 
-  m_matchLabel->setText(QString("%1 replacements made").arg(replacements));
+  ReplaceEngine::apply(m_editor->document(), result.edits);
   updateSearch();
+
+  qint64 elapsed = m_replaceTimer.elapsed();
+  m_matchLabel->setText(QString("%1 replacements made in %2 ms").arg(result.edits.size()).arg(elapsed));
+  qDebug() << "Replace all:" << result.edits.size() << "replacements," << result.elapsedMs << "ms matching,"
+           << elapsed << "ms total";
 }
 
 void EditorWidget::setContent(const QString &content, bool isRichText)
@@ -359,9 +506,214 @@ QString EditorWidget::content(bool asRichText) const
   return asRichText ? m_editor->toHtml() : m_editor->toPlainText();
 }
 
+void EditorWidget::setMarkdownHighlighting(bool enabled)
+{
+  m_markdown->setDocument(enabled ? m_editor->document() : nullptr);
+}
+
+void EditorWidget::attachUndoHistory(bool isRichText)
+{
+  m_undo = UndoHistory::install(m_editor->document(), isRichText);
+  m_undo->setMemoryBudget(m_undoBudget);
+  m_undo->setSpillToDisk(m_undoSpillToDisk);
+}
+
+void EditorWidget::setUndoBudget(qint64 bytes)
+{
+  m_undoBudget = bytes;
+  if (m_undo)
+    m_undo->setMemoryBudget(bytes);
+}
+
+void EditorWidget::setUndoSpillToDisk(bool enabled)
+{
+  m_undoSpillToDisk = enabled;
+  if (m_undo)
+    m_undo->setSpillToDisk(enabled);
+}
+
+bool EditorWidget::canUndo() const
+{
+  return m_undo ? m_undo->canUndo() : m_editor->document()->isUndoAvailable();
+}
+
+bool EditorWidget::canRedo() const
+{
+  return m_undo ? m_undo->canRedo() : m_editor->document()->isRedoAvailable();
+}
+
+void EditorWidget::undo()
+{
+  if (isLargeFileMode())
+    m_largeView->undo();
+  else if (m_undo)
+    placeCursorAfterUndo(m_undo->undo());
+  else
+    m_editor->undo();
+}
+
+void EditorWidget::redo()
+{
+  if (isLargeFileMode())
+    m_largeView->redo();
+  else if (m_undo)
+    placeCursorAfterUndo(m_undo->redo());
+  else
+    m_editor->redo();
+}
+
+void EditorWidget::cut()
+{
+  if (isLargeFileMode())
+    m_largeView->cut();
+  else
+    m_editor->cut();
+}
+
+void EditorWidget::copy()
+{
+  if (isLargeFileMode())
+    m_largeView->copy();
+  else
+    m_editor->copy();
+}
+
+void EditorWidget::paste()
+{
+  if (isLargeFileMode())
+    m_largeView->paste();
+  else
+    m_editor->paste();
+}
+
+void EditorWidget::selectAll()
+{
+  if (isLargeFileMode())
+    m_largeView->selectAll();
+  else
+    m_editor->selectAll();
+}
+
+void EditorWidget::placeCursorAfterUndo(int position)
+{
+  if (position < 0)
+    return;
+  QTextCursor cursor = m_editor->textCursor();
+  cursor.setPosition(position);
+  m_editor->setTextCursor(cursor);
+  m_editor->ensureCursorVisible();
+}
+
+bool EditorWidget::wantsLargeFileMode(const QString &filePath)
+{
+  QFileInfo info(filePath);
+  return !filePath.endsWith(".rtf", Qt::CaseInsensitive) && info.size() >= LargeFileThreshold;
+}
+
+bool EditorWidget::openLargeFile(const QString &filePath, QString *error)
+{
+  hideFindReplace();
+  swapDocument(new QTextDocument(m_editor));
+  if (!m_largeView->open(filePath, error))
+  {
+    closeLargeFile();
+    return false;
+  }
+  m_editor->hide();
+  m_largeView->show();
+  m_largeView->setFocus();
+  return true;
+}
+
+void EditorWidget::closeLargeFile()
+{
+  if (m_largeView->isHidden())
+    return;
+  m_largeView->close();
+  m_largeView->hide();
+  m_editor->show();
+}
+
+void EditorWidget::beginLoading()
+{
+  closeLargeFile();
+  swapDocument(new QTextDocument(m_editor));
+  m_editor->setReadOnly(true);
+}
+
+void EditorWidget::showPreview(const QString &text)
+{
+  m_editor->setPlainText(text);
+}
+
+void EditorWidget::setDocument(QTextDocument *document, const QTextCursor &cursor, int scrollValue)
+{
+  // Without saved state, keep the reader where they were in the preview
+  if (scrollValue < 0)
+  {
+    scrollValue = m_editor->verticalScrollBar()->value();
+  }
+
+  closeLargeFile();
+  document->setParent(m_editor);
+  swapDocument(document);
+  m_editor->setReadOnly(false);
+
+  if (!cursor.isNull() && cursor.document() == document)
+  {
+    m_editor->setTextCursor(cursor);
+  }
+  m_editor->verticalScrollBar()->setValue(scrollValue);
+}
+
+QTextDocument *EditorWidget::document() const
+{
+  return m_editor->document();
+}
+
+void EditorWidget::swapDocument(QTextDocument *document)
+{
+  QTextDocument *previous = m_editor->document();
+  disconnect(previous->documentLayout(), nullptr, this, nullptr);
+  m_markdown->setDocument(nullptr);
+  m_undo = nullptr;
+
+  // QTextEdit deletes the document it created itself, and ones parented to
+  // the editor are ours to delete. Anything else, like a document handed to
+  // the cache, belongs to someone else and survives the swap.
+  bool ownsPrevious = previous->parent() == m_editor;
+  document->setDefaultFont(previous->defaultFont());
+  disconnect(previous, &QTextDocument::contentsChange, this, &EditorWidget::onContentsChange);
+  // Before anything listens to contentsChange, as installing resets the layout
+  LazyDocumentLayout::install(document);
+  m_editor->setDocument(document);
+  connect(document, &QTextDocument::contentsChange, this, &EditorWidget::onContentsChange);
+  if (auto *layout = qobject_cast<LazyDocumentLayout *>(document->documentLayout()))
+  {
+    connect(layout, &LazyDocumentLayout::scrollAdjustmentNeeded, this, &EditorWidget::adjustScroll);
+    layout->setViewportTop(m_editor->verticalScrollBar()->value());
+  }
+  if (ownsPrevious)
+  {
+    previous->deleteLater();
+  }
+
+  // A replace-all still matching against the old text no longer applies
+  m_replaceRevision = -1;
+  m_matchIndex.clear();
+  if (m_findReplaceWidget->isVisible())
+  {
+    updateSearch();
+  }
+}
+
 void EditorWidget::clear()
 {
-  m_editor->clear();
+  // A fresh document rather than QTextEdit::clear(), which would wipe a
+  // document that is still cached for another file
+  closeLargeFile();
+  swapDocument(new QTextDocument(m_editor));
+  m_editor->setReadOnly(false);
 }
 
 void EditorWidget::clearHighlights()
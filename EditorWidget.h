@@ -8,6 +8,17 @@
 #include <QtWidgets/QPushButton>
 #include <QtWidgets/QLabel>
 #include <QtWidgets/QFrame>
+#include <QtWidgets/QCheckBox>
+#include <QtCore/QFutureWatcher>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QPointer>
+#include <QtCore/QTimer>
+#include "MatchIndex.h"
+#include "SearchOverviewBar.h"
+#include "ReplaceEngine.h"
+#include "LargeFileView.h"
+#include "MarkdownHighlighter.h"
+#include "UndoHistory.h"
 
 class EditorWidget : public QWidget
 {
@@ -16,14 +27,48 @@ class EditorWidget : public QWidget
 public:
   EditorWidget(QWidget *parent = nullptr);
   void setContent(const QString &content, bool isRichText = false);
+  // Shows part of a file read-only until setDocument() delivers all of it
+  void beginLoading();
+  void showPreview(const QString &text);
+  // Takes ownership of document and makes the editor writable again,
+  // restoring cursor and scroll position when given
+  void setDocument(QTextDocument *document, const QTextCursor &cursor = QTextCursor(), int scrollValue = -1);
+  QTextDocument *document() const;
   QString content(bool asRichText = false) const;
   void clear();
   QTextEdit *editor() const { return m_editor; }
 
+  // Until the next document swap
+  void setMarkdownHighlighting(bool enabled);
+  // Undo for the current document goes through its UndoHistory from now on
+  void attachUndoHistory(bool isRichText);
+  void setUndoBudget(qint64 bytes);
+  qint64 undoBudget() const { return m_undoBudget; }
+  void setUndoSpillToDisk(bool enabled);
+  bool undoSpillsToDisk() const { return m_undoSpillToDisk; }
+  bool canUndo() const;
+  bool canRedo() const;
+
+  // Big plain-text files skip QTextDocument and open in a LargeFileView
+  static bool wantsLargeFileMode(const QString &filePath);
+  bool openLargeFile(const QString &filePath, QString *error);
+  bool isLargeFileMode() const { return m_largeView->isOpen(); }
+  LargeFileView *largeFileView() const { return m_largeView; }
+
 signals:
   void contentChanged();
 
+protected:
+  bool eventFilter(QObject *obj, QEvent *event) override;
+
 public slots:
+  // Edit actions go to whichever of the two views is showing
+  void undo();
+  void redo();
+  void cut();
+  void copy();
+  void paste();
+  void selectAll();
   void showFindReplace();
   void hideFindReplace();
   void findNext();
@@ -36,8 +81,27 @@ private:
   void setupFindReplaceWidget();
   bool findText(const QString &text, QTextDocument::FindFlags flags = {});
   void clearHighlights();
+  void swapDocument(QTextDocument *document);
+  void onContentsChange(int position, int charsRemoved, int charsAdded);
+  void selectMatch(int index);
+  void refreshHighlights();
+  void refreshOverview();
+  void onReplaceAllFinished();
+  void scrollToFraction(double fraction);
+  void closeLargeFile();
+  void syncLayoutViewport();
+  void adjustScroll(qreal delta);
+  void placeCursorAfterUndo(int position);
 
   QTextEdit *m_editor;
+  LargeFileView *m_largeView;
+  MarkdownHighlighter *m_markdown;
+  QPointer<UndoHistory> m_undo;
+  qint64 m_undoBudget;
+  bool m_undoSpillToDisk;
+  SearchOverviewBar *m_overviewBar;
+  // Batches overview redraws while typing
+  QTimer m_overviewTimer;
   QFrame *m_findReplaceWidget;
   QLineEdit *m_findLineEdit;
   QLineEdit *m_replaceLineEdit;
@@ -45,8 +109,13 @@ private:
   QPushButton *m_findNextButton;
   QPushButton *m_replaceButton;
   QPushButton *m_replaceAllButton;
+  QCheckBox *m_regexCheckBox;
   QPushButton *m_closeButton;
   QLabel *m_matchLabel;
   int m_currentMatch;
   int m_totalMatches;
+  MatchIndex m_matchIndex;
+  QFutureWatcher<ReplaceEngine::Result> m_replaceWatcher;
+  int m_replaceRevision;
+  QElapsedTimer m_replaceTimer;
 };
\ No newline at end of file
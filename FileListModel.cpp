@@ -0,0 +1,373 @@
+#include "FileListModel.h"
+#include <QtCore/QDateTime>
+#include <QtCore/QSet>
+#include <algorithm>
+
+namespace
+{
+  using FileKey = QPair<int, QString>;
+
+  // Past this many separate insertions one reset is cheaper than shifting
+  // the rows for each of them
+  const int MaxInsertRuns = 64;
+}
+
+FileListModel::FileListModel(QObject *parent)
+    : QAbstractListModel(parent)
+{
+}
+
+int FileListModel::rowCount(const QModelIndex &parent) const
+{
+  return parent.isValid() ? 0 : int(m_records.size());
+}
+
+QVariant FileListModel::data(const QModelIndex &index, int role) const
+{
+  if (!index.isValid() || index.row() >= m_records.size())
+    return QVariant();
+
+  const FileRecord &record = m_records.at(index.row());
+  switch (role)
+  {
+  case Qt::DisplayRole:
+  case Qt::EditRole:
+    return record.name;
+  case PathRole:
+    return filePath(index.row());
+  case TypeRole:
+    // Same type names the files pane used with QStandardItemModel
+    return record.type == File ? QStringLiteral("file") : record.type == Favorite ? QStringLiteral("favorite") : QStringLiteral("empty");
+  case ModifiedRole:
+    return QDateTime::fromMSecsSinceEpoch(record.modified);
+  case SizeRole:
+    return record.size;
+  default:
+    return QVariant();
+  }
+}
+
+bool FileListModel::setData(const QModelIndex &index, const QVariant &value, int role)
+{
+  if (role != Qt::EditRole || !index.isValid() || entryType(index.row()) != File)
+    return false;
+
+  QString newName = value.toString().trimmed();
+  if (!newName.isEmpty() && newName != m_records.at(index.row()).name)
+    emit renameRequested(filePath(index.row()), newName);
+
+  // The row changes once the renamed file is listed again
+  return false;
+}
+
+Qt::ItemFlags FileListModel::flags(const QModelIndex &index) const
+{
+  if (!index.isValid() || index.row() >= m_records.size())
+    return Qt::NoItemFlags;
+
+  switch (m_records.at(index.row()).type)
+  {
+  case File:
+    return Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsEditable | Qt::ItemIsDragEnabled;
+  case Favorite:
+    return Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsDragEnabled;
+  default:
+    return Qt::NoItemFlags;
+  }
+}
+
+void FileListModel::setFiles(const QVector<FileMetadata> &files, EntryType type)
+{
+  QVector<FileRecord> incoming;
+  incoming.reserve(files.size());
+  QSet<FileKey> incomingKeys;
+  incomingKeys.reserve(files.size());
+  for (const FileMetadata &file : files)
+  {
+    // Overlapping locations can list the same file twice
+    FileRecord record = makeRecord(file, type);
+    FileKey key(record.directory, record.name);
+    if (incomingKeys.contains(key))
+      continue;
+    incomingKeys.insert(key);
+    incoming.append(record);
+  }
+
+  // A different location shares nothing with the current rows, so there is
+  // nothing to diff against
+  bool overlaps = false;
+  for (const FileRecord &record : m_records)
+  {
+    if (record.type != Placeholder && incomingKeys.contains(FileKey(record.directory, record.name)))
+    {
+      overlaps = true;
+      break;
+    }
+  }
+  if (!overlaps)
+  {
+    beginResetModel();
+    m_records = incoming;
+    endResetModel();
+    return;
+  }
+
+  // Drop rows that are gone, one contiguous run at a time
+  for (int row = int(m_records.size()) - 1; row >= 0;)
+  {
+    const FileRecord &record = m_records.at(row);
+    if (incomingKeys.contains(FileKey(record.directory, record.name)))
+    {
+      --row;
+      continue;
+    }
+    int last = row;
+    while (row >= 0 && !incomingKeys.contains(FileKey(m_records.at(row).directory, m_records.at(row).name)))
+      --row;
+    beginRemoveRows(QModelIndex(), row + 1, last);
+    m_records.remove(row + 1, last - row);
+    endRemoveRows();
+  }
+
+  QSet<FileKey> currentKeys;
+  currentKeys.reserve(m_records.size());
+  for (const FileRecord &record : m_records)
+    currentKeys.insert(FileKey(record.directory, record.name));
+
+  // Every remaining row is also in the new list, so walk the new order and
+  // insert, move or refresh rows until the two agree
+  for (int i = 0; i < incoming.size(); ++i)
+  {
+    const FileRecord &wanted = incoming.at(i);
+    FileKey key(wanted.directory, wanted.name);
+
+    if (!currentKeys.contains(key))
+    {
+      int end = i + 1;
+      while (end < incoming.size() && !currentKeys.contains(FileKey(incoming.at(end).directory, incoming.at(end).name)))
+        ++end;
+      beginInsertRows(QModelIndex(), i, end - 1);
+      m_records.insert(i, end - i, FileRecord());
+      for (int j = i; j < end; ++j)
+        m_records[j] = incoming.at(j);
+      endInsertRows();
+      i = end - 1;
+      continue;
+    }
+
+    if (!sameFile(m_records.at(i), wanted))
+    {
+      // Usually a file that was just saved and now sorts first
+      int from = i + 1;
+      while (!sameFile(m_records.at(from), wanted))
+        ++from;
+      beginMoveRows(QModelIndex(), from, from, QModelIndex(), i);
+      m_records.move(from, i);
+      endMoveRows();
+    }
+
+    FileRecord &record = m_records[i];
+    if (record.modified != wanted.modified || record.size != wanted.size || record.type != wanted.type)
+    {
+      record = wanted;
+      emit dataChanged(index(i), index(i));
+    }
+  }
+}
+
+void FileListModel::addFiles(const QVector<FileMetadata> &files, EntryType type)
+{
+  QSet<FileKey> keys;
+  keys.reserve(m_records.size() + files.size());
+  for (const FileRecord &record : m_records)
+  {
+    if (record.type != Placeholder)
+      keys.insert(FileKey(record.directory, record.name));
+  }
+
+  QVector<FileRecord> incoming;
+  incoming.reserve(files.size());
+  for (const FileMetadata &file : files)
+  {
+    FileRecord record = makeRecord(file, type);
+    FileKey key(record.directory, record.name);
+    if (keys.contains(key))
+      continue;
+    keys.insert(key);
+    incoming.append(record);
+  }
+  if (incoming.isEmpty())
+    return;
+
+  if (m_records.size() == 1 && m_records.first().type == Placeholder)
+  {
+    beginRemoveRows(QModelIndex(), 0, 0);
+    m_records.clear();
+    endRemoveRows();
+  }
+
+  std::stable_sort(incoming.begin(), incoming.end(), [](const FileRecord &a, const FileRecord &b)
+                   { return a.modified > b.modified; });
+
+  // Where each new row goes; both lists are newest first, so this only
+  // ever moves forward
+  QVector<int> positions;
+  positions.reserve(incoming.size());
+  int runs = 0;
+  int position = 0;
+  for (const FileRecord &record : incoming)
+  {
+    while (position < m_records.size() && m_records.at(position).modified >= record.modified)
+      ++position;
+    if (positions.isEmpty() || positions.last() != position)
+      ++runs;
+    positions.append(position);
+  }
+
+  if (runs > MaxInsertRuns)
+  {
+    QVector<FileRecord> merged;
+    merged.reserve(m_records.size() + incoming.size());
+    std::merge(m_records.begin(), m_records.end(), incoming.begin(), incoming.end(), std::back_inserter(merged),
+               [](const FileRecord &a, const FileRecord &b)
+               { return a.modified > b.modified; });
+    beginResetModel();
+    m_records.swap(merged);
+    endResetModel();
+    return;
+  }
+
+  // Back to front, so the positions still ahead stay valid
+  for (int end = int(incoming.size()); end > 0;)
+  {
+    int start = end - 1;
+    while (start > 0 && positions.at(start - 1) == positions.at(end - 1))
+      --start;
+    int row = positions.at(start);
+    beginInsertRows(QModelIndex(), row, row + end - start - 1);
+    m_records.insert(row, end - start, FileRecord());
+    for (int i = start; i < end; ++i)
+      m_records[row + i - start] = incoming.at(i);
+    endInsertRows();
+    end = start;
+  }
+}
+
+void FileListModel::setPlaceholder(const QString &message)
+{
+  FileRecord record;
+  record.name = message;
+  record.type = Placeholder;
+
+  beginResetModel();
+  m_records.clear();
+  m_records.append(record);
+  endResetModel();
+}
+
+void FileListModel::upsertFile(const FileMetadata &file, EntryType type)
+{
+  FileRecord record = makeRecord(file, type);
+
+  // A real file replaces the empty-state line
+  if (m_records.size() == 1 && m_records.first().type == Placeholder)
+  {
+    beginRemoveRows(QModelIndex(), 0, 0);
+    m_records.clear();
+    endRemoveRows();
+  }
+
+  int row = rowOf(file.path);
+  int target = 0;
+  while (target < m_records.size() && (target == row || m_records.at(target).modified >= record.modified))
+    ++target;
+
+  if (row < 0)
+  {
+    beginInsertRows(QModelIndex(), target, target);
+    m_records.insert(target, record);
+    endInsertRows();
+    return;
+  }
+
+  if (target != row && target != row + 1)
+  {
+    beginMoveRows(QModelIndex(), row, row, QModelIndex(), target);
+    m_records.move(row, target > row ? target - 1 : target);
+    endMoveRows();
+    row = target > row ? target - 1 : target;
+  }
+  m_records[row] = record;
+  emit dataChanged(index(row), index(row));
+}
+
+void FileListModel::removeFile(const QString &filePath)
+{
+  int row = rowOf(filePath);
+  if (row < 0)
+    return;
+
+  beginRemoveRows(QModelIndex(), row, row);
+  m_records.remove(row);
+  endRemoveRows();
+}
+
+QString FileListModel::filePath(int row) const
+{
+  if (row < 0 || row >= m_records.size() || m_records.at(row).type == Placeholder)
+    return QString();
+
+  const FileRecord &record = m_records.at(row);
+  return m_directories.at(record.directory) + QLatin1Char('/') + record.name;
+}
+
+FileListModel::EntryType FileListModel::entryType(int row) const
+{
+  return (row >= 0 && row < m_records.size()) ? m_records.at(row).type : Placeholder;
+}
+
+int FileListModel::rowOf(const QString &filePath) const
+{
+  QFileInfo info(filePath);
+  int directory = m_directoryIndex.value(info.path(), -1);
+  if (directory < 0)
+    return -1;
+
+  QString name = info.fileName();
+  for (int row = 0; row < m_records.size(); ++row)
+  {
+    const FileRecord &record = m_records.at(row);
+    if (record.directory == directory && record.name == name && record.type != Placeholder)
+      return row;
+  }
+  return -1;
+}
+
+int FileListModel::internDirectory(const QString &path)
+{
+  auto it = m_directoryIndex.constFind(path);
+  if (it != m_directoryIndex.constEnd())
+    return it.value();
+
+  int directory = int(m_directories.size());
+  m_directories.append(path);
+  m_directoryIndex.insert(path, directory);
+  return directory;
+}
+
+FileListModel::FileRecord FileListModel::makeRecord(const FileMetadata &file, EntryType type)
+{
+  int slash = file.path.lastIndexOf(QLatin1Char('/'));
+  FileRecord record;
+  record.directory = internDirectory(file.path.left(slash));
+  record.name = file.path.mid(slash + 1);
+  record.modified = file.modified;
+  record.size = file.size;
+  record.type = type;
+  return record;
+}
+
+bool FileListModel::sameFile(const FileRecord &a, const FileRecord &b) const
+{
+  return a.directory == b.directory && a.name == b.name;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <QtCore/QAbstractListModel>
+#include <QtCore/QHash>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+#include "MetadataIndex.h"
+
+// Flat model for the files pane. Rows are compact records in one vector,
+// with directory paths stored once and shared between them. Listing a new
+// set of files updates the rows in place, so the view keeps its model and
+// memory stays flat however often the location changes.
+class FileListModel : public QAbstractListModel
+{
+  Q_OBJECT
+
+public:
+  enum EntryType : quint8
+  {
+    File,
+    Favorite,
+    Placeholder
+  };
+
+  enum Roles
+  {
+    PathRole = Qt::UserRole,
+    TypeRole = Qt::UserRole + 1,
+    ModifiedRole,
+    SizeRole
+  };
+
+  explicit FileListModel(QObject *parent = nullptr);
+
+  int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+  QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+  bool setData(const QModelIndex &index, const QVariant &value, int role = Qt::EditRole) override;
+  Qt::ItemFlags flags(const QModelIndex &index) const override;
+
+  void setFiles(const QVector<FileMetadata> &files, EntryType type = File);
+  // Merges more files into the newest-first rows, skipping ones already
+  // listed; for results that stream in from a scan
+  void addFiles(const QVector<FileMetadata> &files, EntryType type = File);
+  // Replaces the rows with a single disabled line of text
+  void setPlaceholder(const QString &message);
+  // Single-file updates that keep the rows newest first
+  void upsertFile(const FileMetadata &file, EntryType type = File);
+  void removeFile(const QString &filePath);
+
+  QString filePath(int row) const;
+  EntryType entryType(int row) const;
+  // Row of the file at filePath, or -1
+  int rowOf(const QString &filePath) const;
+
+signals:
+  // Emitted when a file name is edited in the view; the file itself is
+  // left for the owner to rename
+  void renameRequested(const QString &filePath, const QString &newName);
+
+private:
+  struct FileRecord
+  {
+    int directory = -1;
+    QString name;
+    qint64 modified = 0;
+    qint64 size = 0;
+    EntryType type = File;
+  };
+
+  int internDirectory(const QString &path);
+  FileRecord makeRecord(const FileMetadata &file, EntryType type);
+  bool sameFile(const FileRecord &a, const FileRecord &b) const;
+
+  QVector<FileRecord> m_records;
+  QStringList m_directories;
+  QHash<QString, int> m_directoryIndex;
+};
@@ -10,15 +10,32 @@
 #include <QtCore/QUrl>
 #include <QtWidgets/QListView>
 #include <QtWidgets/QSplitter>
+#include <QtWidgets/QVBoxLayout>
 #include <QDebug>
 #include <QFile>
-#include <QTextStream>
+#include <algorithm>
+#include <utility>
+
+namespace
+{
+  const QStringList &documentFilters()
+  {
+    static const QStringList filters = {"*.txt", "*.md", "*.rtf", "*.html", "*.markdown", "*.text"};
+    return filters;
+  }
+}
 
 FileTreeWidget::FileTreeWidget(QWidget *parent)
     : QWidget(parent), m_model(new QStandardItemModel(this)),
+      m_filesModel(new FileListModel(this)),
+      m_watcher(new DirectoryWatcher(this)),
+      m_scanner(new DirectoryScanner(this)),
+      m_catalogScanner(new DirectoryScanner(this)),
+      m_tagIndex(new TagIndex(this)),
       m_layout(new QHBoxLayout(this)),
       m_locationsView(new QListView(this)),
       m_filesView(new QListView(this)),
+      m_scanStatus(new QLabel(this)),
       m_archiveSection(nullptr)
 {
   // Use direct home path to avoid sandbox
@@ -37,7 +54,17 @@ FileTreeWidget::FileTreeWidget(QWidget *parent)
   // Create a splitter for the views
   QSplitter *viewsSplitter = new QSplitter(Qt::Horizontal, this);
   viewsSplitter->addWidget(m_locationsView);
-  viewsSplitter->addWidget(m_filesView);
+
+  // Scan progress sits under the files it is still adding to
+  QWidget *filesPane = new QWidget(this);
+  QVBoxLayout *filesLayout = new QVBoxLayout(filesPane);
+  filesLayout->setContentsMargins(0, 0, 0, 0);
+  filesLayout->setSpacing(0);
+  filesLayout->addWidget(m_filesView);
+  filesLayout->addWidget(m_scanStatus);
+  m_scanStatus->setStyleSheet("QLabel { color: #888888; background-color: #171717; padding: 4px 8px; }");
+  m_scanStatus->hide();
+  viewsSplitter->addWidget(filesPane);
 
   // Set initial column widths
   QList<int> sizes;
@@ -105,7 +132,8 @@ void FileTreeWidget::setupViews()
   m_locationsView->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
   m_locationsView->setVerticalScrollBarPolicy(Qt::ScrollBarAsNeeded);
 
-  // Set up files view
+  // Set up files view; it keeps this one model and every listing updates it
+  m_filesView->setModel(m_filesModel);
   m_filesView->setEditTriggers(QAbstractItemView::EditKeyPressed | QAbstractItemView::SelectedClicked);
   m_filesView->setSelectionMode(QAbstractItemView::SingleSelection);
   m_filesView->setDragEnabled(true);
@@ -117,24 +145,15 @@ void FileTreeWidget::setupViews()
 
 void FileTreeWidget::setupConnections()
 {
-  QFile logFile(m_basePath + "/writehand.log");
-  logFile.open(QIODevice::WriteOnly | QIODevice::Append);
-  QTextStream log(&logFile);
-  log << "\n=== Setting up connections ===\n";
-  logFile.close();
+  qDebug() << "=== Setting up connections ===";
 
   connect(m_locationsView, &QListView::clicked, this, [this](const QModelIndex &index)
           {
-    QFile logFile(m_basePath + "/writehand.log");
-    logFile.open(QIODevice::WriteOnly | QIODevice::Append);
-    QTextStream log(&logFile);
-    
-    log << "\n=== Click event received ===\n";
-    
+    qDebug() << "=== Click event received ===";
+
     QStandardItem *item = m_model->itemFromIndex(index);
     if (!item) {
-        log << "ERROR: Clicked item is null\n";
-        logFile.close();
+        qWarning() << "Clicked item is null";
         return;
     }
 
@@ -143,57 +162,46 @@ void FileTreeWidget::setupConnections()
     QString text = item->text();
     QStandardItem *parentItem = item->parent();
     
-    log << "Clicked item details:\n";
-    log << "  - Text: " << text << "\n";
-    log << "  - Type: " << type << "\n";
-    log << "  - Parent: " << (parentItem ? parentItem->text() : "none") << "\n";
-    log << "  - Is Archive Section: " << (item == m_archiveSection) << "\n";
-    log << "  - Is Favorites Section: " << (item == m_favoritesSection) << "\n";
-    log << "  - Is Smart Folders Section: " << (item == m_smartFoldersSection) << "\n";
-    log << "  - Is Tags Section: " << (item == m_tagsSection) << "\n";
-    log << "  - Is Locations Section: " << (item == m_locationsSection) << "\n";
+    qDebug().noquote() << "Clicked item:" << text << "type:" << type
+                       << "parent:" << (parentItem ? parentItem->text() : "none");
 
     // Select the item
     m_locationsView->setCurrentIndex(index);
 
     // Handle sections by type
     QString sectionType = item->data(Qt::UserRole + 1).toString();
-    log << "Handling section type: " << sectionType << "\n";
+    qDebug().noquote() << "Handling section type:" << sectionType;
 
     if (sectionType == "archive") {
-        log << "Updating archive view...\n";
-        logFile.close();
+        qDebug() << "Updating archive view...";
         updateArchiveView();
         return;
     } else if (sectionType == "favorites") {
-        log << "Updating favorites view...\n";
-        logFile.close();
+        qDebug() << "Updating favorites view...";
         updateFavoritesView();
         return;
     } else if (sectionType == "smartfolders") {
         if (item == m_smartFoldersSection) {
-            log << "Showing smart folders empty state...\n";
-            logFile.close();
+            qDebug() << "Showing smart folders empty state...";
+            setView(QStringList(), QStringList(), QString());
             showEmptyState("Create a smart folder to filter files by type");
         } else {
-            log << "Updating smart folder view...\n";
-            logFile.close();
+            qDebug() << "Updating smart folder view...";
             updateSmartFolderView(item);
         }
         return;
     } else if (sectionType == "tags") {
-        log << "Showing tags empty state...\n";
-        logFile.close();
-        showEmptyState("Add #tags to your files to group them");
+        qDebug() << "Showing tags empty state...";
+        setView(QStringList(), QStringList(), QString());
+        showEmptyState(m_tagIndex->tags().isEmpty() ? "Add #tags to your files to group them" : "Select a tag to view its files");
         return;
     } else if (sectionType == "locations") {
         if (item == m_locationsSection) {
-            log << "Showing locations empty state...\n";
-            logFile.close();
+            qDebug() << "Showing locations empty state...";
+            setView(QStringList(), QStringList(), QString());
             showEmptyState("Select a location to view files");
         } else {
-            log << "Updating files view for location: " << item->text() << "\n";
-            logFile.close();
+            qDebug().noquote() << "Updating files view for location:" << item->text();
             updateFilesView(item);
         }
         return;
@@ -202,215 +210,228 @@ void FileTreeWidget::setupConnections()
     // Handle items under sections
     if (parentItem) {
         if (type == "location") {
-            log << "Updating files view for location: " << item->text() << "\n";
-            logFile.close();
+            qDebug().noquote() << "Updating files view for location:" << item->text();
             updateFilesView(item);
         } else if (type == "favorite") {
             QString path = item->data(Qt::UserRole).toString();
             QFileInfo fileInfo(path);
             if (fileInfo.isDir()) {
-                log << "Updating files view for favorite directory: " << item->text() << "\n";
-                logFile.close();
+                qDebug().noquote() << "Updating files view for favorite directory:" << item->text();
                 updateFilesView(item);
             } else {
-                log << "Selected favorite file: " << item->text() << "\n";
-                logFile.close();
+                qDebug().noquote() << "Selected favorite file:" << item->text();
                 emit fileSelected(path);
             }
         } else if (type == "smartfolder") {
-            log << "Updating smart folder view: " << item->text() << "\n";
-            logFile.close();
+            qDebug().noquote() << "Updating smart folder view:" << item->text();
             updateSmartFolderView(item);
+        } else if (type == "tag") {
+            qDebug().noquote() << "Updating tag view:" << item->text();
+            updateTagView(item);
         }
-    }
-
-    logFile.close(); });
+    } });
 
   connect(m_filesView, &QListView::clicked, this, [this](const QModelIndex &index)
           {
-    QFile logFile(m_basePath + "/writehand.log");
-    logFile.open(QIODevice::WriteOnly | QIODevice::Append);
-    QTextStream log(&logFile);
-    
-    log << "\n=== Files view click event received ===\n";
-    
-    QStandardItem *item = qobject_cast<QStandardItemModel*>(m_filesView->model())->itemFromIndex(index);
-    if (!item) {
-        log << "ERROR: Clicked item is null\n";
-        logFile.close();
+    qDebug() << "=== Files view click event received ===";
+
+    if (!index.isValid()) {
+        qWarning() << "Clicked index is invalid";
         return;
     }
 
-    QString type = item->data(Qt::UserRole + 1).toString();
-    QString path = item->data(Qt::UserRole).toString();
+    QString type = index.data(FileListModel::TypeRole).toString();
+    QString path = index.data(FileListModel::PathRole).toString();
     
-    log << "Clicked file details:\n";
-    log << "  - Text: " << item->text() << "\n";
-    log << "  - Type: " << type << "\n";
-    log << "  - Path: " << path << "\n";
+    qDebug().noquote() << "Clicked file:" << index.data().toString() << "type:" << type << "path:" << path;
     
     if (type == "file") {
-        log << "Emitting fileSelected signal\n";
+        qDebug() << "Emitting fileSelected signal";
+        m_selectedPath = path;
         emit fileSelected(path);
         m_filesView->setCurrentIndex(index);
-    }
-    
-    logFile.close(); });
+    } });
 
   connect(m_filesView, &QWidget::customContextMenuRequested, this, &FileTreeWidget::handleContextMenu);
+  connect(m_filesModel, &FileListModel::renameRequested, this, &FileTreeWidget::renameFile);
+  connect(m_watcher, &DirectoryWatcher::directoryChanged, this, &FileTreeWidget::applyDirectoryChanges);
+  // Coalesces bursts of index changes into one query run
+  m_viewRefresh.setSingleShot(true);
+  m_viewRefresh.setInterval(50);
+  connect(&m_viewRefresh, &QTimer::timeout, this, &FileTreeWidget::refreshActiveView);
+  m_tagsRefresh.setSingleShot(true);
+  m_tagsRefresh.setInterval(100);
+  connect(&m_tagsRefresh, &QTimer::timeout, this, &FileTreeWidget::syncTagItems);
+  connect(m_tagIndex, &TagIndex::tagsChanged, &m_tagsRefresh, qOverload<>(&QTimer::start));
+  connect(m_scanner, &DirectoryScanner::filesFound, this, &FileTreeWidget::onScanFilesFound);
+  connect(m_scanner, &DirectoryScanner::progress, this, &FileTreeWidget::onScanProgress);
+  connect(m_scanner, &DirectoryScanner::finished, this, &FileTreeWidget::onScanFinished);
+  connect(m_catalogScanner, &DirectoryScanner::filesFound, this, &FileTreeWidget::onCatalogFilesFound);
+  connect(m_catalogScanner, &DirectoryScanner::finished, this, &FileTreeWidget::onCatalogFinished);
+  connect(m_filesModel, &QAbstractItemModel::modelReset, this, [this]()
+          {
+    int row = m_filesModel->rowOf(m_selectedPath);
+    if (row >= 0)
+      m_filesView->setCurrentIndex(m_filesModel->index(row)); });
 }
 
 void FileTreeWidget::updateFilesView(QStandardItem *locationItem)
 {
-  QFile logFile(m_basePath + "/writehand.log");
-  logFile.open(QIODevice::WriteOnly | QIODevice::Append);
-  QTextStream log(&logFile);
-
-  log << "\n=== Updating Files View ===\n";
+  qDebug() << "=== Updating Files View ===";
   QString path = locationItem->data(Qt::UserRole).toString();
-  log << "Location path: " << path << "\n";
+  qDebug().noquote() << "Location path:" << path;
 
-  QStandardItemModel *filesModel = new QStandardItemModel(m_filesView);
+  // Served from the index; nothing in the directory is stat'ed here
+  QVector<FileMetadata> files = indexFor(path)->files();
 
-  QDir dir(path);
-  QStringList filters;
-  filters << "*.txt" << "*.md" << "*.rtf" << "*.html" << "*.markdown" << "*.text";
-  QFileInfoList files = dir.entryInfoList(filters, QDir::Files, QDir::Time);
+  qDebug().noquote() << "Found" << files.count() << "files in location";
+  setView(QStringList() << path, documentFilters(), QString());
+  m_filesModel->setFiles(files);
 
-  log << "Found " << files.count() << " files in location:\n";
-  for (const QFileInfo &fileInfo : files)
-  {
-    QStandardItem *fileItem = new QStandardItem(fileInfo.fileName());
-    fileItem->setData(fileInfo.filePath(), Qt::UserRole);
-    fileItem->setData("file", Qt::UserRole + 1);
-    fileItem->setFlags(fileItem->flags() | Qt::ItemIsEditable);
-    filesModel->appendRow(fileItem);
-    log << "  - Added file: " << fileInfo.fileName() << " (path: " << fileInfo.filePath() << ")\n";
-  }
-
-  log << "Setting new model for files view\n";
-  m_filesView->setModel(filesModel);
-  log << "Files view update complete\n";
-  logFile.close();
+  // Subfolders stream in behind the top level
+  m_scanFound.clear();
+  m_scanner->scan(path, documentFilters(), QStringList() << m_basePath + "/Archive", false);
+  qDebug() << "Files view update complete";
 }
 
 void FileTreeWidget::updateSmartFolderView(QStandardItem *smartFolderItem)
 {
-  QFile logFile(m_basePath + "/writehand.log");
-  logFile.open(QIODevice::WriteOnly | QIODevice::Append);
-  QTextStream log(&logFile);
-
-  log << "\n=== Updating Smart Folder View ===\n";
-  QString pattern = smartFolderItem->data(Qt::UserRole).toString();
-  log << "Smart folder pattern: " << pattern << "\n";
+  qDebug() << "=== Updating Smart Folder View ===";
+  QString name = smartFolderItem->text();
+  qDebug().noquote() << "Smart folder query:" << m_smartFolderQueries.value(name).text();
+
+  // Index changes, not watcher reports, keep this view current
+  setView(QStringList(), QStringList(), QString());
+  m_activeSmartFolder = name;
+  refreshSmartFolderView();
+}
 
-  QStandardItemModel *filesModel = new QStandardItemModel(m_filesView);
+void FileTreeWidget::updateTagView(QStandardItem *tagItem)
+{
+  setView(QStringList(), QStringList(), QString());
+  m_activeTag = tagItem->data(Qt::UserRole).toString();
+  refreshTagView();
+}
 
-  // Add files from all locations that match the pattern
-  int totalFiles = 0;
-  for (auto it = m_locationItems.begin(); it != m_locationItems.end(); ++it)
+void FileTreeWidget::refreshTagView()
+{
+  // Straight from the posting list; no document is read
+  QVector<FileMetadata> files = m_tagIndex->files(m_activeTag);
+  if (files.isEmpty())
   {
-    QString path = it.value()->data(Qt::UserRole).toString();
-    log << "Searching in location: " << path << "\n";
-
-    QDir dir(path);
-    QStringList filters = pattern.split(",");
-    QFileInfoList files = dir.entryInfoList(filters, QDir::Files, QDir::Time);
+    showEmptyState(QString("No files are tagged #%1").arg(m_activeTag));
+    return;
+  }
+  m_filesModel->setFiles(files);
+}
 
-    log << "Found " << files.count() << " matching files\n";
-    totalFiles += files.count();
+void FileTreeWidget::refreshActiveView()
+{
+  if (!m_activeSmartFolder.isEmpty())
+    refreshSmartFolderView();
+  else if (!m_activeTag.isEmpty())
+    refreshTagView();
+}
 
-    for (const QFileInfo &fileInfo : files)
+void FileTreeWidget::syncTagItems()
+{
+  const QStringList tags = m_tagIndex->tags();
+  auto label = [this](const QString &tag)
+  { return QString("#%1 (%2)").arg(tag).arg(m_tagIndex->fileCount(tag)); };
+
+  // Both lists are alphabetical, so one merge pass keeps the rows that
+  // stay, and with them the selection
+  int row = 0;
+  int next = 0;
+  while (row < m_tagsSection->rowCount() || next < tags.size())
+  {
+    QStandardItem *child = row < m_tagsSection->rowCount() ? m_tagsSection->child(row) : nullptr;
+    QString existing = child ? child->data(Qt::UserRole).toString() : QString();
+    if (child && (next >= tags.size() || existing < tags.at(next)))
+    {
+      m_tagsSection->removeRow(row);
+      continue;
+    }
+    if (!child || existing > tags.at(next))
+    {
+      QStandardItem *item = new QStandardItem(label(tags.at(next)));
+      item->setData(tags.at(next), Qt::UserRole);
+      item->setData("tag", Qt::UserRole + 1);
+      item->setFlags(item->flags() & ~Qt::ItemIsEditable);
+      m_tagsSection->insertRow(row, item);
+    }
+    else if (child->text() != label(existing))
     {
-      QStandardItem *fileItem = new QStandardItem(fileInfo.fileName());
-      fileItem->setData(fileInfo.filePath(), Qt::UserRole);
-      fileItem->setData("file", Qt::UserRole + 1);
-      fileItem->setFlags(fileItem->flags() | Qt::ItemIsEditable);
-      filesModel->appendRow(fileItem);
-      log << "  - Added file: " << fileInfo.fileName() << " (path: " << fileInfo.filePath() << ")\n";
+      child->setText(label(existing));
     }
+    ++row;
+    ++next;
   }
 
-  if (totalFiles == 0)
+  if (!m_activeTag.isEmpty())
+    m_viewRefresh.start();
+}
+
+void FileTreeWidget::refreshSmartFolderView()
+{
+  auto query = m_smartFolderQueries.constFind(m_activeSmartFolder);
+  if (query == m_smartFolderQueries.constEnd())
+    return;
+  if (!query->isValid())
   {
-    log << "No matching files found, showing empty state\n";
-    logFile.close();
-    showEmptyState("No files match this smart folder");
+    showEmptyState(query->errorString());
     return;
   }
 
-  log << "Setting new model for files view\n";
-  m_filesView->setModel(filesModel);
-  log << "Smart folder view update complete\n";
-  logFile.close();
+  QVector<FileMetadata> files = query->evaluate(locationIndexes(), m_subfolderFiles);
+  if (files.isEmpty())
+  {
+    showEmptyState("No files match this smart folder");
+    return;
+  }
+  m_filesModel->setFiles(files);
 }
 
 void FileTreeWidget::updateArchiveView()
 {
-  QFile logFile(m_basePath + "/writehand.log");
-  logFile.open(QIODevice::WriteOnly | QIODevice::Append);
-  QTextStream log(&logFile);
-
-  log << "\n=== Updating Archive View ===\n";
+  qDebug() << "=== Updating Archive View ===";
   QString archivePath = m_basePath + "/Archive";
-  log << "Archive path: " << archivePath << "\n";
-
-  QStandardItemModel *filesModel = new QStandardItemModel(m_filesView);
+  qDebug().noquote() << "Archive path:" << archivePath;
 
   QDir dir(archivePath);
-  log << "Archive directory exists: " << dir.exists() << "\n";
+  qDebug().noquote() << "Archive directory exists:" << dir.exists();
+
+  setView(QStringList() << archivePath, documentFilters(), "No archived files");
 
   if (dir.exists())
   {
-    QStringList filters;
-    filters << "*.txt" << "*.md" << "*.rtf" << "*.html" << "*.markdown" << "*.text";
-    QFileInfoList files = dir.entryInfoList(filters, QDir::Files, QDir::Time);
+    QVector<FileMetadata> files = indexFor(archivePath)->files();
 
-    log << "Found " << files.count() << " files in archive:\n";
-    for (const QFileInfo &file : files)
-    {
-      log << "  - " << file.fileName() << "\n";
-    }
+    qDebug().noquote() << "Found" << files.count() << "files in archive";
 
     if (files.isEmpty())
     {
-      log << "No archived files found, showing empty state\n";
-      logFile.close();
+      qDebug() << "No archived files found, showing empty state";
       showEmptyState("No archived files");
       return;
     }
 
-    for (const QFileInfo &fileInfo : files)
-    {
-      QStandardItem *fileItem = new QStandardItem(fileInfo.fileName());
-      fileItem->setData(fileInfo.filePath(), Qt::UserRole);
-      fileItem->setData("file", Qt::UserRole + 1);
-      fileItem->setFlags(fileItem->flags() | Qt::ItemIsEditable);
-      filesModel->appendRow(fileItem);
-      log << "Added archived file to model: " << fileInfo.fileName() << "\n";
-    }
+    m_filesModel->setFiles(files);
   }
   else
   {
-    log << "Archive directory does not exist, showing empty state\n";
-    logFile.close();
+    qDebug() << "Archive directory does not exist, showing empty state";
     showEmptyState("No archived files");
     return;
   }
 
-  log << "Setting new model for files view\n";
-  m_filesView->setModel(filesModel);
-  log << "Archive view update complete\n";
-  logFile.close();
+  qDebug() << "Archive view update complete";
 }
 
 void FileTreeWidget::createSections()
 {
-  QFile logFile(m_basePath + "/writehand.log");
-  logFile.open(QIODevice::WriteOnly | QIODevice::Append);
-  QTextStream log(&logFile);
 
-  log << "\n=== Creating sections ===\n";
+  qDebug() << "=== Creating sections ===";
 
   // Clear any existing items
   m_model->clear();
@@ -423,7 +444,7 @@ void FileTreeWidget::createSections()
   m_tagsSection = new QStandardItem("Tags");
   m_archiveSection = nullptr; // Explicitly set to nullptr
 
-  log << "Created base sections\n";
+  qDebug() << "Created base sections";
 
   // Set sections non-editable
   QList<QStandardItem *> sections = {m_locationsSection, m_favoritesSection, m_smartFoldersSection, m_tagsSection};
@@ -433,57 +454,48 @@ void FileTreeWidget::createSections()
     section->setData("section", Qt::UserRole);
     section->setData(section->text().toLower().replace(" ", ""), Qt::UserRole + 1); // e.g. "locations", "favorites", etc.
     m_model->appendRow(section);
-    log << "Added section: " << section->text() << " with type: " << section->data(Qt::UserRole + 1).toString() << "\n";
+    qDebug().noquote() << "Added section:" << section->text() << "with type:" << section->data(Qt::UserRole + 1).toString();
   }
 
   // Add default locations with the correct path
   addLocation("Documents", m_basePath);
 
   // Add default smart folders
-  addSmartFolder("Recents", "*.{txt,md,rtf,html,markdown,text}");
+  addSmartFolder("Recents", "ext:txt,md,rtf,html,markdown,text modified:<30d");
 
   // Check for archived files and create archive section if needed
   QString archivePath = m_basePath + "/Archive";
   QDir archiveDir(archivePath);
-  log << "\n=== Archive Setup ===\n";
-  log << "Archive path: " << archivePath << "\n";
-  log << "Archive dir exists: " << archiveDir.exists() << "\n";
+  qDebug() << "=== Archive Setup ===";
+  qDebug().noquote() << "Archive path:" << archivePath;
+  qDebug().noquote() << "Archive dir exists:" << archiveDir.exists();
 
   if (archiveDir.exists())
   {
-    QStringList filters;
-    filters << "*.txt" << "*.md" << "*.rtf" << "*.html" << "*.markdown" << "*.text";
-    QFileInfoList files = archiveDir.entryInfoList(filters, QDir::Files, QDir::Time);
-    log << "Found " << files.count() << " archived files:\n";
-    for (const QFileInfo &file : files)
-    {
-      log << "  - " << file.fileName() << "\n";
-    }
+    int archived = indexFor(archivePath)->count();
+    qDebug().noquote() << "Found" << archived << "archived files";
 
-    if (!files.isEmpty())
+    if (archived > 0)
     {
       m_archiveSection = new QStandardItem("Archive");
       m_archiveSection->setFlags(m_archiveSection->flags() & ~Qt::ItemIsEditable);
       m_archiveSection->setData("section", Qt::UserRole);
       m_archiveSection->setData("archive", Qt::UserRole + 1);
       m_model->appendRow(m_archiveSection);
-      log << "Created and added Archive section to model\n";
-      log << "Archive section types - UserRole: " << m_archiveSection->data(Qt::UserRole).toString()
-          << ", UserRole+1: " << m_archiveSection->data(Qt::UserRole + 1).toString() << "\n";
+      qDebug() << "Created and added Archive section to model";
     }
     else
     {
-      log << "No archived files found, skipping Archive section\n";
+      qDebug() << "No archived files found, skipping Archive section";
     }
   }
   else
   {
-    log << "Archive directory does not exist\n";
+    qDebug() << "Archive directory does not exist";
   }
 
-  log << "Archive section pointer: " << m_archiveSection << "\n";
-  log << "=== Section creation complete ===\n";
-  logFile.close();
+  qDebug().noquote() << "Archive section pointer:" << m_archiveSection;
+  qDebug() << "=== Section creation complete ===";
 
   // Select Documents by default and show its files
   if (m_locationItems.contains("Documents"))
@@ -501,20 +513,11 @@ void FileTreeWidget::selectFile(const QString &filePath)
   if (!documentsItem)
     return;
 
-  QString fileName = QFileInfo(filePath).fileName();
-  QStandardItemModel *filesModel = qobject_cast<QStandardItemModel *>(m_filesView->model());
-  if (!filesModel)
-    return;
-
-  // Find and select the file in the files view
-  for (int i = 0; i < filesModel->rowCount(); ++i)
+  m_selectedPath = filePath;
+  int row = m_filesModel->rowOf(filePath);
+  if (row >= 0)
   {
-    QStandardItem *item = filesModel->item(i);
-    if (item && item->data(Qt::UserRole).toString() == filePath)
-    {
-      m_filesView->setCurrentIndex(filesModel->indexFromItem(item));
-      break;
-    }
+    m_filesView->setCurrentIndex(m_filesModel->index(row));
   }
 }
 
@@ -525,18 +528,10 @@ void FileTreeWidget::createNewFile()
   if (file.open(QIODevice::WriteOnly))
   {
     file.close();
-    emit fileCreated(filePath);
 
-    // Update the files view if Documents is selected
-    QModelIndex currentIndex = m_locationsView->currentIndex();
-    if (currentIndex.isValid())
-    {
-      QStandardItem *item = m_model->itemFromIndex(currentIndex);
-      if (item && item->data(Qt::UserRole + 1).toString() == "location")
-      {
-        updateFilesView(item);
-      }
-    }
+    // List it right away so the new file can be selected
+    applyDirectoryChanges(m_basePath, QFileInfoList() << QFileInfo(filePath), QFileInfoList(), QStringList());
+    emit fileCreated(filePath);
   }
 }
 
@@ -559,19 +554,18 @@ QString FileTreeWidget::getNextFileName()
 void FileTreeWidget::handleContextMenu(const QPoint &pos)
 {
   QModelIndex index = m_filesView->indexAt(pos);
-  QStandardItemModel *filesModel = qobject_cast<QStandardItemModel *>(m_filesView->model());
-  QStandardItem *item = filesModel ? filesModel->itemFromIndex(index) : nullptr;
 
   QMenu menu(this);
 
-  if (!item)
+  if (!index.isValid())
   {
     QAction *newFileAction = menu.addAction("New File");
     connect(newFileAction, &QAction::triggered, this, &FileTreeWidget::createNewFile);
   }
   else
   {
-    QString type = item->data(Qt::UserRole + 1).toString();
+    QString type = index.data(FileListModel::TypeRole).toString();
+    QString filePath = index.data(FileListModel::PathRole).toString();
     if (type == "file")
     {
       QAction *renameAction = menu.addAction("Rename");
@@ -581,19 +575,19 @@ void FileTreeWidget::handleContextMenu(const QPoint &pos)
       connect(renameAction, &QAction::triggered, [this, index]()
               { m_filesView->edit(index); });
 
-      connect(deleteAction, &QAction::triggered, [this, item]()
+      connect(deleteAction, &QAction::triggered, [this, filePath]()
               {
-                       QString filePath = item->data(Qt::UserRole).toString();
                        QFile file(filePath);
                        if (file.remove())
                        {
+                           // Drop it from the index before anyone asks for the most recent file
+                           applyDirectoryChanges(QFileInfo(filePath).path(), QFileInfoList(), QFileInfoList(), QStringList() << filePath);
                            emit fileDeleted(filePath);
-                           updateFilesView(m_locationItems["Documents"]);
                        } });
 
-      connect(archiveAction, &QAction::triggered, [this, item]()
+      connect(archiveAction, &QAction::triggered, [this, filePath]()
               {
-                       QString oldPath = item->data(Qt::UserRole).toString();
+                       QString oldPath = filePath;
                        QString fileName = QFileInfo(oldPath).fileName();
                        QString archivePath = m_basePath + "/Archive";
                        
@@ -605,7 +599,9 @@ void FileTreeWidget::handleContextMenu(const QPoint &pos)
                        
                        if (file.rename(newPath))
                        {
-                           updateFilesView(m_locationItems["Documents"]);
+                           indexFor(archivePath);
+                           applyDirectoryChanges(QFileInfo(oldPath).path(), QFileInfoList(), QFileInfoList(), QStringList() << oldPath);
+                           applyDirectoryChanges(archivePath, QFileInfoList() << QFileInfo(newPath), QFileInfoList(), QStringList());
                        } });
     }
   }
@@ -613,6 +609,22 @@ void FileTreeWidget::handleContextMenu(const QPoint &pos)
   menu.exec(m_filesView->viewport()->mapToGlobal(pos));
 }
 
+void FileTreeWidget::renameFile(const QString &filePath, const QString &newName)
+{
+  QFileInfo fileInfo(filePath);
+  QString newPath = fileInfo.path() + "/" + newName;
+
+  if (QFile::exists(newPath) || !QFile::rename(filePath, newPath))
+  {
+    QMessageBox::warning(this, "Rename", QString("Could not rename \"%1\" to \"%2\".").arg(fileInfo.fileName(), newName));
+    return;
+  }
+
+  emit fileRenamed(filePath, newPath);
+  applyDirectoryChanges(fileInfo.path(), QFileInfoList() << QFileInfo(newPath), QFileInfoList(), QStringList() << filePath);
+  selectFile(newPath);
+}
+
 void FileTreeWidget::addLocation(const QString &name, const QString &path)
 {
   QStandardItem *item = new QStandardItem(name);
@@ -621,12 +633,22 @@ void FileTreeWidget::addLocation(const QString &name, const QString &path)
   item->setFlags(item->flags() & ~Qt::ItemIsEditable);
   m_locationItems[name] = item;
   m_locationsSection->appendRow(item);
+  m_tagIndex->addSource(indexFor(path));
+  queueSubfolderScan(path);
 }
 
-void FileTreeWidget::addSmartFolder(const QString &name, const QString &filterPattern)
+void FileTreeWidget::addSmartFolder(const QString &name, const QString &query)
 {
+  // Compiled once; every refresh reuses it
+  SmartFolderQuery compiled(query);
+  if (!compiled.isValid())
+  {
+    qWarning().noquote() << "Smart folder" << name << ":" << compiled.errorString();
+  }
+  m_smartFolderQueries.insert(name, compiled);
+
   QStandardItem *item = new QStandardItem(name);
-  item->setData(filterPattern, Qt::UserRole);
+  item->setData(query, Qt::UserRole);
   item->setData("smartfolder", Qt::UserRole + 1);
   item->setFlags(item->flags() & ~Qt::ItemIsEditable);
   m_smartFolderItems[name] = item;
@@ -645,34 +667,220 @@ void FileTreeWidget::addFavorite(const QString &name, const QString &path)
   m_favoritesSection->appendRow(item);
 }
 
+MetadataIndex *FileTreeWidget::indexFor(const QString &directory)
+{
+  MetadataIndex *index = m_indexes.value(directory);
+  if (!index)
+  {
+    m_watcher->watch(directory);
+    index = new MetadataIndex(directory, documentFilters(), this);
+    connect(index, &MetadataIndex::changed, this, [this]()
+            {
+      if (!m_activeSmartFolder.isEmpty() || !m_activeTag.isEmpty())
+        m_viewRefresh.start(); });
+    index->load();
+    m_indexes.insert(directory, index);
+  }
+  return index;
+}
+
+QString FileTreeWidget::mostRecentFile() const
+{
+  MetadataIndex *index = m_indexes.value(m_basePath);
+  return index ? index->mostRecentFile() : QString();
+}
+
+QVector<const MetadataIndex *> FileTreeWidget::locationIndexes() const
+{
+  // Every location's index is created when the location is added
+  QVector<const MetadataIndex *> indexes;
+  for (auto it = m_locationItems.constBegin(); it != m_locationItems.constEnd(); ++it)
+  {
+    indexes.append(m_indexes.value(it.value()->data(Qt::UserRole).toString()));
+  }
+  return indexes;
+}
+
+QStringList FileTreeWidget::searchScopes() const
+{
+  return m_locationItems.keys() + m_smartFolderItems.keys();
+}
+
+QStringList FileTreeWidget::filesInScope(const QString &scope) const
+{
+  QVector<FileMetadata> files;
+  if (m_locationItems.contains(scope))
+  {
+    QString directory = m_locationItems.value(scope)->data(Qt::UserRole).toString();
+    const MetadataIndex *index = m_indexes.value(directory);
+    if (index)
+      files = index->files();
+    files += m_subfolderFiles.value(directory);
+  }
+  else if (m_smartFolderQueries.contains(scope))
+  {
+    files = m_smartFolderQueries.value(scope).evaluate(locationIndexes(), m_subfolderFiles);
+  }
+
+  QStringList paths;
+  paths.reserve(files.size());
+  for (const FileMetadata &file : files)
+    paths.append(file.path);
+  return paths;
+}
+
+void FileTreeWidget::noteFileSaved(const QString &filePath)
+{
+  QFileInfo fileInfo(filePath);
+  applyDirectoryChanges(fileInfo.path(), QFileInfoList(), QFileInfoList() << fileInfo, QStringList());
+}
+
 void FileTreeWidget::showEmptyState(const QString &message)
 {
-  QStandardItemModel *model = new QStandardItemModel(m_filesView);
-  QStandardItem *emptyItem = new QStandardItem(message);
-  emptyItem->setFlags(emptyItem->flags() & ~Qt::ItemIsEnabled);
-  emptyItem->setData("empty", Qt::UserRole + 1);
-  model->appendRow(emptyItem);
-  m_filesView->setModel(model);
+  m_filesModel->setPlaceholder(message);
 }
 
-void FileTreeWidget::updateFavoritesView()
+void FileTreeWidget::setView(const QStringList &directories, const QStringList &filters, const QString &emptyMessage)
+{
+  // Whatever was still being scanned belongs to the previous view
+  m_scanner->cancel();
+  m_scanStatus->hide();
+
+  m_activeSmartFolder.clear();
+  m_activeTag.clear();
+  m_viewDirectories = QSet<QString>(directories.begin(), directories.end());
+  m_viewFilters = filters;
+  m_viewEmptyMessage = emptyMessage;
+}
+
+void FileTreeWidget::applyDirectoryChanges(const QString &directory, const QFileInfoList &added,
+                                           const QFileInfoList &modified, const QStringList &removedPaths)
 {
-  QStandardItemModel *filesModel = new QStandardItemModel(m_filesView);
+  // Indexes follow every watched directory, listed or not
+  MetadataIndex *index = m_indexes.value(directory);
+  if (index)
+  {
+    for (const QString &path : removedPaths)
+      index->remove(path);
+    for (const QFileInfoList *files : {&added, &modified})
+    {
+      for (const QFileInfo &fileInfo : *files)
+        index->update(fileInfo.filePath());
+    }
+  }
+
+  if (!m_viewDirectories.contains(directory))
+    return;
 
+  qDebug().noquote() << "Directory changed:" << directory << "added" << added.size() << "modified" << modified.size()
+                     << "removed" << removedPaths.size();
+
+  for (const QString &path : removedPaths)
+  {
+    m_filesModel->removeFile(path);
+  }
+  for (const QFileInfoList *files : {&added, &modified})
+  {
+    for (const QFileInfo &fileInfo : *files)
+    {
+      // The index has no entry for files that vanished again
+      FileMetadata file = index ? index->file(fileInfo.filePath()) : FileMetadata::fromFileInfo(fileInfo);
+      if (!file.path.isEmpty() && QDir::match(m_viewFilters, fileInfo.fileName()))
+      {
+        m_filesModel->upsertFile(file);
+      }
+    }
+  }
+
+  if (m_filesModel->rowCount() == 0 && !m_viewEmptyMessage.isEmpty())
+  {
+    showEmptyState(m_viewEmptyMessage);
+  }
+}
+
+void FileTreeWidget::onScanFilesFound(const QString &root, const QVector<FileMetadata> &files)
+{
+  Q_UNUSED(root);
+  m_scanFound += files;
+
+  // Own operations on these files are applied like those in the top level
+  for (const FileMetadata &file : files)
+  {
+    m_viewDirectories.insert(file.path.left(file.path.lastIndexOf('/')));
+  }
+  m_filesModel->addFiles(files);
+}
+
+void FileTreeWidget::onScanProgress(const QString &root, int directories, int files)
+{
+  Q_UNUSED(root);
+  m_scanStatus->setText(QString("Scanning... %1 files in %2 folders").arg(files).arg(directories));
+  m_scanStatus->show();
+}
+
+void FileTreeWidget::onScanFinished(const QString &root, int directories, int files, qint64 elapsedMs)
+{
+  qDebug().noquote() << "Scanned" << root << ":" << files << "files in" << directories << "folders in" << elapsedMs << "ms";
+  m_scanStatus->hide();
+
+  // A complete listing, as good as the background one
+  m_subfolderFiles.insert(root, std::exchange(m_scanFound, QVector<FileMetadata>()));
+  emit subfolderFilesChanged();
+  if (!m_activeSmartFolder.isEmpty())
+    m_viewRefresh.start();
+}
+
+void FileTreeWidget::queueSubfolderScan(const QString &directory)
+{
+  if (!m_catalogQueue.contains(directory))
+    m_catalogQueue.append(directory);
+  if (m_catalogScanner->isScanning())
+    return;
+
+  m_catalogFound.clear();
+  m_catalogScanner->scan(m_catalogQueue.first(), documentFilters(), QStringList() << m_basePath + "/Archive", false);
+}
+
+void FileTreeWidget::onCatalogFilesFound(const QString &root, const QVector<FileMetadata> &files)
+{
+  Q_UNUSED(root);
+  m_catalogFound += files;
+}
+
+void FileTreeWidget::onCatalogFinished(const QString &root, int directories, int files, qint64 elapsedMs)
+{
+  qDebug().noquote() << "Catalogued" << files << "files in" << directories << "subfolders of" << root << "in"
+                     << elapsedMs << "ms";
+  m_subfolderFiles.insert(root, std::exchange(m_catalogFound, QVector<FileMetadata>()));
+  emit subfolderFilesChanged();
+  if (!m_activeSmartFolder.isEmpty())
+    m_viewRefresh.start();
+
+  m_catalogQueue.removeAll(root);
+  if (!m_catalogQueue.isEmpty())
+  {
+    m_catalogScanner->scan(m_catalogQueue.first(), documentFilters(), QStringList() << m_basePath + "/Archive", false);
+  }
+}
+
+void FileTreeWidget::updateFavoritesView()
+{
+  setView(QStringList(), QStringList(), QString());
   if (m_favoriteItems.isEmpty())
   {
     showEmptyState("Drag folders and files here for quick access");
     return;
   }
 
+  QVector<FileMetadata> favorites;
   for (auto it = m_favoriteItems.begin(); it != m_favoriteItems.end(); ++it)
   {
     QStandardItem *item = it.value();
     if (item->data(Qt::UserRole + 1).toString() != "placeholder")
     {
-      filesModel->appendRow(item->clone());
+      favorites.append(FileMetadata::fromFileInfo(QFileInfo(item->data(Qt::UserRole).toString())));
     }
   }
 
-  m_filesView->setModel(filesModel);
+  m_filesModel->setFiles(favorites, FileListModel::Favorite);
 }
\ No newline at end of file
@@ -3,8 +3,16 @@
 #include <QtWidgets/QWidget>
 #include <QtWidgets/QHBoxLayout>
 #include <QtWidgets/QListView>
+#include <QtWidgets/QLabel>
 #include <QtGui/QStandardItemModel>
 #include <QtCore/QMap>
+#include <QtCore/QTimer>
+#include "FileListModel.h"
+#include "DirectoryWatcher.h"
+#include "MetadataIndex.h"
+#include "DirectoryScanner.h"
+#include "SmartFolderQuery.h"
+#include "TagIndex.h"
 
 class FileTreeWidget : public QWidget
 {
@@ -14,18 +22,44 @@ public:
   explicit FileTreeWidget(QWidget *parent = nullptr);
   void selectFile(const QString &filePath);
   void refreshModel();
+  // Newest document in the default location, from its metadata index
+  QString mostRecentFile() const;
+  QVector<const MetadataIndex *> locationIndexes() const;
+  // Names of the locations, then the smart folders
+  QStringList searchScopes() const;
+  QStringList filesInScope(const QString &scope) const;
+  // Documents in the locations' subfolders, which their indexes leave out,
+  // keyed by location and as of the last complete scan of each
+  const QHash<QString, QVector<FileMetadata>> &subfolderFiles() const { return m_subfolderFiles; }
 
 signals:
   void fileSelected(const QString &filePath);
   void fileCreated(const QString &filePath);
   void fileRenamed(const QString &oldPath, const QString &newPath);
   void fileDeleted(const QString &filePath);
+  void subfolderFilesChanged();
 
 private slots:
   void handleContextMenu(const QPoint &pos);
+  void renameFile(const QString &filePath, const QString &newName);
+  void applyDirectoryChanges(const QString &directory, const QFileInfoList &added, const QFileInfoList &modified,
+                             const QStringList &removedPaths);
+  void onScanFilesFound(const QString &root, const QVector<FileMetadata> &files);
+  void onScanProgress(const QString &root, int directories, int files);
+  void onScanFinished(const QString &root, int directories, int files, qint64 elapsedMs);
+  void onCatalogFilesFound(const QString &root, const QVector<FileMetadata> &files);
+  void onCatalogFinished(const QString &root, int directories, int files, qint64 elapsedMs);
+  // Re-runs the open smart folder's query against the indexes
+  void refreshSmartFolderView();
+  void refreshTagView();
+  void refreshActiveView();
+  // Brings the Tags section's children in line with the tag index
+  void syncTagItems();
 
 public slots:
   void createNewFile();
+  // Keeps the index and the files pane current after the app wrote a file
+  void noteFileSaved(const QString &filePath);
 
 private:
   void setupModel();
@@ -34,19 +68,41 @@ private:
   void createSections();
   void addLocation(const QString &name, const QString &path);
   void addFavorite(const QString &name, const QString &path);
-  void addSmartFolder(const QString &name, const QString &filterPattern);
+  void addSmartFolder(const QString &name, const QString &query);
+  // Loads and watches the directory's index on first use
+  MetadataIndex *indexFor(const QString &directory);
+  // Lists a location's subfolders in the background, one location at a time
+  void queueSubfolderScan(const QString &directory);
   QString getNextFileName();
   void updateFilesView(QStandardItem *locationItem);
   void updateSmartFolderView(QStandardItem *smartFolderItem);
   void updateArchiveView();
   void updateFavoritesView();
+  void updateTagView(QStandardItem *tagItem);
   void showEmptyState(const QString &message);
+  // What the files pane is listing, so watcher reports can be applied to it
+  void setView(const QStringList &directories, const QStringList &filters, const QString &emptyMessage);
 
   QListView *m_locationsView;
   QListView *m_filesView;
   QStandardItemModel *m_model;
+  FileListModel *m_filesModel;
+  DirectoryWatcher *m_watcher;
+  QHash<QString, MetadataIndex *> m_indexes;
+  DirectoryScanner *m_scanner;
+  QVector<FileMetadata> m_scanFound;
+  DirectoryScanner *m_catalogScanner;
+  QStringList m_catalogQueue;
+  QVector<FileMetadata> m_catalogFound;
+  QHash<QString, QVector<FileMetadata>> m_subfolderFiles;
+  QLabel *m_scanStatus;
+  QSet<QString> m_viewDirectories;
+  QStringList m_viewFilters;
+  QString m_viewEmptyMessage;
   QHBoxLayout *m_layout;
   QString m_basePath;
+  // Reselected when the files model is reset
+  QString m_selectedPath;
 
   QStandardItem *m_locationsSection;
   QStandardItem *m_favoritesSection;
@@ -57,4 +113,11 @@ private:
   QMap<QString, QStandardItem *> m_locationItems;
   QMap<QString, QStandardItem *> m_favoriteItems;
   QMap<QString, QStandardItem *> m_smartFolderItems;
+  QHash<QString, SmartFolderQuery> m_smartFolderQueries;
+  // Name of the smart folder or the tag being shown, if any
+  QString m_activeSmartFolder;
+  QString m_activeTag;
+  QTimer m_viewRefresh;
+  TagIndex *m_tagIndex;
+  QTimer m_tagsRefresh;
 };
\ No newline at end of file
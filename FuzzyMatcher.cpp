@@ -0,0 +1,227 @@
+#include "FuzzyMatcher.h"
+#include <QtCore/QDateTime>
+#include <QtCore/QtAlgorithms>
+#include <algorithm>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+  const int NoMatch = std::numeric_limits<int>::min();
+
+  const int MatchPoints = 16;
+  const int ConsecutivePoints = 6;
+  const int GapStartPenalty = 3;
+  const int GapExtensionPenalty = 1;
+  const int MaxGapPenalty = 12;
+  const int NameMatchPoints = 24;
+
+  inline char16_t fold(QChar c)
+  {
+    return char16_t(c.toLower().unicode());
+  }
+
+  // Letters and digits get a bit each; everything else shares the rest
+  inline quint64 characterBit(char16_t c)
+  {
+    if (c >= u'a' && c <= u'z')
+      return quint64(1) << (c - u'a');
+    if (c >= u'0' && c <= u'9')
+      return quint64(1) << (26 + c - u'0');
+    return quint64(1) << (36 + c % 28);
+  }
+
+  quint8 boundaryBonus(QStringView text, int i, int nameStart)
+  {
+    if (i == nameStart)
+      return 10;
+    if (i == 0)
+      return 8;
+    QChar previous = text[i - 1];
+    QChar c = text[i];
+    if (previous == u'/')
+      return 9;
+    if (previous == u' ' || previous == u'_' || previous == u'-' || previous == u'.')
+      return 8;
+    if (previous.isLower() && c.isUpper())
+      return 7;
+    if (!previous.isLetterOrNumber() && c.isLetterOrNumber())
+      return 6;
+    return 0;
+  }
+
+  int findCharacter(const char16_t *text, int from, int to, char16_t c)
+  {
+    int pos = from;
+#if defined(__SSE2__) || defined(_M_X64)
+    const __m128i needle = _mm_set1_epi16(short(c));
+    for (; pos + 8 <= to; pos += 8)
+    {
+      __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text + pos));
+      // Two mask bits per UTF-16 unit
+      unsigned mask = unsigned(_mm_movemask_epi8(_mm_cmpeq_epi16(x, needle)));
+      if (mask)
+        return pos + qCountTrailingZeroBits(mask) / 2;
+    }
+#endif
+    for (; pos < to; ++pos)
+    {
+      if (text[pos] == c)
+        return pos;
+    }
+    return -1;
+  }
+
+  int recencyBonus(qint64 ageMs)
+  {
+    const qint64 hour = 60 * 60 * 1000;
+    if (ageMs < hour)
+      return 12;
+    if (ageMs < 24 * hour)
+      return 8;
+    if (ageMs < 7 * 24 * hour)
+      return 4;
+    if (ageMs < 30 * 24 * hour)
+      return 2;
+    return 0;
+  }
+}
+
+void FuzzyMatcher::clear()
+{
+  m_entries.clear();
+  m_arena.clear();
+  m_bonus.clear();
+}
+
+void FuzzyMatcher::reserve(int candidates, int characters)
+{
+  m_entries.reserve(candidates);
+  m_arena.reserve(characters);
+  m_bonus.reserve(characters);
+}
+
+void FuzzyMatcher::addCandidate(QStringView text, int nameStart, qint64 modified)
+{
+  Entry entry;
+  entry.mask = 0;
+  entry.modified = modified;
+  entry.offset = int(m_arena.size());
+  entry.length = int(text.size());
+  entry.nameStart = qBound(0, nameStart, entry.length);
+
+  for (int i = 0; i < entry.length; ++i)
+  {
+    char16_t c = fold(text[i]);
+    m_arena.append(c);
+    m_bonus.append(boundaryBonus(text, i, entry.nameStart));
+    entry.mask |= characterBit(c);
+  }
+  m_entries.append(entry);
+}
+
+int FuzzyMatcher::scoreRange(const char16_t *text, const quint8 *bonus, int from, int to, const char16_t *query,
+                             int queryLength) const
+{
+  // First window that holds the query
+  int end = from;
+  for (int i = 0; i < queryLength; ++i)
+  {
+    end = findCharacter(text, end, to, query[i]);
+    if (end < 0)
+      return NoMatch;
+    ++end;
+  }
+
+  // Shrink it from the right, so "ab" in "a_x_a_b" starts at the second a
+  int start = end;
+  for (int i = queryLength - 1; i >= 0; --i)
+  {
+    do
+      --start;
+    while (text[start] != query[i]);
+  }
+
+  int score = 0;
+  int last = -1;
+  int pos = start;
+  for (int i = 0; i < queryLength; ++i, ++pos)
+  {
+    while (text[pos] != query[i])
+      ++pos;
+    score += MatchPoints + bonus[pos];
+    if (i > 0 && pos == last + 1)
+      score += ConsecutivePoints;
+    else if (i > 0)
+      score -= qMin(MaxGapPenalty, GapStartPenalty + GapExtensionPenalty * (pos - last - 2));
+    last = pos;
+  }
+  return score;
+}
+
+int FuzzyMatcher::score(const Entry &entry, const char16_t *query, int queryLength) const
+{
+  const char16_t *text = m_arena.constData() + entry.offset;
+  const quint8 *bonus = m_bonus.constData() + entry.offset;
+
+  int score = scoreRange(text, bonus, entry.nameStart, entry.length, query, queryLength);
+  if (score != NoMatch)
+  {
+    score += NameMatchPoints;
+  }
+  else
+  {
+    score = scoreRange(text, bonus, 0, entry.length, query, queryLength);
+    if (score == NoMatch)
+      return NoMatch;
+  }
+  // Of two equal matches, the shorter candidate is the likelier one
+  return score - entry.length / 8;
+}
+
+QVector<FuzzyMatcher::Match> FuzzyMatcher::match(const QString &query, int limit) const
+{
+  QVector<char16_t> folded;
+  quint64 queryMask = 0;
+  for (QChar c : query)
+  {
+    if (c.isSpace())
+      continue;
+    folded.append(fold(c));
+    queryMask |= characterBit(folded.last());
+  }
+
+  const qint64 now = QDateTime::currentMSecsSinceEpoch();
+  QVector<Match> matches;
+  for (int i = 0; i < m_entries.size(); ++i)
+  {
+    const Entry &entry = m_entries.at(i);
+    if ((entry.mask & queryMask) != queryMask)
+      continue;
+
+    Match match;
+    match.candidate = i;
+    if (!folded.isEmpty())
+    {
+      match.score = score(entry, folded.constData(), int(folded.size()));
+      if (match.score == NoMatch)
+        continue;
+    }
+    match.score += recencyBonus(now - entry.modified);
+    matches.append(match);
+  }
+
+  limit = qMin(limit, int(matches.size()));
+  std::partial_sort(matches.begin(), matches.begin() + limit, matches.end(), [this](const Match &a, const Match &b)
+                    {
+    if (a.score != b.score)
+      return a.score > b.score;
+    qint64 modifiedA = m_entries.at(a.candidate).modified;
+    qint64 modifiedB = m_entries.at(b.candidate).modified;
+    return modifiedA != modifiedB ? modifiedA > modifiedB : a.candidate < b.candidate; });
+  matches.resize(limit);
+  return matches;
+}
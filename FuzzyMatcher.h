@@ -0,0 +1,54 @@
+#pragma once
+
+#include <QtCore/QString>
+#include <QtCore/QStringView>
+#include <QtCore/QVector>
+
+// Subsequence matcher for quick-open. Candidates are case-folded into one
+// contiguous UTF-16 arena, next to a byte per character saying how good a
+// place it is for a match to land (start of the name, after a separator,
+// a camelCase hump). Each candidate also keeps a 64-bit summary of the
+// characters it contains, so most candidates are rejected with one AND;
+// the rest are matched with an SSE2 character scan where available.
+//
+// A match is scored fzf-style: find the first window holding the query as
+// a subsequence, shrink it from the right end back, then score the window
+// for consecutive runs and boundary hits against gaps and length. Matches
+// that fit in the file name outrank those that need the directory, and
+// recently modified files get a small boost.
+class FuzzyMatcher
+{
+public:
+  struct Match
+  {
+    int candidate = -1;
+    int score = 0;
+  };
+
+  void clear();
+  void reserve(int candidates, int characters);
+  // Text is matched as given; the file name starts at nameStart
+  void addCandidate(QStringView text, int nameStart, qint64 modified);
+  int count() const { return int(m_entries.size()); }
+
+  // Best matches first; an empty query lists the most recent candidates
+  QVector<Match> match(const QString &query, int limit) const;
+
+private:
+  struct Entry
+  {
+    quint64 mask;
+    qint64 modified;
+    int offset;
+    int length;
+    int nameStart;
+  };
+
+  int score(const Entry &entry, const char16_t *query, int queryLength) const;
+  int scoreRange(const char16_t *text, const quint8 *bonus, int from, int to, const char16_t *query,
+                 int queryLength) const;
+
+  QVector<Entry> m_entries;
+  QVector<char16_t> m_arena;
+  QVector<quint8> m_bonus;
+};
@@ -0,0 +1,672 @@
+#include "LargeFileView.h"
+#include <QtGui/QPainter>
+#include <QtGui/QKeyEvent>
+#include <QtGui/QMouseEvent>
+#include <QtGui/QClipboard>
+#include <QtGui/QGuiApplication>
+#include <QtGui/QInputMethod>
+#include <QtWidgets/QScrollBar>
+#include <QtCore/QMetaObject>
+#include <QtCore/QDebug>
+#include <cmath>
+
+namespace
+{
+  const int Margin = 4;
+  // Longer lines are only shown up to here; the text itself is untouched
+  const qint64 MaxLineBytes = 16 * 1024;
+  const int TabColumns = 4;
+
+  bool isContinuationByte(char c)
+  {
+    return (uchar(c) & 0xC0) == 0x80;
+  }
+}
+
+LargeFileView::LargeFileView(QWidget *parent)
+    : QAbstractScrollArea(parent), m_cursor(0), m_anchor(0), m_preferredColumn(-1), m_widestLine(0)
+{
+  setFocusPolicy(Qt::StrongFocus);
+  viewport()->setCursor(Qt::IBeamCursor);
+  setAttribute(Qt::WA_InputMethodEnabled);
+}
+
+bool LargeFileView::open(const QString &filePath, QString *error)
+{
+  close();
+  if (!m_table.open(filePath, error))
+    return false;
+  updateScrollBars();
+  viewport()->update();
+  return true;
+}
+
+void LargeFileView::close()
+{
+  m_table.close();
+  m_preedit.clear();
+  m_cursor = 0;
+  m_anchor = 0;
+  m_preferredColumn = -1;
+  m_widestLine = 0;
+  verticalScrollBar()->setValue(0);
+  horizontalScrollBar()->setValue(0);
+  updateScrollBars();
+  viewport()->update();
+}
+
+QFuture<DocumentWriter::Result> LargeFileView::save(const QString &filePath)
+{
+  quint64 revision = m_table.revision();
+  QFuture<DocumentWriter::Result> written = DocumentWriter::instance().write(filePath, m_table.snapshot());
+  written.then(this, [this, revision](const DocumentWriter::Result &result)
+               {
+    if (result.ok && m_table.revision() == revision)
+      m_table.setModified(false); });
+  return written;
+}
+
+int LargeFileView::lineHeight() const
+{
+  return qMax(1, fontMetrics().lineSpacing());
+}
+
+int LargeFileView::visibleLines() const
+{
+  return qMax(1, viewport()->height() / lineHeight());
+}
+
+void LargeFileView::updateScrollBars()
+{
+  int lines = visibleLines();
+  verticalScrollBar()->setRange(0, qMax(0, m_table.estimatedLineCount() - lines));
+  verticalScrollBar()->setPageStep(lines);
+  verticalScrollBar()->setSingleStep(1);
+
+  int width = viewport()->width();
+  horizontalScrollBar()->setRange(0, qMax(0, m_widestLine - width));
+  horizontalScrollBar()->setPageStep(width);
+  horizontalScrollBar()->setSingleStep(fontMetrics().averageCharWidth() * 4);
+}
+
+QString LargeFileView::lineText(qint64 lineStart, qint64 *lineEnd) const
+{
+  qint64 end = m_table.nextLineStart(lineStart);
+  if (end > lineStart && m_table.at(end - 1) == '\n')
+    --end;
+  if (end > lineStart && m_table.at(end - 1) == '\r')
+    --end;
+  *lineEnd = end;
+  return m_table.text(lineStart, qMin(end - lineStart, MaxLineBytes));
+}
+
+bool LargeFileView::checkOriginal()
+{
+  if (m_table.isOriginalIntact())
+    return true;
+
+  // Nothing past the new end of the file can be read any more, edits included
+  QString filePath = m_table.filePath();
+  qWarning() << "Large file" << filePath << "was truncated by another program; reopening it";
+  QString error;
+  if (!open(filePath, &error))
+  {
+    qWarning() << "Could not reopen" << filePath << ":" << error;
+    close();
+  }
+  return false;
+}
+
+int LargeFileView::tabWidth() const
+{
+  return qMax(1, TabColumns * fontMetrics().horizontalAdvance(u' '));
+}
+
+int LargeFileView::advance(const QString &text, int column) const
+{
+  // Runs between tabs are measured whole; a tab moves on to the next stop
+  QFontMetrics metrics = fontMetrics();
+  int tab = tabWidth();
+  int x = 0;
+  int runStart = 0;
+  column = qMin(column, int(text.size()));
+  for (int i = 0; i < column; ++i)
+  {
+    if (text.at(i) != u'\t')
+      continue;
+    x += metrics.horizontalAdvance(text.mid(runStart, i - runStart));
+    x = (x / tab + 1) * tab;
+    runStart = i + 1;
+  }
+  return x + metrics.horizontalAdvance(text.mid(runStart, column - runStart));
+}
+
+void LargeFileView::drawLine(QPainter &painter, int left, int baseline, const QString &text) const
+{
+  QFontMetrics metrics = fontMetrics();
+  int tab = tabWidth();
+  int x = 0;
+  int runStart = 0;
+  for (int i = 0; i <= text.size(); ++i)
+  {
+    if (i < text.size() && text.at(i) != u'\t')
+      continue;
+    QString run = text.mid(runStart, i - runStart);
+    painter.drawText(left + x, baseline, run);
+    x += metrics.horizontalAdvance(run);
+    if (i < text.size())
+      x = (x / tab + 1) * tab;
+    runStart = i + 1;
+  }
+}
+
+int LargeFileView::columnAt(qint64 position) const
+{
+  qint64 lineStart = m_table.lineStart(position);
+  return int(m_table.text(lineStart, qMin(position - lineStart, MaxLineBytes)).size());
+}
+
+qint64 LargeFileView::offsetForColumn(qint64 lineStart, int column) const
+{
+  qint64 lineEnd = 0;
+  QString text = lineText(lineStart, &lineEnd);
+  // Don't land between the halves of a surrogate pair
+  if (column > 0 && column < text.size() && text.at(column).isLowSurrogate())
+    --column;
+  return qMin(lineEnd, lineStart + text.left(column).toUtf8().size());
+}
+
+qint64 LargeFileView::positionAt(const QPoint &point)
+{
+  int row = qMax(0, point.y()) / lineHeight();
+  qint64 lineStart = m_table.lineStartOf(verticalScrollBar()->value() + row);
+  qint64 lineEnd = 0;
+  QString text = lineText(lineStart, &lineEnd);
+
+  QFontMetricsF metrics(font());
+  qreal tab = tabWidth();
+  qreal x = point.x() + horizontalScrollBar()->value() - Margin;
+  qreal advance = 0;
+  int column = 0;
+  while (column < text.size())
+  {
+    int length = text.at(column).isHighSurrogate() && column + 1 < text.size() ? 2 : 1;
+    qreal width = text.at(column) == u'\t' ? (std::floor(advance / tab) + 1) * tab - advance
+                                            : metrics.horizontalAdvance(text.mid(column, length));
+    if (x < advance + width / 2)
+      break;
+    advance += width;
+    column += length;
+  }
+  return offsetForColumn(lineStart, column);
+}
+
+qint64 LargeFileView::previousCharacter(qint64 position) const
+{
+  if (position <= 0)
+    return 0;
+  --position;
+  if (position > 0 && m_table.at(position) == '\n' && m_table.at(position - 1) == '\r')
+    return position - 1;
+  while (position > 0 && isContinuationByte(m_table.at(position)))
+    --position;
+  return position;
+}
+
+qint64 LargeFileView::nextCharacter(qint64 position) const
+{
+  qint64 size = m_table.size();
+  if (position >= size)
+    return size;
+  if (m_table.at(position) == '\r' && position + 1 < size && m_table.at(position + 1) == '\n')
+    return position + 2;
+  ++position;
+  while (position < size && isContinuationByte(m_table.at(position)))
+    ++position;
+  return position;
+}
+
+qint64 LargeFileView::lineAbove(qint64 position) const
+{
+  qint64 lineStart = m_table.lineStart(position);
+  return lineStart > 0 ? m_table.lineStart(lineStart - 1) : -1;
+}
+
+qint64 LargeFileView::lineBelow(qint64 position) const
+{
+  qint64 next = m_table.nextLineStart(position);
+  qint64 size = m_table.size();
+  // The last line has no line break after it, unless it is empty
+  if (next == size && (size == 0 || m_table.at(size - 1) != '\n'))
+    return -1;
+  return next > m_table.lineStart(position) ? next : -1;
+}
+
+void LargeFileView::moveCursor(qint64 position, bool select)
+{
+  m_cursor = qBound<qint64>(0, position, m_table.size());
+  if (!select)
+    m_anchor = m_cursor;
+  ensureCursorVisible();
+  viewport()->update();
+}
+
+void LargeFileView::ensureCursorVisible()
+{
+  // Finding the cursor's line extends the index that far, which may move
+  // the estimated line count
+  int line = m_table.lineAt(m_cursor);
+  qint64 lineStart = m_table.lineStart(m_cursor);
+  QString before = m_table.text(lineStart, qMin(m_cursor - lineStart, MaxLineBytes));
+  int x = Margin + advance(before, int(before.size()));
+  m_widestLine = qMax(m_widestLine, x + Margin);
+  updateScrollBars();
+
+  QScrollBar *vertical = verticalScrollBar();
+  if (line < vertical->value())
+    vertical->setValue(line);
+  else if (line >= vertical->value() + visibleLines())
+    vertical->setValue(line - visibleLines() + 1);
+
+  QScrollBar *horizontal = horizontalScrollBar();
+  int width = viewport()->width();
+  if (x - Margin < horizontal->value())
+    horizontal->setValue(x - Margin);
+  else if (x + Margin > horizontal->value() + width)
+    horizontal->setValue(x + Margin - width);
+}
+
+void LargeFileView::edited()
+{
+  m_preferredColumn = -1;
+  ensureCursorVisible();
+  viewport()->update();
+  emit contentChanged();
+}
+
+void LargeFileView::insertText(const QString &text)
+{
+  if (hasSelection())
+    removeSelection();
+  QByteArray utf8 = text.toUtf8();
+  qint64 position = m_cursor;
+  m_table.insert(position, utf8);
+  m_cursor = position + utf8.size();
+  m_anchor = m_cursor;
+  edited();
+}
+
+void LargeFileView::removeSelection()
+{
+  qint64 start = qMin(m_cursor, m_anchor);
+  qint64 end = qMax(m_cursor, m_anchor);
+  m_table.remove(start, end - start);
+  m_cursor = start;
+  m_anchor = start;
+}
+
+void LargeFileView::copy() const
+{
+  if (!hasSelection() || !m_table.isOriginalIntact())
+    return;
+  qint64 start = qMin(m_cursor, m_anchor);
+  QGuiApplication::clipboard()->setText(m_table.text(start, qAbs(m_cursor - m_anchor)));
+}
+
+void LargeFileView::undo()
+{
+  undoStep(false);
+}
+
+void LargeFileView::redo()
+{
+  undoStep(true);
+}
+
+void LargeFileView::undoStep(bool redo)
+{
+  if (!checkOriginal())
+    return;
+  qint64 position = redo ? m_table.redo() : m_table.undo();
+  if (position >= 0)
+  {
+    m_cursor = qMin(position, m_table.size());
+    m_anchor = m_cursor;
+    edited();
+  }
+}
+
+void LargeFileView::cut()
+{
+  if (!checkOriginal())
+    return;
+  if (hasSelection())
+  {
+    copy();
+    removeSelection();
+    edited();
+  }
+}
+
+void LargeFileView::paste()
+{
+  if (!checkOriginal())
+    return;
+  QString text = QGuiApplication::clipboard()->text();
+  if (!text.isEmpty())
+    insertText(text);
+}
+
+void LargeFileView::selectAll()
+{
+  if (!checkOriginal())
+    return;
+  m_anchor = 0;
+  moveCursor(m_table.size(), true);
+}
+
+bool LargeFileView::event(QEvent *event)
+{
+  // The Edit menu's shortcuts would otherwise go to the hidden QTextEdit
+  if (event->type() == QEvent::ShortcutOverride)
+  {
+    QKeyEvent *keyEvent = static_cast<QKeyEvent *>(event);
+    if (keyEvent->matches(QKeySequence::Undo) || keyEvent->matches(QKeySequence::Redo) ||
+        keyEvent->matches(QKeySequence::Cut) || keyEvent->matches(QKeySequence::Copy) ||
+        keyEvent->matches(QKeySequence::Paste) || keyEvent->matches(QKeySequence::SelectAll))
+    {
+      event->accept();
+      return true;
+    }
+  }
+  return QAbstractScrollArea::event(event);
+}
+
+void LargeFileView::keyPressEvent(QKeyEvent *event)
+{
+  if (!checkOriginal())
+    return;
+  if (event->matches(QKeySequence::SelectAll))
+  {
+    selectAll();
+    return;
+  }
+  if (event->matches(QKeySequence::Copy))
+  {
+    copy();
+    return;
+  }
+  if (event->matches(QKeySequence::Cut))
+  {
+    cut();
+    return;
+  }
+  if (event->matches(QKeySequence::Paste))
+  {
+    paste();
+    return;
+  }
+  if (event->matches(QKeySequence::Undo) || event->matches(QKeySequence::Redo))
+  {
+    undoStep(event->matches(QKeySequence::Redo));
+    return;
+  }
+
+  bool select = event->modifiers() & Qt::ShiftModifier;
+  bool control = event->modifiers() & Qt::ControlModifier;
+  qint64 start = qMin(m_cursor, m_anchor);
+  qint64 end = qMax(m_cursor, m_anchor);
+
+  switch (event->key())
+  {
+  case Qt::Key_Left:
+    m_preferredColumn = -1;
+    moveCursor(hasSelection() && !select ? start : previousCharacter(m_cursor), select);
+    return;
+  case Qt::Key_Right:
+    m_preferredColumn = -1;
+    moveCursor(hasSelection() && !select ? end : nextCharacter(m_cursor), select);
+    return;
+  case Qt::Key_Up:
+  case Qt::Key_Down:
+  case Qt::Key_PageUp:
+  case Qt::Key_PageDown:
+  {
+    if (m_preferredColumn < 0)
+      m_preferredColumn = columnAt(m_cursor);
+    bool up = event->key() == Qt::Key_Up || event->key() == Qt::Key_PageUp;
+    int steps = (event->key() == Qt::Key_Up || event->key() == Qt::Key_Down) ? 1 : visibleLines();
+    qint64 lineStart = m_table.lineStart(m_cursor);
+    for (int i = 0; i < steps; ++i)
+    {
+      qint64 next = up ? lineAbove(lineStart) : lineBelow(lineStart);
+      if (next < 0)
+        break;
+      lineStart = next;
+    }
+    int column = m_preferredColumn;
+    moveCursor(offsetForColumn(lineStart, column), select);
+    m_preferredColumn = column;
+    return;
+  }
+  case Qt::Key_Home:
+    m_preferredColumn = -1;
+    moveCursor(control ? 0 : m_table.lineStart(m_cursor), select);
+    return;
+  case Qt::Key_End:
+  {
+    m_preferredColumn = -1;
+    qint64 lineEnd = m_table.size();
+    if (!control)
+      lineText(m_table.lineStart(m_cursor), &lineEnd);
+    moveCursor(lineEnd, select);
+    return;
+  }
+  case Qt::Key_Backspace:
+  case Qt::Key_Delete:
+  {
+    if (!hasSelection())
+    {
+      if (event->key() == Qt::Key_Backspace)
+        m_anchor = previousCharacter(m_cursor);
+      else
+        m_anchor = nextCharacter(m_cursor);
+    }
+    if (hasSelection())
+    {
+      removeSelection();
+      edited();
+    }
+    return;
+  }
+  case Qt::Key_Return:
+  case Qt::Key_Enter:
+    insertText("\n");
+    return;
+  case Qt::Key_Tab:
+    insertText("\t");
+    return;
+  default:
+    break;
+  }
+
+  QString text = event->text();
+  if (!text.isEmpty() && !control && text.at(0).isPrint())
+  {
+    insertText(text);
+    return;
+  }
+  QAbstractScrollArea::keyPressEvent(event);
+}
+
+void LargeFileView::mousePressEvent(QMouseEvent *event)
+{
+  if (event->button() != Qt::LeftButton || !checkOriginal())
+    return;
+  // Clicking away finishes a composition where it is
+  if (!m_preedit.isEmpty())
+    QGuiApplication::inputMethod()->commit();
+  m_preferredColumn = -1;
+  moveCursor(positionAt(event->position().toPoint()), event->modifiers() & Qt::ShiftModifier);
+}
+
+void LargeFileView::mouseMoveEvent(QMouseEvent *event)
+{
+  if ((event->buttons() & Qt::LeftButton) && checkOriginal())
+    moveCursor(positionAt(event->position().toPoint()), true);
+}
+
+void LargeFileView::focusInEvent(QFocusEvent *event)
+{
+  QAbstractScrollArea::focusInEvent(event);
+  viewport()->update();
+}
+
+void LargeFileView::focusOutEvent(QFocusEvent *event)
+{
+  QAbstractScrollArea::focusOutEvent(event);
+  viewport()->update();
+}
+
+void LargeFileView::inputMethodEvent(QInputMethodEvent *event)
+{
+  event->accept();
+  if (!checkOriginal())
+    return;
+
+  // What to replace is counted in characters from the cursor
+  if (event->replacementLength() > 0 && !hasSelection())
+  {
+    qint64 from = m_cursor;
+    for (int i = 0; i > event->replacementStart(); --i)
+      from = previousCharacter(from);
+    for (int i = 0; i < event->replacementStart(); ++i)
+      from = nextCharacter(from);
+    qint64 to = from;
+    for (int i = 0; i < event->replacementLength(); ++i)
+      to = nextCharacter(to);
+    m_anchor = from;
+    m_cursor = to;
+  }
+
+  if (!event->commitString().isEmpty())
+  {
+    insertText(event->commitString());
+  }
+  else if (event->replacementLength() > 0 && hasSelection())
+  {
+    removeSelection();
+    edited();
+  }
+  m_preedit = event->preeditString();
+  viewport()->update();
+}
+
+QVariant LargeFileView::inputMethodQuery(Qt::InputMethodQuery query) const
+{
+  if (!m_table.isOpen() || !m_table.isOriginalIntact())
+    return QAbstractScrollArea::inputMethodQuery(query);
+
+  switch (query)
+  {
+  case Qt::ImEnabled:
+    return true;
+  case Qt::ImCursorRectangle:
+    return m_cursorRect;
+  case Qt::ImFont:
+    return font();
+  case Qt::ImHints:
+    return int(Qt::ImhMultiLine);
+  case Qt::ImCursorPosition:
+    return columnAt(m_cursor);
+  case Qt::ImAnchorPosition:
+    // Surrounding text is the cursor's line, so an anchor elsewhere can't be placed in it
+    return m_table.lineStart(m_anchor) == m_table.lineStart(m_cursor) ? columnAt(m_anchor) : columnAt(m_cursor);
+  case Qt::ImSurroundingText:
+  {
+    qint64 lineEnd = 0;
+    return lineText(m_table.lineStart(m_cursor), &lineEnd);
+  }
+  case Qt::ImCurrentSelection:
+    return m_table.text(qMin(m_cursor, m_anchor), qMin(qAbs(m_cursor - m_anchor), MaxLineBytes));
+  default:
+    return QAbstractScrollArea::inputMethodQuery(query);
+  }
+}
+
+void LargeFileView::resizeEvent(QResizeEvent *event)
+{
+  QAbstractScrollArea::resizeEvent(event);
+  updateScrollBars();
+}
+
+void LargeFileView::paintEvent(QPaintEvent *)
+{
+  QPainter painter(viewport());
+  painter.fillRect(viewport()->rect(), palette().color(QPalette::Base));
+  if (!m_table.isOpen() || !checkOriginal())
+    return;
+
+  QFontMetrics metrics = fontMetrics();
+  int height = lineHeight();
+  int left = Margin - horizontalScrollBar()->value();
+  qint64 selectionStart = qMin(m_cursor, m_anchor);
+  qint64 selectionEnd = qMax(m_cursor, m_anchor);
+  int widest = m_widestLine;
+
+  // Only the rows on screen are ever read out of the table
+  qint64 lineStart = m_table.lineStartOf(verticalScrollBar()->value());
+  int rows = visibleLines() + 1;
+  for (int row = 0; row < rows; ++row)
+  {
+    qint64 lineEnd = 0;
+    QString text = lineText(lineStart, &lineEnd);
+    int top = row * height;
+    int width = advance(text, int(text.size()));
+    widest = qMax(widest, width + 2 * Margin);
+
+    if (selectionStart <= lineEnd && selectionEnd > lineStart)
+    {
+      int from = selectionStart > lineStart ? advance(text, columnAt(selectionStart)) : 0;
+      int to = selectionEnd > lineEnd ? width + metrics.averageCharWidth() : advance(text, columnAt(selectionEnd));
+      painter.fillRect(QRect(left + from, top, to - from, height), palette().color(QPalette::Highlight));
+    }
+
+    painter.setPen(palette().color(QPalette::Text));
+    drawLine(painter, left, top + metrics.ascent(), text);
+
+    if (hasFocus() && m_cursor >= lineStart && m_cursor <= lineEnd)
+    {
+      int x = left + advance(text, columnAt(m_cursor));
+      if (!m_preedit.isEmpty())
+      {
+        // Over the text after the cursor, underlined as compositions are
+        int preeditWidth = metrics.horizontalAdvance(m_preedit);
+        painter.fillRect(QRect(x, top, preeditWidth, height), palette().color(QPalette::Base));
+        painter.drawText(x, top + metrics.ascent(), m_preedit);
+        painter.drawLine(x, top + metrics.ascent() + 1, x + preeditWidth, top + metrics.ascent() + 1);
+        x += preeditWidth;
+      }
+      painter.fillRect(QRect(x, top, 1, height), palette().color(QPalette::Text));
+
+      QRect cursorRect(viewport()->mapTo(this, QPoint(x, top)), QSize(1, height));
+      if (cursorRect != m_cursorRect)
+      {
+        m_cursorRect = cursorRect;
+        QGuiApplication::inputMethod()->update(Qt::ImCursorRectangle);
+      }
+    }
+
+    qint64 next = m_table.nextLineStart(lineStart);
+    if (next <= lineStart || (next == m_table.size() && lineEnd == next))
+      break;
+    lineStart = next;
+  }
+
+  // Painting may have extended the line index or met a wider line
+  if (widest != m_widestLine || verticalScrollBar()->maximum() != qMax(0, m_table.estimatedLineCount() - visibleLines()))
+  {
+    m_widestLine = widest;
+    QMetaObject::invokeMethod(this, &LargeFileView::updateScrollBars, Qt::QueuedConnection);
+  }
+}
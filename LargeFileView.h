@@ -0,0 +1,92 @@
+#pragma once
+
+#include <QtWidgets/QAbstractScrollArea>
+#include <QtCore/QString>
+#include <QtCore/QFuture>
+#include "PieceTable.h"
+
+class QPainter;
+
+// Plain-text editor for files too big for QTextEdit. The text stays in a
+// PieceTable and only the lines in the viewport are ever turned into
+// QStrings and painted, so there is no document layout to build. Lines
+// don't wrap; the vertical scroll bar counts lines, using the table's
+// estimate until its line index has reached the end.
+class LargeFileView : public QAbstractScrollArea
+{
+  Q_OBJECT
+
+public:
+  explicit LargeFileView(QWidget *parent = nullptr);
+
+  bool open(const QString &filePath, QString *error);
+  void close();
+  bool isOpen() const { return m_table.isOpen(); }
+  QString filePath() const { return m_table.filePath(); }
+  // Streams a snapshot out on DocumentWriter's thread; editing carries on
+  // meanwhile, and the view counts as saved if nothing changed since
+  QFuture<DocumentWriter::Result> save(const QString &filePath);
+  bool isModified() const { return m_table.isModified(); }
+  const PieceTable &pieceTable() const { return m_table; }
+  QVariant inputMethodQuery(Qt::InputMethodQuery query) const override;
+
+public slots:
+  void undo();
+  void redo();
+  void cut();
+  void copy() const;
+  void paste();
+  void selectAll();
+
+signals:
+  void contentChanged();
+
+protected:
+  bool event(QEvent *event) override;
+  void paintEvent(QPaintEvent *event) override;
+  void resizeEvent(QResizeEvent *event) override;
+  void keyPressEvent(QKeyEvent *event) override;
+  void mousePressEvent(QMouseEvent *event) override;
+  void mouseMoveEvent(QMouseEvent *event) override;
+  void focusInEvent(QFocusEvent *event) override;
+  void focusOutEvent(QFocusEvent *event) override;
+  void inputMethodEvent(QInputMethodEvent *event) override;
+
+private:
+  int lineHeight() const;
+  int visibleLines() const;
+  void updateScrollBars();
+  // Reopens the file if another program truncated it under the mapping;
+  // false when that happened and the caller should leave it be
+  bool checkOriginal();
+  // Text of the line starting at lineStart, without its line break
+  QString lineText(qint64 lineStart, qint64 *lineEnd) const;
+  // Width of the first column characters of a line, tabs expanded
+  int advance(const QString &text, int column) const;
+  int tabWidth() const;
+  void drawLine(QPainter &painter, int left, int baseline, const QString &text) const;
+  qint64 positionAt(const QPoint &point);
+  qint64 offsetForColumn(qint64 lineStart, int column) const;
+  int columnAt(qint64 position) const;
+  qint64 previousCharacter(qint64 position) const;
+  qint64 nextCharacter(qint64 position) const;
+  qint64 lineAbove(qint64 position) const;
+  qint64 lineBelow(qint64 position) const;
+  void moveCursor(qint64 position, bool select);
+  void ensureCursorVisible();
+  bool hasSelection() const { return m_cursor != m_anchor; }
+  void insertText(const QString &text);
+  void removeSelection();
+  void edited();
+  void undoStep(bool redo);
+
+  PieceTable m_table;
+  qint64 m_cursor;
+  qint64 m_anchor;
+  // Column kept while moving up and down through shorter lines
+  int m_preferredColumn;
+  int m_widestLine;
+  // Input method composition, drawn at the cursor until committed
+  QString m_preedit;
+  QRect m_cursorRect;
+};
@@ -0,0 +1,572 @@
+#include "LazyDocumentLayout.h"
+#include <QtGui/QPainter>
+#include <QtGui/QTextDocument>
+#include <QtGui/QTextFrame>
+#include <QtGui/QTextList>
+#include <QtGui/QTextLayout>
+#include <QtGui/QPixmap>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QUrl>
+#include <QtCore/qmath.h>
+
+namespace
+{
+  // Edits touching more blocks than this are estimated and refined later
+  const int MaxEagerBlocks = 64;
+  // Layout work per idle tick
+  const int RefineSliceMs = 4;
+}
+
+LazyDocumentLayout::LazyDocumentLayout(QTextDocument *document)
+    : QAbstractTextDocumentLayout(document), m_pendingScroll(0), m_flushQueued(false), m_sizeChanged(false),
+      m_viewportTop(0), m_width(-1), m_lineSpacing(1), m_averageCharWidth(1), m_refineNext(0)
+{
+  registerHandler(QTextFormat::ImageObject, this);
+  m_refineTimer.setSingleShot(true);
+  m_refineTimer.setInterval(0);
+  connect(&m_refineTimer, &QTimer::timeout, this, &LazyDocumentLayout::refineIdle);
+}
+
+void LazyDocumentLayout::install(QTextDocument *document)
+{
+  // findChild rather than documentLayout(), which would create the default
+  // layout just to throw it away
+  bool installed = document->findChild<LazyDocumentLayout *>(QString(), Qt::FindDirectChildrenOnly) != nullptr;
+  bool wanted = canLayout(document);
+  if (wanted && !installed)
+    document->setDocumentLayout(new LazyDocumentLayout(document));
+  else if (!wanted && installed)
+    document->setDocumentLayout(nullptr); // documentLayout() recreates the default on demand
+}
+
+bool LazyDocumentLayout::canLayout(const QTextDocument *document)
+{
+  // Tables and other frames need QTextDocumentLayout's frame layout
+  return document->rootFrame()->childFrames().isEmpty();
+}
+
+void LazyDocumentLayout::setViewportTop(qreal top)
+{
+  m_viewportTop = top;
+  // Refinement carries on from what the reader is looking at
+  if (!m_heights.isEmpty())
+    m_refineNext = blockAt(top);
+}
+
+void LazyDocumentLayout::updateMetrics()
+{
+  QFontMetricsF metrics(document()->defaultFont());
+  m_lineSpacing = qMax<qreal>(1, metrics.lineSpacing());
+  m_averageCharWidth = qMax<qreal>(1, metrics.averageCharWidth());
+  m_width = document()->pageSize().width();
+}
+
+qreal LazyDocumentLayout::indent(const QTextBlock &block) const
+{
+  QTextList *list = block.textList();
+  int level = list ? list->format().indent() : block.blockFormat().indent();
+  return level * document()->indentWidth();
+}
+
+qreal LazyDocumentLayout::availableWidth(const QTextBlock &block) const
+{
+  if (m_width <= 0)
+    return 1e6;
+  QTextBlockFormat format = block.blockFormat();
+  qreal width = m_width - 2 * document()->documentMargin() - format.leftMargin() - format.rightMargin() - indent(block);
+  return qMax<qreal>(1, width);
+}
+
+qreal LazyDocumentLayout::estimateHeight(const QTextBlock &block) const
+{
+  if (!block.isVisible())
+    return 0;
+  QTextBlockFormat format = block.blockFormat();
+  int lines = 1;
+  if (m_width > 0)
+    lines = qMax(1, qCeil((block.length() - 1) * m_averageCharWidth / availableWidth(block)));
+  return format.topMargin() + lines * m_lineSpacing + format.bottomMargin();
+}
+
+qreal LazyDocumentLayout::layoutBlock(const QTextBlock &block) const
+{
+  QTextLayout *layout = block.layout();
+  if (!block.isVisible())
+  {
+    layout->clearLayout();
+    return 0;
+  }
+
+  QTextBlockFormat format = block.blockFormat();
+  QTextOption option = document()->defaultTextOption();
+  option.setTextDirection(block.textDirection());
+  option.setAlignment(format.alignment());
+  if (m_width <= 0)
+    option.setWrapMode(QTextOption::NoWrap);
+  layout->setTextOption(option);
+
+  qreal width = availableWidth(block);
+  qreal y = 0;
+  layout->beginLayout();
+  for (bool first = true;; first = false)
+  {
+    QTextLine line = layout->createLine();
+    if (!line.isValid())
+      break;
+    qreal textIndent = first ? format.textIndent() : 0;
+    line.setLineWidth(qMax<qreal>(1, width - textIndent));
+    line.setPosition(QPointF(textIndent, y));
+    y += format.lineHeight(line.height(), 1.0);
+  }
+  layout->endLayout();
+  return format.topMargin() + y + format.bottomMargin();
+}
+
+void LazyDocumentLayout::ensureLayout(const QTextBlock &block) const
+{
+  int number = block.blockNumber();
+  if (number < 0 || number >= m_heights.size())
+    return;
+  if (!m_exact.at(number) || (block.isVisible() && block.layout()->lineCount() == 0))
+    setHeight(number, layoutBlock(block), true);
+
+  // Blocks above may have moved since this one was laid out
+  QTextBlockFormat format = block.blockFormat();
+  block.layout()->setPosition(QPointF(document()->documentMargin() + format.leftMargin() + indent(block),
+                                      blockTop(number) + format.topMargin()));
+}
+
+void LazyDocumentLayout::setHeight(int blockNumber, qreal height, bool exact) const
+{
+  qreal delta = height - m_heights.at(blockNumber);
+  m_exact[blockNumber] = exact;
+  if (qFuzzyIsNull(delta))
+    return;
+
+  // A block wholly above the viewport pushes the text on screen down;
+  // scroll by the same amount so it stays where it was
+  if (blockTop(blockNumber) + m_heights.at(blockNumber) <= m_viewportTop)
+  {
+    m_pendingScroll += delta;
+    m_viewportTop += delta;
+  }
+  m_heights[blockNumber] = height;
+  addToTree(blockNumber, delta);
+  m_sizeChanged = true;
+  queueFlush();
+}
+
+void LazyDocumentLayout::queueFlush() const
+{
+  // Heights change mid-paint, when the scroll bars must not be touched
+  if (m_flushQueued)
+    return;
+  m_flushQueued = true;
+  LazyDocumentLayout *self = const_cast<LazyDocumentLayout *>(this);
+  QMetaObject::invokeMethod(self, [self]()
+                            { self->flushChanges(); }, Qt::QueuedConnection);
+}
+
+void LazyDocumentLayout::flushChanges()
+{
+  m_flushQueued = false;
+  if (m_sizeChanged)
+  {
+    m_sizeChanged = false;
+    emit documentSizeChanged(documentSize());
+  }
+  if (!qFuzzyIsNull(m_pendingScroll))
+  {
+    qreal delta = m_pendingScroll;
+    m_pendingScroll = 0;
+    emit scrollAdjustmentNeeded(delta);
+  }
+}
+
+void LazyDocumentLayout::rebuildTree() const
+{
+  int count = int(m_heights.size());
+  m_tree.fill(0, count + 1);
+  for (int i = 1; i <= count; ++i)
+  {
+    m_tree[i] += m_heights.at(i - 1);
+    int parent = i + (i & -i);
+    if (parent <= count)
+      m_tree[parent] += m_tree.at(i);
+  }
+}
+
+void LazyDocumentLayout::addToTree(int index, qreal delta) const
+{
+  for (int i = index + 1; i < m_tree.size(); i += i & -i)
+    m_tree[i] += delta;
+}
+
+qreal LazyDocumentLayout::blockTop(int blockNumber) const
+{
+  qreal top = document()->documentMargin();
+  for (int i = qMin(blockNumber, int(m_tree.size()) - 1); i > 0; i -= i & -i)
+    top += m_tree.at(i);
+  return top;
+}
+
+int LazyDocumentLayout::blockAt(qreal y) const
+{
+  int count = int(m_heights.size());
+  if (count == 0)
+    return 0;
+
+  // Walk down the tree for the last block starting at or above y
+  qreal remaining = y - document()->documentMargin();
+  int position = 0;
+  int step = 1;
+  while (step * 2 <= count)
+    step *= 2;
+  for (; step > 0; step /= 2)
+  {
+    if (position + step <= count && m_tree.at(position + step) <= remaining)
+    {
+      position += step;
+      remaining -= m_tree.at(position);
+    }
+  }
+  return qMin(position, count - 1);
+}
+
+void LazyDocumentLayout::relayoutAll()
+{
+  // Remember how far into its block the viewport starts, to put it back
+  // there once the estimates have changed
+  int anchor = -1;
+  qreal fraction = 0;
+  if (!m_heights.isEmpty() && m_viewportTop > 0)
+  {
+    anchor = blockAt(m_viewportTop);
+    qreal height = m_heights.at(anchor);
+    fraction = height > 0 ? qBound<qreal>(0, (m_viewportTop - blockTop(anchor)) / height, 1) : 0;
+  }
+
+  updateMetrics();
+  QTextDocument *doc = document();
+  int count = doc->blockCount();
+  m_heights.resize(count);
+  m_exact.fill(false, count);
+  int i = 0;
+  for (QTextBlock block = doc->begin(); block.isValid() && i < count; block = block.next(), ++i)
+    m_heights[i] = estimateHeight(block);
+  rebuildTree();
+
+  if (anchor >= 0 && anchor < count)
+  {
+    qreal top = blockTop(anchor) + fraction * m_heights.at(anchor);
+    m_pendingScroll += top - m_viewportTop;
+    m_viewportTop = top;
+    queueFlush();
+    m_refineNext = anchor;
+  }
+  else
+  {
+    m_refineNext = 0;
+  }
+  m_sizeChanged = false;
+  emit documentSizeChanged(documentSize());
+  emit update();
+  m_refineTimer.start();
+}
+
+void LazyDocumentLayout::documentChanged(int from, int charsRemoved, int charsAdded)
+{
+  Q_UNUSED(charsRemoved);
+  QTextDocument *doc = document();
+
+  // A table or frame pasted in needs QTextDocumentLayout from now on. Not
+  // from in here, as swapping layouts deletes this one.
+  if (!canLayout(doc))
+    QMetaObject::invokeMethod(doc, [doc]()
+                              { install(doc); }, Qt::QueuedConnection);
+
+  // Width and font changes, a new layout and whole-document replacements
+  // all arrive as a change covering everything
+  if (m_heights.isEmpty() || (from == 0 && charsAdded >= doc->characterCount()))
+  {
+    relayoutAll();
+    return;
+  }
+
+  // Blocks before the change are untouched and those after it only move,
+  // so only the range in between is replaced
+  QTextBlock first = doc->findBlock(from);
+  QTextBlock last = doc->findBlock(from + charsAdded);
+  if (!last.isValid())
+    last = doc->lastBlock();
+  int firstNumber = first.blockNumber();
+  int lastNumber = last.blockNumber();
+  int grown = doc->blockCount() - int(m_heights.size());
+  int oldLast = qBound(firstNumber - 1, lastNumber - grown, int(m_heights.size()) - 1);
+
+  qreal oldTop = blockTop(firstNumber);
+  qreal oldBottom = blockTop(oldLast + 1);
+  int removed = oldLast - firstNumber + 1;
+  int added = lastNumber - firstNumber + 1;
+  bool exact = added <= MaxEagerBlocks;
+  qreal newHeight = 0;
+  QTextBlock block = first;
+  if (added == removed)
+  {
+    // Typing within blocks keeps their number, so the tree is updated in place
+    for (int i = 0; i < added && block.isValid(); ++i, block = block.next())
+    {
+      int number = firstNumber + i;
+      qreal height = exact ? layoutBlock(block) : estimateHeight(block);
+      addToTree(number, height - m_heights.at(number));
+      m_heights[number] = height;
+      m_exact[number] = exact;
+      newHeight += height;
+    }
+  }
+  else
+  {
+    m_heights.remove(firstNumber, removed);
+    m_exact.remove(firstNumber, removed);
+    m_heights.insert(firstNumber, added, 0.0);
+    m_exact.insert(firstNumber, added, exact);
+    for (int i = 0; i < added && block.isValid(); ++i, block = block.next())
+    {
+      m_heights[firstNumber + i] = exact ? layoutBlock(block) : estimateHeight(block);
+      newHeight += m_heights.at(firstNumber + i);
+    }
+    rebuildTree();
+  }
+
+  qreal shift = newHeight - (oldBottom - oldTop);
+  if (oldBottom <= m_viewportTop && !qFuzzyIsNull(shift))
+  {
+    m_pendingScroll += shift;
+    m_viewportTop += shift;
+    queueFlush();
+  }
+
+  emit documentSizeChanged(documentSize());
+  emit update(QRectF(0, oldTop, 1000000000., 1000000000.));
+  if (!exact)
+    m_refineTimer.start();
+}
+
+void LazyDocumentLayout::refineIdle()
+{
+  int count = int(m_heights.size());
+  if (count == 0)
+    return;
+
+  QElapsedTimer timer;
+  timer.start();
+  int index = qBound(0, m_refineNext, count - 1);
+  int visited = 0;
+  for (; visited < count; ++visited, index = (index + 1) % count)
+  {
+    if (m_exact.at(index))
+      continue;
+    if (timer.elapsed() >= RefineSliceMs)
+      break;
+    setHeight(index, layoutBlock(document()->findBlockByNumber(index)), true);
+  }
+  m_refineNext = index;
+
+  flushChanges();
+  if (visited < count)
+    m_refineTimer.start();
+}
+
+QSizeF LazyDocumentLayout::documentSize() const
+{
+  qreal margin = document()->documentMargin();
+  return QSizeF(qMax<qreal>(0, m_width), blockTop(int(m_heights.size())) + margin);
+}
+
+QRectF LazyDocumentLayout::frameBoundingRect(QTextFrame *frame) const
+{
+  if (frame != document()->rootFrame())
+    return QRectF();
+  return QRectF(QPointF(0, 0), documentSize());
+}
+
+QRectF LazyDocumentLayout::blockBoundingRect(const QTextBlock &block) const
+{
+  if (!block.isValid() || block.blockNumber() >= m_heights.size())
+    return QRectF();
+  ensureLayout(block);
+  const QTextLayout *layout = block.layout();
+  QRectF rect = layout->boundingRect();
+  rect.moveTopLeft(layout->position());
+  return rect;
+}
+
+int LazyDocumentLayout::hitTest(const QPointF &point, Qt::HitTestAccuracy accuracy) const
+{
+  if (m_heights.isEmpty())
+    return -1;
+
+  QTextBlock block = document()->findBlockByNumber(blockAt(point.y()));
+  while (block.isValid() && !block.isVisible())
+    block = block.next();
+  if (!block.isValid())
+    return accuracy == Qt::ExactHit ? -1 : document()->characterCount() - 1;
+
+  ensureLayout(block);
+  QTextLayout *layout = block.layout();
+  QPointF local = point - layout->position();
+  for (int i = 0; i < layout->lineCount(); ++i)
+  {
+    QTextLine line = layout->lineAt(i);
+    if (local.y() >= line.y() + line.height() && i + 1 < layout->lineCount())
+      continue;
+    if (accuracy == Qt::ExactHit &&
+        (local.y() < line.y() || local.y() > line.y() + line.height() || local.x() < line.x() ||
+         local.x() > line.x() + line.naturalTextWidth()))
+      return -1;
+    return block.position() + line.xToCursor(local.x());
+  }
+  return accuracy == Qt::ExactHit ? -1 : block.position();
+}
+
+void LazyDocumentLayout::draw(QPainter *painter, const PaintContext &context)
+{
+  if (m_heights.isEmpty())
+    return;
+
+  QRectF clip = context.clip.isValid() ? context.clip : QRectF(QPointF(0, 0), documentSize());
+  bool ok = false;
+  int cursorWidth = property("cursorWidth").toInt(&ok);
+  if (!ok)
+    cursorWidth = 1;
+  painter->setPen(context.palette.color(QPalette::Text));
+
+  for (QTextBlock block = document()->findBlockByNumber(blockAt(clip.top())); block.isValid(); block = block.next())
+  {
+    int number = block.blockNumber();
+    qreal top = blockTop(number);
+    if (top > clip.bottom())
+      break;
+    if (!block.isVisible())
+      continue;
+
+    ensureLayout(block);
+    QTextLayout *layout = block.layout();
+    QTextBlockFormat format = block.blockFormat();
+    if (format.hasProperty(QTextFormat::BackgroundBrush))
+      painter->fillRect(QRectF(0, top, documentSize().width(), m_heights.at(number)), format.background());
+
+    // Selections, including the editor's extra selections, clipped to this block
+    int position = block.position();
+    int length = block.length();
+    QList<QTextLayout::FormatRange> selections;
+    for (const Selection &selection : context.selections)
+    {
+      if (selection.format.boolProperty(QTextFormat::FullWidthSelection))
+      {
+        int cursor = selection.cursor.position() - position;
+        QTextLine line = cursor >= 0 && cursor < length ? layout->lineForTextPosition(cursor) : QTextLine();
+        if (line.isValid())
+          painter->fillRect(QRectF(0, layout->position().y() + line.y(), documentSize().width(), line.height()),
+                            selection.format.background());
+        continue;
+      }
+      int start = selection.cursor.selectionStart() - position;
+      int end = selection.cursor.selectionEnd() - position;
+      if (start >= end || end <= 0 || start >= length)
+        continue;
+      QTextLayout::FormatRange range;
+      range.start = qMax(start, 0);
+      range.length = qMin(end, length) - range.start;
+      range.format = selection.format;
+      selections.append(range);
+    }
+
+    layout->draw(painter, QPointF(), selections, clip);
+    if (block.textList())
+      drawListMarker(painter, block, context);
+    if (context.cursorPosition >= position && context.cursorPosition < position + length)
+      layout->drawCursor(painter, QPointF(), context.cursorPosition - position, cursorWidth);
+  }
+}
+
+void LazyDocumentLayout::drawListMarker(QPainter *painter, const QTextBlock &block, const PaintContext &context) const
+{
+  QTextList *list = block.textList();
+  QString marker;
+  switch (list->format().style())
+  {
+  case QTextListFormat::ListDisc:
+    marker = QChar(0x2022);
+    break;
+  case QTextListFormat::ListCircle:
+    marker = QChar(0x25E6);
+    break;
+  case QTextListFormat::ListSquare:
+    marker = QChar(0x25AA);
+    break;
+  default:
+    marker = list->itemText(block);
+    break;
+  }
+  QTextLayout *layout = block.layout();
+  if (marker.isEmpty() || layout->lineCount() == 0)
+    return;
+
+  // Right-aligned in the indent, on the first line's baseline
+  QTextLine line = layout->lineAt(0);
+  QFont font = block.charFormat().font();
+  QFontMetricsF metrics(font);
+  qreal x = layout->position().x() + line.x() - metrics.horizontalAdvance(marker) - metrics.horizontalAdvance(u' ');
+  qreal baseline = layout->position().y() + line.y() + line.ascent();
+
+  painter->save();
+  painter->setFont(font);
+  painter->setPen(context.palette.color(QPalette::Text));
+  painter->drawText(QPointF(x, baseline), marker);
+  painter->restore();
+}
+
+QImage LazyDocumentLayout::image(const QTextImageFormat &format) const
+{
+  QUrl name(format.name());
+  QVariant data = document()->resource(QTextDocument::ImageResource, name);
+  if (data.userType() == QMetaType::QImage)
+    return data.value<QImage>();
+  if (data.userType() == QMetaType::QPixmap)
+    return data.value<QPixmap>().toImage();
+
+  // Decode raw data once and keep the result as the resource
+  QImage image;
+  if (data.userType() == QMetaType::QByteArray && image.loadFromData(data.toByteArray()))
+    document()->addResource(QTextDocument::ImageResource, name, image);
+  return image;
+}
+
+QSizeF LazyDocumentLayout::intrinsicSize(QTextDocument *, int, const QTextFormat &format)
+{
+  QTextImageFormat imageFormat = format.toImageFormat();
+  QSizeF size = image(imageFormat).size();
+  bool hasWidth = imageFormat.hasProperty(QTextFormat::ImageWidth);
+  bool hasHeight = imageFormat.hasProperty(QTextFormat::ImageHeight);
+
+  // A single given dimension scales the other to keep the aspect ratio
+  if (hasWidth && hasHeight)
+    size = QSizeF(imageFormat.width(), imageFormat.height());
+  else if (hasWidth && size.width() > 0)
+    size = QSizeF(imageFormat.width(), size.height() * imageFormat.width() / size.width());
+  else if (hasHeight && size.height() > 0)
+    size = QSizeF(size.width() * imageFormat.height() / size.height(), imageFormat.height());
+
+  if (size.isEmpty())
+    size = QSizeF(16, 16);
+  return size;
+}
+
+void LazyDocumentLayout::drawObject(QPainter *painter, const QRectF &rect, QTextDocument *, int,
+                                    const QTextFormat &format)
+{
+  QImage image = this->image(format.toImageFormat());
+  if (!image.isNull())
+    painter->drawImage(rect, image);
+}
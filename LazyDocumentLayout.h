@@ -0,0 +1,94 @@
+#pragma once
+
+#include <QtGui/QAbstractTextDocumentLayout>
+#include <QtGui/QTextObjectInterface>
+#include <QtGui/QTextBlock>
+#include <QtCore/QTimer>
+#include <QtCore/QVector>
+
+// Document layout that only lays out the blocks something asks about:
+// those being painted, hit-tested or measured for the cursor. Every other
+// block gets a height estimated from its length, and a timer replaces the
+// estimates with real layouts a few milliseconds at a time while the UI is
+// idle. Resizing or changing the font therefore costs one screenful of
+// layout instead of the whole document.
+//
+// Block heights live in a Fenwick tree, so a block's y offset and the
+// block at a given y are both O(log n). When a block above the viewport
+// changes height the layout asks for the scroll position to move by the
+// same amount, so what is on screen stays put.
+//
+// Handles paragraphs, lists and inline images. Documents with tables or
+// other nested frames keep QTextDocumentLayout; see install(). One that
+// gains a table later is handed back to QTextDocumentLayout.
+class LazyDocumentLayout : public QAbstractTextDocumentLayout, public QTextObjectInterface
+{
+  Q_OBJECT
+  Q_INTERFACES(QTextObjectInterface)
+
+public:
+  explicit LazyDocumentLayout(QTextDocument *document);
+
+  // Gives document a LazyDocumentLayout, or back the default one if it has
+  // content this layout can't place. Resets the layout, so call it before
+  // anything listens to the document's contentsChange.
+  static void install(QTextDocument *document);
+  static bool canLayout(const QTextDocument *document);
+
+  // Document y at the top of the viewport, in pixels
+  void setViewportTop(qreal top);
+
+  void draw(QPainter *painter, const PaintContext &context) override;
+  int hitTest(const QPointF &point, Qt::HitTestAccuracy accuracy) const override;
+  int pageCount() const override { return 1; }
+  QSizeF documentSize() const override;
+  QRectF frameBoundingRect(QTextFrame *frame) const override;
+  QRectF blockBoundingRect(const QTextBlock &block) const override;
+
+  // QTextObjectInterface, for inline images
+  QSizeF intrinsicSize(QTextDocument *document, int posInDocument, const QTextFormat &format) override;
+  void drawObject(QPainter *painter, const QRectF &rect, QTextDocument *document, int posInDocument,
+                  const QTextFormat &format) override;
+
+signals:
+  // Scroll by delta to keep the viewport on the same text
+  void scrollAdjustmentNeeded(qreal delta);
+
+protected:
+  void documentChanged(int from, int charsRemoved, int charsAdded) override;
+
+private:
+  void relayoutAll();
+  void updateMetrics();
+  qreal estimateHeight(const QTextBlock &block) const;
+  qreal layoutBlock(const QTextBlock &block) const;
+  void ensureLayout(const QTextBlock &block) const;
+  void setHeight(int blockNumber, qreal height, bool exact) const;
+  qreal blockTop(int blockNumber) const;
+  qreal availableWidth(const QTextBlock &block) const;
+  int blockAt(qreal y) const;
+  qreal indent(const QTextBlock &block) const;
+  void drawListMarker(QPainter *painter, const QTextBlock &block, const PaintContext &context) const;
+  void refineIdle();
+  void queueFlush() const;
+  void flushChanges();
+  QImage image(const QTextImageFormat &format) const;
+
+  void rebuildTree() const;
+  void addToTree(int index, qreal delta) const;
+
+  // Laying out on demand happens inside const queries, so these are mutable
+  mutable QVector<qreal> m_heights; // Per block, including its margins
+  mutable QVector<bool> m_exact;
+  mutable QVector<qreal> m_tree;
+  mutable qreal m_pendingScroll;
+  mutable bool m_flushQueued;
+  mutable bool m_sizeChanged;
+  mutable qreal m_viewportTop;
+
+  qreal m_width;
+  qreal m_lineSpacing;
+  qreal m_averageCharWidth;
+  int m_refineNext;
+  QTimer m_refineTimer;
+};
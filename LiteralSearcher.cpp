@@ -0,0 +1,255 @@
+#include "LiteralSearcher.h"
+#include <QtCore/QtAlgorithms>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define LITERALSEARCHER_HAS_AVX2
+#endif
+
+namespace
+{
+  inline char16_t foldUnit(char16_t c)
+  {
+    if (c < 0x80)
+      return (c >= 'A' && c <= 'Z') ? char16_t(c + 32) : c;
+    return char16_t(QChar(c).toCaseFolded().unicode());
+  }
+
+  inline bool isWordUnit(char16_t c)
+  {
+    return QChar(c).isLetterOrNumber();
+  }
+
+#ifdef LITERALSEARCHER_HAS_AVX2
+  bool cpuHasAvx2()
+  {
+    static const bool hasAvx2 = __builtin_cpu_supports("avx2");
+    return hasAvx2;
+  }
+#endif
+}
+
+LiteralSearcher::LiteralSearcher()
+    : m_vectorizable(false)
+{
+}
+
+LiteralSearcher::LiteralSearcher(const QString &pattern, Options options)
+    : m_pattern(pattern), m_options(options), m_vectorizable(false)
+{
+  if (m_pattern.isEmpty())
+    return;
+
+  m_needle = m_pattern;
+  if (m_options & CaseInsensitive)
+  {
+    for (QChar &c : m_needle)
+      c = QChar(foldUnit(c.unicode()));
+  }
+
+  // Probe with the first and last pattern characters the vector filter can
+  // represent exactly, moving inwards past any it can't
+  int first = 0;
+  while (first < m_pattern.size() && !isVectorizable(m_pattern.at(first)))
+    first++;
+  int last = m_pattern.size() - 1;
+  while (last > first && !isVectorizable(m_pattern.at(last)))
+    last--;
+
+  if (first < m_pattern.size())
+  {
+    m_probeA = makeProbe(first);
+    m_probeB = makeProbe(last);
+    m_vectorizable = true;
+  }
+}
+
+bool LiteralSearcher::isVectorizable(QChar c) const
+{
+  // Case-insensitively, only ASCII has a small known set of matching forms
+  return !(m_options & CaseInsensitive) || c.unicode() < 0x80;
+}
+
+LiteralSearcher::Probe LiteralSearcher::makeProbe(int offset) const
+{
+  Probe probe;
+  probe.offset = offset;
+  char16_t c = m_pattern.at(offset).unicode();
+  probe.forms[0] = probe.forms[1] = probe.forms[2] = c;
+
+  if ((m_options & CaseInsensitive) && QChar(c).isLetter())
+  {
+    char16_t lower = foldUnit(c);
+    probe.forms[0] = lower;
+    probe.forms[1] = char16_t(lower - 32);
+    probe.forms[2] = lower;
+
+    // The two non-ASCII characters that fold onto ASCII letters
+    if (lower == 'k')
+      probe.forms[2] = 0x212A; // KELVIN SIGN
+    else if (lower == 's')
+      probe.forms[2] = 0x017F; // LATIN SMALL LETTER LONG S
+  }
+  return probe;
+}
+
+bool LiteralSearcher::matchesAt(const char16_t *text, int length, int pos) const
+{
+  const int m = m_needle.size();
+  const char16_t *needle = reinterpret_cast<const char16_t *>(m_needle.constData());
+
+  if (m_options & CaseInsensitive)
+  {
+    for (int i = 0; i < m; ++i)
+    {
+      if (foldUnit(text[pos + i]) != needle[i])
+        return false;
+    }
+  }
+  else if (std::memcmp(text + pos, needle, size_t(m) * sizeof(char16_t)) != 0)
+  {
+    return false;
+  }
+
+  // Same rule as QTextDocument::FindWholeWords
+  if (m_options & WholeWords)
+  {
+    if (pos > 0 && isWordUnit(text[pos - 1]))
+      return false;
+    if (pos + m < length && isWordUnit(text[pos + m]))
+      return false;
+  }
+  return true;
+}
+
+int LiteralSearcher::scanScalar(const char16_t *text, int length, int from, int lastStart) const
+{
+  if (!m_vectorizable)
+  {
+    for (int pos = from; pos <= lastStart; ++pos)
+    {
+      if (matchesAt(text, length, pos))
+        return pos;
+    }
+    return -1;
+  }
+
+  const Probe &a = m_probeA;
+  const Probe &b = m_probeB;
+  for (int pos = from; pos <= lastStart; ++pos)
+  {
+    char16_t x = text[pos + a.offset];
+    if (x != a.forms[0] && x != a.forms[1] && x != a.forms[2])
+      continue;
+    char16_t y = text[pos + b.offset];
+    if (y != b.forms[0] && y != b.forms[1] && y != b.forms[2])
+      continue;
+    if (matchesAt(text, length, pos))
+      return pos;
+  }
+  return -1;
+}
+
+#if defined(__SSE2__) || defined(_M_X64)
+int LiteralSearcher::scanSse2(const char16_t *text, int length, int from, int lastStart) const
+{
+  const __m128i a0 = _mm_set1_epi16(short(m_probeA.forms[0]));
+  const __m128i a1 = _mm_set1_epi16(short(m_probeA.forms[1]));
+  const __m128i a2 = _mm_set1_epi16(short(m_probeA.forms[2]));
+  const __m128i b0 = _mm_set1_epi16(short(m_probeB.forms[0]));
+  const __m128i b1 = _mm_set1_epi16(short(m_probeB.forms[1]));
+  const __m128i b2 = _mm_set1_epi16(short(m_probeB.forms[2]));
+
+  int pos = from;
+  for (; pos + 7 <= lastStart; pos += 8)
+  {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text + pos + m_probeA.offset));
+    __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text + pos + m_probeB.offset));
+    __m128i hitA = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi16(x, a0), _mm_cmpeq_epi16(x, a1)), _mm_cmpeq_epi16(x, a2));
+    __m128i hitB = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi16(y, b0), _mm_cmpeq_epi16(y, b1)), _mm_cmpeq_epi16(y, b2));
+
+    // Two mask bits per UTF-16 unit
+    unsigned mask = unsigned(_mm_movemask_epi8(_mm_and_si128(hitA, hitB)));
+    while (mask)
+    {
+      int bit = qCountTrailingZeroBits(mask);
+      if (matchesAt(text, length, pos + bit / 2))
+        return pos + bit / 2;
+      mask &= ~(3u << bit);
+    }
+  }
+  return scanScalar(text, length, pos, lastStart);
+}
+#endif
+
+#ifdef LITERALSEARCHER_HAS_AVX2
+__attribute__((target("avx2"))) int LiteralSearcher::scanAvx2(const char16_t *text, int length, int from, int lastStart) const
+{
+  const __m256i a0 = _mm256_set1_epi16(short(m_probeA.forms[0]));
+  const __m256i a1 = _mm256_set1_epi16(short(m_probeA.forms[1]));
+  const __m256i a2 = _mm256_set1_epi16(short(m_probeA.forms[2]));
+  const __m256i b0 = _mm256_set1_epi16(short(m_probeB.forms[0]));
+  const __m256i b1 = _mm256_set1_epi16(short(m_probeB.forms[1]));
+  const __m256i b2 = _mm256_set1_epi16(short(m_probeB.forms[2]));
+
+  int pos = from;
+  for (; pos + 15 <= lastStart; pos += 16)
+  {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(text + pos + m_probeA.offset));
+    __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(text + pos + m_probeB.offset));
+    __m256i hitA = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi16(x, a0), _mm256_cmpeq_epi16(x, a1)), _mm256_cmpeq_epi16(x, a2));
+    __m256i hitB = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi16(y, b0), _mm256_cmpeq_epi16(y, b1)), _mm256_cmpeq_epi16(y, b2));
+
+    unsigned mask = unsigned(_mm256_movemask_epi8(_mm256_and_si256(hitA, hitB)));
+    while (mask)
+    {
+      int bit = qCountTrailingZeroBits(mask);
+      if (matchesAt(text, length, pos + bit / 2))
+        return pos + bit / 2;
+      mask &= ~(3u << bit);
+    }
+  }
+  return scanScalar(text, length, pos, lastStart);
+}
+#endif
+
+int LiteralSearcher::indexIn(QStringView text, int from, int to) const
+{
+  const int length = int(text.size());
+  if (to < 0 || to > length)
+    to = length;
+  from = qMax(from, 0);
+
+  const int lastStart = to - int(m_needle.size());
+  if (m_needle.isEmpty() || from > lastStart)
+    return -1;
+
+  const char16_t *data = text.utf16();
+  if (!m_vectorizable)
+    return scanScalar(data, length, from, lastStart);
+
+#ifdef LITERALSEARCHER_HAS_AVX2
+  if (cpuHasAvx2())
+    return scanAvx2(data, length, from, lastStart);
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+  return scanSse2(data, length, from, lastStart);
+#else
+  return scanScalar(data, length, from, lastStart);
+#endif
+}
+
+void LiteralSearcher::findAll(QStringView text, int from, int to, int offset, QVector<int> &out) const
+{
+  const int m = int(m_needle.size());
+  int pos = indexIn(text, from, to);
+  while (pos >= 0)
+  {
+    out.append(offset + pos);
+    pos = indexIn(text, pos + m, to);
+  }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <QtCore/QString>
+#include <QtCore/QStringView>
+#include <QtCore/QVector>
+#include <QtCore/QFlags>
+
+// Literal substring search over contiguous UTF-16 text.
+// Candidate positions are found by comparing two probe characters of the
+// pattern (normally the first and last) against 8 or 16 text positions at
+// a time with SSE2/AVX2, and only candidates that pass both probes are
+// compared in full. Other architectures use the same filter in scalar code.
+class LiteralSearcher
+{
+public:
+  enum Option
+  {
+    CaseInsensitive = 0x1,
+    WholeWords = 0x2
+  };
+  Q_DECLARE_FLAGS(Options, Option)
+
+  LiteralSearcher();
+  explicit LiteralSearcher(const QString &pattern, Options options = {});
+
+  const QString &pattern() const { return m_pattern; }
+  Options options() const { return m_options; }
+  bool isEmpty() const { return m_pattern.isEmpty(); }
+
+  // First match starting at or after from and ending at or before to
+  // (defaults to the end of text); -1 if there is none
+  int indexIn(QStringView text, int from = 0, int to = -1) const;
+
+  // Appends offset + start of every non-overlapping match, left to right
+  void findAll(QStringView text, int from, int to, int offset, QVector<int> &out) const;
+
+private:
+  struct Probe
+  {
+    int offset = 0;
+    // Every form a text character may take to match this pattern position
+    char16_t forms[3] = {0, 0, 0};
+  };
+
+  Probe makeProbe(int offset) const;
+  bool isVectorizable(QChar c) const;
+  bool matchesAt(const char16_t *text, int length, int pos) const;
+  int scanScalar(const char16_t *text, int length, int from, int lastStart) const;
+#if defined(__SSE2__) || defined(_M_X64)
+  int scanSse2(const char16_t *text, int length, int from, int lastStart) const;
+#endif
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+  int scanAvx2(const char16_t *text, int length, int from, int lastStart) const;
+#endif
+
+  QString m_pattern;
+  QString m_needle; // Case-folded pattern when searching case-insensitively
+  Options m_options;
+  Probe m_probeA;
+  Probe m_probeB;
+  bool m_vectorizable;
+};
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(LiteralSearcher::Options)
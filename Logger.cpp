@@ -0,0 +1,226 @@
+#include "Logger.h"
+#include <QtCore/QDateTime>
+#include <QtCore/QFileInfo>
+#include <QtCore/QDir>
+#include <cstdio>
+
+Logger &Logger::instance()
+{
+  static Logger instance;
+  return instance;
+}
+
+Logger::Logger()
+    : m_slots(new Slot[Capacity]), m_minimumSeverity(0), m_writer(nullptr), m_maxFileSize(5 * 1024 * 1024), m_maxBackups(3)
+{
+  for (quint64 i = 0; i < Capacity; ++i)
+    m_slots[i].sequence.store(i, std::memory_order_relaxed);
+
+#ifdef QT_NO_DEBUG
+  m_minimumSeverity = severity(QtInfoMsg);
+#endif
+}
+
+Logger::~Logger()
+{
+  shutdown();
+}
+
+void Logger::messageHandler(QtMsgType type, const QMessageLogContext &context, const QString &message)
+{
+  Q_UNUSED(context);
+  Logger &logger = instance();
+  logger.log(type, message);
+
+  // Qt aborts as soon as the handler returns
+  if (type == QtFatalMsg)
+    logger.shutdown();
+}
+
+void Logger::start(const QString &filePath)
+{
+  if (m_running)
+    return;
+
+  m_filePath = filePath;
+  QDir().mkpath(QFileInfo(filePath).absolutePath());
+  m_file.setFileName(filePath);
+  if (!m_file.open(QIODevice::WriteOnly | QIODevice::Append))
+    std::fprintf(stderr, "Could not open log file %s\n", qPrintable(filePath));
+
+  m_running = true;
+  m_writer = QThread::create([this]()
+                             { writerLoop(); });
+  m_writer->setObjectName("Logger");
+  m_writer->start(QThread::LowPriority);
+}
+
+void Logger::shutdown()
+{
+  if (!m_running.load() || m_stopped.exchange(true))
+    return;
+
+  // A producer that got past the m_stopped check may still be filling its
+  // slot; the writer's final pass must come after it
+  while (m_producers.load() > 0)
+    QThread::yield();
+  m_running = false;
+
+  m_wakeup.release();
+  m_writer->wait();
+  delete m_writer;
+  m_writer = nullptr;
+  m_file.close();
+}
+
+void Logger::setMinimumLevel(QtMsgType level)
+{
+  m_minimumSeverity = severity(level);
+}
+
+int Logger::severity(QtMsgType type)
+{
+  switch (type)
+  {
+  case QtDebugMsg:
+    return 0;
+  case QtInfoMsg:
+    return 1;
+  case QtWarningMsg:
+    return 2;
+  case QtCriticalMsg:
+    return 3;
+  case QtFatalMsg:
+    return 4;
+  }
+  return 0;
+}
+
+void Logger::log(QtMsgType type, const QString &message)
+{
+  int level = severity(type);
+  if (level < m_minimumSeverity.load(std::memory_order_relaxed))
+    return;
+
+  // Counted before the check so shutdown() can wait for whoever passed it
+  Producer producer(m_producers);
+
+  // Nothing is left to drain the ring once the writer has stopped
+  if (m_stopped.load())
+  {
+    std::fprintf(stderr, "%s\n", qPrintable(message));
+    return;
+  }
+
+  // Vyukov-style bounded queue: a slot is free for ticket pos when its
+  // sequence equals pos, and holds a message when it equals pos + 1
+  quint64 pos = m_head.load(std::memory_order_relaxed);
+  Slot *slot = nullptr;
+  while (true)
+  {
+    slot = &m_slots[pos & (Capacity - 1)];
+    quint64 sequence = slot->sequence.load(std::memory_order_acquire);
+    qint64 diff = qint64(sequence) - qint64(pos);
+    if (diff == 0)
+    {
+      if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        break;
+    }
+    else if (diff < 0)
+    {
+      // Full: drop rather than stall the GUI thread
+      m_dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    else
+    {
+      pos = m_head.load(std::memory_order_relaxed);
+    }
+  }
+
+  slot->timestamp = QDateTime::currentMSecsSinceEpoch();
+  slot->type = type;
+  slot->message = message;
+  slot->sequence.store(pos + 1, std::memory_order_release);
+
+  // The writer wakes on its own every so often; only hurry it along for
+  // problems or when the ring is filling up
+  if (level >= severity(QtWarningMsg) || (pos & (Capacity / 4 - 1)) == 0)
+    m_wakeup.release();
+}
+
+bool Logger::pop(Slot &out)
+{
+  Slot &slot = m_slots[m_tail & (Capacity - 1)];
+  if (slot.sequence.load(std::memory_order_acquire) != m_tail + 1)
+    return false;
+
+  out.timestamp = slot.timestamp;
+  out.type = slot.type;
+  out.message = std::move(slot.message);
+  slot.message = QString();
+  slot.sequence.store(m_tail + Capacity, std::memory_order_release);
+  m_tail++;
+  return true;
+}
+
+void Logger::writerLoop()
+{
+  static const char *const labels[] = {"Debug", "Info", "Warning", "Critical", "Fatal"};
+
+  while (true)
+  {
+    m_wakeup.tryAcquire(1, 250);
+    bool running = m_running.load(std::memory_order_acquire);
+
+    QByteArray batch;
+    Slot item;
+    while (pop(item))
+    {
+      batch += QDateTime::fromMSecsSinceEpoch(item.timestamp).toString("yyyy-MM-dd hh:mm:ss.zzz ").toUtf8();
+      batch += labels[severity(item.type)];
+      batch += ": ";
+      batch += item.message.toUtf8();
+      batch += '\n';
+    }
+
+    quint64 dropped = m_dropped.exchange(0, std::memory_order_relaxed);
+    if (dropped > 0)
+      batch += QByteArray("Logger: dropped ") + QByteArray::number(dropped) + " messages\n";
+
+    if (!batch.isEmpty())
+      writeBatch(batch);
+
+    // The final pass above drained whatever was queued before shutdown()
+    if (!running)
+      break;
+  }
+}
+
+void Logger::writeBatch(const QByteArray &batch)
+{
+  if (!m_file.isOpen())
+    return;
+
+  m_file.write(batch);
+  m_file.flush();
+
+  if (m_maxFileSize > 0 && m_file.size() > m_maxFileSize)
+    rotate();
+}
+
+void Logger::rotate()
+{
+  m_file.close();
+
+  // writehand.log -> writehand.log.1 -> ... -> writehand.log.N, oldest dropped
+  QFile::remove(QString("%1.%2").arg(m_filePath).arg(m_maxBackups));
+  for (int i = m_maxBackups - 1; i >= 1; --i)
+    QFile::rename(QString("%1.%2").arg(m_filePath).arg(i), QString("%1.%2").arg(m_filePath).arg(i + 1));
+  if (m_maxBackups > 0)
+    QFile::rename(m_filePath, m_filePath + ".1");
+  else
+    QFile::remove(m_filePath);
+
+  m_file.open(QIODevice::WriteOnly | QIODevice::Append);
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <QtCore/QString>
+#include <QtCore/QFile>
+#include <QtCore/QSemaphore>
+#include <QtCore/QThread>
+#include <QtCore/QtGlobal>
+#include <atomic>
+#include <memory>
+
+// Process-wide log sink behind Qt's message handler. Producers claim a slot
+// in a fixed ring buffer with a compare-and-swap and never block or touch
+// the disk; one writer thread drains the ring in batches, appends them to
+// the log file and rotates it once it grows past the size limit.
+//
+// qDebug() output is compiled out of release builds (QT_NO_DEBUG_OUTPUT);
+// setMinimumLevel() filters the rest at runtime.
+class Logger
+{
+public:
+  static Logger &instance();
+  static void messageHandler(QtMsgType type, const QMessageLogContext &context, const QString &message);
+
+  void start(const QString &filePath);
+  // Drains everything queued so far and stops the writer thread
+  void shutdown();
+
+  void setMinimumLevel(QtMsgType level);
+  void setMaxFileSize(qint64 bytes) { m_maxFileSize = bytes; }
+  void setMaxBackups(int count) { m_maxBackups = count; }
+
+  void log(QtMsgType type, const QString &message);
+
+private:
+  Logger();
+  ~Logger();
+  Logger(const Logger &) = delete;
+  Logger &operator=(const Logger &) = delete;
+
+  struct Slot
+  {
+    std::atomic<quint64> sequence{0};
+    qint64 timestamp = 0;
+    QtMsgType type = QtDebugMsg;
+    QString message;
+  };
+
+  static constexpr quint64 Capacity = 4096;
+
+  // Counts a thread inside log() for as long as it is in scope
+  struct Producer
+  {
+    explicit Producer(std::atomic<int> &producers) : count(producers) { count++; }
+    ~Producer() { count--; }
+    std::atomic<int> &count;
+  };
+
+  static int severity(QtMsgType type);
+  bool pop(Slot &out);
+  void writerLoop();
+  void writeBatch(const QByteArray &batch);
+  void rotate();
+
+  std::unique_ptr<Slot[]> m_slots;
+  alignas(64) std::atomic<quint64> m_head{0};
+  alignas(64) quint64 m_tail = 0;
+  std::atomic<int> m_minimumSeverity;
+  std::atomic<quint64> m_dropped{0};
+  std::atomic<bool> m_running{false};
+  std::atomic<bool> m_stopped{false};
+  std::atomic<int> m_producers{0};
+  QSemaphore m_wakeup;
+
+  QThread *m_writer;
+  QFile m_file;
+  QString m_filePath;
+  qint64 m_maxFileSize;
+  int m_maxBackups;
+};
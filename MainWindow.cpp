@@ -8,13 +8,17 @@
 #include <QtWidgets/QToolButton>
 #include <QtWidgets/QMenuBar>
 #include <QtWidgets/QMenu>
+#include <QtWidgets/QScrollBar>
+#include <QtWidgets/QStatusBar>
 #include <QtCore/QDebug>
 #include <QtCore/QStandardPaths>
 #include <QtCore/QDir>
+#include <QtCore/QLocale>
 #include <QtSvg/QSvgRenderer>
 #include <QtWidgets/QFileDialog>
 #include <QtWidgets/QMessageBox>
-#include <QtPrintSupport/QPrinter>
+#include <QtGui/QPdfWriter>
+#include <QtCore/QBuffer>
 #include <QtGui/QPainter>
 #include <QtCore/QPropertyAnimation>
 #include <QtCore/QParallelAnimationGroup>
@@ -23,20 +27,8 @@
 // Test comment to verify watch script
 // Another test comment to verify rebuild
 MainWindow::MainWindow(QWidget *parent)
-    : QMainWindow(parent), m_editorWidget(new EditorWidget(this)), m_fileTreeWidget(new FileTreeWidget(this)), m_welcomeWidget(new WelcomeWidget(this)), m_formatToolBar(nullptr), m_isDistractionFree(false), m_distractionFreeMarginChars(80), m_wasToolbarVisible(true), m_wasSidebarVisible(true)
+    : QMainWindow(parent), m_editorWidget(new EditorWidget(this)), m_fileTreeWidget(new FileTreeWidget(this)), m_welcomeWidget(new WelcomeWidget(this)), m_autosave(new AutosaveScheduler(this)), m_journal(new EditJournal(this)), m_loader(new DocumentLoader(this)), m_documentCache(new DocumentCache(this)), m_searchIndex(new SearchIndex(this)), m_searchPanel(new SearchPanel(m_searchIndex, this)), m_quickOpen(new QuickOpenPalette(this)), m_replaceDialog(new CorpusReplaceDialog(m_fileTreeWidget, this)), m_largeFileSaveTimer(new QTimer(this)), m_stats(new DocumentStats(this)), m_statsLabel(new QLabel(this)), m_formatToolBar(nullptr), m_isDistractionFree(false), m_distractionFreeMarginChars(80), m_wasToolbarVisible(true), m_wasSidebarVisible(true)
 {
-    // Set up logging to file
-    static QFile logFile(QDir::homePath() + "/Documents/WriteHand/writehand.log");
-    if (logFile.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text))
-    {
-        qInstallMessageHandler([](QtMsgType type, const QMessageLogContext &context, const QString &msg)
-                               {
-            static QTextStream stream(&logFile);
-            stream << QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss.zzz ")
-                  << msg << Qt::endl;
-            stream.flush(); });
-    }
-
     setupMenuBar();
 
     // Create a container widget for the editor area
@@ -55,7 +47,9 @@ MainWindow::MainWindow(QWidget *parent)
     // Create a splitter
     QSplitter *splitter = new QSplitter(Qt::Horizontal, contentContainer);
     splitter->addWidget(m_fileTreeWidget);
+    splitter->addWidget(m_searchPanel);
     splitter->addWidget(editorContainer);
+    m_searchPanel->hide();
 
     // Style the splitter
     splitter->setStyleSheet(
@@ -86,15 +80,62 @@ MainWindow::MainWindow(QWidget *parent)
     setCentralWidget(contentContainer);
     setupToolbar();
 
+    m_statsLabel->setContentsMargins(12, 3, 12, 3);
+    statusBar()->setSizeGripEnabled(false);
+    statusBar()->setStyleSheet("QStatusBar::item { border: none; }");
+    statusBar()->addWidget(m_statsLabel, 1);
+
     // Connect signals
     connect(m_fileTreeWidget, &FileTreeWidget::fileSelected, this, &MainWindow::onFileSelected);
     connect(m_fileTreeWidget, &FileTreeWidget::fileCreated, this, &MainWindow::onFileCreated);
     connect(m_fileTreeWidget, &FileTreeWidget::fileRenamed, this, &MainWindow::onFileRenamed);
     connect(m_fileTreeWidget, &FileTreeWidget::fileDeleted, this, &MainWindow::onFileDeleted);
+    connect(m_searchPanel, &SearchPanel::fileSelected, this, &MainWindow::onFileSelected);
+    connect(m_quickOpen, &QuickOpenPalette::fileSelected, this, &MainWindow::onFileSelected);
+    connect(m_replaceDialog, &CorpusReplaceDialog::fileSelected, this, &MainWindow::onFileSelected);
+    connect(m_replaceDialog, &CorpusReplaceDialog::filesReplaced, this, &MainWindow::onFilesReplaced);
     connect(m_editorWidget, &EditorWidget::contentChanged, this, &MainWindow::onContentChanged);
     connect(m_welcomeWidget, &WelcomeWidget::newFileRequested, m_fileTreeWidget, &FileTreeWidget::createNewFile);
     connect(&ThemeManager::instance(), &ThemeManager::themeChanged, this, &MainWindow::onThemeChanged);
 
+    // The journal makes every edit durable within a fraction of a second, so
+    // full-file autosaves only need to happen occasionally to compact it
+    m_autosave->setIdleInterval(5000);
+    m_autosave->setMaxLatency(60000);
+    connect(m_autosave, &AutosaveScheduler::snapshotTaken, m_journal, &EditJournal::checkpoint);
+    connect(m_autosave, &AutosaveScheduler::saveCompleted, m_journal,
+            [this](const QString &filePath, bool ok, qint64, int, const QByteArray &checksum)
+            {
+                m_journal->compact(ok, checksum);
+                if (filePath == m_currentFile)
+                    m_currentChecksum = ok ? checksum : QByteArray();
+                if (ok)
+                    m_fileTreeWidget->noteFileSaved(filePath);
+            });
+    connect(m_journal, &EditJournal::compactionRequested, m_autosave, &AutosaveScheduler::flush);
+
+    // Large files have no journal, so they are written out once typing pauses
+    m_largeFileSaveTimer->setSingleShot(true);
+    m_largeFileSaveTimer->setInterval(5000);
+    connect(m_largeFileSaveTimer, &QTimer::timeout, this, &MainWindow::saveLargeFile);
+
+    connect(m_stats, &DocumentStats::changed, this, &MainWindow::updateStatistics);
+
+    // Indexes the locations' documents in the background, starting with
+    // whatever changed since the last run
+    for (const MetadataIndex *index : m_fileTreeWidget->locationIndexes())
+    {
+        m_searchIndex->addSource(index);
+        m_quickOpen->addSource(index);
+    }
+    m_quickOpen->setSubfolderFiles(m_fileTreeWidget->subfolderFiles());
+    connect(m_fileTreeWidget, &FileTreeWidget::subfolderFilesChanged, this, [this]()
+            { m_quickOpen->setSubfolderFiles(m_fileTreeWidget->subfolderFiles()); });
+
+    connect(m_loader, &DocumentLoader::previewReady, this, &MainWindow::onDocumentPreview);
+    connect(m_loader, &DocumentLoader::loaded, this, &MainWindow::onDocumentLoaded);
+    connect(m_loader, &DocumentLoader::failed, this, &MainWindow::onDocumentLoadFailed);
+
     // Check for existing files
     QString appPath = QDir::homePath() + "/Documents/WriteHand";
     QDir appDir(appPath);
@@ -105,11 +146,17 @@ MainWindow::MainWindow(QWidget *parent)
         appDir.mkpath(".");
     }
 
-    QStringList filters;
-    filters << "*.txt" << "*.md" << "*.rtf" << "*.html" << "*.markdown" << "*.text";
-    QFileInfoList files = appDir.entryInfoList(filters, QDir::Files, QDir::Time); // Sort by time, newest first
+    // Replay edits that were journaled but never saved before a crash
+    QStringList recovered = EditJournal::recover();
+    if (!recovered.isEmpty())
+    {
+        qDebug() << "Recovered unsaved edits in" << recovered;
+    }
+
+    // Served from the location's metadata index, newest first
+    QString mostRecent = m_fileTreeWidget->mostRecentFile();
 
-    if (files.isEmpty())
+    if (mostRecent.isEmpty())
     {
         // Show welcome widget if no files exist
         stackedLayout->setCurrentWidget(m_welcomeWidget);
@@ -122,7 +169,7 @@ MainWindow::MainWindow(QWidget *parent)
         stackedLayout->setCurrentWidget(m_editorWidget);
         m_welcomeWidget->hide();
         m_editorWidget->show();
-        onFileSelected(files.first().filePath());
+        onFileSelected(mostRecent);
     }
 
     setWindowTitle("WriteHand");
@@ -136,6 +183,7 @@ MainWindow::MainWindow(QWidget *parent)
     // Install event filter for hover zones
     m_topHoverZone->installEventFilter(this);
     m_bottomHoverZone->installEventFilter(this);
+    m_statsLabel->installEventFilter(this);
 }
 
 void MainWindow::updateTheme()
@@ -147,6 +195,7 @@ void MainWindow::updateTheme()
     {
         m_formatToolBar->setStyleSheet(theme.getStyleSheet("toolbar"));
     }
+    m_statsLabel->setStyleSheet(theme.getStyleSheet("wordCount"));
 }
 
 void MainWindow::onThemeChanged(bool isDarkMode)
@@ -218,6 +267,18 @@ void MainWindow::showEditorContextMenu(const QPoint &pos)
 {
     QMenu *menu = m_editorWidget->editor()->createStandardContextMenu();
 
+    // The document's own undo stack is off, so point Undo and Redo at ours
+    for (QAction *action : menu->actions())
+    {
+        if (action->objectName() == "edit-undo" || action->objectName() == "edit-redo")
+        {
+            bool isUndo = action->objectName() == "edit-undo";
+            disconnect(action, &QAction::triggered, nullptr, nullptr);
+            action->setEnabled(isUndo ? m_editorWidget->canUndo() : m_editorWidget->canRedo());
+            connect(action, &QAction::triggered, m_editorWidget, isUndo ? &EditorWidget::undo : &EditorWidget::redo);
+        }
+    }
+
     // Add separator before formatting actions
     menu->addSeparator();
 
@@ -239,37 +300,97 @@ void MainWindow::showEditorContextMenu(const QPoint &pos)
 void MainWindow::onFileSelected(const QString &filePath)
 {
     saveCurrentFile(); // Save current file before switching
+    stashCurrentDocument();
+
+    // Reading a large file back before its last save lands would show the old text
+    if (filePath == m_largeFileSavePath)
+        m_largeFileSave.waitForFinished();
     m_currentFile = filePath;
+    detachDocument();
 
-    QFile file(filePath);
-    if (file.open(QIODevice::ReadOnly))
+    bool isRichText = filePath.endsWith(".rtf", Qt::CaseInsensitive);
+    DocumentCache::Entry cached = m_documentCache->take(filePath);
+    if (EditorWidget::wantsLargeFileMode(filePath))
     {
-        QTextStream in(&file);
-        bool isRichText = filePath.endsWith(".rtf", Qt::CaseInsensitive);
-        m_editorWidget->setContent(in.readAll(), isRichText);
-        file.close();
-
-        // Switch to editor widget
-        QStackedLayout *stackedLayout = qobject_cast<QStackedLayout *>(m_editorWidget->parentWidget()->layout());
-        if (stackedLayout)
+        // Edited in place over the mapped file; the cache, autosave and
+        // journal all work on QTextDocuments and stay detached
+        m_loader->cancel();
+        delete cached.document;
+        QString error;
+        if (!m_editorWidget->openLargeFile(filePath, &error))
         {
-            stackedLayout->setCurrentWidget(m_editorWidget);
-            m_welcomeWidget->hide();
-            m_editorWidget->show();
+            onDocumentLoadFailed(filePath, error);
+            return;
         }
+    }
+    else if (cached.document)
+    {
+        m_loader->cancel();
+        m_editorWidget->setDocument(cached.document, cached.cursor, cached.scrollValue);
+        attachDocument(filePath, isRichText, cached.checksum);
+    }
+    else
+    {
+        // Nothing may save or journal the editor while it only holds part of the file
+        m_editorWidget->beginLoading();
+        m_loader->load(filePath, isRichText);
+    }
 
-        setWindowTitle("WriteHand - " + QFileInfo(filePath).fileName());
+    // Switch to editor widget
+    QStackedLayout *stackedLayout = qobject_cast<QStackedLayout *>(m_editorWidget->parentWidget()->layout());
+    if (stackedLayout)
+    {
+        stackedLayout->setCurrentWidget(m_editorWidget);
+        m_welcomeWidget->hide();
+        m_editorWidget->show();
+    }
+
+    setWindowTitle("WriteHand - " + QFileInfo(filePath).fileName());
+
+    // Select the file in the tree
+    m_fileTreeWidget->selectFile(filePath);
+}
+
+void MainWindow::onDocumentPreview(const QString &filePath, const QString &text)
+{
+    if (filePath == m_currentFile)
+    {
+        m_editorWidget->showPreview(text);
+    }
+}
 
-        // Select the file in the tree
-        m_fileTreeWidget->selectFile(filePath);
+void MainWindow::onDocumentLoaded(const QString &filePath, QTextDocument *document, const QByteArray &checksum)
+{
+    if (filePath != m_currentFile)
+    {
+        delete document;
+        return;
+    }
+
+    m_editorWidget->setDocument(document);
+    attachDocument(filePath, filePath.endsWith(".rtf", Qt::CaseInsensitive), checksum);
+}
+
+void MainWindow::onDocumentLoadFailed(const QString &filePath, const QString &error)
+{
+    qWarning() << "Could not open" << filePath << ":" << error;
+    if (filePath == m_currentFile)
+    {
+        m_currentFile.clear();
+        m_editorWidget->clear();
+        setWindowTitle("WriteHand");
+        QMessageBox::warning(this, tr("Open File"), tr("Could not open %1:\n%2").arg(QFileInfo(filePath).fileName(), error));
     }
 }
 
 void MainWindow::onFileCreated(const QString &filePath)
 {
     saveCurrentFile();
+    stashCurrentDocument();
+    m_loader->cancel();
     m_currentFile = filePath;
     m_editorWidget->clear();
+    attachDocument(filePath, filePath.endsWith(".rtf", Qt::CaseInsensitive), EditJournal::checksum(QByteArray()));
 
     // Switch to editor widget
     QStackedLayout *stackedLayout = qobject_cast<QStackedLayout *>(m_editorWidget->parentWidget()->layout());
@@ -293,26 +414,34 @@ void MainWindow::onFileRenamed(const QString &oldPath, const QString &newPath)
     if (m_currentFile == oldPath)
     {
         m_currentFile = newPath;
+        m_autosave->setFilePath(newPath);
+        m_journal->setFilePath(newPath);
+        if (!m_editorWidget->isLargeFileMode() && !m_loader->isLoading())
+            m_editorWidget->setMarkdownHighlighting(MarkdownHighlighter::isMarkdownFile(newPath));
         setWindowTitle("WriteHand - " + QFileInfo(newPath).fileName());
     }
+    else
+    {
+        m_documentCache->rename(oldPath, newPath);
+    }
 }
 
 void MainWindow::onFileDeleted(const QString &filePath)
 {
+    m_documentCache->remove(filePath);
     if (m_currentFile == filePath)
     {
+        // Detach autosave first so clearing the editor doesn't recreate the file
+        m_loader->cancel();
+        m_autosave->setDocument(nullptr, QString(), false);
+        m_journal->discard();
         m_currentFile.clear();
         m_editorWidget->clear();
 
         // Check if this was the last file
-        QString appPath = QDir::homePath() + "/Documents/WriteHand";
-        QDir appDir(appPath);
+        QString mostRecent = m_fileTreeWidget->mostRecentFile();
 
-        QStringList filters;
-        filters << "*.txt" << "*.md" << "*.rtf" << "*.html" << "*.markdown" << "*.text";
-        QFileInfoList files = appDir.entryInfoList(filters, QDir::Files, QDir::Time);
-
-        if (files.isEmpty())
+        if (mostRecent.isEmpty())
         {
             // Show welcome widget if no files exist
             QStackedLayout *stackedLayout = qobject_cast<QStackedLayout *>(m_editorWidget->parentWidget()->layout());
@@ -327,14 +456,17 @@ void MainWindow::onFileDeleted(const QString &filePath)
         else
         {
             // Open the most recently modified file
-            onFileSelected(files.first().filePath());
+            onFileSelected(mostRecent);
         }
     }
 }
 
 void MainWindow::onContentChanged()
 {
-    saveCurrentFile();
+    if (m_editorWidget->isLargeFileMode())
+        m_largeFileSaveTimer->start();
+    else
+        m_autosave->markDirty();
 }
 
 void MainWindow::saveCurrentFile()
@@ -342,14 +474,84 @@ void MainWindow::saveCurrentFile()
     if (m_currentFile.isEmpty())
         return;
 
-    QFile file(m_currentFile);
-    if (!file.open(QIODevice::WriteOnly))
+    if (m_editorWidget->isLargeFileMode())
+    {
+        saveLargeFile();
         return;
+    }
 
-    QTextStream out(&file);
-    bool isRichText = m_currentFile.endsWith(".rtf", Qt::CaseInsensitive);
-    out << m_editorWidget->content(isRichText);
-    file.close();
+    // Blocks until any pending edits are on disk
+    m_autosave->flushNow();
+}
+
+void MainWindow::saveLargeFile()
+{
+    m_largeFileSaveTimer->stop();
+    LargeFileView *view = m_editorWidget->largeFileView();
+    if (m_currentFile.isEmpty() || !m_editorWidget->isLargeFileMode() || !view->isModified())
+        return;
+
+    // Streamed out on the writer thread; DocumentWriter logs any failure
+    QString filePath = m_currentFile;
+    m_largeFileSave = view->save(filePath);
+    m_largeFileSavePath = filePath;
+    m_largeFileSave.then(this, [this, filePath](const DocumentWriter::Result &result)
+                         {
+        if (result.ok)
+            m_fileTreeWidget->noteFileSaved(filePath); });
+}
+
+void MainWindow::attachDocument(const QString &filePath, bool isRichText, const QByteArray &baseChecksum)
+{
+    QTextDocument *document = m_editorWidget->editor()->document();
+    m_editorWidget->attachUndoHistory(isRichText);
+    m_autosave->setDocument(document, filePath, isRichText);
+    m_journal->attach(document, filePath, isRichText, baseChecksum);
+    m_currentChecksum = baseChecksum;
+    m_replaceDialog->setOpenDocument(filePath, document);
+    m_stats->setDocument(document);
+    m_editorWidget->setMarkdownHighlighting(MarkdownHighlighter::isMarkdownFile(filePath));
+}
+
+void MainWindow::detachDocument()
+{
+    // Unsaved journal records stay on disk for recovery
+    m_autosave->setDocument(nullptr, QString(), false);
+    m_journal->attach(nullptr, QString(), false, QByteArray());
+    m_currentChecksum.clear();
+    m_replaceDialog->setOpenDocument(QString(), nullptr);
+    m_stats->setDocument(nullptr);
+}
+
+void MainWindow::updateStatistics()
+{
+    // Large files and documents still loading aren't counted
+    if (!m_stats->document())
+    {
+        m_statsLabel->clear();
+        return;
+    }
+
+    const DocumentStats::Counts &counts = m_stats->counts();
+    QLocale locale;
+    m_statsLabel->setText(tr("%1 words  ·  %2 characters  ·  %3 sentences  ·  %4 paragraphs")
+                              .arg(locale.toString(counts.words), locale.toString(counts.characters),
+                                   locale.toString(counts.sentences), locale.toString(counts.paragraphs)));
+}
+
+void MainWindow::stashCurrentDocument()
+{
+    // Only a fully loaded document that matches the file on disk is worth keeping
+    if (m_currentFile.isEmpty() || m_loader->isLoading() || m_currentChecksum.isEmpty())
+        return;
+
+    QTextEdit *editor = m_editorWidget->editor();
+    DocumentCache::Entry entry;
+    entry.document = m_editorWidget->document();
+    entry.checksum = m_currentChecksum;
+    entry.cursor = editor->textCursor();
+    entry.scrollValue = editor->verticalScrollBar()->value();
+    m_documentCache->insert(m_currentFile, entry);
 }
 
 void MainWindow::toggleSidebar()
@@ -357,6 +559,48 @@ void MainWindow::toggleSidebar()
     m_fileTreeWidget->setVisible(!m_fileTreeWidget->isVisible());
 }
 
+void MainWindow::toggleSearchPanel()
+{
+    // A second press closes it only once the search box has focus
+    if (m_searchPanel->isVisible() && m_searchPanel->isAncestorOf(QApplication::focusWidget()))
+    {
+        m_searchPanel->hide();
+        m_editorWidget->editor()->setFocus();
+        return;
+    }
+    m_searchPanel->show();
+    m_searchPanel->focusQuery();
+}
+
+void MainWindow::showReplaceInDocuments()
+{
+    m_replaceDialog->show();
+    m_replaceDialog->raise();
+    m_replaceDialog->activateWindow();
+}
+
+void MainWindow::onFilesReplaced(const QStringList &filePaths)
+{
+    for (const QString &filePath : filePaths)
+    {
+        m_documentCache->remove(filePath);
+        m_fileTreeWidget->noteFileSaved(filePath);
+    }
+
+    // Still loading the old contents; start over from the new ones
+    if (filePaths.contains(m_currentFile) && m_loader->isLoading())
+        m_loader->load(m_currentFile, m_currentFile.endsWith(".rtf", Qt::CaseInsensitive));
+
+    // A large file still shows the old mapping; reopen it unless it has edits of its own
+    if (filePaths.contains(m_currentFile) && m_editorWidget->isLargeFileMode() &&
+        !m_editorWidget->largeFileView()->isModified())
+    {
+        QString error;
+        if (!m_editorWidget->openLargeFile(m_currentFile, &error))
+            onDocumentLoadFailed(m_currentFile, error);
+    }
+}
+
 void MainWindow::setBold()
 {
     QTextCharFormat format;
@@ -395,6 +639,11 @@ void MainWindow::setupMenuBar()
     connect(openAction, &QAction::triggered, this, &MainWindow::openFile);
     fileMenu->addAction(openAction);
 
+    QAction *quickOpenAction = new QAction("Quick Open...", this);
+    quickOpenAction->setShortcut(QKeySequence("Ctrl+P"));
+    connect(quickOpenAction, &QAction::triggered, m_quickOpen, &QuickOpenPalette::popup);
+    fileMenu->addAction(quickOpenAction);
+
     fileMenu->addSeparator();
 
     QAction *saveAction = new QAction("Save", this);
@@ -424,36 +673,36 @@ void MainWindow::setupMenuBar()
     QMenu *editMenu = menuBar->addMenu("Edit");
     QAction *undoAction = new QAction("Undo", this);
     undoAction->setShortcut(QKeySequence::Undo);
-    connect(undoAction, &QAction::triggered, m_editorWidget->editor(), &QTextEdit::undo);
+    connect(undoAction, &QAction::triggered, m_editorWidget, &EditorWidget::undo);
     editMenu->addAction(undoAction);
 
     QAction *redoAction = new QAction("Redo", this);
     redoAction->setShortcut(QKeySequence::Redo);
-    connect(redoAction, &QAction::triggered, m_editorWidget->editor(), &QTextEdit::redo);
+    connect(redoAction, &QAction::triggered, m_editorWidget, &EditorWidget::redo);
     editMenu->addAction(redoAction);
 
     editMenu->addSeparator();
 
     QAction *cutAction = new QAction("Cut", this);
     cutAction->setShortcut(QKeySequence::Cut);
-    connect(cutAction, &QAction::triggered, m_editorWidget->editor(), &QTextEdit::cut);
+    connect(cutAction, &QAction::triggered, m_editorWidget, &EditorWidget::cut);
     editMenu->addAction(cutAction);
 
     QAction *copyAction = new QAction("Copy", this);
     copyAction->setShortcut(QKeySequence::Copy);
-    connect(copyAction, &QAction::triggered, m_editorWidget->editor(), &QTextEdit::copy);
+    connect(copyAction, &QAction::triggered, m_editorWidget, &EditorWidget::copy);
     editMenu->addAction(copyAction);
 
     QAction *pasteAction = new QAction("Paste", this);
     pasteAction->setShortcut(QKeySequence::Paste);
-    connect(pasteAction, &QAction::triggered, m_editorWidget->editor(), &QTextEdit::paste);
+    connect(pasteAction, &QAction::triggered, m_editorWidget, &EditorWidget::paste);
     editMenu->addAction(pasteAction);
 
     editMenu->addSeparator();
 
     QAction *selectAllAction = new QAction("Select All", this);
     selectAllAction->setShortcut(QKeySequence::SelectAll);
-    connect(selectAllAction, &QAction::triggered, m_editorWidget->editor(), &QTextEdit::selectAll);
+    connect(selectAllAction, &QAction::triggered, m_editorWidget, &EditorWidget::selectAll);
     editMenu->addAction(selectAllAction);
 
     editMenu->addSeparator();
@@ -474,6 +723,16 @@ void MainWindow::setupMenuBar()
     connect(findPreviousAction, &QAction::triggered, m_editorWidget, &EditorWidget::findPrevious);
     editMenu->addAction(findPreviousAction);
 
+    QAction *searchAllAction = new QAction("Search All Documents...", this);
+    searchAllAction->setShortcut(QKeySequence("Ctrl+Shift+F"));
+    connect(searchAllAction, &QAction::triggered, this, &MainWindow::toggleSearchPanel);
+    editMenu->addAction(searchAllAction);
+
+    QAction *replaceAllDocumentsAction = new QAction("Replace in Documents...", this);
+    replaceAllDocumentsAction->setShortcut(QKeySequence("Ctrl+Shift+H"));
+    connect(replaceAllDocumentsAction, &QAction::triggered, this, &MainWindow::showReplaceInDocuments);
+    editMenu->addAction(replaceAllDocumentsAction);
+
     editMenu->addSeparator();
 
     // Add Preferences to Edit menu
@@ -574,6 +833,20 @@ void MainWindow::showPreferences()
         m_editorWidget->editor()->setFont(newFont); });
     editorLayout->addRow("Font Size:", fontSizeSpinner);
 
+    // Undo history
+    QSpinBox *undoBudgetSpinner = new QSpinBox(editorGroup);
+    undoBudgetSpinner->setRange(4, 1024);
+    undoBudgetSpinner->setSuffix(" MB");
+    undoBudgetSpinner->setValue(int(m_editorWidget->undoBudget() / (1024 * 1024)));
+    connect(undoBudgetSpinner, QOverload<int>::of(&QSpinBox::valueChanged), [this](int megabytes)
+            { m_editorWidget->setUndoBudget(qint64(megabytes) * 1024 * 1024); });
+    editorLayout->addRow("Undo Memory:", undoBudgetSpinner);
+
+    QCheckBox *undoSpillCheckbox = new QCheckBox("Keep older undo history on disk", editorGroup);
+    undoSpillCheckbox->setChecked(m_editorWidget->undoSpillsToDisk());
+    connect(undoSpillCheckbox, &QCheckBox::toggled, m_editorWidget, &EditorWidget::setUndoSpillToDisk);
+    editorLayout->addRow("", undoSpillCheckbox);
+
     layout->addWidget(editorGroup);
 
     // Add Distraction Free section
@@ -646,6 +919,10 @@ void MainWindow::openFile()
 
 void MainWindow::saveAs()
 {
+    // The editor only holds part of the file until loading finishes
+    if (m_loader->isLoading())
+        return;
+
     QString defaultPath;
     if (!m_currentFile.isEmpty())
     {
@@ -665,31 +942,87 @@ void MainWindow::saveAs()
 
     if (!filePath.isEmpty())
     {
-        // Save the file
-        QFile file(filePath);
-        if (file.open(QIODevice::WriteOnly))
-        {
-            QTextStream out(&file);
-            bool isRichText = filePath.endsWith(".rtf", Qt::CaseInsensitive);
-            out << m_editorWidget->content(isRichText);
-            file.close();
+        // Finish the pending autosave of the old file before retargeting
+        saveCurrentFile();
 
-            // Update current file and window title
+        if (m_editorWidget->isLargeFileMode())
+        {
+            // Switch over now and back again if the write fails
+            QString previousFile = m_currentFile;
             m_currentFile = filePath;
             setWindowTitle("WriteHand - " + QFileInfo(filePath).fileName());
+            m_largeFileSave = m_editorWidget->largeFileView()->save(filePath);
+            m_largeFileSavePath = filePath;
+            m_largeFileSave.then(this, [this, filePath, previousFile](const DocumentWriter::Result &result)
+                                 {
+                if (result.ok)
+                {
+                    m_fileTreeWidget->noteFileSaved(filePath);
+                    if (m_currentFile == filePath)
+                        m_fileTreeWidget->selectFile(filePath);
+                    return;
+                }
+                if (m_currentFile == filePath)
+                {
+                    m_currentFile = previousFile;
+                    setWindowTitle("WriteHand - " + QFileInfo(previousFile).fileName());
+                }
+                QMessageBox::warning(this, tr("Error"), tr("Could not save file:\n%1").arg(result.error)); });
+            return;
+        }
+
+        // Save the file
+        bool isRichText = filePath.endsWith(".rtf", Qt::CaseInsensitive);
+        QByteArray data = m_editorWidget->content(isRichText).toUtf8();
+        QFuture<DocumentWriter::Result> saved = DocumentWriter::instance().write(filePath, data);
+
+        // Autosaves to the new path queue up behind this write, so the
+        // editor can switch over without waiting for the disk, and back
+        // again if the write fails
+        QString previousFile = m_currentFile;
+        QByteArray previousChecksum = m_currentChecksum;
+        m_currentFile = filePath;
+        attachDocument(filePath, isRichText, EditJournal::checksum(data));
+        setWindowTitle("WriteHand - " + QFileInfo(filePath).fileName());
+
+        saved.then(this, [this, filePath, previousFile, previousChecksum](const DocumentWriter::Result &result)
+                   {
+            if (!result.ok)
+            {
+                if (m_currentFile == filePath)
+                {
+                    // Edits made since belong to the old file now, so it is left unsaved
+                    m_journal->discard();
+                    m_currentFile = previousFile;
+                    if (previousFile.isEmpty())
+                    {
+                        detachDocument();
+                        setWindowTitle("WriteHand");
+                    }
+                    else
+                    {
+                        attachDocument(previousFile, previousFile.endsWith(".rtf", Qt::CaseInsensitive), previousChecksum);
+                        setWindowTitle("WriteHand - " + QFileInfo(previousFile).fileName());
+                        m_autosave->markDirty();
+                    }
+                }
+                QMessageBox::warning(this, tr("Error"), tr("Could not save file:\n%1").arg(result.error));
+                return;
+            }
+            m_fileTreeWidget->noteFileSaved(filePath);
 
             // Update file tree
-            m_fileTreeWidget->selectFile(filePath);
-        }
-        else
-        {
-            QMessageBox::warning(this, tr("Error"), tr("Could not save file."));
-        }
+            if (m_currentFile == filePath)
+                m_fileTreeWidget->selectFile(filePath); });
     }
 }
 
 void MainWindow::exportFile()
 {
+    // The editor only holds part of the file until loading finishes
+    if (m_loader->isLoading())
+        return;
+
     QString defaultPath;
     if (!m_currentFile.isEmpty())
     {
@@ -709,18 +1042,45 @@ void MainWindow::exportFile()
 
     if (!filePath.isEmpty())
     {
+        if (m_editorWidget->isLargeFileMode())
+        {
+            // There is no QTextDocument to print or convert, only the text itself
+            if (filePath.endsWith(".pdf", Qt::CaseInsensitive) || filePath.endsWith(".docx", Qt::CaseInsensitive))
+            {
+                QMessageBox::warning(this, tr("Error"), tr("Large files can only be exported as plain text."));
+                return;
+            }
+            DocumentWriter::instance()
+                .write(filePath, m_editorWidget->largeFileView()->pieceTable().snapshot())
+                .then(this, [this](const DocumentWriter::Result &result)
+                      {
+                    if (!result.ok)
+                        QMessageBox::warning(this, tr("Error"), tr("Could not export file:\n%1").arg(result.error)); });
+            return;
+        }
+
+        auto reportFailure = [this](const DocumentWriter::Result &result)
+        {
+            if (!result.ok)
+                QMessageBox::warning(this, tr("Error"), tr("Could not export file:\n%1").arg(result.error));
+        };
+
         if (filePath.endsWith(".pdf", Qt::CaseInsensitive))
         {
-            // Export as PDF
-            QPrinter printer(QPrinter::HighResolution);
-            printer.setOutputFormat(QPrinter::PdfFormat);
-            printer.setOutputFileName(filePath);
+            // Export as PDF, rendered in memory so the writer can replace the file in one go
+            QByteArray pdf;
+            {
+                QBuffer buffer(&pdf);
+                buffer.open(QIODevice::WriteOnly);
+                QPdfWriter writer(&buffer);
 
-            // Set page size and margins
-            printer.setPageSize(QPageSize(QPageSize::A4));
-            printer.setPageMargins(QMarginsF(20, 20, 20, 20), QPageLayout::Millimeter);
+                // Set page size and margins
+                writer.setPageSize(QPageSize(QPageSize::A4));
+                writer.setPageMargins(QMarginsF(20, 20, 20, 20), QPageLayout::Millimeter);
 
-            m_editorWidget->editor()->document()->print(&printer);
+                m_editorWidget->editor()->document()->print(&writer);
+            }
+            DocumentWriter::instance().write(filePath, pdf).then(this, reportFailure);
         }
         else if (filePath.endsWith(".docx", Qt::CaseInsensitive))
         {
@@ -728,37 +1088,28 @@ void MainWindow::exportFile()
             QString htmlPath = filePath;
             htmlPath.replace(".docx", ".html");
 
-            QFile file(htmlPath);
-            if (file.open(QIODevice::WriteOnly))
-            {
-                QTextStream out(&file);
-                out << m_editorWidget->editor()->toHtml();
-                file.close();
-
+            QByteArray html = m_editorWidget->editor()->toHtml().toUtf8();
+            DocumentWriter::instance().write(htmlPath, html).then(this, [this, htmlPath, reportFailure](const DocumentWriter::Result &result)
+                                                                  {
+                if (!result.ok)
+                {
+                    reportFailure(result);
+                    return;
+                }
                 QMessageBox::information(this, tr("Export as Word"),
                                          tr("The document has been exported as HTML. To convert to Word format:\n\n"
                                             "1. Open Microsoft Word or LibreOffice\n"
                                             "2. Open the saved HTML file\n"
                                             "3. Save as DOCX\n\n"
                                             "The HTML file has been saved as: %1")
-                                             .arg(htmlPath));
-            }
+                                             .arg(htmlPath)); });
         }
         else
         {
             // Handle other formats as before
-            QFile file(filePath);
-            if (file.open(QIODevice::WriteOnly))
-            {
-                QTextStream out(&file);
-                bool isRichText = filePath.endsWith(".rtf", Qt::CaseInsensitive);
-                out << m_editorWidget->content(isRichText);
-                file.close();
-            }
-            else
-            {
-                QMessageBox::warning(this, tr("Error"), tr("Could not export file."));
-            }
+            bool isRichText = filePath.endsWith(".rtf", Qt::CaseInsensitive);
+            QByteArray data = m_editorWidget->content(isRichText).toUtf8();
+            DocumentWriter::instance().write(filePath, data).then(this, reportFailure);
         }
     }
 }
@@ -969,6 +1320,12 @@ void MainWindow::enterDistractionFreeMode()
     m_overlay->hide();
     m_fileTreeWidget->hide();
 
+    // Statistics float over the bottom edge instead, shown on hover
+    statusBar()->removeWidget(m_statsLabel);
+    m_statsLabel->setParent(this);
+    m_statsLabel->hide();
+    statusBar()->hide();
+
     // Show hover zones
     updateHoverZones();
 
@@ -1004,6 +1361,9 @@ void MainWindow::exitDistractionFreeMode()
         m_formatToolBar->show();
     if (m_wasSidebarVisible)
         m_fileTreeWidget->show();
+    statusBar()->addWidget(m_statsLabel, 1);
+    m_statsLabel->show();
+    statusBar()->show();
 
     // Hide overlay and hover zones
     m_overlay->hide();
@@ -1017,6 +1377,12 @@ void MainWindow::exitDistractionFreeMode()
         m_distractionFreeAction->setChecked(false);
 }
 
+void MainWindow::closeEvent(QCloseEvent *event)
+{
+    saveCurrentFile();
+    QMainWindow::closeEvent(event);
+}
+
 void MainWindow::resizeEvent(QResizeEvent *event)
 {
     QMainWindow::resizeEvent(event);
@@ -1093,13 +1459,32 @@ bool MainWindow::eventFilter(QObject *obj, QEvent *event)
                 return true;
             }
         }
+        else if (obj == m_statsLabel && event->type() == QEvent::Leave)
+        {
+            handleBottomHover(false);
+            return true;
+        }
     }
     return QMainWindow::eventFilter(obj, event);
 }
 
 void MainWindow::handleBottomHover(bool entered)
 {
-    // TODO: Implement status bar show/hide when we add it
+    if (!m_isDistractionFree)
+        return;
+
+    if (entered)
+    {
+        int labelHeight = m_statsLabel->sizeHint().height();
+        m_statsLabel->setGeometry(0, height() - labelHeight, width(), labelHeight);
+        m_statsLabel->show();
+        m_statsLabel->raise();
+    }
+    else if (!m_statsLabel->rect().contains(m_statsLabel->mapFromGlobal(QCursor::pos())))
+    {
+        // The label covers the hover zone, so leaving the zone can mean entering it
+        m_statsLabel->hide();
+    }
 }
 
 void MainWindow::keyPressEvent(QKeyEvent *event)
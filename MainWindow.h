@@ -10,13 +10,26 @@
 #include <QtWidgets/QFontComboBox>
 #include <QtWidgets/QSpinBox>
 #include <QtWidgets/QPushButton>
+#include <QtWidgets/QLabel>
 #include <QtGui/QKeyEvent>
 #include <QtGui/QResizeEvent>
+#include <QtGui/QCloseEvent>
 #include <QShortcut>
+#include <QtCore/QTimer>
 #include "EditorWidget.h"
 #include "FileTreeWidget.h"
 #include "WelcomeWidget.h"
 #include "ThemeManager.h"
+#include "AutosaveScheduler.h"
+#include "EditJournal.h"
+#include "DocumentLoader.h"
+#include "DocumentCache.h"
+#include "SearchIndex.h"
+#include "SearchPanel.h"
+#include "QuickOpenPalette.h"
+#include "CorpusReplaceDialog.h"
+#include "DocumentStats.h"
+#include "DocumentWriter.h"
 
 class MainWindow : public QMainWindow
 {
@@ -31,7 +44,13 @@ private slots:
     void onFileRenamed(const QString &oldPath, const QString &newPath);
     void onFileDeleted(const QString &filePath);
     void onContentChanged();
+    void onDocumentPreview(const QString &filePath, const QString &text);
+    void onDocumentLoaded(const QString &filePath, QTextDocument *document, const QByteArray &checksum);
+    void onDocumentLoadFailed(const QString &filePath, const QString &error);
     void toggleSidebar();
+    void toggleSearchPanel();
+    void showReplaceInDocuments();
+    void onFilesReplaced(const QStringList &filePaths);
     void setBold();
     void setItalic();
     void setUnderline();
@@ -49,12 +68,18 @@ protected:
     bool eventFilter(QObject *obj, QEvent *event) override;
     void keyPressEvent(QKeyEvent *event) override;
     void resizeEvent(QResizeEvent *event) override;
+    void closeEvent(QCloseEvent *event) override;
 
 private:
     void setupToolbar();
     void setupMenuBar();
     void updateTheme();
     void saveCurrentFile();
+    void saveLargeFile();
+    void updateStatistics();
+    void attachDocument(const QString &filePath, bool isRichText, const QByteArray &baseChecksum);
+    void detachDocument();
+    void stashCurrentDocument();
     void setupDistractionFreeMode();
     void enterDistractionFreeMode();
     void exitDistractionFreeMode();
@@ -65,7 +90,22 @@ private:
     EditorWidget *m_editorWidget;
     FileTreeWidget *m_fileTreeWidget;
     WelcomeWidget *m_welcomeWidget;
+    AutosaveScheduler *m_autosave;
+    EditJournal *m_journal;
+    DocumentLoader *m_loader;
+    DocumentCache *m_documentCache;
+    SearchIndex *m_searchIndex;
+    SearchPanel *m_searchPanel;
+    QuickOpenPalette *m_quickOpen;
+    CorpusReplaceDialog *m_replaceDialog;
+    QTimer *m_largeFileSaveTimer;
+    // The large file's latest save, which reopening that file waits for
+    QFuture<DocumentWriter::Result> m_largeFileSave;
+    QString m_largeFileSavePath;
+    DocumentStats *m_stats;
+    QLabel *m_statsLabel; // In the status bar, or over the bottom edge in distraction-free mode
     QString m_currentFile;
+    QByteArray m_currentChecksum; // Of the current file's contents on disk
     QToolBar *m_formatToolBar;
     QAction *m_boldAction;
     QAction *m_italicAction;
@@ -0,0 +1,496 @@
+#include "MarkdownHighlighter.h"
+#include "ThemeManager.h"
+#include <QtGui/QFontDatabase>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QSignalBlocker>
+
+namespace
+{
+  // Idle highlighting per slice, and what an edit may spend past the
+  // blocks it touched before leaving the rest to the slices
+  const int SliceMs = 4;
+  const qint64 EditBudgetNs = 1000000;
+  // Inline markup isn't looked for in longer lines
+  const int MaxInlineLength = 10000;
+
+  void addRange(QList<QTextLayout::FormatRange> &ranges, int start, int length, const QTextCharFormat &format)
+  {
+    if (length <= 0)
+      return;
+    QTextLayout::FormatRange range;
+    range.start = start;
+    range.length = length;
+    range.format = format;
+    ranges.append(range);
+  }
+
+  int runLength(const QString &text, int i, int to, QChar c)
+  {
+    int run = 0;
+    while (i + run < to && text.at(i + run) == c)
+      ++run;
+    return run;
+  }
+
+  // Start of the next run of exactly run c's that can close a span opened
+  // at from, or -1
+  int findClosing(const QString &text, int from, int to, QChar c, int run, bool emphasis)
+  {
+    for (int j = from; j < to; ++j)
+    {
+      if (text.at(j) == u'\\' && c != u'`')
+      {
+        ++j;
+        continue;
+      }
+      if (text.at(j) != c)
+        continue;
+      int length = runLength(text, j, to, c);
+      bool closes = length == run;
+      if (closes && emphasis)
+      {
+        // Not after a space, and an underscore not inside a word
+        closes = j > from && !text.at(j - 1).isSpace() &&
+                 (c != u'_' || j + length >= to || !text.at(j + length).isLetterOrNumber());
+      }
+      if (closes)
+        return j;
+      j += length - 1;
+    }
+    return -1;
+  }
+}
+
+MarkdownHighlighter::MarkdownHighlighter(QObject *parent)
+    : QObject(parent), m_nextBlock(0), m_blockCount(0)
+{
+  m_sliceTimer.setSingleShot(true);
+  m_sliceTimer.setInterval(0);
+  connect(&m_sliceTimer, &QTimer::timeout, this, &MarkdownHighlighter::highlightSlice);
+
+  updateFormats();
+  connect(&ThemeManager::instance(), &ThemeManager::themeChanged, this, [this]()
+          {
+    updateFormats();
+    if (m_document)
+      restart(); });
+}
+
+bool MarkdownHighlighter::isMarkdownFile(const QString &filePath)
+{
+  return filePath.endsWith(".md", Qt::CaseInsensitive) || filePath.endsWith(".markdown", Qt::CaseInsensitive);
+}
+
+void MarkdownHighlighter::setDocument(QTextDocument *document)
+{
+  if (document == m_document)
+    return;
+  disconnect(m_connection);
+  m_sliceTimer.stop();
+  if (m_document)
+    clearFormats();
+  m_document = document;
+  if (!m_document)
+    return;
+
+  m_connection = connect(m_document, &QTextDocument::contentsChange, this, &MarkdownHighlighter::onContentsChange);
+  restart();
+}
+
+void MarkdownHighlighter::clearFormats()
+{
+  int dirtyFrom = -1;
+  int dirtyTo = -1;
+  for (QTextBlock block = m_document->begin(); block.isValid(); block = block.next())
+  {
+    QTextBlock target = block;
+    target.setUserState(-1);
+    QTextLayout *layout = block.layout();
+    if (layout->formats().isEmpty())
+      continue;
+    layout->clearFormats();
+    if (dirtyFrom < 0)
+      dirtyFrom = block.position();
+    dirtyTo = block.position() + block.length();
+  }
+  markDirty(dirtyFrom, dirtyTo);
+}
+
+void MarkdownHighlighter::restart()
+{
+  m_nextBlock = 0;
+  m_blockCount = m_document->blockCount();
+  m_sliceTimer.start();
+}
+
+void MarkdownHighlighter::updateFormats()
+{
+  ThemeManager &theme = ThemeManager::instance();
+  QColor accent(theme.getColor("accent"));
+  QColor secondary(theme.getColor("secondaryText"));
+
+  m_headingFormat = QTextCharFormat();
+  m_headingFormat.setFontWeight(QFont::Bold);
+  m_headingFormat.setForeground(accent);
+
+  m_markerFormat = QTextCharFormat();
+  m_markerFormat.setForeground(secondary);
+
+  m_emphasisFormat = QTextCharFormat();
+  m_emphasisFormat.setFontItalic(true);
+
+  m_strongFormat = QTextCharFormat();
+  m_strongFormat.setFontWeight(QFont::Bold);
+
+  m_strikeFormat = QTextCharFormat();
+  m_strikeFormat.setFontStrikeOut(true);
+
+  m_codeFormat = QTextCharFormat();
+  m_codeFormat.setFontFamilies({QFontDatabase::systemFont(QFontDatabase::FixedFont).family()});
+  m_codeFormat.setFontFixedPitch(true);
+  m_codeFormat.setBackground(QColor(theme.getColor("hover")));
+
+  m_linkFormat = QTextCharFormat();
+  m_linkFormat.setForeground(accent);
+  m_linkFormat.setFontUnderline(true);
+
+  m_urlFormat = QTextCharFormat();
+  m_urlFormat.setForeground(secondary);
+
+  m_quoteFormat = QTextCharFormat();
+  m_quoteFormat.setForeground(secondary);
+  m_quoteFormat.setFontItalic(true);
+}
+
+void MarkdownHighlighter::onContentsChange(int position, int charsRemoved, int charsAdded)
+{
+  Q_UNUSED(charsRemoved);
+  int count = m_document->blockCount();
+  int grown = count - m_blockCount;
+  m_blockCount = count;
+
+  // Blocks the slices haven't reached yet will be done when they are
+  QTextBlock block = m_document->findBlock(position);
+  int first = block.blockNumber();
+  if (first >= m_nextBlock)
+    return;
+  m_nextBlock = qMax(first, m_nextBlock + grown);
+
+  QTextBlock last = m_document->findBlock(position + charsAdded);
+  int lastNumber = last.isValid() ? last.blockNumber() : count - 1;
+
+  QElapsedTimer timer;
+  timer.start();
+  int dirtyFrom = -1;
+  int dirtyTo = -1;
+  bool stateChanged = false;
+  for (int number = first; block.isValid() && number < m_nextBlock; block = block.next(), ++number)
+  {
+    // Past the edit, only a block whose incoming state changed needs redoing
+    if (number > lastNumber)
+    {
+      if (!stateChanged)
+        break;
+      if (timer.nsecsElapsed() > EditBudgetNs)
+      {
+        m_nextBlock = number;
+        m_sliceTimer.start();
+        break;
+      }
+    }
+
+    bool formatsChanged = false;
+    stateChanged = highlightBlock(block, &formatsChanged);
+    if (formatsChanged)
+    {
+      if (dirtyFrom < 0)
+        dirtyFrom = block.position();
+      dirtyTo = block.position() + block.length();
+    }
+  }
+  markDirty(dirtyFrom, dirtyTo);
+}
+
+void MarkdownHighlighter::highlightSlice()
+{
+  if (!m_document)
+    return;
+
+  QElapsedTimer timer;
+  timer.start();
+  int dirtyFrom = -1;
+  int dirtyTo = -1;
+  QTextBlock block = m_document->findBlockByNumber(m_nextBlock);
+  while (block.isValid() && timer.elapsed() < SliceMs)
+  {
+    bool formatsChanged = false;
+    highlightBlock(block, &formatsChanged);
+    if (formatsChanged)
+    {
+      if (dirtyFrom < 0)
+        dirtyFrom = block.position();
+      dirtyTo = block.position() + block.length();
+    }
+    block = block.next();
+    ++m_nextBlock;
+  }
+  markDirty(dirtyFrom, dirtyTo);
+
+  if (block.isValid())
+    m_sliceTimer.start();
+}
+
+void MarkdownHighlighter::markDirty(int from, int to)
+{
+  if (from < 0)
+    return;
+  // Relayouts and repaints the blocks. Formats aren't edits, so this stays
+  // away from contentsChange listeners like the journal and the find index.
+  QSignalBlocker blocker(m_document);
+  m_document->markContentsDirty(from, to - from);
+}
+
+bool MarkdownHighlighter::highlightBlock(const QTextBlock &block, bool *formatsChanged)
+{
+  QTextBlock previous = block.previous();
+  int state = previous.isValid() && previous.userState() >= 0 ? previous.userState() : int(AfterBlank);
+
+  QList<QTextLayout::FormatRange> ranges;
+  int newState = highlightLine(block.text(), state, ranges);
+
+  QTextLayout *layout = block.layout();
+  *formatsChanged = layout->formats() != ranges;
+  if (*formatsChanged)
+    layout->setFormats(ranges);
+
+  QTextBlock target = block;
+  bool stateChanged = target.userState() != newState;
+  target.setUserState(newState);
+  return stateChanged;
+}
+
+int MarkdownHighlighter::highlightLine(const QString &text, int state, QList<QTextLayout::FormatRange> &ranges) const
+{
+  int size = int(text.size());
+  int start = 0;
+  int indent = 0;
+  while (start < size && (text.at(start) == u' ' || text.at(start) == u'\t'))
+  {
+    indent += text.at(start) == u'\t' ? 4 - indent % 4 : 1;
+    ++start;
+  }
+  auto onlySpacesFrom = [&](int i)
+  {
+    for (; i < size; ++i)
+    {
+      if (!text.at(i).isSpace())
+        return false;
+    }
+    return true;
+  };
+
+  if (state & InFence)
+  {
+    QChar fence = (state & TildeFence) ? u'~' : u'`';
+    int run = runLength(text, start, size, fence);
+    bool closes = indent <= 3 && run >= (state >> FenceLengthShift) && onlySpacesFrom(start + run);
+    addRange(ranges, 0, size, m_codeFormat);
+    if (closes)
+      addRange(ranges, 0, size, m_markerFormat);
+    return closes ? 0 : state;
+  }
+
+  if (start == size)
+    return AfterBlank | (state & InList);
+
+  QChar first = text.at(start);
+  if (indent >= 4 && !(state & InList) && (state & (AfterBlank | InIndentedCode)))
+  {
+    addRange(ranges, start, size - start, m_codeFormat);
+    return InIndentedCode;
+  }
+
+  if (indent <= 3)
+  {
+    if (first == u'`' || first == u'~')
+    {
+      // A backtick fence's info string can't hold backticks
+      int run = runLength(text, start, size, first);
+      if (run >= 3 && (first == u'~' || text.indexOf(u'`', start + run) < 0))
+      {
+        addRange(ranges, 0, size, m_codeFormat);
+        addRange(ranges, 0, size, m_markerFormat);
+        return InFence | (first == u'~' ? TildeFence : 0) | (qMin(run, 255) << FenceLengthShift);
+      }
+    }
+
+    if (first == u'#')
+    {
+      int level = runLength(text, start, size, first);
+      if (level <= 6 && (start + level == size || text.at(start + level).isSpace()))
+      {
+        addRange(ranges, start, level, m_markerFormat);
+        addRange(ranges, start + level, size - start - level, m_headingFormat);
+        highlightInline(text, start + level, size, ranges);
+        return 0;
+      }
+    }
+
+    if (first == u'>')
+    {
+      addRange(ranges, start, 1, m_markerFormat);
+      addRange(ranges, start + 1, size - start - 1, m_quoteFormat);
+      highlightInline(text, start + 1, size, ranges);
+      return 0;
+    }
+
+    // Thematic breaks like "---" or "* * *", which would otherwise read as list items
+    if (first == u'-' || first == u'*' || first == u'_')
+    {
+      int count = 0;
+      int i = start;
+      for (; i < size && (text.at(i) == first || text.at(i) == u' ' || text.at(i) == u'\t'); ++i)
+        count += text.at(i) == first ? 1 : 0;
+      if (i == size && count >= 3)
+      {
+        addRange(ranges, start, size - start, m_markerFormat);
+        return 0;
+      }
+    }
+  }
+
+  // List items; deeper indents are nested items while inside a list
+  if (indent <= 3 || (state & InList))
+  {
+    int markerEnd = -1;
+    if ((first == u'-' || first == u'*' || first == u'+') && (start + 1 == size || text.at(start + 1).isSpace()))
+    {
+      markerEnd = start + 1;
+    }
+    else if (first.isDigit())
+    {
+      int j = start;
+      while (j < size && j - start < 9 && text.at(j).isDigit())
+        ++j;
+      if (j < size && (text.at(j) == u'.' || text.at(j) == u')') && (j + 1 == size || text.at(j + 1).isSpace()))
+        markerEnd = j + 1;
+    }
+    if (markerEnd > 0)
+    {
+      addRange(ranges, start, markerEnd - start, m_markerFormat);
+      highlightInline(text, markerEnd, size, ranges);
+      return InList;
+    }
+  }
+
+  highlightInline(text, start, size, ranges);
+  // A line straight after list content, or indented under it, continues the item
+  return (state & InList) && (indent > 0 || !(state & AfterBlank)) ? int(InList) : 0;
+}
+
+void MarkdownHighlighter::highlightInline(const QString &text, int from, int to,
+                                          QList<QTextLayout::FormatRange> &ranges) const
+{
+  if (to - from > MaxInlineLength)
+    return;
+
+  for (int i = from; i < to; ++i)
+  {
+    QChar c = text.at(i);
+    if (c == u'\\')
+    {
+      ++i;
+      continue;
+    }
+
+    if (c == u'`')
+    {
+      int run = runLength(text, i, to, c);
+      int close = findClosing(text, i + run, to, c, run, false);
+      if (close >= 0)
+      {
+        addRange(ranges, i, close + run - i, m_codeFormat);
+        i = close + run - 1;
+      }
+      else
+      {
+        i += run - 1;
+      }
+      continue;
+    }
+
+    if (c == u'[' || (c == u'!' && i + 1 < to && text.at(i + 1) == u'['))
+    {
+      // [text](url) and ![alt](src)
+      int open = c == u'!' ? i + 1 : i;
+      int depth = 0;
+      int close = -1;
+      for (int j = open; j < to && close < 0; ++j)
+      {
+        if (text.at(j) == u'\\')
+          ++j;
+        else if (text.at(j) == u'[')
+          ++depth;
+        else if (text.at(j) == u']' && --depth == 0)
+          close = j;
+      }
+      int end = close >= 0 && close + 1 < to && text.at(close + 1) == u'(' ? int(text.indexOf(u')', close + 2)) : -1;
+      if (end >= 0 && end < to)
+      {
+        addRange(ranges, i, open + 1 - i, m_markerFormat);
+        addRange(ranges, open + 1, close - open - 1, m_linkFormat);
+        highlightInline(text, open + 1, close, ranges);
+        addRange(ranges, close, 1, m_markerFormat);
+        addRange(ranges, close + 1, end - close, m_urlFormat);
+        i = end;
+      }
+      continue;
+    }
+
+    if (c == u'<')
+    {
+      int end = int(text.indexOf(u'>', i + 1));
+      if (end >= 0 && end < to)
+      {
+        QStringView inner = QStringView(text).mid(i + 1, end - i - 1);
+        bool autolink = inner.startsWith(u"http://") || inner.startsWith(u"https://") ||
+                        inner.startsWith(u"mailto:") || (inner.contains(u'@') && !inner.contains(u' '));
+        if (autolink)
+        {
+          addRange(ranges, i, end - i + 1, m_urlFormat);
+          i = end;
+          continue;
+        }
+      }
+    }
+
+    if (c == u'*' || c == u'_' || c == u'~')
+    {
+      int run = runLength(text, i, to, c);
+      bool canOpen = run <= 3 && (c != u'~' || run == 2) && i + run < to && !text.at(i + run).isSpace() &&
+                     (c != u'_' || i == 0 || !text.at(i - 1).isLetterOrNumber());
+      int close = canOpen ? findClosing(text, i + run, to, c, run, true) : -1;
+      if (close < 0)
+      {
+        i += run - 1;
+        continue;
+      }
+
+      QTextCharFormat format;
+      if (c == u'~')
+        format = m_strikeFormat;
+      else if (run == 1)
+        format = m_emphasisFormat;
+      else
+        format = m_strongFormat;
+      if (run == 3)
+        format.merge(m_emphasisFormat);
+
+      addRange(ranges, i, run, m_markerFormat);
+      addRange(ranges, i + run, close - i - run, format);
+      highlightInline(text, i + run, close, ranges);
+      addRange(ranges, close, run, m_markerFormat);
+      i = close + run - 1;
+    }
+  }
+}
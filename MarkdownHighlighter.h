@@ -0,0 +1,77 @@
+#pragma once
+
+#include <QtCore/QObject>
+#include <QtCore/QPointer>
+#include <QtCore/QTimer>
+#include <QtGui/QTextDocument>
+#include <QtGui/QTextBlock>
+#include <QtGui/QTextCharFormat>
+#include <QtGui/QTextLayout>
+
+// Markdown highlighting for headings, emphasis, inline code, code fences,
+// links, block quotes and lists. Like QSyntaxHighlighter, each block keeps
+// the state its last line ended in (inside a fence, inside a list, after a
+// blank line) in QTextBlock::userState(), so an edit re-highlights the
+// blocks it touched and then only carries on while the state coming out
+// of a block differs from before.
+//
+// Unlike QSyntaxHighlighter nothing is highlighted in one go: a new
+// document is worked through in short idle slices from the top, and an
+// edit that flips the state of everything below it (opening a fence, say)
+// highlights for at most a millisecond before leaving the rest to those
+// slices. Formats go on the block layouts as additional formats, so they
+// are never part of the text, its undo stack or the edit journal.
+class MarkdownHighlighter : public QObject
+{
+  Q_OBJECT
+
+public:
+  explicit MarkdownHighlighter(QObject *parent = nullptr);
+
+  // nullptr stops highlighting. Either way the formats it put on the
+  // previous document are taken off again.
+  void setDocument(QTextDocument *document);
+  QTextDocument *document() const { return m_document; }
+
+  static bool isMarkdownFile(const QString &filePath);
+
+private:
+  enum StateFlag
+  {
+    InFence = 0x01,
+    TildeFence = 0x02,
+    InIndentedCode = 0x04,
+    InList = 0x08,
+    AfterBlank = 0x10
+  };
+  // The opening fence's length sits above the flags
+  static const int FenceLengthShift = 8;
+
+  void onContentsChange(int position, int charsRemoved, int charsAdded);
+  void highlightSlice();
+  void restart();
+  void clearFormats();
+  void updateFormats();
+  // Returns whether the state the block ends in changed
+  bool highlightBlock(const QTextBlock &block, bool *formatsChanged);
+  int highlightLine(const QString &text, int state, QList<QTextLayout::FormatRange> &ranges) const;
+  void highlightInline(const QString &text, int from, int to, QList<QTextLayout::FormatRange> &ranges) const;
+  void markDirty(int from, int to);
+
+  QPointer<QTextDocument> m_document;
+  QMetaObject::Connection m_connection;
+  QTimer m_sliceTimer;
+  // Blocks from here on haven't been highlighted since the last restart
+  int m_nextBlock;
+  int m_blockCount;
+
+  QTextCharFormat m_headingFormat;
+  QTextCharFormat m_markerFormat;
+  QTextCharFormat m_emphasisFormat;
+  QTextCharFormat m_strongFormat;
+  QTextCharFormat m_strikeFormat;
+  QTextCharFormat m_codeFormat;
+  QTextCharFormat m_linkFormat;
+  QTextCharFormat m_urlFormat;
+  QTextCharFormat m_quoteFormat;
+};
@@ -0,0 +1,225 @@
+#include "MatchIndex.h"
+#include <QtGui/QTextBlock>
+#include <QtGui/QTextCursor>
+#include <algorithm>
+
+MatchIndex::MatchIndex()
+    : m_isRegex(false), m_maxLength(0)
+{
+}
+
+void MatchIndex::build(const QTextDocument *document, const QString &pattern, LiteralSearcher::Options options,
+                       bool regex)
+{
+  m_isRegex = regex;
+  m_matches.clear();
+  m_lengths.clear();
+  m_maxLength = 0;
+  if (regex)
+  {
+    m_searcher = LiteralSearcher();
+    m_regex = RegexSearcher(pattern, options);
+    buildRegex(document);
+    return;
+  }
+
+  m_regex = RegexSearcher();
+  m_searcher = LiteralSearcher(pattern, options);
+  if (!document || m_searcher.isEmpty())
+    return;
+
+  // Non-overlapping, left to right, the same way QTextDocument::find walks
+  QString text = document->toPlainText();
+  m_searcher.findAll(text, 0, int(text.size()), 0, m_matches);
+}
+
+void MatchIndex::clear()
+{
+  m_searcher = LiteralSearcher();
+  m_regex = RegexSearcher();
+  m_isRegex = false;
+  m_matches.clear();
+  m_lengths.clear();
+  m_maxLength = 0;
+}
+
+void MatchIndex::update(const QTextDocument *document, int position, int charsRemoved, int charsAdded)
+{
+  if (!document || !isActive())
+    return;
+  if (m_isRegex)
+  {
+    updateRegex(document, position, charsRemoved, charsAdded);
+    return;
+  }
+
+  int length = this->length();
+  int delta = charsAdded - charsRemoved;
+  int editEnd = position + charsRemoved;
+
+  // Whole-word matches also depend on the character either side of them
+  int context = (m_searcher.options() & LiteralSearcher::WholeWords) ? 1 : 0;
+
+  // Matches wholly before the edit stay put; wholly after it just shift.
+  // Anything touching the edited range is dropped and rescanned.
+  auto firstTouched = std::lower_bound(m_matches.begin(), m_matches.end(), position - length + 1 - context);
+  auto firstAfter = std::lower_bound(firstTouched, m_matches.end(), editEnd + context);
+
+  QVector<int> after(firstAfter, m_matches.end());
+  for (int &start : after)
+    start += delta;
+  m_matches.erase(firstTouched, m_matches.end());
+
+  // Rescan the window that could hold a match crossing the new text
+  int from = qMax(0, position - length + 1 - context);
+  if (!m_matches.isEmpty())
+    from = qMax(from, m_matches.last() + length);
+  int textLength = document->characterCount() - 1;
+  int to = qMin(textLength, position + charsAdded + length - 1 + context);
+
+  if (from < to)
+  {
+    // Fetch one extra character each side for the word-boundary checks
+    int windowStart = qMax(0, from - 1);
+    QString window = documentText(document, windowStart, qMin(textLength, to + 1));
+    m_searcher.findAll(window, from - windowStart, to - windowStart, windowStart, m_matches);
+  }
+
+  // For self-overlapping patterns a rescanned match can swallow the start
+  // of a shifted one, and an occurrence the old scan skipped becomes a match
+  // instead. Such occurrences can only sit within a pattern length of the
+  // rescanned window, so keep scanning until the greedy walk lines back up
+  // with an existing shifted match.
+  int resumeAt = m_matches.isEmpty() ? 0 : m_matches.last() + length;
+  auto next = std::lower_bound(after.begin(), after.end(), resumeAt);
+  while (true)
+  {
+    int limit = qMax(to + 1, resumeAt + length - 1);
+    if (next != after.end())
+      limit = qMin(limit, *next);
+    if (resumeAt >= limit)
+      break;
+
+    int windowStart = qMax(0, resumeAt - 1);
+    int windowEnd = qMin(textLength, limit + length - 1);
+    QString window = documentText(document, windowStart, qMin(textLength, windowEnd + 1));
+    int found = m_searcher.indexIn(window, resumeAt - windowStart, windowEnd - windowStart);
+    if (found < 0)
+      break;
+
+    m_matches.append(windowStart + found);
+    resumeAt = windowStart + found + length;
+    next = std::lower_bound(next, after.end(), resumeAt);
+  }
+
+  for (auto it = next; it != after.end(); ++it)
+    m_matches.append(*it);
+}
+
+void MatchIndex::buildRegex(const QTextDocument *document)
+{
+  if (!document || !isActive())
+    return;
+  QString text = document->toPlainText();
+  appendRegexMatches(text, 0);
+}
+
+void MatchIndex::appendRegexMatches(QStringView text, int offset)
+{
+  m_regex.forEachMatch(text, [this, offset](const QRegularExpressionMatch &match, qsizetype base)
+                       {
+    int length = int(match.capturedLength());
+    m_matches.append(offset + int(base + match.capturedStart()));
+    m_lengths.append(length);
+    m_maxLength = qMax(m_maxLength, length);
+    return true; });
+}
+
+void MatchIndex::updateRegex(const QTextDocument *document, int position, int charsRemoved, int charsAdded)
+{
+  if (!m_regex.isLineBound())
+  {
+    m_matches.clear();
+    m_lengths.clear();
+    m_maxLength = 0;
+    buildRegex(document);
+    return;
+  }
+
+  // Every match lies within a block, so only the blocks the edit touched
+  // are rescanned. The text after them is unchanged, only shifted.
+  int delta = charsAdded - charsRemoved;
+  QTextBlock first = document->findBlock(position);
+  QTextBlock last = document->findBlock(position + charsAdded);
+  if (!last.isValid())
+    last = document->lastBlock();
+  int start = first.position();
+  int end = last.position() + last.length() - 1;
+  int oldEnd = end - delta;
+
+  int firstTouched = lowerBound(start);
+  int firstAfter = lowerBound(oldEnd);
+  QVector<int> after = m_matches.mid(firstAfter);
+  QVector<int> afterLengths = m_lengths.mid(firstAfter);
+  for (int &match : after)
+    match += delta;
+  m_matches.resize(firstTouched);
+  m_lengths.resize(firstTouched);
+
+  appendRegexMatches(documentText(document, start, end), start);
+  m_matches += after;
+  m_lengths += afterLengths;
+}
+
+QRegularExpressionMatch MatchIndex::regexMatch(const QTextDocument *document, int index) const
+{
+  if (!m_isRegex || !document || index < 0 || index >= count())
+    return QRegularExpressionMatch();
+
+  // Match again over the same text the index was built from, anchored at
+  // the entry, so lookarounds see the same context
+  int start = m_matches.at(index);
+  int windowStart = 0;
+  QString window;
+  if (m_regex.isLineBound())
+  {
+    QTextBlock block = document->findBlock(start);
+    windowStart = block.position();
+    window = documentText(document, windowStart, windowStart + block.length() - 1);
+  }
+  else
+  {
+    window = document->toPlainText();
+  }
+  return m_regex.regex().match(window, start - windowStart, QRegularExpression::NormalMatch,
+                               QRegularExpression::AnchorAtOffsetMatchOption);
+}
+
+int MatchIndex::lowerBound(int position) const
+{
+  return int(std::lower_bound(m_matches.begin(), m_matches.end(), position) - m_matches.begin());
+}
+
+int MatchIndex::indexOf(int position) const
+{
+  int index = lowerBound(position);
+  return (index < m_matches.size() && m_matches.at(index) == position) ? index : -1;
+}
+
+QString MatchIndex::documentText(const QTextDocument *document, int from, int to)
+{
+  QTextCursor cursor(const_cast<QTextDocument *>(document));
+  cursor.setPosition(from);
+  cursor.setPosition(to, QTextCursor::KeepAnchor);
+
+  // Match toPlainText() so offsets and content agree with a full build
+  QString text = cursor.selectedText();
+  for (QChar &c : text)
+  {
+    if (c == QChar::ParagraphSeparator || c == QChar::LineSeparator)
+      c = QLatin1Char('\n');
+    else if (c == QChar::Nbsp)
+      c = QLatin1Char(' ');
+  }
+  return text;
+}
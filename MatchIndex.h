@@ -0,0 +1,60 @@
+#pragma once
+
+#include <QtCore/QString>
+#include <QtCore/QVector>
+#include <QtGui/QTextDocument>
+#include "LiteralSearcher.h"
+#include "RegexSearcher.h"
+
+// Sorted start offsets of every match of a query in a document. Built once
+// per query, then patched from contentsChange deltas so an edit only
+// rescans the text around it. Regex matches vary in length, so their
+// lengths are kept alongside; a regex whose matches may span lines is
+// rebuilt on every edit instead.
+class MatchIndex
+{
+public:
+  MatchIndex();
+
+  void build(const QTextDocument *document, const QString &pattern,
+             LiteralSearcher::Options options = LiteralSearcher::CaseInsensitive, bool regex = false);
+  void update(const QTextDocument *document, int position, int charsRemoved, int charsAdded);
+  void clear();
+
+  bool isActive() const { return m_isRegex ? m_regex.isValid() && !m_regex.isEmpty() : !m_searcher.isEmpty(); }
+  bool isRegex() const { return m_isRegex; }
+  // Why an invalid regex did not build
+  QString errorString() const { return m_isRegex ? m_regex.errorString() : QString(); }
+  const QString &pattern() const { return m_isRegex ? m_regex.pattern() : m_searcher.pattern(); }
+  LiteralSearcher::Options options() const { return m_isRegex ? m_regex.options() : m_searcher.options(); }
+  int length() const { return m_searcher.pattern().length(); }
+  int lengthAt(int index) const { return m_isRegex ? m_lengths.at(index) : length(); }
+  // No match is longer than this
+  int maxLength() const { return m_isRegex ? m_maxLength : length(); }
+  int count() const { return m_matches.size(); }
+  int at(int index) const { return m_matches.at(index); }
+  const QVector<int> &matches() const { return m_matches; }
+
+  // The regex match behind an entry, with its captures
+  QRegularExpressionMatch regexMatch(const QTextDocument *document, int index) const;
+
+  // Index of the first match starting at or after position, or count()
+  int lowerBound(int position) const;
+  // Index of the match starting exactly at position, or -1
+  int indexOf(int position) const;
+
+  static QString documentText(const QTextDocument *document, int from, int to);
+
+private:
+  void buildRegex(const QTextDocument *document);
+  void updateRegex(const QTextDocument *document, int position, int charsRemoved, int charsAdded);
+  void appendRegexMatches(QStringView text, int offset);
+
+  LiteralSearcher m_searcher;
+  RegexSearcher m_regex;
+  bool m_isRegex;
+  QVector<int> m_matches;
+  // Parallel to m_matches, for regex queries only
+  QVector<int> m_lengths;
+  int m_maxLength;
+};
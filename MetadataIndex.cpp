@@ -0,0 +1,464 @@
+#include "MetadataIndex.h"
+#include "TagIndex.h"
+#include <QtConcurrent/QtConcurrentMap>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDateTime>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QSaveFile>
+#include <QtCore/QStandardPaths>
+#include <QtCore/QStringDecoder>
+#include <QtCore/QtEndian>
+#include <QtGui/QTextDocumentFragment>
+#include <QtCore/QDebug>
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+  const quint32 IndexMagic = 0x494d4857; // "WHMI"
+  const quint32 IndexVersion = 2;
+  const int MaxTitleLength = 120;
+
+  // All fields little-endian; strings are (offset, length) into the pool
+  struct IndexHeader
+  {
+    quint32 magic;
+    quint32 version;
+    qint64 directoryModified;
+    quint32 count;
+    quint32 poolSize;
+  };
+
+  struct IndexRecord
+  {
+    qint64 size;
+    qint64 modified;
+    qint32 wordCount;
+    quint32 nameOffset;
+    quint32 nameLength;
+    quint32 titleOffset;
+    quint32 titleLength;
+    quint32 tagsOffset;
+    quint32 tagsLength;
+    quint32 reserved;
+  };
+
+  static_assert(sizeof(IndexHeader) == 24, "index header layout");
+  static_assert(sizeof(IndexRecord) == 48, "index record layout");
+
+  qint64 directoryModified(const QString &directory)
+  {
+    return QFileInfo(directory).lastModified().toMSecsSinceEpoch();
+  }
+}
+
+FileMetadata FileMetadata::fromFileInfo(const QFileInfo &info)
+{
+  FileMetadata entry;
+  entry.path = info.filePath();
+  entry.size = info.size();
+  entry.modified = info.lastModified().toMSecsSinceEpoch();
+  return entry;
+}
+
+MetadataIndex::MetadataIndex(const QString &directory, const QStringList &nameFilters, QObject *parent)
+    : QObject(parent), m_directory(directory), m_nameFilters(nameFilters), m_directoryModified(0), m_dirty(false),
+      m_analysisPending(false)
+{
+  QByteArray key = QCryptographicHash::hash(directory.toUtf8(), QCryptographicHash::Md5).toHex();
+  m_indexPath = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/index/" + QString::fromLatin1(key) + ".idx";
+
+  // Batches bursts of updates into one write
+  m_saveTimer.setSingleShot(true);
+  m_saveTimer.setInterval(2000);
+  connect(&m_saveTimer, &QTimer::timeout, this, &MetadataIndex::save);
+  connect(&m_analysis, &QFutureWatcher<FileMetadata>::finished, this, &MetadataIndex::onAnalysisFinished);
+}
+
+MetadataIndex::~MetadataIndex()
+{
+  m_analysis.cancel();
+  m_analysis.waitForFinished();
+  save();
+}
+
+void MetadataIndex::load()
+{
+  bool stored = readIndexFile();
+  if (!stored || directoryModified(m_directory) != m_directoryModified)
+  {
+    qDebug().noquote() << "Rescanning" << m_directory << (stored ? "(changed since last run)" : "(no index)");
+    rescan();
+  }
+
+  // Files whose analysis was cut short last time
+  scheduleAnalysis();
+}
+
+bool MetadataIndex::readIndexFile()
+{
+  QFile file(m_indexPath);
+  if (!file.open(QIODevice::ReadOnly) || file.size() < qint64(sizeof(IndexHeader)))
+    return false;
+
+  qint64 length = file.size();
+  const uchar *data = file.map(0, length);
+  if (!data)
+    return false;
+
+  IndexHeader header;
+  std::memcpy(&header, data, sizeof(header));
+  quint32 count = qFromLittleEndian(header.count);
+  quint32 poolSize = qFromLittleEndian(header.poolSize);
+  qint64 poolStart = qint64(sizeof(IndexHeader)) + qint64(count) * qint64(sizeof(IndexRecord));
+  if (qFromLittleEndian(header.magic) != IndexMagic || qFromLittleEndian(header.version) != IndexVersion ||
+      poolStart + poolSize != length)
+  {
+    qWarning().noquote() << "Ignoring unreadable metadata index" << m_indexPath;
+    file.unmap(const_cast<uchar *>(data));
+    return false;
+  }
+
+  const char *pool = reinterpret_cast<const char *>(data + poolStart);
+  auto text = [pool, poolSize](quint32 offset, quint32 size, QString *out)
+  {
+    offset = qFromLittleEndian(offset);
+    size = qFromLittleEndian(size);
+    if (quint64(offset) + size > poolSize)
+      return false;
+    *out = QString::fromUtf8(pool + offset, size);
+    return true;
+  };
+
+  QHash<QString, FileMetadata> files;
+  files.reserve(count);
+  const uchar *records = data + sizeof(IndexHeader);
+  for (quint32 i = 0; i < count; ++i)
+  {
+    IndexRecord record;
+    std::memcpy(&record, records + qint64(i) * sizeof(IndexRecord), sizeof(record));
+
+    QString name;
+    QString tags;
+    FileMetadata entry;
+    if (!text(record.nameOffset, record.nameLength, &name) || !text(record.titleOffset, record.titleLength, &entry.title) ||
+        !text(record.tagsOffset, record.tagsLength, &tags))
+    {
+      qWarning().noquote() << "Ignoring corrupt metadata index" << m_indexPath;
+      file.unmap(const_cast<uchar *>(data));
+      return false;
+    }
+
+    entry.path = m_directory + "/" + name;
+    entry.size = qFromLittleEndian(record.size);
+    entry.modified = qFromLittleEndian(record.modified);
+    entry.wordCount = qFromLittleEndian(record.wordCount);
+    entry.tags = tags.split('\n', Qt::SkipEmptyParts);
+    files.insert(name, entry);
+  }
+
+  m_directoryModified = qFromLittleEndian(header.directoryModified);
+  file.unmap(const_cast<uchar *>(data));
+  m_files.swap(files);
+  return true;
+}
+
+void MetadataIndex::save()
+{
+  m_saveTimer.stop();
+  if (!m_dirty)
+    return;
+
+  QByteArray records;
+  records.reserve(m_files.size() * sizeof(IndexRecord));
+  QByteArray pool;
+  auto append = [&pool](const QString &text, quint32 *offset, quint32 *size)
+  {
+    QByteArray utf8 = text.toUtf8();
+    *offset = qToLittleEndian(quint32(pool.size()));
+    *size = qToLittleEndian(quint32(utf8.size()));
+    pool += utf8;
+  };
+
+  for (auto it = m_files.constBegin(); it != m_files.constEnd(); ++it)
+  {
+    IndexRecord record = {};
+    record.size = qToLittleEndian(it->size);
+    record.modified = qToLittleEndian(it->modified);
+    record.wordCount = qToLittleEndian(qint32(it->wordCount));
+    append(it.key(), &record.nameOffset, &record.nameLength);
+    append(it->title, &record.titleOffset, &record.titleLength);
+    append(it->tags.join('\n'), &record.tagsOffset, &record.tagsLength);
+    records.append(reinterpret_cast<const char *>(&record), sizeof(record));
+  }
+
+  IndexHeader header = {};
+  header.magic = qToLittleEndian(IndexMagic);
+  header.version = qToLittleEndian(IndexVersion);
+  header.directoryModified = qToLittleEndian(m_directoryModified);
+  header.count = qToLittleEndian(quint32(m_files.size()));
+  header.poolSize = qToLittleEndian(quint32(pool.size()));
+
+  QDir().mkpath(QFileInfo(m_indexPath).absolutePath());
+  QSaveFile file(m_indexPath);
+  if (!file.open(QIODevice::WriteOnly))
+  {
+    qWarning().noquote() << "Could not write metadata index" << m_indexPath << file.errorString();
+    return;
+  }
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  file.write(records);
+  file.write(pool);
+  if (!file.commit())
+  {
+    qWarning().noquote() << "Could not write metadata index" << m_indexPath << file.errorString();
+    return;
+  }
+  m_dirty = false;
+}
+
+void MetadataIndex::rescan()
+{
+  // Read before listing, so anything that changes during the scan shows up
+  // as a mismatch next time
+  m_directoryModified = directoryModified(m_directory);
+
+  QHash<QString, FileMetadata> files;
+  QStringList changedPaths;
+  const QStringList names = QDir(m_directory).entryList(m_nameFilters, QDir::Files, QDir::Unsorted);
+  files.reserve(names.size());
+  for (const QString &name : names)
+  {
+    FileMetadata entry = FileMetadata::fromFileInfo(QFileInfo(m_directory + "/" + name));
+
+    // Unchanged files keep what was read from them last time
+    auto known = m_files.constFind(name);
+    if (known != m_files.constEnd() && known->modified == entry.modified && known->size == entry.size)
+    {
+      entry = known.value();
+    }
+    else
+    {
+      if (known != m_files.constEnd())
+      {
+        entry.title = known->title;
+        entry.tags = known->tags;
+      }
+      changedPaths.append(entry.path);
+    }
+    files.insert(name, entry);
+  }
+  for (auto it = m_files.constBegin(); it != m_files.constEnd(); ++it)
+  {
+    if (!files.contains(it.key()))
+      changedPaths.append(it->path);
+  }
+
+  m_files.swap(files);
+  markDirty();
+  if (!changedPaths.isEmpty())
+    emit filesChanged(changedPaths);
+  emit changed();
+}
+
+bool MetadataIndex::contains(const QString &filePath) const
+{
+  QFileInfo info(filePath);
+  return info.path() == m_directory && m_files.contains(info.fileName());
+}
+
+FileMetadata MetadataIndex::file(const QString &filePath) const
+{
+  QFileInfo info(filePath);
+  if (info.path() != m_directory)
+    return FileMetadata();
+  return m_files.value(info.fileName());
+}
+
+QVector<FileMetadata> MetadataIndex::files() const
+{
+  QVector<FileMetadata> files;
+  files.reserve(m_files.size());
+  for (const FileMetadata &entry : m_files)
+    files.append(entry);
+
+  std::sort(files.begin(), files.end(), [](const FileMetadata &a, const FileMetadata &b)
+            { return a.modified != b.modified ? a.modified > b.modified : a.path < b.path; });
+  return files;
+}
+
+QString MetadataIndex::mostRecentFile() const
+{
+  const FileMetadata *newest = nullptr;
+  for (const FileMetadata &entry : m_files)
+  {
+    if (!newest || entry.modified > newest->modified)
+      newest = &entry;
+  }
+  return newest ? newest->path : QString();
+}
+
+void MetadataIndex::update(const QString &filePath)
+{
+  QFileInfo info(filePath);
+  if (info.path() != m_directory)
+    return;
+
+  QString name = info.fileName();
+  if (!info.isFile() || !accepts(name))
+  {
+    remove(filePath);
+    return;
+  }
+
+  FileMetadata entry = FileMetadata::fromFileInfo(info);
+  auto known = m_files.constFind(name);
+  if (known != m_files.constEnd() && known->modified == entry.modified && known->size == entry.size)
+    return;
+
+  if (known != m_files.constEnd())
+  {
+    // Until the file is read again its old title and tags stand in, so
+    // nothing built on them blinks out in between
+    entry.title = known->title;
+    entry.tags = known->tags;
+  }
+  m_files.insert(name, entry);
+  markDirectorySeen();
+  markDirty();
+  scheduleAnalysis();
+  emit filesChanged(QStringList() << entry.path);
+  emit changed();
+}
+
+void MetadataIndex::remove(const QString &filePath)
+{
+  QFileInfo info(filePath);
+  if (info.path() != m_directory || !m_files.remove(info.fileName()))
+    return;
+
+  markDirectorySeen();
+  markDirty();
+  emit filesChanged(QStringList() << m_directory + "/" + info.fileName());
+  emit changed();
+}
+
+bool MetadataIndex::accepts(const QString &name) const
+{
+  return m_nameFilters.isEmpty() || QDir::match(m_nameFilters, name);
+}
+
+void MetadataIndex::markDirectorySeen()
+{
+  // The index now reflects the directory as it is
+  m_directoryModified = directoryModified(m_directory);
+}
+
+void MetadataIndex::markDirty()
+{
+  m_dirty = true;
+  if (!m_saveTimer.isActive())
+    m_saveTimer.start();
+}
+
+void MetadataIndex::scheduleAnalysis()
+{
+  if (m_analysis.isRunning())
+  {
+    m_analysisPending = true;
+    return;
+  }
+
+  QVector<FileMetadata> pending;
+  for (const FileMetadata &entry : m_files)
+  {
+    if (entry.wordCount < 0)
+      pending.append(entry);
+  }
+  if (!pending.isEmpty())
+    m_analysis.setFuture(QtConcurrent::mapped(std::move(pending), &MetadataIndex::analyze));
+}
+
+void MetadataIndex::onAnalysisFinished()
+{
+  QStringList updated;
+  if (!m_analysis.isCanceled())
+  {
+    const QList<FileMetadata> results = m_analysis.future().results();
+    for (const FileMetadata &result : results)
+    {
+      // Drop results for files that changed again while being read
+      auto entry = m_files.find(QFileInfo(result.path).fileName());
+      if (entry == m_files.end() || entry->modified != result.modified || entry->size != result.size)
+        continue;
+      *entry = result;
+      updated.append(result.path);
+    }
+  }
+
+  if (!updated.isEmpty())
+  {
+    markDirty();
+    emit filesChanged(updated);
+    emit changed();
+  }
+  if (m_analysisPending)
+  {
+    m_analysisPending = false;
+    scheduleAnalysis();
+  }
+}
+
+bool MetadataIndex::readPlainText(const QString &filePath, QString *text)
+{
+  QFile file(filePath);
+  if (!file.open(QIODevice::ReadOnly))
+    return false;
+
+  QByteArray data = file.readAll();
+  QStringDecoder decoder(QStringConverter::encodingForData(data).value_or(QStringConverter::Utf8));
+  *text = decoder(data);
+  // Rich text documents are stored as HTML
+  if (filePath.endsWith(".rtf", Qt::CaseInsensitive))
+    *text = QTextDocumentFragment::fromHtml(*text).toPlainText();
+  return true;
+}
+
+FileMetadata MetadataIndex::analyze(const FileMetadata &entry)
+{
+  FileMetadata result = entry;
+  result.wordCount = 0;
+  result.title.clear();
+  result.tags.clear();
+
+  QString text;
+  if (!readPlainText(entry.path, &text))
+    return result;
+
+  bool inWord = false;
+  for (const QChar c : text)
+  {
+    bool space = c.isSpace();
+    if (!space && !inWord)
+      ++result.wordCount;
+    inWord = !space;
+  }
+
+  // First non-empty line, without Markdown heading marks
+  for (QStringView line : QStringView(text).tokenize(u'\n'))
+  {
+    QString title = line.trimmed().toString();
+    while (title.startsWith('#'))
+      title.remove(0, 1);
+    title = title.trimmed();
+    if (!title.isEmpty())
+    {
+      result.title = title.left(MaxTitleLength);
+      break;
+    }
+  }
+
+  result.tags = TagIndex::extractTags(text);
+  return result;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <QtCore/QObject>
+#include <QtCore/QFileInfo>
+#include <QtCore/QFutureWatcher>
+#include <QtCore/QHash>
+#include <QtCore/QStringList>
+#include <QtCore/QTimer>
+#include <QtCore/QVector>
+
+struct FileMetadata
+{
+  QString path;
+  qint64 size = 0;
+  // Milliseconds since the epoch
+  qint64 modified = 0;
+  // -1 until the content has been read; title and tags may then still be
+  // those of an earlier version
+  int wordCount = -1;
+  QString title;
+  QStringList tags;
+
+  static FileMetadata fromFileInfo(const QFileInfo &info);
+};
+
+// What is known about the documents in one directory, kept on disk between
+// runs. The file is a fixed-size record table followed by a UTF-8 string
+// pool, so loading it is one mapping and a linear pass. If the directory's
+// mtime still matches the stored one, no file is touched at all; otherwise
+// the directory is re-listed and stat'ed, and only new or changed files are
+// read again. Word counts, titles and tags are read on the thread pool.
+class MetadataIndex : public QObject
+{
+  Q_OBJECT
+
+public:
+  MetadataIndex(const QString &directory, const QStringList &nameFilters, QObject *parent = nullptr);
+  ~MetadataIndex();
+
+  QString directory() const { return m_directory; }
+  // Reads the stored index and brings it up to date with the directory
+  void load();
+  void save();
+
+  int count() const { return int(m_files.size()); }
+  bool contains(const QString &filePath) const;
+  FileMetadata file(const QString &filePath) const;
+  // Newest first
+  QVector<FileMetadata> files() const;
+  QString mostRecentFile() const;
+  // Every entry, in no particular order and without copying
+  template <typename Visitor>
+  void forEachFile(Visitor visit) const
+  {
+    for (const FileMetadata &entry : m_files)
+      visit(entry);
+  }
+
+  // Decoded text of a document, with rich text reduced to plain text; safe
+  // to call from any thread
+  static bool readPlainText(const QString &filePath, QString *text);
+
+  // Re-stats one file, dropping it if it is gone
+  void update(const QString &filePath);
+  void remove(const QString &filePath);
+
+signals:
+  // Entries that were added, removed or analyzed; a path the index no
+  // longer has was removed
+  void filesChanged(const QStringList &paths);
+  void changed();
+
+private slots:
+  void onAnalysisFinished();
+
+private:
+  bool readIndexFile();
+  void rescan();
+  bool accepts(const QString &name) const;
+  void markDirectorySeen();
+  void markDirty();
+  void scheduleAnalysis();
+  static FileMetadata analyze(const FileMetadata &entry);
+
+  QString m_directory;
+  QStringList m_nameFilters;
+  QString m_indexPath;
+  // Keyed by file name
+  QHash<QString, FileMetadata> m_files;
+  qint64 m_directoryModified;
+  bool m_dirty;
+
+  QTimer m_saveTimer;
+  QFutureWatcher<FileMetadata> m_analysis;
+  bool m_analysisPending;
+};
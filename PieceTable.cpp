@@ -0,0 +1,427 @@
+#include "PieceTable.h"
+#include <algorithm>
+#include <cstring>
+
+#ifndef Q_OS_WIN
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+  const int MaxUndoSteps = 1000;
+  // How far the line index grows per step when catching up
+  const qint64 IndexChunk = 1024 * 1024;
+}
+
+PieceTable::MappedFile::~MappedFile()
+{
+  if (data)
+    file.unmap(reinterpret_cast<uchar *>(const_cast<char *>(data)));
+}
+
+bool PieceTable::MappedFile::isIntact() const
+{
+#ifndef Q_OS_WIN
+  // Asks the open descriptor, not the path, which a save may have replaced
+  struct stat info;
+  if (data && ::fstat(file.handle(), &info) == 0)
+    return info.st_size >= size;
+#endif
+  // Windows refuses to truncate a mapped file
+  return true;
+}
+
+PieceTable::PieceTable()
+    : m_size(0), m_modified(false), m_revision(0), m_lastInsertEnd(-1), m_indexedTo(0)
+{
+  m_lineStarts.append(0);
+}
+
+PieceTable::~PieceTable()
+{
+  close();
+}
+
+bool PieceTable::open(const QString &filePath, QString *error)
+{
+  close();
+  QSharedPointer<MappedFile> original(new MappedFile);
+  original->file.setFileName(filePath);
+  if (!original->file.open(QIODevice::ReadOnly))
+  {
+    *error = original->file.errorString();
+    return false;
+  }
+
+  original->size = original->file.size();
+  if (original->size > 0)
+  {
+    uchar *mapped = original->file.map(0, original->size);
+    if (!mapped)
+    {
+      *error = original->file.errorString();
+      return false;
+    }
+    original->data = reinterpret_cast<const char *>(mapped);
+    m_pieces.append({Original, 0, original->size});
+  }
+  m_original = original;
+  m_size = original->size;
+  return true;
+}
+
+bool PieceTable::isOriginalIntact() const
+{
+  return !m_original || m_original->isIntact();
+}
+
+void PieceTable::close()
+{
+  m_original.reset();
+  m_added.clear();
+  m_pieces.clear();
+  m_size = 0;
+  m_modified = false;
+  m_undo.clear();
+  m_redo.clear();
+  m_lastInsertEnd = -1;
+  m_lineStarts = {0};
+  m_indexedTo = 0;
+}
+
+DocumentWriter::Producer PieceTable::snapshot() const
+{
+  // Both buffers only ever grow, so the piece list and a handle on each
+  // buffer pin the text down as it is now. The original stays mapped:
+  // on POSIX the old file lives on until it is unmapped, however it is
+  // replaced.
+  QVector<Piece> pieces = m_pieces;
+  QByteArray added = m_added;
+  QSharedPointer<MappedFile> original = m_original;
+  return [pieces, added, original](QFileDevice &file, QString *error)
+  {
+    if (original && !original->isIntact())
+    {
+      *error = "the file was truncated by another program while open";
+      return false;
+    }
+    for (const Piece &piece : pieces)
+    {
+      const char *text = (piece.buffer == Original ? original->data : added.constData()) + piece.start;
+      if (file.write(text, piece.length) != piece.length)
+        return false;
+    }
+    return true;
+  };
+}
+
+const char *PieceTable::data(const Piece &piece) const
+{
+  return (piece.buffer == Original ? m_original->data : m_added.constData()) + piece.start;
+}
+
+int PieceTable::findPiece(qint64 position, qint64 *pieceStart) const
+{
+  qint64 start = 0;
+  for (int i = 0; i < m_pieces.size(); ++i)
+  {
+    if (position < start + m_pieces.at(i).length)
+    {
+      *pieceStart = start;
+      return i;
+    }
+    start += m_pieces.at(i).length;
+  }
+  *pieceStart = start;
+  return int(m_pieces.size());
+}
+
+QByteArray PieceTable::bytes(qint64 position, qint64 length) const
+{
+  position = qBound<qint64>(0, position, m_size);
+  length = qBound<qint64>(0, length, m_size - position);
+
+  QByteArray result;
+  result.reserve(length);
+  qint64 pieceStart = 0;
+  for (int i = findPiece(position, &pieceStart); i < m_pieces.size() && length > 0; ++i)
+  {
+    const Piece &piece = m_pieces.at(i);
+    qint64 skip = position - pieceStart;
+    qint64 take = qMin(piece.length - skip, length);
+    result.append(data(piece) + skip, take);
+    length -= take;
+    position += take;
+    pieceStart += piece.length;
+  }
+  return result;
+}
+
+char PieceTable::at(qint64 position) const
+{
+  qint64 pieceStart = 0;
+  int i = findPiece(position, &pieceStart);
+  if (i >= m_pieces.size())
+    return '\0';
+  return data(m_pieces.at(i))[position - pieceStart];
+}
+
+void PieceTable::splitAt(qint64 position, int *index)
+{
+  qint64 pieceStart = 0;
+  int i = findPiece(position, &pieceStart);
+  if (i < m_pieces.size() && pieceStart != position)
+  {
+    qint64 offset = position - pieceStart;
+    Piece right = m_pieces.at(i);
+    right.start += offset;
+    right.length -= offset;
+    m_pieces[i].length = offset;
+    m_pieces.insert(i + 1, right);
+    ++i;
+  }
+  *index = i;
+}
+
+int PieceTable::beginEdit(qint64 from, qint64 to, QVector<Piece> *before) const
+{
+  // From the piece before the edit, which typing may extend, to the one
+  // holding its end, which may be split
+  qint64 pieceStart = 0;
+  int first = qMin(findPiece(qMax<qint64>(0, from - 1), &pieceStart), int(m_pieces.size()));
+  int last = qMin(findPiece(to, &pieceStart), int(m_pieces.size()) - 1);
+  *before = m_pieces.mid(first, qMax(0, last - first + 1));
+  return first;
+}
+
+void PieceTable::recordUndo(qint64 position, int index, const QVector<Piece> &before, int oldCount, bool extend)
+{
+  // Pieces outside [index, index + before.size()) are untouched, so the
+  // edit replaced that run with one longer by however many pieces it added
+  int added = int(m_pieces.size()) - oldCount;
+  if (extend && !m_undo.isEmpty())
+  {
+    Change &last = m_undo.last();
+    if (index >= last.index && index + before.size() <= last.index + last.after.size())
+    {
+      last.after = m_pieces.mid(last.index, last.after.size() + added);
+      return;
+    }
+  }
+
+  m_undo.append({index, before, m_pieces.mid(index, before.size() + added), position});
+  if (m_undo.size() > MaxUndoSteps)
+    m_undo.removeFirst();
+  m_redo.clear();
+}
+
+void PieceTable::insert(qint64 position, const QByteArray &utf8)
+{
+  if (utf8.isEmpty())
+    return;
+  position = qBound<qint64>(0, position, m_size);
+
+  QVector<Piece> before;
+  int first = beginEdit(position, position, &before);
+  int oldCount = int(m_pieces.size());
+
+  int index = 0;
+  splitAt(position, &index);
+  if (index > 0 && m_pieces.at(index - 1).buffer == Added &&
+      m_pieces.at(index - 1).start + m_pieces.at(index - 1).length == m_added.size())
+  {
+    m_pieces[index - 1].length += utf8.size();
+  }
+  else
+  {
+    m_pieces.insert(index, {Added, qint64(m_added.size()), qint64(utf8.size())});
+  }
+
+  // Typing carries on the same undo step until the cursor moves or a line ends
+  recordUndo(position, first, before, oldCount, position == m_lastInsertEnd && !utf8.contains('\n'));
+
+  m_added.append(utf8);
+  m_size += utf8.size();
+  m_modified = true;
+  m_revision++;
+  // Nor does the typing after a new line join the step that added it
+  m_lastInsertEnd = utf8.endsWith('\n') ? -1 : position + utf8.size();
+  invalidateLines(position);
+}
+
+void PieceTable::remove(qint64 position, qint64 length)
+{
+  position = qBound<qint64>(0, position, m_size);
+  length = qBound<qint64>(0, length, m_size - position);
+  if (length == 0)
+    return;
+
+  QVector<Piece> before;
+  int index = beginEdit(position, position + length, &before);
+  int oldCount = int(m_pieces.size());
+
+  int first = 0;
+  int last = 0;
+  splitAt(position, &first);
+  splitAt(position + length, &last);
+  m_pieces.remove(first, last - first);
+  recordUndo(position, index, before, oldCount, false);
+
+  m_size -= length;
+  m_modified = true;
+  m_revision++;
+  m_lastInsertEnd = -1;
+  invalidateLines(position);
+}
+
+qint64 PieceTable::restore(QVector<Change> &from, QVector<Change> &to, bool undoing)
+{
+  if (from.isEmpty())
+    return -1;
+  Change change = from.takeLast();
+  const QVector<Piece> &removed = undoing ? change.after : change.before;
+  const QVector<Piece> &restored = undoing ? change.before : change.after;
+
+  for (const Piece &piece : removed)
+    m_size -= piece.length;
+  for (const Piece &piece : restored)
+    m_size += piece.length;
+  m_pieces = m_pieces.mid(0, change.index) + restored + m_pieces.mid(change.index + removed.size());
+
+  to.append(change);
+  m_modified = true;
+  m_revision++;
+  m_lastInsertEnd = -1;
+  invalidateLines(change.position);
+  return change.position;
+}
+
+qint64 PieceTable::undo()
+{
+  return restore(m_undo, m_redo, true);
+}
+
+qint64 PieceTable::redo()
+{
+  return restore(m_redo, m_undo, false);
+}
+
+qint64 PieceTable::lineStart(qint64 position) const
+{
+  position = qBound<qint64>(0, position, m_size);
+  if (position <= m_indexedTo)
+    return *(std::upper_bound(m_lineStarts.begin(), m_lineStarts.end(), position) - 1);
+
+  // Past the index: walk back through the pieces to the previous newline
+  qint64 pieceStart = 0;
+  int i = findPiece(position, &pieceStart);
+  qint64 end = position - pieceStart;
+  for (; i >= 0; --i)
+  {
+    if (i < m_pieces.size())
+    {
+      const char *text = data(m_pieces.at(i));
+      for (qint64 j = end - 1; j >= 0; --j)
+      {
+        if (text[j] == '\n')
+          return pieceStart + j + 1;
+      }
+    }
+    if (i > 0)
+    {
+      pieceStart -= m_pieces.at(i - 1).length;
+      end = m_pieces.at(i - 1).length;
+    }
+  }
+  return 0;
+}
+
+qint64 PieceTable::nextLineStart(qint64 position) const
+{
+  position = qBound<qint64>(0, position, m_size);
+  qint64 pieceStart = 0;
+  for (int i = findPiece(position, &pieceStart); i < m_pieces.size(); ++i)
+  {
+    const Piece &piece = m_pieces.at(i);
+    qint64 skip = qMax<qint64>(0, position - pieceStart);
+    const char *text = data(piece);
+    const void *found = std::memchr(text + skip, '\n', size_t(piece.length - skip));
+    if (found)
+      return pieceStart + (static_cast<const char *>(found) - text) + 1;
+    pieceStart += piece.length;
+  }
+  return m_size;
+}
+
+void PieceTable::invalidateLines(qint64 position)
+{
+  // Line starts at or before the edit are still right
+  auto firstStale = std::upper_bound(m_lineStarts.begin(), m_lineStarts.end(), position);
+  m_lineStarts.erase(firstStale, m_lineStarts.end());
+  m_indexedTo = qMin(m_indexedTo, position);
+}
+
+void PieceTable::indexLinesUntil(qint64 position, int line)
+{
+  // Until position is covered and the line is known, or the text runs out
+  while (m_indexedTo < m_size && (m_indexedTo < position || m_lineStarts.size() <= line))
+  {
+    qint64 pieceStart = 0;
+    int i = findPiece(m_indexedTo, &pieceStart);
+    qint64 budget = IndexChunk;
+    for (; i < m_pieces.size() && budget > 0; ++i)
+    {
+      const Piece &piece = m_pieces.at(i);
+      const char *text = data(piece);
+      qint64 skip = m_indexedTo - pieceStart;
+      qint64 end = qMin(piece.length, skip + budget);
+      const char *p = text + skip;
+      const char *stop = text + end;
+      while (p < stop)
+      {
+        const void *found = std::memchr(p, '\n', size_t(stop - p));
+        if (!found)
+          break;
+        p = static_cast<const char *>(found) + 1;
+        m_lineStarts.append(pieceStart + (p - text));
+      }
+      budget -= end - skip;
+      m_indexedTo = pieceStart + end;
+      pieceStart += piece.length;
+    }
+  }
+}
+
+int PieceTable::lineAt(qint64 position)
+{
+  position = qBound<qint64>(0, position, m_size);
+  indexLinesUntil(position, -1);
+  return int(std::upper_bound(m_lineStarts.begin(), m_lineStarts.end(), position) - m_lineStarts.begin()) - 1;
+}
+
+qint64 PieceTable::lineStartOf(int line)
+{
+  indexLinesUntil(-1, line);
+  return m_lineStarts.at(qBound(0, line, int(m_lineStarts.size()) - 1));
+}
+
+int PieceTable::estimatedLineCount() const
+{
+  if (isLineCountKnown())
+    return int(m_lineStarts.size());
+  if (m_indexedTo == 0)
+    return int(m_size / 80) + 1;
+  double perByte = double(m_lineStarts.size()) / double(m_indexedTo);
+  return int(m_lineStarts.size() + perByte * double(m_size - m_indexedTo));
+}
+
+qint64 PieceTable::memoryUsage() const
+{
+  qint64 undo = 0;
+  for (const Change &change : m_undo)
+    undo += (change.before.size() + change.after.size()) * qint64(sizeof(Piece));
+  for (const Change &change : m_redo)
+    undo += (change.before.size() + change.after.size()) * qint64(sizeof(Piece));
+  return m_added.capacity() + m_pieces.size() * qint64(sizeof(Piece)) + m_lineStarts.size() * qint64(sizeof(qint64)) +
+         undo;
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <QtCore/QByteArray>
+#include <QtCore/QFile>
+#include <QtCore/QString>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QVector>
+#include "DocumentWriter.h"
+
+// UTF-8 text as a sequence of pieces over two buffers: the original file,
+// mapped read-only, and an append-only buffer holding everything typed
+// since. An edit only splits or adds pieces, so opening costs the same for
+// any file size and memory stays close to the file plus what was typed.
+// Undo keeps, per step, only the run of pieces the edit replaced and the
+// run that replaced it, never text.
+//
+// Line starts are indexed lazily: the index only ever covers a prefix of
+// the text, extended with memchr when a line beyond it is asked for, and
+// cut back to the edit point by every edit.
+class PieceTable
+{
+public:
+  PieceTable();
+  ~PieceTable();
+
+  bool open(const QString &filePath, QString *error);
+  void close();
+  bool isOpen() const { return !m_original.isNull(); }
+  // False once another process has truncated the mapped file, after which
+  // reading the pieces over it would fault
+  bool isOriginalIntact() const;
+  QString filePath() const { return m_original ? m_original->file.fileName() : QString(); }
+  // The current text for DocumentWriter to stream out; it stays valid
+  // whatever happens to the table meanwhile. Leaves isModified() alone.
+  DocumentWriter::Producer snapshot() const;
+
+  qint64 size() const { return m_size; }
+  QByteArray bytes(qint64 position, qint64 length) const;
+  QString text(qint64 position, qint64 length) const { return QString::fromUtf8(bytes(position, length)); }
+  char at(qint64 position) const;
+
+  void insert(qint64 position, const QByteArray &utf8);
+  void remove(qint64 position, qint64 length);
+
+  bool canUndo() const { return !m_undo.isEmpty(); }
+  bool canRedo() const { return !m_redo.isEmpty(); }
+  // Each returns where the change happened, or -1
+  qint64 undo();
+  qint64 redo();
+  bool isModified() const { return m_modified; }
+  void setModified(bool modified) { m_modified = modified; }
+  // Goes up with every edit, undo and redo, across files
+  quint64 revision() const { return m_revision; }
+
+  // Start of the line holding position, and of the line after it (or size())
+  qint64 lineStart(qint64 position) const;
+  qint64 nextLineStart(qint64 position) const;
+
+  // Line numbers are 0-based and go through the lazy index
+  int lineAt(qint64 position);
+  qint64 lineStartOf(int line);
+  bool isLineCountKnown() const { return m_indexedTo >= m_size; }
+  // Exact once the index reaches the end, else extrapolated from it
+  int estimatedLineCount() const;
+
+  // Roughly what the table holds on top of the mapped file
+  qint64 memoryUsage() const;
+
+private:
+  enum Buffer
+  {
+    Original,
+    Added
+  };
+
+  struct Piece
+  {
+    Buffer buffer;
+    qint64 start;
+    qint64 length;
+  };
+
+  // Shared with snapshots, so closing the table never unmaps the file
+  // from under a save that is still streaming from it
+  struct MappedFile
+  {
+    QFile file;
+    const char *data = nullptr;
+    qint64 size = 0;
+    ~MappedFile();
+    bool isIntact() const;
+  };
+
+  // Pieces from index on were before, and after the edit are after
+  struct Change
+  {
+    int index;
+    QVector<Piece> before;
+    QVector<Piece> after;
+    qint64 position;
+  };
+
+  const char *data(const Piece &piece) const;
+  // Index of the piece holding position and that piece's start offset
+  int findPiece(qint64 position, qint64 *pieceStart) const;
+  void splitAt(qint64 position, int *index);
+  // Bracket an edit of [from, to): the pieces it may touch, then the step
+  int beginEdit(qint64 from, qint64 to, QVector<Piece> *before) const;
+  void recordUndo(qint64 position, int index, const QVector<Piece> &before, int oldCount, bool extend);
+  void invalidateLines(qint64 position);
+  void indexLinesUntil(qint64 position, int line);
+  qint64 restore(QVector<Change> &from, QVector<Change> &to, bool undoing);
+
+  QSharedPointer<MappedFile> m_original;
+  QByteArray m_added;
+  QVector<Piece> m_pieces;
+  qint64 m_size;
+  bool m_modified;
+  quint64 m_revision;
+
+  QVector<Change> m_undo;
+  QVector<Change> m_redo;
+  // Typing extends the last undo step rather than adding one per key
+  qint64 m_lastInsertEnd;
+
+  // Line starts up to m_indexedTo; always begins with 0
+  QVector<qint64> m_lineStarts;
+  qint64 m_indexedTo;
+};
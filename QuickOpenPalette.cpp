@@ -0,0 +1,187 @@
+#include "QuickOpenPalette.h"
+#include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QDebug>
+#include <QtGui/QKeyEvent>
+#include <QtWidgets/QVBoxLayout>
+
+namespace
+{
+  const int MaxResults = 50;
+}
+
+QuickOpenPalette::QuickOpenPalette(QWidget *parent)
+    : QFrame(parent), m_stale(true), m_query(new QLineEdit(this)), m_results(new QListWidget(this))
+{
+  QVBoxLayout *layout = new QVBoxLayout(this);
+  layout->setContentsMargins(1, 1, 1, 1);
+  layout->setSpacing(0);
+  layout->addWidget(m_query);
+  layout->addWidget(m_results);
+
+  m_query->setPlaceholderText("Open file by name");
+  m_query->installEventFilter(this);
+  // Keys stay in the query; the list only follows them
+  m_results->setFocusPolicy(Qt::NoFocus);
+  m_results->setUniformItemSizes(true);
+
+  setObjectName("quickOpen");
+  setStyleSheet(
+      "#quickOpen { "
+      "    background-color: #171717; "
+      "    border: 1px solid #3D3D3D; "
+      "} "
+      "QLineEdit { "
+      "    background-color: #202020; "
+      "    border: none; "
+      "    border-bottom: 1px solid #2D2D2D; "
+      "    padding: 8px; "
+      "} "
+      "QListWidget { "
+      "    background-color: #171717; "
+      "    border: none; "
+      "} "
+      "QListWidget::item { "
+      "    padding: 4px 8px; "
+      "} "
+      "QListWidget::item:selected { "
+      "    background-color: #2D2D2D; "
+      "}");
+
+  connect(m_query, &QLineEdit::textChanged, this, &QuickOpenPalette::updateResults);
+  connect(m_results, &QListWidget::itemClicked, this, [this](QListWidgetItem *item)
+          {
+    m_results->setCurrentItem(item);
+    accept(); });
+
+  hide();
+}
+
+void QuickOpenPalette::addSource(const MetadataIndex *index)
+{
+  m_sources.append(index);
+  connect(index, &MetadataIndex::filesChanged, this, [this]()
+          { m_stale = true; });
+  m_stale = true;
+}
+
+void QuickOpenPalette::setSubfolderFiles(const QHash<QString, QVector<FileMetadata>> &files)
+{
+  m_subfolderFiles = files;
+  m_stale = true;
+}
+
+void QuickOpenPalette::popup()
+{
+  if (m_stale)
+    rebuildCandidates();
+
+  QWidget *area = parentWidget();
+  int width = qMin(640, area->width() - 40);
+  int height = qMin(400, area->height() - 80);
+  setGeometry((area->width() - width) / 2, 60, width, height);
+
+  m_query->clear();
+  updateResults();
+  show();
+  raise();
+  m_query->setFocus();
+}
+
+void QuickOpenPalette::rebuildCandidates()
+{
+  QElapsedTimer timer;
+  timer.start();
+
+  int count = 0;
+  for (const MetadataIndex *source : m_sources)
+    count += source->count() + int(m_subfolderFiles.value(source->directory()).size());
+  m_matcher.clear();
+  m_matcher.reserve(count, count * 32);
+  m_paths.clear();
+  m_paths.reserve(count);
+
+  for (const MetadataIndex *source : m_sources)
+  {
+    // Matched as "location/name"
+    const QString prefix = QDir(source->directory()).dirName() + "/";
+    source->forEachFile([&](const FileMetadata &file)
+                        {
+      QString name = QFileInfo(file.path).fileName();
+      m_matcher.addCandidate(QString(prefix + name), int(prefix.size()), file.modified);
+      m_paths.append(file.path); });
+
+    // Further down as "location/subfolder/name"
+    const int skip = int(source->directory().size()) + 1;
+    for (const FileMetadata &file : m_subfolderFiles.value(source->directory()))
+    {
+      QString candidate = prefix + file.path.mid(skip);
+      m_matcher.addCandidate(candidate, int(candidate.lastIndexOf('/')) + 1, file.modified);
+      m_paths.append(file.path);
+    }
+  }
+  m_stale = false;
+  qDebug().noquote() << "Quick open:" << m_paths.size() << "candidates in" << timer.elapsed() << "ms";
+}
+
+void QuickOpenPalette::updateResults()
+{
+  QElapsedTimer timer;
+  timer.start();
+  QVector<FuzzyMatcher::Match> matches = m_matcher.match(m_query->text(), MaxResults);
+  qint64 elapsedUs = timer.nsecsElapsed() / 1000;
+
+  m_results->clear();
+  for (const FuzzyMatcher::Match &match : matches)
+  {
+    const QString &path = m_paths.at(match.candidate);
+    QFileInfo info(path);
+    QListWidgetItem *item = new QListWidgetItem(info.fileName() + "  —  " + QDir(info.path()).dirName(), m_results);
+    item->setData(Qt::UserRole, path);
+    item->setToolTip(path);
+  }
+  m_results->setCurrentRow(0);
+
+  if (elapsedUs > 5000)
+    qDebug().noquote() << "Quick open: ranking" << m_paths.size() << "candidates took" << elapsedUs << "us";
+}
+
+void QuickOpenPalette::accept()
+{
+  QListWidgetItem *item = m_results->currentItem();
+  hide();
+  if (item)
+    emit fileSelected(item->data(Qt::UserRole).toString());
+}
+
+bool QuickOpenPalette::eventFilter(QObject *watched, QEvent *event)
+{
+  if (watched == m_query && event->type() == QEvent::KeyPress)
+  {
+    QKeyEvent *keyEvent = static_cast<QKeyEvent *>(event);
+    switch (keyEvent->key())
+    {
+    case Qt::Key_Escape:
+      hide();
+      return true;
+    case Qt::Key_Return:
+    case Qt::Key_Enter:
+      accept();
+      return true;
+    case Qt::Key_Down:
+      m_results->setCurrentRow(qMin(m_results->currentRow() + 1, m_results->count() - 1));
+      return true;
+    case Qt::Key_Up:
+      m_results->setCurrentRow(qMax(m_results->currentRow() - 1, 0));
+      return true;
+    default:
+      break;
+    }
+  }
+  else if (watched == m_query && event->type() == QEvent::FocusOut)
+  {
+    // Clicking anywhere else dismisses it
+    hide();
+  }
+  return QFrame::eventFilter(watched, event);
+}
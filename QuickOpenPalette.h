@@ -0,0 +1,49 @@
+#pragma once
+
+#include <QtWidgets/QFrame>
+#include <QtWidgets/QLineEdit>
+#include <QtWidgets/QListWidget>
+#include "FuzzyMatcher.h"
+#include "MetadataIndex.h"
+
+// Ctrl+P overlay that fuzzy-matches "location/file name" across every
+// location, and "location/subfolder/file name" for files further down.
+// Candidates come from the metadata indexes and the subfolder scans and are
+// only rebuilt when one of them reported a change since the last time it
+// opened; each keystroke re-ranks them all.
+class QuickOpenPalette : public QFrame
+{
+  Q_OBJECT
+
+public:
+  explicit QuickOpenPalette(QWidget *parent);
+
+  void addSource(const MetadataIndex *index);
+  // Files below the sources' top level, keyed by the source's directory
+  void setSubfolderFiles(const QHash<QString, QVector<FileMetadata>> &files);
+  // Shows it over the top of the parent with an empty query
+  void popup();
+
+signals:
+  void fileSelected(const QString &filePath);
+
+protected:
+  bool eventFilter(QObject *watched, QEvent *event) override;
+
+private slots:
+  void updateResults();
+
+private:
+  void rebuildCandidates();
+  void accept();
+
+  QVector<const MetadataIndex *> m_sources;
+  QHash<QString, QVector<FileMetadata>> m_subfolderFiles;
+  FuzzyMatcher m_matcher;
+  // Parallel to the matcher's candidates
+  QStringList m_paths;
+  bool m_stale;
+
+  QLineEdit *m_query;
+  QListWidget *m_results;
+};
@@ -0,0 +1,219 @@
+#include "RegexSearcher.h"
+
+namespace
+{
+  // Shorter literals occur on nearly every line and filter nothing
+  const int MinLiteralLength = 2;
+
+  bool isQuantifierAt(const QString &pattern, int i, int *end, int *minimum)
+  {
+    // {n}, {n,}, {n,m} or, since PCRE2 10.43, {,m}, which may also have
+    // spaces inside; anything else is a literal brace
+    auto skipSpaces = [&](int j)
+    {
+      while (j < pattern.size() && (pattern.at(j) == u' ' || pattern.at(j) == u'\t'))
+        ++j;
+      return j;
+    };
+    auto readNumber = [&](int j, int *value)
+    {
+      *value = 0;
+      while (j < pattern.size() && pattern.at(j).isDigit())
+      {
+        *value = qMin(*value * 10 + pattern.at(j).digitValue(), 100000);
+        ++j;
+      }
+      return j;
+    };
+
+    int value = 0;
+    int start = skipSpaces(i + 1);
+    int j = readNumber(start, &value);
+    bool lower = j > start;
+    bool upper = false;
+    j = skipSpaces(j);
+    if (j < pattern.size() && pattern.at(j) == u',')
+    {
+      int unused = 0;
+      start = skipSpaces(j + 1);
+      j = readNumber(start, &unused);
+      upper = j > start;
+      j = skipSpaces(j);
+    }
+    if (!lower && !upper)
+      return false;
+    if (j >= pattern.size() || pattern.at(j) != u'}')
+      return false;
+    *end = j;
+    *minimum = lower ? value : 0;
+    return true;
+  }
+}
+
+RegexSearcher::RegexSearcher()
+    : m_lineBound(false)
+{
+}
+
+RegexSearcher::RegexSearcher(const QString &pattern, LiteralSearcher::Options options)
+    : m_pattern(pattern), m_options(options), m_lineBound(false)
+{
+  if (m_pattern.isEmpty())
+    return;
+
+  QString expression = m_pattern;
+  if (m_options & LiteralSearcher::WholeWords)
+    expression = "\\b(?:" + expression + ")\\b";
+
+  QRegularExpression::PatternOptions patternOptions = QRegularExpression::MultilineOption;
+  if (m_options & LiteralSearcher::CaseInsensitive)
+    patternOptions |= QRegularExpression::CaseInsensitiveOption;
+  m_regex = QRegularExpression(expression, patternOptions);
+  if (!m_regex.isValid())
+    return;
+  // JIT-compile now rather than on the first match
+  m_regex.optimize();
+
+  m_lineBound = !mayCrossLines(m_pattern);
+  if (m_lineBound)
+  {
+    QString literal = extractRequiredLiteral(m_pattern);
+    if (literal.size() >= MinLiteralLength)
+      m_literal = LiteralSearcher(literal, m_options & LiteralSearcher::CaseInsensitive);
+  }
+}
+
+QRegularExpressionMatchIterator RegexSearcher::matchesIn(QStringView text) const
+{
+#if QT_VERSION >= QT_VERSION_CHECK(6, 5, 0)
+  return m_regex.globalMatchView(text);
+#else
+  return m_regex.globalMatch(text);
+#endif
+}
+
+bool RegexSearcher::mayCrossLines(const QString &pattern)
+{
+  // Anything that can match a line break, anchors that mean something
+  // different inside a line, and escapes too involved to reason about
+  static const char *const crossing[] = {"\\n", "\\r", "\\s", "\\W", "\\D", "\\H", "\\V", "\\R", "\\v", "\\X",
+                                         "\\C", "\\x", "\\u", "\\0", "\\o", "\\p", "\\P", "\\c", "\\Q", "\\A",
+                                         "\\z", "\\Z", "\\G", "[^", "(?s", "(?-", "\n", "\r"};
+  for (const char *sequence : crossing)
+  {
+    if (pattern.contains(QLatin1String(sequence)))
+      return true;
+  }
+
+  // Inline options such as (?i) or (?x) change how the rest reads
+  for (qsizetype i = pattern.indexOf("(?"); i >= 0; i = pattern.indexOf("(?", i + 2))
+  {
+    if (i + 2 < pattern.size() && pattern.at(i + 2).isLetter())
+      return true;
+  }
+  return false;
+}
+
+QString RegexSearcher::extractRequiredLiteral(const QString &pattern)
+{
+  // Only runs at the top level count: groups may be optional or hold
+  // alternatives, and a top-level | makes every run optional
+  QString best;
+  QString run;
+  auto endRun = [&]()
+  {
+    if (run.size() > best.size())
+      best = run;
+    run.clear();
+  };
+
+  for (int i = 0; i < pattern.size(); ++i)
+  {
+    QChar c = pattern.at(i);
+    if (c == u'\\')
+    {
+      if (i + 1 >= pattern.size())
+        break;
+      QChar next = pattern.at(++i);
+      if (!next.isLetterOrNumber())
+      {
+        run += next;
+        continue;
+      }
+      // Escapes whose argument follows them, like \x41 or \p{L}, are not
+      // worth parsing
+      if (QStringLiteral("xuopPNckgQE").contains(next))
+        return QString();
+      endRun();
+    }
+    else if (c == u'[')
+    {
+      endRun();
+      int j = i + 1;
+      if (j < pattern.size() && pattern.at(j) == u'^')
+        ++j;
+      if (j < pattern.size() && pattern.at(j) == u']')
+        ++j;
+      while (j < pattern.size() && pattern.at(j) != u']')
+        j += pattern.at(j) == u'\\' ? 2 : 1;
+      i = j;
+    }
+    else if (c == u'(')
+    {
+      endRun();
+      int depth = 1;
+      int j = i + 1;
+      bool inClass = false;
+      for (; j < pattern.size() && depth > 0; ++j)
+      {
+        QChar g = pattern.at(j);
+        if (g == u'\\')
+          ++j;
+        else if (inClass)
+          inClass = g != u']';
+        else if (g == u'[')
+          inClass = true;
+        else if (g == u'(')
+          ++depth;
+        else if (g == u')')
+          --depth;
+      }
+      i = j - 1;
+    }
+    else if (c == u'|')
+    {
+      return QString();
+    }
+    else if (c == u'*' || c == u'?')
+    {
+      // The character before is optional
+      if (!run.isEmpty())
+        run.chop(1);
+      endRun();
+    }
+    else if (c == u'{')
+    {
+      int end = 0;
+      int minimum = 0;
+      if (!isQuantifierAt(pattern, i, &end, &minimum))
+      {
+        run += c;
+        continue;
+      }
+      if (minimum == 0 && !run.isEmpty())
+        run.chop(1);
+      endRun();
+      i = end;
+    }
+    else if (c == u'+' || c == u'.' || c == u'^' || c == u'$' || c == u')')
+    {
+      endRun();
+    }
+    else
+    {
+      run += c;
+    }
+  }
+  endRun();
+  return best;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <QtCore/QRegularExpression>
+#include <QtCore/QString>
+#include <QtCore/QStringView>
+#include "LiteralSearcher.h"
+
+// Regular expression search that avoids running the regex over text that
+// cannot match. The pattern is scanned for a literal that every match must
+// contain, such as "todo(" in "todo\(\w+\):"; when one exists and no match
+// can cross a line break, LiteralSearcher finds each occurrence and the
+// regex only runs over the line around it. Otherwise the regex makes one
+// pass over the whole text, which is still a single JIT-compiled scan
+// rather than one per block.
+class RegexSearcher
+{
+public:
+  RegexSearcher();
+  explicit RegexSearcher(const QString &pattern, LiteralSearcher::Options options = LiteralSearcher::CaseInsensitive);
+
+  const QString &pattern() const { return m_pattern; }
+  LiteralSearcher::Options options() const { return m_options; }
+  bool isEmpty() const { return m_pattern.isEmpty(); }
+  bool isValid() const { return m_regex.isValid(); }
+  QString errorString() const { return m_regex.errorString(); }
+  const QRegularExpression &regex() const { return m_regex; }
+
+  // Every match lies within one line
+  bool isLineBound() const { return m_lineBound; }
+  // The prefilter literal, empty if the regex runs over all the text
+  QString requiredLiteral() const { return m_literal.pattern(); }
+
+  // Calls visit(match, base) for each non-empty match left to right, where
+  // base + match.capturedStart() is the offset in text; stops early when
+  // visit returns false
+  template <typename Visitor>
+  void forEachMatch(QStringView text, Visitor visit) const
+  {
+    if (isEmpty() || !isValid())
+      return;
+    if (m_literal.isEmpty())
+    {
+      visitMatches(text, 0, visit);
+      return;
+    }
+
+    qsizetype from = 0;
+    while (from < text.size())
+    {
+      int found = m_literal.indexIn(text, int(from));
+      if (found < 0)
+        return;
+      qsizetype lineStart = found > 0 ? text.lastIndexOf(u'\n', found - 1) + 1 : 0;
+      qsizetype lineEnd = text.indexOf(u'\n', found);
+      if (lineEnd < 0)
+        lineEnd = text.size();
+      if (!visitMatches(text.mid(lineStart, lineEnd - lineStart), lineStart, visit))
+        return;
+      from = lineEnd + 1;
+    }
+  }
+
+  // Pattern text for the literal every match of pattern contains, or an
+  // empty string when there is none worth filtering on
+  static QString extractRequiredLiteral(const QString &pattern);
+
+private:
+  template <typename Visitor>
+  bool visitMatches(QStringView text, qsizetype base, Visitor &visit) const
+  {
+    QRegularExpressionMatchIterator it = matchesIn(text);
+    while (it.hasNext())
+    {
+      QRegularExpressionMatch match = it.next();
+      // Replacing or highlighting empty matches is never what was meant
+      if (match.capturedLength() == 0)
+        continue;
+      if (!visit(match, base))
+        return false;
+    }
+    return true;
+  }
+
+  QRegularExpressionMatchIterator matchesIn(QStringView text) const;
+  static bool mayCrossLines(const QString &pattern);
+
+  QString m_pattern;
+  LiteralSearcher::Options m_options;
+  QRegularExpression m_regex;
+  LiteralSearcher m_literal;
+  bool m_lineBound;
+};
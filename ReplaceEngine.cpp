@@ -0,0 +1,129 @@
+#include "ReplaceEngine.h"
+#include <QtCore/QElapsedTimer>
+#include <QtGui/QTextCursor>
+
+ReplaceEngine::Result ReplaceEngine::computeEdits(const QString &text, const QString &pattern, const QString &replacement,
+                                                  Mode mode, LiteralSearcher::Options options)
+{
+  Result result;
+  QElapsedTimer timer;
+  timer.start();
+
+  if (pattern.isEmpty())
+    return result;
+
+  if (mode == Literal)
+  {
+    LiteralSearcher searcher(pattern, options);
+    QVector<int> matches;
+    searcher.findAll(text, 0, int(text.size()), 0, matches);
+
+    result.edits.reserve(matches.size());
+    for (int start : matches)
+    {
+      Edit edit;
+      edit.position = start;
+      edit.length = int(pattern.size());
+      edit.replacement = replacement;
+      result.edits.append(edit);
+    }
+  }
+  else
+  {
+    RegexSearcher searcher(pattern, options);
+    if (!searcher.isValid())
+    {
+      result.error = searcher.errorString();
+      return result;
+    }
+
+    searcher.forEachMatch(text, [&](const QRegularExpressionMatch &match, qsizetype base)
+                          {
+      Edit edit;
+      edit.position = int(base + match.capturedStart());
+      edit.length = int(match.capturedLength());
+      edit.replacement = expand(replacement, match);
+      result.edits.append(edit);
+      return true; });
+  }
+
+  result.elapsedMs = timer.elapsed();
+  return result;
+}
+
+void ReplaceEngine::apply(QTextDocument *document, const QVector<Edit> &edits)
+{
+  if (!document || edits.isEmpty())
+    return;
+
+  // Back to front so each edit leaves the offsets before it untouched
+  QTextCursor cursor(document);
+  cursor.beginEditBlock();
+  for (int i = edits.size() - 1; i >= 0; --i)
+  {
+    const Edit &edit = edits.at(i);
+    cursor.setPosition(edit.position);
+    cursor.setPosition(edit.position + edit.length, QTextCursor::KeepAnchor);
+    cursor.insertText(edit.replacement);
+  }
+  cursor.endEditBlock();
+}
+
+QString ReplaceEngine::expand(const QString &replacement, const QRegularExpressionMatch &match)
+{
+  QString result;
+  result.reserve(replacement.size());
+
+  for (int i = 0; i < replacement.size(); ++i)
+  {
+    QChar c = replacement.at(i);
+    if ((c == '\\' || c == '$') && i + 1 < replacement.size())
+    {
+      QChar next = replacement.at(i + 1);
+      if (next == c)
+      {
+        result += c;
+        i++;
+        continue;
+      }
+      if (next.isDigit())
+      {
+        // Take up to two digits, as long as they name an existing group
+        int group = next.digitValue();
+        int consumed = 1;
+        if (i + 2 < replacement.size() && replacement.at(i + 2).isDigit())
+        {
+          int twoDigits = group * 10 + replacement.at(i + 2).digitValue();
+          if (twoDigits <= match.lastCapturedIndex())
+          {
+            group = twoDigits;
+            consumed = 2;
+          }
+        }
+        result += match.captured(group);
+        i += consumed;
+        continue;
+      }
+      if (c == '$' && next == '&')
+      {
+        result += match.captured(0);
+        i++;
+        continue;
+      }
+      if (c == '\\' && next == 'n')
+      {
+        result += '\n';
+        i++;
+        continue;
+      }
+      if (c == '\\' && next == 't')
+      {
+        result += '\t';
+        i++;
+        continue;
+      }
+    }
+    result += c;
+  }
+  return result;
+}
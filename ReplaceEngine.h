@@ -0,0 +1,44 @@
+#pragma once
+
+#include <QtCore/QString>
+#include <QtCore/QVector>
+#include <QtCore/QRegularExpression>
+#include <QtGui/QTextDocument>
+#include "LiteralSearcher.h"
+#include "RegexSearcher.h"
+
+// Replace-all in two halves: computeEdits() finds every match in one pass
+// over a plain-text snapshot and is safe to run on a worker thread, then
+// apply() patches the document back to front inside a single edit block so
+// the whole replacement is one undo step.
+class ReplaceEngine
+{
+public:
+  enum Mode
+  {
+    Literal,
+    Regex
+  };
+
+  struct Edit
+  {
+    int position = 0;
+    int length = 0;
+    QString replacement;
+  };
+
+  struct Result
+  {
+    QVector<Edit> edits;
+    QString error;
+    qint64 elapsedMs = 0;
+  };
+
+  static Result computeEdits(const QString &text, const QString &pattern, const QString &replacement,
+                             Mode mode, LiteralSearcher::Options options = LiteralSearcher::CaseInsensitive);
+  static void apply(QTextDocument *document, const QVector<Edit> &edits);
+
+  // Expands \N and $N references to capture groups, $& to the whole
+  // match, plus \n and \t; \\ and $$ stand for themselves
+  static QString expand(const QString &replacement, const QRegularExpressionMatch &match);
+};
@@ -0,0 +1,1118 @@
+#include "SearchIndex.h"
+#include <QtConcurrent/QtConcurrentRun>
+#include <QtCore/QDataStream>
+#include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QSaveFile>
+#include <QtCore/QStandardPaths>
+#include <QtCore/QtEndian>
+#include <QtCore/QDebug>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+namespace
+{
+  const quint32 SegmentMagic = 0x53534857; // "WHSS"
+  const quint32 SegmentVersion = 1;
+  const quint32 ManifestMagic = 0x4d534857; // "WHSM"
+  const quint32 ManifestVersion = 1;
+
+  // Text tokenized into one segment before it is written out
+  const qint64 SegmentTextBudget = 32 * 1024 * 1024;
+  const int MaxSegments = 8;
+  const int SegmentsPerMerge = 6;
+  const int MaxTermLength = 64;
+
+  // Saves come in bursts; index them together. A batch that could not be
+  // written is tried again after a longer wait, as the disk is likely full.
+  const int IndexDelay = 500;
+  const int RetryDelay = 30 * 1000;
+
+  // BM25 parameters
+  const double K1 = 1.2;
+  const double B = 0.75;
+
+  // All fields little-endian
+  struct SegmentHeader
+  {
+    quint32 magic;
+    quint32 version;
+    quint32 termCount;
+    quint32 documentCount;
+    quint64 postingsOffset;
+    quint64 stringsOffset;
+    quint64 termsOffset;
+  };
+
+  struct TermEntry
+  {
+    quint32 stringOffset;
+    quint32 stringLength;
+    quint32 documentFrequency;
+    quint32 reserved;
+    quint64 postingsOffset;
+    quint64 postingsLength;
+  };
+
+  static_assert(sizeof(SegmentHeader) == 40, "segment header layout");
+  static_assert(sizeof(TermEntry) == 32, "term entry layout");
+
+  void appendVarint(QByteArray &out, quint32 value)
+  {
+    while (value >= 0x80)
+    {
+      out.append(char(value | 0x80));
+      value >>= 7;
+    }
+    out.append(char(value));
+  }
+
+  bool readVarint(const uchar *&p, const uchar *end, quint32 *value)
+  {
+    quint32 result = 0;
+    for (int shift = 0; p < end && shift < 35; shift += 7)
+    {
+      uchar byte = *p++;
+      result |= quint32(byte & 0x7f) << shift;
+      if (!(byte & 0x80))
+      {
+        *value = result;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Lowercased runs of letters and digits, numbered in order. The visitor
+  // gets the term, its position and its offset in text, and returns false
+  // to stop.
+  template <typename Visitor>
+  void tokenize(QStringView text, Visitor visit)
+  {
+    quint32 position = 0;
+    const qsizetype length = text.size();
+    for (qsizetype i = 0; i < length;)
+    {
+      if (!text[i].isLetterOrNumber())
+      {
+        ++i;
+        continue;
+      }
+      qsizetype start = i;
+      while (i < length && text[i].isLetterOrNumber())
+        ++i;
+      if (i - start <= MaxTermLength && !visit(text.mid(start, i - start).toString().toLower(), position, start))
+        return;
+      ++position;
+    }
+  }
+
+  QStringList queryTerms(QStringView text)
+  {
+    QStringList terms;
+    tokenize(text, [&terms](const QString &term, quint32, qsizetype)
+             {
+      terms.append(term);
+      return true; });
+    return terms;
+  }
+
+  // Walks one term's postings
+  struct PostingReader
+  {
+    PostingReader(const uchar *data, quint64 length)
+        : p(data), end(data + length)
+    {
+    }
+
+    bool next()
+    {
+      quint32 delta = 0;
+      quint32 positionBytes = 0;
+      if (p >= end || !readVarint(p, end, &delta) || !readVarint(p, end, &frequency) ||
+          !readVarint(p, end, &positionBytes) || positionBytes > quint64(end - p))
+        return false;
+      document += delta;
+      positions = p;
+      positionsEnd = p + positionBytes;
+      p = positionsEnd;
+      return true;
+    }
+
+    QVector<quint32> decodePositions() const
+    {
+      QVector<quint32> out;
+      out.reserve(frequency);
+      const uchar *q = positions;
+      quint32 value = 0;
+      quint32 delta = 0;
+      while (q < positionsEnd && readVarint(q, positionsEnd, &delta))
+      {
+        value += delta;
+        out.append(value);
+      }
+      return out;
+    }
+
+    const uchar *p;
+    const uchar *end;
+    quint32 document = 0;
+    quint32 frequency = 0;
+    const uchar *positions = nullptr;
+    const uchar *positionsEnd = nullptr;
+  };
+
+  // Writes a segment whose terms arrive in increasing byte order. Postings
+  // are streamed out first; the header is rewritten once their size is known.
+  class SegmentWriter
+  {
+  public:
+    explicit SegmentWriter(const QString &path)
+        : m_file(path), m_termCount(0), m_postingsSize(0)
+    {
+    }
+
+    bool open()
+    {
+      if (!m_file.open(QIODevice::WriteOnly))
+        return false;
+      SegmentHeader header = {};
+      return m_file.write(reinterpret_cast<const char *>(&header), sizeof(header)) == qint64(sizeof(header));
+    }
+
+    void addTerm(const QByteArray &term, quint32 documentFrequency, const QByteArray &postings)
+    {
+      TermEntry entry = {};
+      entry.stringOffset = qToLittleEndian(quint32(m_strings.size()));
+      entry.stringLength = qToLittleEndian(quint32(term.size()));
+      entry.documentFrequency = qToLittleEndian(documentFrequency);
+      entry.postingsOffset = qToLittleEndian(quint64(sizeof(SegmentHeader)) + m_postingsSize);
+      entry.postingsLength = qToLittleEndian(quint64(postings.size()));
+      m_table.append(reinterpret_cast<const char *>(&entry), sizeof(entry));
+      m_strings += term;
+      m_file.write(postings);
+      m_postingsSize += postings.size();
+      ++m_termCount;
+    }
+
+    bool commit(quint32 documentCount)
+    {
+      quint64 stringsOffset = sizeof(SegmentHeader) + m_postingsSize;
+      m_file.write(m_strings);
+      m_file.write(m_table);
+
+      SegmentHeader header = {};
+      header.magic = qToLittleEndian(SegmentMagic);
+      header.version = qToLittleEndian(SegmentVersion);
+      header.termCount = qToLittleEndian(m_termCount);
+      header.documentCount = qToLittleEndian(documentCount);
+      header.postingsOffset = qToLittleEndian(quint64(sizeof(SegmentHeader)));
+      header.stringsOffset = qToLittleEndian(stringsOffset);
+      header.termsOffset = qToLittleEndian(stringsOffset + m_strings.size());
+      if (!m_file.seek(0) || m_file.write(reinterpret_cast<const char *>(&header), sizeof(header)) != qint64(sizeof(header)))
+      {
+        m_file.cancelWriting();
+        return false;
+      }
+      return m_file.commit();
+    }
+
+  private:
+    QSaveFile m_file;
+    QByteArray m_strings;
+    QByteArray m_table;
+    quint32 m_termCount;
+    quint64 m_postingsSize;
+  };
+
+  // Postings of new documents, appended in increasing ID order
+  class SegmentBuilder
+  {
+  public:
+    void addDocument(quint32 id, const QHash<QString, QVector<quint32>> &positions)
+    {
+      QByteArray encoded;
+      for (auto it = positions.constBegin(); it != positions.constEnd(); ++it)
+      {
+        Term &term = m_terms[it.key()];
+        appendVarint(term.postings, id - term.lastDocument);
+        appendVarint(term.postings, quint32(it->size()));
+
+        encoded.clear();
+        quint32 last = 0;
+        for (quint32 position : *it)
+        {
+          appendVarint(encoded, position - last);
+          last = position;
+        }
+        appendVarint(term.postings, quint32(encoded.size()));
+        term.postings += encoded;
+        term.lastDocument = id;
+        term.documentFrequency++;
+      }
+      ++m_documentCount;
+    }
+
+    bool isEmpty() const { return m_documentCount == 0; }
+
+    bool write(const QString &path) const
+    {
+      QVector<QPair<QByteArray, const Term *>> terms;
+      terms.reserve(m_terms.size());
+      for (auto it = m_terms.constBegin(); it != m_terms.constEnd(); ++it)
+        terms.append(qMakePair(it.key().toUtf8(), &it.value()));
+      std::sort(terms.begin(), terms.end(), [](const auto &a, const auto &b)
+                { return a.first < b.first; });
+
+      SegmentWriter writer(path);
+      if (!writer.open())
+        return false;
+      for (const auto &term : terms)
+        writer.addTerm(term.first, term.second->documentFrequency, term.second->postings);
+      return writer.commit(m_documentCount);
+    }
+
+  private:
+    struct Term
+    {
+      QByteArray postings;
+      quint32 lastDocument = 0;
+      quint32 documentFrequency = 0;
+    };
+
+    QHash<QString, Term> m_terms;
+    quint32 m_documentCount = 0;
+  };
+}
+
+// One mapped segment file
+class SearchIndex::Segment
+{
+public:
+  explicit Segment(const QString &path)
+      : m_file(path), m_data(nullptr), m_size(0), m_termCount(0), m_documentCount(0), m_stringsOffset(0),
+        m_termsOffset(0)
+  {
+  }
+
+  ~Segment()
+  {
+    if (m_data)
+      m_file.unmap(m_data);
+  }
+
+  bool open()
+  {
+    if (!m_file.open(QIODevice::ReadOnly))
+      return false;
+    m_size = m_file.size();
+    if (m_size < qint64(sizeof(SegmentHeader)))
+      return false;
+    m_data = m_file.map(0, m_size);
+    if (!m_data)
+      return false;
+
+    SegmentHeader header;
+    std::memcpy(&header, m_data, sizeof(header));
+    m_termCount = qFromLittleEndian(header.termCount);
+    m_documentCount = qFromLittleEndian(header.documentCount);
+    m_stringsOffset = qFromLittleEndian(header.stringsOffset);
+    m_termsOffset = qFromLittleEndian(header.termsOffset);
+    return qFromLittleEndian(header.magic) == SegmentMagic && qFromLittleEndian(header.version) == SegmentVersion &&
+           m_stringsOffset <= m_termsOffset && m_termsOffset + quint64(m_termCount) * sizeof(TermEntry) == quint64(m_size);
+  }
+
+  QString fileName() const { return QFileInfo(m_file.fileName()).fileName(); }
+  qint64 size() const { return m_size; }
+  quint32 termCount() const { return m_termCount; }
+  quint32 documentCount() const { return m_documentCount; }
+
+  TermEntry entry(quint32 index) const
+  {
+    TermEntry entry;
+    std::memcpy(&entry, m_data + m_termsOffset + quint64(index) * sizeof(TermEntry), sizeof(entry));
+    entry.stringOffset = qFromLittleEndian(entry.stringOffset);
+    entry.stringLength = qFromLittleEndian(entry.stringLength);
+    entry.documentFrequency = qFromLittleEndian(entry.documentFrequency);
+    entry.postingsOffset = qFromLittleEndian(entry.postingsOffset);
+    entry.postingsLength = qFromLittleEndian(entry.postingsLength);
+    return entry;
+  }
+
+  // Points into the mapping; empty if the entry is out of bounds
+  QByteArray term(const TermEntry &entry) const
+  {
+    if (m_stringsOffset + entry.stringOffset + entry.stringLength > m_termsOffset)
+      return QByteArray();
+    return QByteArray::fromRawData(reinterpret_cast<const char *>(m_data + m_stringsOffset + entry.stringOffset),
+                                   entry.stringLength);
+  }
+
+  PostingReader postings(const TermEntry &entry) const
+  {
+    if (entry.postingsOffset + entry.postingsLength > m_stringsOffset)
+      return PostingReader(m_data, 0);
+    return PostingReader(m_data + entry.postingsOffset, entry.postingsLength);
+  }
+
+  // Binary search of the term table, without copying any term
+  bool find(const QByteArray &term, TermEntry *found) const
+  {
+    quint32 low = 0;
+    quint32 high = m_termCount;
+    while (low < high)
+    {
+      quint32 middle = low + (high - low) / 2;
+      TermEntry candidate = entry(middle);
+      int order = term.compare(this->term(candidate));
+      if (order == 0)
+      {
+        *found = candidate;
+        return true;
+      }
+      if (order < 0)
+        high = middle;
+      else
+        low = middle + 1;
+    }
+    return false;
+  }
+
+private:
+  QFile m_file;
+  uchar *m_data;
+  qint64 m_size;
+  quint32 m_termCount;
+  quint32 m_documentCount;
+  quint64 m_stringsOffset;
+  quint64 m_termsOffset;
+};
+
+SearchIndex::SearchIndex(QObject *parent)
+    : QObject(parent), m_totalLength(0), m_nextDocumentId(1), m_nextSegmentNumber(1), m_dirty(false), m_indexing(false),
+      m_merging(false)
+{
+  m_directory = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/search";
+  QDir().mkpath(m_directory);
+
+  // One thread indexes while another merges
+  m_pool.setMaxThreadCount(2);
+
+  m_indexTimer.setSingleShot(true);
+  m_indexTimer.setInterval(IndexDelay);
+  connect(&m_indexTimer, &QTimer::timeout, this, &SearchIndex::startIndexing);
+
+  m_saveTimer.setSingleShot(true);
+  m_saveTimer.setInterval(2000);
+  connect(&m_saveTimer, &QTimer::timeout, this, &SearchIndex::saveManifest);
+
+  connect(&m_indexWatcher, &QFutureWatcher<BatchResult>::finished, this, &SearchIndex::onIndexingFinished);
+  connect(&m_mergeWatcher, &QFutureWatcher<MergeResult>::finished, this, &SearchIndex::onMergeFinished);
+
+  loadManifest();
+}
+
+SearchIndex::~SearchIndex()
+{
+  // Whatever a worker writes after this is not in the manifest, and is
+  // cleaned up at the next start
+  m_pool.waitForDone();
+  saveManifest();
+}
+
+QString SearchIndex::segmentPath(const QString &fileName) const
+{
+  return m_directory + "/" + fileName;
+}
+
+void SearchIndex::loadManifest()
+{
+  QFile file(m_directory + "/manifest");
+  if (file.open(QIODevice::ReadOnly))
+  {
+    QDataStream in(&file);
+    quint32 magic = 0;
+    quint32 version = 0;
+    QStringList segmentFiles;
+    quint32 count = 0;
+    in >> magic >> version;
+    if (magic == ManifestMagic && version == ManifestVersion)
+    {
+      in >> m_nextDocumentId >> m_nextSegmentNumber >> segmentFiles >> count;
+      m_documents.reserve(count);
+      for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i)
+      {
+        quint32 id = 0;
+        Document document;
+        in >> id >> document.path >> document.modified >> document.size >> document.length;
+        m_documents.insert(id, document);
+        m_documentIds.insert(document.path, id);
+        m_totalLength += document.length;
+      }
+
+      bool ok = in.status() == QDataStream::Ok;
+      for (const QString &segmentFile : segmentFiles)
+      {
+        QSharedPointer<Segment> segment = QSharedPointer<Segment>::create(segmentPath(segmentFile));
+        if (!ok || !segment->open())
+        {
+          ok = false;
+          break;
+        }
+        m_segments.append(segment);
+      }
+
+      if (!ok)
+      {
+        qWarning() << "Search index is damaged, rebuilding it";
+        discardIndex();
+      }
+    }
+  }
+
+  // Segments a worker wrote after the last manifest
+  QSet<QString> known;
+  for (const QSharedPointer<Segment> &segment : m_segments)
+    known.insert(segment->fileName());
+  for (const QString &name : QDir(m_directory).entryList(QStringList() << "*.seg", QDir::Files))
+  {
+    if (!known.contains(name))
+      QFile::remove(segmentPath(name));
+  }
+
+  qDebug().noquote() << "Search index:" << m_documents.size() << "documents in" << m_segments.size() << "segments";
+}
+
+void SearchIndex::discardIndex()
+{
+  m_segments.clear();
+  m_documents.clear();
+  m_documentIds.clear();
+  m_totalLength = 0;
+  markDirty();
+}
+
+void SearchIndex::saveManifest()
+{
+  m_saveTimer.stop();
+  if (!m_dirty)
+    return;
+
+  QStringList segmentFiles;
+  for (const QSharedPointer<Segment> &segment : m_segments)
+    segmentFiles.append(segment->fileName());
+
+  QSaveFile file(m_directory + "/manifest");
+  if (!file.open(QIODevice::WriteOnly))
+  {
+    qWarning().noquote() << "Could not write search manifest" << file.errorString();
+    return;
+  }
+  QDataStream out(&file);
+  out << ManifestMagic << ManifestVersion << m_nextDocumentId << m_nextSegmentNumber << segmentFiles
+      << quint32(m_documents.size());
+  for (auto it = m_documents.constBegin(); it != m_documents.constEnd(); ++it)
+    out << it.key() << it->path << it->modified << it->size << it->length;
+  if (!file.commit())
+  {
+    qWarning().noquote() << "Could not write search manifest" << file.errorString();
+    return;
+  }
+  m_dirty = false;
+}
+
+void SearchIndex::markDirty()
+{
+  m_dirty = true;
+  if (!m_saveTimer.isActive())
+    m_saveTimer.start();
+}
+
+void SearchIndex::addSource(const MetadataIndex *index)
+{
+  m_sources.append(index);
+  connect(index, &MetadataIndex::filesChanged, this, [this](const QStringList &paths)
+          {
+    for (const QString &path : paths)
+      queue(path); });
+
+  // Catch up with whatever changed while the app was closed
+  index->forEachFile([this](const FileMetadata &file)
+                     {
+    auto id = m_documentIds.constFind(file.path);
+    if (id == m_documentIds.constEnd())
+    {
+      queue(file.path);
+      return;
+    }
+    const Document &document = m_documents[id.value()];
+    if (document.modified != file.modified || document.size != file.size)
+      queue(file.path); });
+
+  QString prefix = index->directory() + "/";
+  for (auto it = m_documentIds.constBegin(); it != m_documentIds.constEnd(); ++it)
+  {
+    if (it.key().startsWith(prefix) && !index->contains(it.key()))
+      queue(it.key());
+  }
+}
+
+void SearchIndex::queue(const QString &filePath)
+{
+  bool wasIndexing = isIndexing();
+  m_pending.insert(filePath);
+  if (!m_indexTimer.isActive())
+    m_indexTimer.start(IndexDelay);
+  if (!wasIndexing)
+    emit indexingChanged(true);
+}
+
+void SearchIndex::removeDocument(const QString &filePath)
+{
+  auto id = m_documentIds.find(filePath);
+  if (id == m_documentIds.end())
+    return;
+
+  // Its postings stay in the segments until they are merged away
+  m_totalLength -= m_documents.value(id.value()).length;
+  m_documents.remove(id.value());
+  m_documentIds.erase(id);
+  markDirty();
+}
+
+void SearchIndex::startIndexing()
+{
+  if (m_indexing || m_pending.isEmpty())
+    return;
+
+  QVector<IndexedDocument> batch;
+  bool removed = false;
+  const QSet<QString> pending = std::exchange(m_pending, QSet<QString>());
+  for (const QString &path : pending)
+  {
+    FileMetadata file;
+    for (const MetadataIndex *source : m_sources)
+    {
+      if (source->contains(path))
+      {
+        file = source->file(path);
+        break;
+      }
+    }
+
+    if (file.path.isEmpty())
+    {
+      removed = removed || m_documentIds.contains(path);
+      removeDocument(path);
+      continue;
+    }
+
+    auto id = m_documentIds.constFind(path);
+    if (id != m_documentIds.constEnd())
+    {
+      const Document &document = m_documents[id.value()];
+      if (document.modified == file.modified && document.size == file.size)
+        continue;
+    }
+
+    IndexedDocument indexed;
+    indexed.id = m_nextDocumentId++;
+    indexed.document.path = path;
+    indexed.document.modified = file.modified;
+    indexed.document.size = file.size;
+    batch.append(indexed);
+  }
+
+  if (removed)
+    emit documentsChanged();
+  if (batch.isEmpty())
+  {
+    emit indexingChanged(false);
+    return;
+  }
+
+  m_indexing = true;
+  markDirty();
+  m_indexWatcher.setFuture(QtConcurrent::run(&m_pool, &SearchIndex::indexBatch, this, batch, m_nextSegmentNumber++));
+}
+
+SearchIndex::BatchResult SearchIndex::indexBatch(QVector<IndexedDocument> documents, quint32 batchNumber)
+{
+  QElapsedTimer timer;
+  timer.start();
+
+  BatchResult result;
+  SegmentBuilder builder;
+  qint64 textBytes = 0;
+  qint64 totalBytes = 0;
+
+  // The whole batch goes back to be retried, minus its partial output
+  auto fail = [&]()
+  {
+    for (const QString &fileName : result.segmentFiles)
+      QFile::remove(segmentPath(fileName));
+    result.segmentFiles.clear();
+    result.documents = documents;
+    result.failed = true;
+    return result;
+  };
+
+  auto flush = [&]()
+  {
+    if (builder.isEmpty())
+      return true;
+    QString fileName = QString("%1-%2.seg").arg(batchNumber, 8, 10, QLatin1Char('0')).arg(result.segmentFiles.size());
+    if (!builder.write(segmentPath(fileName)))
+    {
+      qWarning().noquote() << "Could not write search segment" << fileName;
+      return false;
+    }
+    result.segmentFiles.append(fileName);
+    builder = SegmentBuilder();
+    textBytes = 0;
+    return true;
+  };
+
+  for (IndexedDocument &indexed : documents)
+  {
+    QString text;
+    if (!MetadataIndex::readPlainText(indexed.document.path, &text))
+      continue;
+
+    QHash<QString, QVector<quint32>> positions;
+    quint32 length = 0;
+    tokenize(text, [&positions, &length](const QString &term, quint32 position, qsizetype)
+             {
+      positions[term].append(position);
+      length = position + 1;
+      return true; });
+
+    builder.addDocument(indexed.id, positions);
+    indexed.document.length = length;
+    indexed.ok = true;
+    textBytes += text.size() * 2;
+    totalBytes += text.size() * 2;
+
+    if (textBytes >= SegmentTextBudget && !flush())
+      return fail();
+  }
+  if (!flush())
+    return fail();
+
+  qDebug().noquote() << "Indexed" << documents.size() << "documents," << totalBytes / 1024 << "KB of text in"
+                     << timer.elapsed() << "ms";
+  result.documents = documents;
+  return result;
+}
+
+void SearchIndex::onIndexingFinished()
+{
+  m_indexing = false;
+  BatchResult result = m_indexWatcher.result();
+
+  QVector<QSharedPointer<Segment>> segments;
+  for (const QString &fileName : result.segmentFiles)
+  {
+    QSharedPointer<Segment> segment = QSharedPointer<Segment>::create(segmentPath(fileName));
+    if (!segment->open())
+    {
+      qWarning().noquote() << "Could not open search segment" << fileName;
+      segments.clear();
+      result.failed = true;
+      break;
+    }
+    segments.append(segment);
+  }
+  m_segments += segments;
+
+  if (result.failed)
+  {
+    for (const QString &fileName : result.segmentFiles)
+      QFile::remove(segmentPath(fileName));
+    for (const IndexedDocument &indexed : result.documents)
+      m_pending.insert(indexed.document.path);
+    result.documents.clear();
+  }
+
+  for (const IndexedDocument &indexed : result.documents)
+  {
+    if (!indexed.ok)
+      continue;
+
+    // Changed again, or gone, while it was being read
+    const QString &path = indexed.document.path;
+    FileMetadata file;
+    for (const MetadataIndex *source : m_sources)
+    {
+      if (source->contains(path))
+        file = source->file(path);
+    }
+    if (file.modified != indexed.document.modified || file.size != indexed.document.size)
+    {
+      m_pending.insert(path);
+      continue;
+    }
+
+    removeDocument(path);
+    m_documents.insert(indexed.id, indexed.document);
+    m_documentIds.insert(path, indexed.id);
+    m_totalLength += indexed.document.length;
+  }
+
+  markDirty();
+  emit documentsChanged();
+  maybeMerge();
+
+  if (!m_pending.isEmpty())
+    m_indexTimer.start(result.failed ? RetryDelay : IndexDelay);
+  else
+    emit indexingChanged(false);
+}
+
+void SearchIndex::maybeMerge()
+{
+  if (m_merging || m_segments.size() <= MaxSegments)
+    return;
+
+  // The smallest segments, so big ones are rewritten rarely
+  QVector<QSharedPointer<Segment>> sorted = m_segments;
+  std::sort(sorted.begin(), sorted.end(), [](const QSharedPointer<Segment> &a, const QSharedPointer<Segment> &b)
+            { return a->size() < b->size(); });
+  sorted.resize(SegmentsPerMerge);
+
+  QSet<quint32> live;
+  live.reserve(m_documents.size());
+  for (auto it = m_documents.constBegin(); it != m_documents.constEnd(); ++it)
+    live.insert(it.key());
+
+  m_merging = true;
+  markDirty();
+  m_mergeWatcher.setFuture(QtConcurrent::run(&m_pool, &SearchIndex::mergeSegments, this, sorted, live, m_nextSegmentNumber++));
+}
+
+SearchIndex::MergeResult SearchIndex::mergeSegments(QVector<QSharedPointer<Segment>> sources, QSet<quint32> live,
+                                                    quint32 segmentNumber)
+{
+  QElapsedTimer timer;
+  timer.start();
+
+  MergeResult result;
+  QString fileName = QString("%1-m.seg").arg(segmentNumber, 8, 10, QLatin1Char('0'));
+  SegmentWriter writer(segmentPath(fileName));
+  if (!writer.open())
+    return result;
+
+  struct Posting
+  {
+    quint32 document;
+    quint32 frequency;
+    const uchar *positions;
+    int positionBytes;
+  };
+
+  // K-way merge of the sorted term tables
+  QVector<quint32> cursors(sources.size(), 0);
+  QSet<quint32> documents;
+  QVector<Posting> postings;
+  QByteArray encoded;
+  while (true)
+  {
+    QByteArray term;
+    bool found = false;
+    for (int i = 0; i < sources.size(); ++i)
+    {
+      if (cursors[i] >= sources[i]->termCount())
+        continue;
+      QByteArray candidate = sources[i]->term(sources[i]->entry(cursors[i]));
+      if (!found || candidate < term)
+      {
+        term = QByteArray(candidate.constData(), candidate.size());
+        found = true;
+      }
+    }
+    if (!found)
+      break;
+
+    postings.clear();
+    for (int i = 0; i < sources.size(); ++i)
+    {
+      if (cursors[i] >= sources[i]->termCount())
+        continue;
+      TermEntry entry = sources[i]->entry(cursors[i]);
+      if (sources[i]->term(entry) != term)
+        continue;
+      ++cursors[i];
+
+      PostingReader reader = sources[i]->postings(entry);
+      while (reader.next())
+      {
+        if (live.contains(reader.document))
+          postings.append({reader.document, reader.frequency, reader.positions, int(reader.positionsEnd - reader.positions)});
+      }
+    }
+    if (postings.isEmpty())
+      continue;
+
+    // Segments written at different times can hold interleaved IDs
+    std::sort(postings.begin(), postings.end(), [](const Posting &a, const Posting &b)
+              { return a.document < b.document; });
+    encoded.clear();
+    quint32 last = 0;
+    for (const Posting &posting : postings)
+    {
+      appendVarint(encoded, posting.document - last);
+      appendVarint(encoded, posting.frequency);
+      appendVarint(encoded, quint32(posting.positionBytes));
+      encoded.append(reinterpret_cast<const char *>(posting.positions), posting.positionBytes);
+      last = posting.document;
+      documents.insert(posting.document);
+    }
+    writer.addTerm(term, quint32(postings.size()), encoded);
+  }
+
+  if (!writer.commit(quint32(documents.size())))
+    return result;
+
+  for (const QSharedPointer<Segment> &source : sources)
+    result.mergedFiles.append(source->fileName());
+  result.segmentFile = fileName;
+  qDebug().noquote() << "Merged" << sources.size() << "search segments into" << fileName << "in" << timer.elapsed() << "ms";
+  return result;
+}
+
+void SearchIndex::onMergeFinished()
+{
+  m_merging = false;
+  MergeResult result = m_mergeWatcher.result();
+  if (result.segmentFile.isEmpty())
+    return;
+
+  QSharedPointer<Segment> merged = QSharedPointer<Segment>::create(segmentPath(result.segmentFile));
+  if (!merged->open())
+  {
+    qWarning().noquote() << "Could not open merged search segment" << result.segmentFile;
+    QFile::remove(segmentPath(result.segmentFile));
+    return;
+  }
+
+  for (int i = int(m_segments.size()) - 1; i >= 0; --i)
+  {
+    if (result.mergedFiles.contains(m_segments.at(i)->fileName()))
+      m_segments.removeAt(i);
+  }
+  m_segments.append(merged);
+  saveManifest();
+
+  // Only once the manifest no longer names them
+  for (const QString &fileName : result.mergedFiles)
+    QFile::remove(segmentPath(fileName));
+
+  maybeMerge();
+}
+
+SearchIndex::Result SearchIndex::search(const QString &query, int limit) const
+{
+  QElapsedTimer timer;
+  timer.start();
+  Result result;
+
+  // Odd pieces between quotes are phrases
+  QVector<QStringList> phrases;
+  const QStringList pieces = query.split('"');
+  for (int i = 0; i < pieces.size(); ++i)
+  {
+    QStringList words = queryTerms(pieces.at(i));
+    for (const QString &word : words)
+    {
+      if (!result.terms.contains(word))
+        result.terms.append(word);
+    }
+    if (i % 2 == 1 && words.size() > 1)
+      phrases.append(words);
+  }
+  if (result.terms.isEmpty() || m_documents.isEmpty())
+    return result;
+
+  QSet<QString> phraseTerms;
+  for (const QStringList &phrase : phrases)
+  {
+    for (const QString &word : phrase)
+      phraseTerms.insert(word);
+  }
+
+  // Rarest terms first keeps the candidate set small from the start
+  struct QueryTerm
+  {
+    QString text;
+    QByteArray utf8;
+    quint64 frequency = 0;
+  };
+  QVector<QueryTerm> terms;
+  for (const QString &text : result.terms)
+  {
+    QueryTerm term;
+    term.text = text;
+    term.utf8 = text.toUtf8();
+    for (const QSharedPointer<Segment> &segment : m_segments)
+    {
+      TermEntry entry;
+      if (segment->find(term.utf8, &entry))
+        term.frequency += entry.documentFrequency;
+    }
+    if (term.frequency == 0)
+      return result;
+    terms.append(term);
+  }
+  std::sort(terms.begin(), terms.end(), [](const QueryTerm &a, const QueryTerm &b)
+            { return a.frequency < b.frequency; });
+
+  struct Candidate
+  {
+    double score = 0;
+    int matchedTerms = 0;
+    QHash<QString, QVector<quint32>> positions;
+  };
+  QHash<quint32, Candidate> candidates;
+
+  const double documentCount = double(m_documents.size());
+  const double averageLength = double(m_totalLength) / documentCount;
+  for (int t = 0; t < terms.size(); ++t)
+  {
+    const QueryTerm &term = terms.at(t);
+    bool wantPositions = phraseTerms.contains(term.text);
+
+    // Per live document: frequency, and positions if a phrase needs them.
+    // idf counts every live document with the term, not only the ones
+    // still in the running after the earlier terms.
+    QVector<QPair<quint32, quint32>> hits;
+    QHash<quint32, QVector<quint32>> positions;
+    qint64 documentFrequency = 0;
+    for (const QSharedPointer<Segment> &segment : m_segments)
+    {
+      TermEntry entry;
+      if (!segment->find(term.utf8, &entry))
+        continue;
+      PostingReader reader = segment->postings(entry);
+      while (reader.next())
+      {
+        if (!m_documents.contains(reader.document))
+          continue;
+        documentFrequency++;
+        if (t > 0 && !candidates.contains(reader.document))
+          continue;
+        hits.append(qMakePair(reader.document, reader.frequency));
+        if (wantPositions)
+          positions.insert(reader.document, reader.decodePositions());
+      }
+    }
+
+    double idf = std::log(1.0 + (documentCount - documentFrequency + 0.5) / (documentFrequency + 0.5));
+    for (const auto &hit : hits)
+    {
+      Candidate &candidate = candidates[hit.first];
+      if (candidate.matchedTerms != t)
+        continue;
+      double length = m_documents.value(hit.first).length;
+      double frequency = hit.second;
+      candidate.score += idf * frequency * (K1 + 1) / (frequency + K1 * (1 - B + B * length / averageLength));
+      candidate.matchedTerms++;
+      if (wantPositions)
+        candidate.positions.insert(term.text, positions.value(hit.first));
+    }
+
+    // Every word must match
+    for (auto it = candidates.begin(); it != candidates.end();)
+    {
+      if (it->matchedTerms != t + 1)
+        it = candidates.erase(it);
+      else
+        ++it;
+    }
+    if (candidates.isEmpty())
+      break;
+  }
+
+  QVector<QPair<double, quint32>> ranked;
+  ranked.reserve(candidates.size());
+  for (auto it = candidates.constBegin(); it != candidates.constEnd(); ++it)
+  {
+    bool phrasesMatch = true;
+    for (const QStringList &phrase : phrases)
+    {
+      const QVector<quint32> starts = it->positions.value(phrase.first());
+      bool found = false;
+      for (quint32 start : starts)
+      {
+        found = true;
+        for (int k = 1; k < phrase.size() && found; ++k)
+        {
+          const QVector<quint32> next = it->positions.value(phrase.at(k));
+          found = std::binary_search(next.begin(), next.end(), start + quint32(k));
+        }
+        if (found)
+          break;
+      }
+      if (!found)
+      {
+        phrasesMatch = false;
+        break;
+      }
+    }
+    if (phrasesMatch)
+      ranked.append(qMakePair(it->score, it.key()));
+  }
+
+  result.matches = int(ranked.size());
+  int count = qMin(limit, int(ranked.size()));
+  std::partial_sort(ranked.begin(), ranked.begin() + count, ranked.end(), [](const auto &a, const auto &b)
+                    { return a.first > b.first; });
+  for (int i = 0; i < count; ++i)
+  {
+    Hit hit;
+    hit.path = m_documents.value(ranked.at(i).second).path;
+    hit.score = ranked.at(i).first;
+    for (const MetadataIndex *source : m_sources)
+    {
+      if (source->contains(hit.path))
+        hit.title = source->file(hit.path).title;
+    }
+    if (hit.title.isEmpty())
+      hit.title = QFileInfo(hit.path).fileName();
+    result.hits.append(hit);
+  }
+
+  result.elapsedUs = timer.nsecsElapsed() / 1000;
+  return result;
+}
+
+QString SearchIndex::snippet(const QString &filePath, const QStringList &terms, int context)
+{
+  QString text;
+  if (!MetadataIndex::readPlainText(filePath, &text))
+    return QString();
+
+  const QSet<QString> wanted(terms.begin(), terms.end());
+  qsizetype start = -1;
+  qsizetype end = -1;
+  tokenize(text, [&](const QString &term, quint32, qsizetype offset)
+           {
+    if (!wanted.contains(term))
+      return true;
+    start = offset;
+    end = offset + term.size();
+    return false; });
+  if (start < 0)
+    return text.left(2 * context).simplified();
+
+  qsizetype from = qMax<qsizetype>(0, start - context);
+  qsizetype to = qMin<qsizetype>(text.size(), end + context);
+  QString snippet = text.mid(from, to - from).simplified();
+  if (from > 0)
+    snippet.prepend(QStringLiteral("..."));
+  if (to < text.size())
+    snippet.append(QStringLiteral("..."));
+  return snippet;
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <QtCore/QObject>
+#include <QtCore/QFutureWatcher>
+#include <QtCore/QHash>
+#include <QtCore/QSet>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QStringList>
+#include <QtCore/QThreadPool>
+#include <QtCore/QTimer>
+#include <QtCore/QVector>
+#include "MetadataIndex.h"
+
+// Full-text index over the documents of every location it is given.
+//
+// Postings live in immutable segment files under AppDataLocation/search: a
+// block of postings, a string pool and a term table sorted by UTF-8 bytes.
+// A term's postings are delta-encoded document IDs, each followed by the
+// term frequency and its delta-encoded positions, all as varints. Segments
+// are mapped and searched in place.
+//
+// Changed documents are tokenized on a worker thread and written out as new
+// segments under fresh document IDs; the old IDs just drop out of the
+// document table. Once there are too many segments, the smallest ones are
+// merged in the background and their dead postings left behind.
+class SearchIndex : public QObject
+{
+  Q_OBJECT
+
+public:
+  struct Hit
+  {
+    QString path;
+    QString title;
+    double score = 0;
+  };
+
+  struct Result
+  {
+    QVector<Hit> hits;
+    // Query words as indexed, for highlighting and snippets
+    QStringList terms;
+    int matches = 0;
+    qint64 elapsedUs = 0;
+  };
+
+  explicit SearchIndex(QObject *parent = nullptr);
+  ~SearchIndex();
+
+  // Indexes whatever of the source is new or changed, then follows it
+  void addSource(const MetadataIndex *index);
+
+  // Documents containing every word, best first by BM25; words in quotes
+  // must appear next to each other
+  Result search(const QString &query, int limit = 50) const;
+  bool isIndexing() const { return m_indexing || !m_pending.isEmpty(); }
+  int documentCount() const { return int(m_documents.size()); }
+
+  // Text around the first place one of the terms occurs, on one line; safe
+  // to call from any thread
+  static QString snippet(const QString &filePath, const QStringList &terms, int context = 80);
+
+signals:
+  void indexingChanged(bool indexing);
+  void documentsChanged();
+
+private slots:
+  void startIndexing();
+  void onIndexingFinished();
+  void onMergeFinished();
+  void saveManifest();
+
+private:
+  class Segment;
+
+  struct Document
+  {
+    QString path;
+    qint64 modified = 0;
+    qint64 size = 0;
+    quint32 length = 0;
+  };
+
+  struct IndexedDocument
+  {
+    quint32 id = 0;
+    Document document;
+    bool ok = false;
+  };
+
+  struct BatchResult
+  {
+    QStringList segmentFiles;
+    QVector<IndexedDocument> documents;
+    bool failed = false; // Nothing was indexed; the documents go back in the queue
+  };
+
+  struct MergeResult
+  {
+    QString segmentFile;
+    QStringList mergedFiles;
+  };
+
+  void loadManifest();
+  void discardIndex();
+  void queue(const QString &filePath);
+  void removeDocument(const QString &filePath);
+  void maybeMerge();
+  void markDirty();
+  QString segmentPath(const QString &fileName) const;
+  BatchResult indexBatch(QVector<IndexedDocument> documents, quint32 batchNumber);
+  MergeResult mergeSegments(QVector<QSharedPointer<Segment>> sources, QSet<quint32> live, quint32 segmentNumber);
+
+  QString m_directory;
+  QVector<const MetadataIndex *> m_sources;
+  QHash<quint32, Document> m_documents;
+  QHash<QString, quint32> m_documentIds;
+  quint64 m_totalLength;
+  QVector<QSharedPointer<Segment>> m_segments;
+  quint32 m_nextDocumentId;
+  quint32 m_nextSegmentNumber;
+
+  QSet<QString> m_pending;
+  QTimer m_indexTimer;
+  QTimer m_saveTimer;
+  bool m_dirty;
+  bool m_indexing;
+  bool m_merging;
+  QThreadPool m_pool;
+  QFutureWatcher<BatchResult> m_indexWatcher;
+  QFutureWatcher<MergeResult> m_mergeWatcher;
+};
@@ -0,0 +1,93 @@
+#include "SearchOverviewBar.h"
+#include <QtGui/QPainter>
+#include <QtGui/QMouseEvent>
+#include <QtGui/QResizeEvent>
+
+SearchOverviewBar::SearchOverviewBar(QWidget *parent)
+    : QWidget(parent), m_documentLength(0), m_currentMatch(-1), m_maxDensity(0)
+{
+  setFixedWidth(10);
+  setCursor(Qt::PointingHandCursor);
+}
+
+QSize SearchOverviewBar::sizeHint() const
+{
+  return QSize(10, 100);
+}
+
+void SearchOverviewBar::setMatches(const QVector<int> &starts, int documentLength, int currentMatch)
+{
+  m_starts = starts;
+  m_documentLength = documentLength;
+  m_currentMatch = currentMatch;
+  rebuildDensity();
+  update();
+}
+
+void SearchOverviewBar::clearMatches()
+{
+  m_starts.clear();
+  m_density.clear();
+  m_maxDensity = 0;
+  m_currentMatch = -1;
+  update();
+}
+
+void SearchOverviewBar::rebuildDensity()
+{
+  int rows = height();
+  m_density.fill(0, rows);
+  m_maxDensity = 0;
+  if (rows <= 0 || m_documentLength <= 0)
+    return;
+
+  // Character offsets stand in for layout height; close enough for prose and
+  // doesn't force the whole document to be laid out
+  for (int start : m_starts)
+  {
+    int row = int(qint64(start) * rows / m_documentLength);
+    row = qBound(0, row, rows - 1);
+    m_maxDensity = qMax(m_maxDensity, ++m_density[row]);
+  }
+}
+
+void SearchOverviewBar::resizeEvent(QResizeEvent *event)
+{
+  QWidget::resizeEvent(event);
+  rebuildDensity();
+}
+
+void SearchOverviewBar::paintEvent(QPaintEvent *event)
+{
+  Q_UNUSED(event);
+  if (m_maxDensity == 0)
+    return;
+
+  QPainter painter(this);
+  QColor marker(255, 255, 0);
+
+  for (int row = 0; row < m_density.size(); ++row)
+  {
+    if (m_density[row] == 0)
+      continue;
+
+    // Denser rows are more opaque, but a lone match is still visible
+    marker.setAlphaF(0.35 + 0.65 * m_density[row] / m_maxDensity);
+    painter.fillRect(2, row, width() - 4, 2, marker);
+  }
+
+  if (m_currentMatch >= 0 && m_currentMatch < m_starts.size())
+  {
+    int row = int(qint64(m_starts.at(m_currentMatch)) * height() / m_documentLength);
+    painter.fillRect(0, qBound(0, row - 1, height() - 3), width(), 3, palette().color(QPalette::Highlight));
+  }
+}
+
+void SearchOverviewBar::mousePressEvent(QMouseEvent *event)
+{
+  if (height() > 0)
+  {
+    emit positionRequested(qBound(0.0, event->position().y() / height(), 1.0));
+  }
+  event->accept();
+}
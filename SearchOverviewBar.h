@@ -0,0 +1,36 @@
+#pragma once
+
+#include <QtWidgets/QWidget>
+#include <QtCore/QVector>
+
+// Thin strip beside the editor showing where search matches are across the
+// whole document, including the ones that aren't highlighted off-screen.
+class SearchOverviewBar : public QWidget
+{
+  Q_OBJECT
+
+public:
+  explicit SearchOverviewBar(QWidget *parent = nullptr);
+
+  void setMatches(const QVector<int> &starts, int documentLength, int currentMatch);
+  void clearMatches();
+  QSize sizeHint() const override;
+
+signals:
+  // Fraction of the document (0..1) the user clicked on
+  void positionRequested(double fraction);
+
+protected:
+  void paintEvent(QPaintEvent *event) override;
+  void resizeEvent(QResizeEvent *event) override;
+  void mousePressEvent(QMouseEvent *event) override;
+
+private:
+  void rebuildDensity();
+
+  QVector<int> m_starts;
+  int m_documentLength;
+  int m_currentMatch;
+  QVector<int> m_density; // Matches per pixel row
+  int m_maxDensity;
+};
@@ -0,0 +1,130 @@
+#include "SearchPanel.h"
+#include <QtConcurrent/QtConcurrentMap>
+#include <QtWidgets/QVBoxLayout>
+
+namespace
+{
+  // Snippets are read for the first results only; the rest show titles
+  const int SnippetCount = 20;
+}
+
+SearchPanel::SearchPanel(SearchIndex *index, QWidget *parent)
+    : QWidget(parent), m_index(index), m_query(new QLineEdit(this)), m_results(new QListWidget(this)),
+      m_status(new QLabel(this))
+{
+  QVBoxLayout *layout = new QVBoxLayout(this);
+  layout->setContentsMargins(0, 0, 0, 0);
+  layout->setSpacing(0);
+  layout->addWidget(m_query);
+  layout->addWidget(m_results);
+  layout->addWidget(m_status);
+
+  m_query->setPlaceholderText("Search all documents");
+  m_query->setClearButtonEnabled(true);
+  m_results->setWordWrap(true);
+  m_results->setUniformItemSizes(false);
+
+  setStyleSheet(
+      "QLineEdit { "
+      "    background-color: #202020; "
+      "    border: none; "
+      "    border-bottom: 1px solid #2D2D2D; "
+      "    padding: 6px 8px; "
+      "} "
+      "QListWidget { "
+      "    border-right: 1px solid #2D2D2D; "
+      "    background-color: #171717; "
+      "} "
+      "QListWidget::item { "
+      "    padding: 4px 8px; "
+      "    border: none; "
+      "} "
+      "QListWidget::item:selected { "
+      "    background-color: #2D2D2D; "
+      "} "
+      "QListWidget::item:hover { "
+      "    background-color: #202020; "
+      "}");
+  m_status->setStyleSheet("QLabel { color: #888888; background-color: #171717; padding: 4px 8px; }");
+
+  // Searching on every keystroke would mostly answer prefixes nobody wants
+  m_searchTimer.setSingleShot(true);
+  m_searchTimer.setInterval(150);
+  connect(&m_searchTimer, &QTimer::timeout, this, &SearchPanel::runSearch);
+  connect(m_query, &QLineEdit::textChanged, &m_searchTimer, qOverload<>(&QTimer::start));
+  connect(m_query, &QLineEdit::returnPressed, this, &SearchPanel::runSearch);
+
+  connect(m_results, &QListWidget::itemActivated, this, [this](QListWidgetItem *item)
+          { emit fileSelected(item->data(Qt::UserRole).toString()); });
+  connect(m_results, &QListWidget::itemClicked, this, [this](QListWidgetItem *item)
+          { emit fileSelected(item->data(Qt::UserRole).toString()); });
+
+  connect(&m_snippets, &QFutureWatcher<QString>::resultReadyAt, this, &SearchPanel::onSnippetReady);
+
+  connect(m_index, &SearchIndex::indexingChanged, this, &SearchPanel::updateStatus);
+  connect(m_index, &SearchIndex::documentsChanged, this, [this]()
+          {
+    if (isVisible() && !m_query->text().trimmed().isEmpty())
+      m_searchTimer.start(); });
+
+  updateStatus();
+}
+
+void SearchPanel::focusQuery()
+{
+  m_query->setFocus();
+  m_query->selectAll();
+}
+
+void SearchPanel::runSearch()
+{
+  m_searchTimer.stop();
+  m_snippets.cancel();
+  m_results->clear();
+
+  QString query = m_query->text().trimmed();
+  m_result = query.isEmpty() ? SearchIndex::Result() : m_index->search(query);
+
+  QStringList paths;
+  for (const SearchIndex::Hit &hit : m_result.hits)
+  {
+    QListWidgetItem *item = new QListWidgetItem(hit.title, m_results);
+    item->setData(Qt::UserRole, hit.path);
+    item->setToolTip(hit.path);
+    if (paths.size() < SnippetCount)
+      paths.append(hit.path);
+  }
+  updateStatus();
+
+  if (paths.isEmpty())
+    return;
+  const QStringList terms = m_result.terms;
+  m_snippets.setFuture(QtConcurrent::mapped(paths, [terms](const QString &path)
+                                            { return SearchIndex::snippet(path, terms); }));
+}
+
+void SearchPanel::onSnippetReady(int index)
+{
+  QString snippet = m_snippets.resultAt(index);
+  QListWidgetItem *item = m_results->item(index);
+  if (!item || snippet.isEmpty())
+    return;
+  item->setText(m_result.hits.at(index).title + "\n" + snippet);
+}
+
+void SearchPanel::updateStatus()
+{
+  QString status;
+  if (!m_query->text().trimmed().isEmpty())
+  {
+    status = m_result.matches == 1 ? QString("1 document") : QString("%1 documents").arg(m_result.matches);
+    status += QString(" in %1 ms").arg(m_result.elapsedUs / 1000.0, 0, 'f', 1);
+  }
+  else
+  {
+    status = QString("%1 documents indexed").arg(m_index->documentCount());
+  }
+  if (m_index->isIndexing())
+    status += QString::fromUtf8(" — indexing…");
+  m_status->setText(status);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <QtWidgets/QWidget>
+#include <QtWidgets/QLabel>
+#include <QtWidgets/QLineEdit>
+#include <QtWidgets/QListWidget>
+#include <QtCore/QFutureWatcher>
+#include <QtCore/QTimer>
+#include "SearchIndex.h"
+
+// Search box over the full-text index. Results are listed by title as soon
+// as the index answers; the snippets under them are read from the documents
+// on the thread pool and filled in as they arrive.
+class SearchPanel : public QWidget
+{
+  Q_OBJECT
+
+public:
+  explicit SearchPanel(SearchIndex *index, QWidget *parent = nullptr);
+
+  // Selects the query so typing replaces it
+  void focusQuery();
+
+signals:
+  void fileSelected(const QString &filePath);
+
+private slots:
+  void runSearch();
+  void onSnippetReady(int index);
+  void updateStatus();
+
+private:
+  SearchIndex *m_index;
+  QLineEdit *m_query;
+  QListWidget *m_results;
+  QLabel *m_status;
+  QTimer m_searchTimer;
+  SearchIndex::Result m_result;
+  QFutureWatcher<QString> m_snippets;
+};
@@ -0,0 +1,318 @@
+#include "SmartFolderQuery.h"
+#include <QtCore/QDateTime>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QRegularExpression>
+#include <QtCore/QDebug>
+#include <algorithm>
+
+SmartFolderQuery::SmartFolderQuery()
+{
+}
+
+SmartFolderQuery::SmartFolderQuery(const QString &text)
+    : m_text(text.trimmed())
+{
+  const QStringList terms = m_text.split(QRegularExpression("\\s+"), Qt::SkipEmptyParts);
+  for (const QString &term : terms)
+  {
+    if (!parseTerm(term))
+    {
+      if (m_error.isEmpty())
+        m_error = QString("Can't use \"%1\" in a smart folder").arg(term);
+      m_checks.clear();
+      return;
+    }
+  }
+
+  // Plain field comparisons first, string sets and the tag lists last
+  std::sort(m_checks.begin(), m_checks.end(), [](Check a, Check b)
+            {
+    static const int cost[] = {2, 3, 0, 0, 1, 4};
+    return cost[a] < cost[b]; });
+}
+
+bool SmartFolderQuery::parseTerm(const QString &term)
+{
+  int colon = term.indexOf(':');
+  if (colon < 0)
+    return parseGlob(term);
+
+  QString key = term.left(colon).toLower();
+  QString value = term.mid(colon + 1);
+  if (value.isEmpty())
+    return false;
+
+  if (key == "ext")
+  {
+    for (const QString &extension : value.split(',', Qt::SkipEmptyParts))
+    {
+      QString normalized = extension.toLower();
+      if (normalized.startsWith('.'))
+        normalized.remove(0, 1);
+      m_extensions.insert(normalized);
+    }
+    addCheck(Extension);
+    return true;
+  }
+  if (key == "path")
+  {
+    m_pathPrefixes.append(value);
+    addCheck(PathPrefix);
+    return true;
+  }
+  if (key == "size")
+  {
+    addCheck(Size);
+    return parseRange(value, &SmartFolderQuery::parseSize, &m_size);
+  }
+  if (key == "words")
+  {
+    addCheck(Words);
+    return parseRange(value, [](const QString &number, bool *ok)
+                      { return number.toLongLong(ok); }, &m_words);
+  }
+  if (key == "modified")
+  {
+    addCheck(Modified);
+    // A date anywhere in the value makes the whole range absolute
+    if (!value.contains(QRegularExpression("\\d{4}-\\d{2}-\\d{2}")))
+      return parseRange(value, &SmartFolderQuery::parseAge, &m_age);
+    return parseRange(value, &SmartFolderQuery::parseDate, &m_modified, &SmartFolderQuery::parseDateEnd);
+  }
+  if (key == "tag")
+  {
+    QString tag = value.toLower();
+    if (tag.startsWith('#'))
+      tag.remove(0, 1);
+    m_tags.append(tag);
+    addCheck(Tags);
+    return true;
+  }
+
+  m_error = QString("Unknown smart folder term \"%1:\"").arg(key);
+  return false;
+}
+
+bool SmartFolderQuery::parseGlob(const QString &glob)
+{
+  // *.txt,*.md or *.{txt,md}
+  static const QRegularExpression pattern("^\\*\\.(?:\\{([^{}]+)\\}|([^*?{}\\[\\]/]+))$");
+
+  for (const QString &part : glob.split(',', Qt::SkipEmptyParts))
+  {
+    QRegularExpressionMatch match = pattern.match(part);
+    if (!match.hasMatch())
+    {
+      // The comma inside braces splits them apart
+      match = pattern.match(glob);
+      if (!match.hasMatch())
+        return false;
+      for (const QString &extension : match.captured(1).split(',', Qt::SkipEmptyParts))
+        m_extensions.insert(extension.trimmed().toLower());
+      addCheck(Extension);
+      return true;
+    }
+    m_extensions.insert(match.captured(2).toLower());
+  }
+  addCheck(Extension);
+  return true;
+}
+
+bool SmartFolderQuery::parseRange(const QString &value, qint64 (*parseValue)(const QString &, bool *), Range *range,
+                                  qint64 (*parseLast)(const QString &, bool *))
+{
+  if (!parseLast)
+    parseLast = parseValue;
+
+  bool ok = false;
+  Range parsed;
+  int dots = value.indexOf("..");
+  if (dots >= 0)
+  {
+    bool maxOk = false;
+    parsed.min = parseValue(value.left(dots), &ok);
+    parsed.max = parseLast(value.mid(dots + 2), &maxOk);
+    ok = ok && maxOk && parsed.min <= parsed.max;
+  }
+  else if (value.startsWith('<'))
+  {
+    parsed.max = parseValue(value.mid(1), &ok) - 1;
+  }
+  else if (value.startsWith('>'))
+  {
+    parsed.min = parseLast(value.mid(1), &ok) + 1;
+  }
+  else
+  {
+    bool maxOk = false;
+    parsed.min = parseValue(value, &ok);
+    parsed.max = parseLast(value, &maxOk);
+    ok = ok && maxOk;
+  }
+  if (!ok)
+    return false;
+
+  // An earlier term for the same field narrows this one
+  range->min = qMax(range->min, parsed.min);
+  range->max = qMin(range->max, parsed.max);
+  return true;
+}
+
+qint64 SmartFolderQuery::parseSize(const QString &value, bool *ok)
+{
+  QString number = value.toLower();
+  qint64 unit = 1;
+  if (number.endsWith('k'))
+    unit = 1024;
+  else if (number.endsWith('m'))
+    unit = 1024 * 1024;
+  else if (number.endsWith('g'))
+    unit = 1024 * 1024 * 1024;
+  if (unit > 1)
+    number.chop(1);
+  return qint64(number.toDouble(ok) * unit);
+}
+
+qint64 SmartFolderQuery::parseAge(const QString &value, bool *ok)
+{
+  QString number = value.toLower();
+  qint64 unit = 0;
+  switch (number.isEmpty() ? 0 : number.back().unicode())
+  {
+  case 'm':
+    unit = 60 * 1000;
+    break;
+  case 'h':
+    unit = 60 * 60 * 1000;
+    break;
+  case 'd':
+    unit = 24 * 60 * 60 * 1000;
+    break;
+  case 'w':
+    unit = 7 * 24 * 60 * 60 * 1000;
+    break;
+  default:
+    *ok = false;
+    return 0;
+  }
+  number.chop(1);
+  return qint64(number.toDouble(ok) * unit);
+}
+
+qint64 SmartFolderQuery::parseDate(const QString &value, bool *ok)
+{
+  QDate date = QDate::fromString(value, Qt::ISODate);
+  *ok = date.isValid();
+  return date.isValid() ? date.startOfDay().toMSecsSinceEpoch() : 0;
+}
+
+qint64 SmartFolderQuery::parseDateEnd(const QString &value, bool *ok)
+{
+  // The last millisecond of the day, which may not be 24 hours long
+  QDate date = QDate::fromString(value, Qt::ISODate);
+  *ok = date.isValid();
+  return date.isValid() ? date.addDays(1).startOfDay().toMSecsSinceEpoch() - 1 : 0;
+}
+
+void SmartFolderQuery::addCheck(Check check)
+{
+  if (!m_checks.contains(check))
+    m_checks.append(check);
+}
+
+QVector<FileMetadata> SmartFolderQuery::evaluate(const QVector<const MetadataIndex *> &indexes,
+                                                const QHash<QString, QVector<FileMetadata>> &subfolderFiles) const
+{
+  QVector<FileMetadata> results;
+  if (!isValid())
+    return results;
+
+  QElapsedTimer timer;
+  timer.start();
+
+  // Ages become dates once per run, so a smart folder rolls forward
+  Range modified = m_modified;
+  qint64 now = QDateTime::currentMSecsSinceEpoch();
+  if (m_age.max != std::numeric_limits<qint64>::max())
+    modified.min = qMax(modified.min, now - m_age.max);
+  if (m_age.min != std::numeric_limits<qint64>::min())
+    modified.max = qMin(modified.max, now - m_age.min);
+
+  int scanned = 0;
+  for (const MetadataIndex *index : indexes)
+  {
+    QString location = index->directory() + "/";
+    index->forEachFile([&](const FileMetadata &file)
+                       {
+      ++scanned;
+      if (matches(file, location, modified))
+        results.append(file); });
+    for (const FileMetadata &file : subfolderFiles.value(index->directory()))
+    {
+      ++scanned;
+      if (matches(file, location, modified))
+        results.append(file);
+    }
+  }
+
+  std::sort(results.begin(), results.end(), [](const FileMetadata &a, const FileMetadata &b)
+            { return a.modified != b.modified ? a.modified > b.modified : a.path < b.path; });
+
+  qDebug().noquote() << "Smart folder" << m_text << "matched" << results.size() << "of" << scanned << "files in"
+                     << timer.nsecsElapsed() / 1000 << "us";
+  return results;
+}
+
+bool SmartFolderQuery::matches(const FileMetadata &file, const QString &location, const Range &modified) const
+{
+  for (Check check : m_checks)
+  {
+    switch (check)
+    {
+    case Extension:
+    {
+      int dot = file.path.lastIndexOf('.');
+      if (dot < 0 || !m_extensions.contains(file.path.mid(dot + 1).toLower()))
+        return false;
+      break;
+    }
+    case PathPrefix:
+    {
+      bool found = false;
+      for (const QString &prefix : m_pathPrefixes)
+      {
+        bool absolute = prefix.startsWith('/');
+        if (absolute ? file.path.startsWith(prefix)
+                     : file.path.startsWith(location) && QStringView(file.path).mid(location.size()).startsWith(prefix))
+        {
+          found = true;
+          break;
+        }
+      }
+      if (!found)
+        return false;
+      break;
+    }
+    case Size:
+      if (file.size < m_size.min || file.size > m_size.max)
+        return false;
+      break;
+    case Modified:
+      if (file.modified < modified.min || file.modified > modified.max)
+        return false;
+      break;
+    case Words:
+      if (file.wordCount < 0 || file.wordCount < m_words.min || file.wordCount > m_words.max)
+        return false;
+      break;
+    case Tags:
+      for (const QString &tag : m_tags)
+      {
+        if (!file.tags.contains(tag))
+          return false;
+      }
+      break;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <QtCore/QSet>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+#include <limits>
+#include "MetadataIndex.h"
+
+// A smart folder's definition, parsed once into the checks it needs.
+// Terms are separated by spaces and must all match:
+//
+//   ext:md,txt              extension is one of these
+//   modified:<7d            changed in the last 7 days (m, h, d, w);
+//                           >7d is older, 2024-01-01..2024-02-01 a date
+//                           range with both days included
+//   size:>10k  size:<2m     size in bytes, k, m or g
+//   words:100..500          word count
+//   tag:draft               has #draft; repeat for more tags
+//   path:Novel/             path starts with this, absolute or relative to
+//                           the location it is in; repeat for alternatives
+//
+// Repeated size:, words: and modified: terms must all hold, so
+// modified:>2024-01-01 modified:<30d is a range too. Glob terms such as
+// *.{txt,md} or *.txt are taken as ext: terms. Checks run cheapest first
+// and files not read yet never match on words. Files in a location's
+// subfolders come from a directory scan rather than an index, so they
+// match on everything but words and tags.
+class SmartFolderQuery
+{
+public:
+  SmartFolderQuery();
+  explicit SmartFolderQuery(const QString &text);
+
+  const QString &text() const { return m_text; }
+  bool isValid() const { return m_error.isEmpty(); }
+  const QString &errorString() const { return m_error; }
+
+  // Matching entries of the indexes and of the files found in their
+  // subfolders, keyed by the index's directory; newest first
+  QVector<FileMetadata> evaluate(const QVector<const MetadataIndex *> &indexes,
+                                 const QHash<QString, QVector<FileMetadata>> &subfolderFiles = {}) const;
+
+private:
+  enum Check
+  {
+    Extension,
+    PathPrefix,
+    Size,
+    Modified,
+    Words,
+    Tags
+  };
+
+  struct Range
+  {
+    qint64 min = std::numeric_limits<qint64>::min();
+    qint64 max = std::numeric_limits<qint64>::max();
+  };
+
+  bool parseTerm(const QString &term);
+  bool parseGlob(const QString &glob);
+  // Narrows range to the one in value; parseLast gives the last value a
+  // bound covers, for dates that stand for a whole day
+  static bool parseRange(const QString &value, qint64 (*parseValue)(const QString &, bool *), Range *range,
+                         qint64 (*parseLast)(const QString &, bool *) = nullptr);
+  static qint64 parseSize(const QString &value, bool *ok);
+  static qint64 parseAge(const QString &value, bool *ok);
+  static qint64 parseDate(const QString &value, bool *ok);
+  static qint64 parseDateEnd(const QString &value, bool *ok);
+  void addCheck(Check check);
+  bool matches(const FileMetadata &file, const QString &location, const Range &modified) const;
+
+  QString m_text;
+  QString m_error;
+  // Active checks in the order they run
+  QVector<Check> m_checks;
+
+  QSet<QString> m_extensions;
+  QStringList m_pathPrefixes;
+  Range m_size;
+  Range m_modified;
+  // Ages rather than dates, resolved when the query runs
+  Range m_age;
+  Range m_words;
+  QStringList m_tags;
+};
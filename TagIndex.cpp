@@ -0,0 +1,167 @@
+#include "TagIndex.h"
+#include <QtCore/QSet>
+#include <algorithm>
+
+TagIndex::TagIndex(QObject *parent)
+    : QObject(parent)
+{
+}
+
+void TagIndex::addSource(const MetadataIndex *index)
+{
+  bool changed = false;
+  index->forEachFile([&](const FileMetadata &file)
+                     { changed |= updateDocument(index, file.path, file.tags); });
+
+  connect(index, &MetadataIndex::filesChanged, this, [this, index](const QStringList &paths)
+          {
+    bool changed = false;
+    for (const QString &path : paths)
+    {
+      // Removed files come back without a path
+      FileMetadata file = index->file(path);
+      changed |= updateDocument(index, path, file.path.isEmpty() ? QStringList() : file.tags);
+    }
+    if (changed)
+      emit tagsChanged(); });
+
+  if (changed)
+    emit tagsChanged();
+}
+
+QStringList TagIndex::tags() const
+{
+  QStringList tags = m_postings.keys();
+  tags.sort();
+  return tags;
+}
+
+int TagIndex::fileCount(const QString &tag) const
+{
+  auto posting = m_postings.constFind(tag);
+  return posting == m_postings.constEnd() ? 0 : int(posting->size());
+}
+
+QVector<FileMetadata> TagIndex::files(const QString &tag) const
+{
+  QVector<FileMetadata> files;
+  auto posting = m_postings.constFind(tag);
+  if (posting == m_postings.constEnd())
+    return files;
+
+  files.reserve(posting->size());
+  for (int id : *posting)
+  {
+    const Document &document = m_documents.at(id);
+    files.append(document.source->file(document.path));
+  }
+  std::sort(files.begin(), files.end(), [](const FileMetadata &a, const FileMetadata &b)
+            { return a.modified != b.modified ? a.modified > b.modified : a.path < b.path; });
+  return files;
+}
+
+bool TagIndex::updateDocument(const MetadataIndex *source, const QString &path, const QStringList &tags)
+{
+  auto known = m_ids.constFind(path);
+  int id = -1;
+  if (known == m_ids.constEnd())
+  {
+    // Untagged documents take no space
+    if (tags.isEmpty())
+      return false;
+    if (!m_freeIds.isEmpty())
+    {
+      id = m_freeIds.takeLast();
+    }
+    else
+    {
+      id = int(m_documents.size());
+      m_documents.append(Document());
+    }
+    m_documents[id].path = path;
+    m_ids.insert(path, id);
+  }
+  else
+  {
+    id = known.value();
+  }
+
+  Document &document = m_documents[id];
+  document.source = source;
+  if (document.tags == tags)
+    return false;
+
+  for (const QString &tag : document.tags)
+  {
+    if (tags.contains(tag))
+      continue;
+    auto posting = m_postings.find(tag);
+    if (posting == m_postings.end())
+      continue;
+    auto position = std::lower_bound(posting->begin(), posting->end(), id);
+    if (position != posting->end() && *position == id)
+      posting->erase(position);
+    if (posting->isEmpty())
+      m_postings.erase(posting);
+  }
+  for (const QString &tag : tags)
+  {
+    if (document.tags.contains(tag))
+      continue;
+    QVector<int> &posting = m_postings[tag];
+    posting.insert(std::lower_bound(posting.begin(), posting.end(), id), id);
+  }
+
+  if (tags.isEmpty())
+  {
+    m_ids.remove(path);
+    document = Document();
+    m_freeIds.append(id);
+  }
+  else
+  {
+    document.tags = tags;
+  }
+  return true;
+}
+
+QStringList TagIndex::extractTags(QStringView text)
+{
+  QStringList tags;
+  QSet<QString> seen;
+  const qsizetype length = text.size();
+  for (qsizetype i = 0; i < length; ++i)
+  {
+    if (text[i] != u'#' || (i > 0 && !text[i - 1].isSpace()))
+      continue;
+
+    qsizetype end = i + 1;
+    bool digitsOnly = true;
+    while (end < length)
+    {
+      QChar c = text[end];
+      if (c.isLetterOrNumber() || c == u'_' || (c == u'-' && end > i + 1))
+      {
+        digitsOnly = digitsOnly && c.isDigit();
+        ++end;
+        continue;
+      }
+      break;
+    }
+
+    // "#draft-" is tagged draft
+    while (end > i + 1 && text[end - 1] == u'-')
+      --end;
+    if (end > i + 1 && !digitsOnly)
+    {
+      QString tag = text.mid(i + 1, end - i - 1).toString().toLower();
+      if (!seen.contains(tag))
+      {
+        seen.insert(tag);
+        tags.append(tag);
+      }
+    }
+    i = end - 1;
+  }
+  return tags;
+}
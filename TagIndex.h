@@ -0,0 +1,55 @@
+#pragma once
+
+#include <QtCore/QObject>
+#include <QtCore/QHash>
+#include <QtCore/QStringList>
+#include <QtCore/QStringView>
+#include <QtCore/QVector>
+#include "MetadataIndex.h"
+
+// Inverted index from #tag to the documents carrying it, built from the
+// tags the metadata indexes already store, so answering a tag never reads
+// a document. Documents get small integer IDs and each tag keeps a sorted
+// posting list of them. Changes reported by a source index are applied per
+// document, and the postings follow the indexes across runs.
+class TagIndex : public QObject
+{
+  Q_OBJECT
+
+public:
+  explicit TagIndex(QObject *parent = nullptr);
+
+  // Indexes everything the source has and follows its changes
+  void addSource(const MetadataIndex *index);
+
+  // Alphabetical
+  QStringList tags() const;
+  int fileCount(const QString &tag) const;
+  // Newest first
+  QVector<FileMetadata> files(const QString &tag) const;
+
+  // Lowercased #tags in text, each once in order of first use. A tag starts
+  // after whitespace or at the start of the text, and is letters, digits,
+  // '_' and '-', not all digits, so "# Heading" and "#1" are not tags.
+  static QStringList extractTags(QStringView text);
+
+signals:
+  void tagsChanged();
+
+private:
+  struct Document
+  {
+    QString path;
+    const MetadataIndex *source = nullptr;
+    QStringList tags;
+  };
+
+  bool updateDocument(const MetadataIndex *source, const QString &path, const QStringList &tags);
+
+  // Indexed by document ID; free IDs have an empty path
+  QVector<Document> m_documents;
+  QVector<int> m_freeIds;
+  QHash<QString, int> m_ids;
+  // Sorted document IDs per tag
+  QHash<QString, QVector<int>> m_postings;
+};
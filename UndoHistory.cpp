@@ -0,0 +1,728 @@
+#include "UndoHistory.h"
+#include <QtCore/QDataStream>
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
+#include <QtGui/QTextBlock>
+#include <QtGui/QTextCursor>
+
+namespace
+{
+  const qint64 DefaultBudget = 16 * 1024 * 1024;
+  // Never packed, so undoing the last few steps never decompresses
+  const int KeepRecentSteps = 100;
+  // Uncompressed steps per chunk
+  const qint64 ChunkBytes = 256 * 1024;
+  // Typing after a pause this long starts a new step
+  const qint64 GroupPauseMs = 2000;
+  // Time the shadow copy is built for per turn of the event loop
+  const qint64 ShadowSliceMs = 8;
+
+  QByteArray fromText(const QString &text)
+  {
+    return QByteArray(reinterpret_cast<const char *>(text.constData()), text.size() * qsizetype(sizeof(QChar)));
+  }
+
+  QString toText(const QByteArray &payload)
+  {
+    return QString(reinterpret_cast<const QChar *>(payload.constData()), payload.size() / qsizetype(sizeof(QChar)));
+  }
+
+  QTextCursor select(QTextDocument *document, int position, int length)
+  {
+    QTextCursor cursor(document);
+    cursor.setPosition(position);
+    cursor.setPosition(position + length, QTextCursor::KeepAnchor);
+    return cursor;
+  }
+
+  // Rich content is kept as runs of text in one format. A paragraph
+  // separator is a run of its own that starts a block with blockFormat.
+  struct Run
+  {
+    QString text;
+    QTextCharFormat format;
+    QTextBlockFormat blockFormat;
+  };
+
+  bool isSeparator(const Run &run)
+  {
+    return run.text.size() == 1 && run.text.at(0) == QChar::ParagraphSeparator;
+  }
+
+  void appendRun(QList<Run> &runs, const Run &run)
+  {
+    if (run.text.isEmpty())
+      return;
+    if (!isSeparator(run) && !runs.isEmpty() && !isSeparator(runs.last()) && runs.last().format == run.format)
+      runs.last().text += run.text;
+    else
+      runs.append(run);
+  }
+
+  QList<Run> toRuns(const QByteArray &payload)
+  {
+    QList<Run> runs;
+    QDataStream in(payload);
+    in.setVersion(QDataStream::Qt_6_0);
+    while (!in.atEnd())
+    {
+      Run run;
+      QTextFormat format;
+      QTextFormat blockFormat;
+      in >> run.text >> format;
+      if (isSeparator(run))
+        in >> blockFormat;
+      if (in.status() != QDataStream::Ok)
+        break;
+      run.format = format.toCharFormat();
+      run.blockFormat = blockFormat.toBlockFormat();
+      runs.append(run);
+    }
+    return runs;
+  }
+
+  QByteArray fromRuns(const QList<Run> &runs)
+  {
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_6_0);
+    for (const Run &run : runs)
+    {
+      out << run.text << QTextFormat(run.format);
+      if (isSeparator(run))
+        out << QTextFormat(run.blockFormat);
+    }
+    return payload;
+  }
+
+  void insertRuns(QTextCursor &cursor, const QList<Run> &runs)
+  {
+    for (const Run &run : runs)
+    {
+      if (isSeparator(run))
+        cursor.insertBlock(run.blockFormat, run.format);
+      else
+        cursor.insertText(run.text, run.format);
+    }
+  }
+
+  // The part of one block's text from offset, split where its format changes
+  void appendBlockRuns(QList<Run> &runs, const QString &text, const QTextCharFormat &blockCharFormat,
+                       const QList<QTextLayout::FormatRange> &ranges, int offset, int length)
+  {
+    int at = offset;
+    int end = offset + length;
+    for (const QTextLayout::FormatRange &range : ranges)
+    {
+      int start = qMax(at, range.start);
+      int stop = qMin(end, range.start + range.length);
+      if (stop <= start)
+        continue;
+      if (start > at)
+        appendRun(runs, Run{text.mid(at, start - at), blockCharFormat, QTextBlockFormat()});
+      appendRun(runs, Run{text.mid(start, stop - start), range.format, QTextBlockFormat()});
+      at = stop;
+    }
+    if (at < end)
+      appendRun(runs, Run{text.mid(at, end - at), blockCharFormat, QTextBlockFormat()});
+  }
+}
+
+UndoHistory *UndoHistory::install(QTextDocument *document, bool isRichText)
+{
+  UndoHistory *history = document->findChild<UndoHistory *>(QString(), Qt::FindDirectChildrenOnly);
+  if (!history)
+    history = new UndoHistory(document, isRichText);
+  return history;
+}
+
+UndoHistory::UndoHistory(QTextDocument *document, bool isRichText)
+    : QObject(document), m_document(document), m_isRichText(isRichText), m_shadowLength(0), m_shadowComplete(false),
+      m_applying(false), m_recentBytes(0), m_redoBytes(0), m_chunkBytes(0), m_spilledBytes(0), m_budget(DefaultBudget),
+      m_spillToDisk(true)
+{
+  m_spillFile.setFileTemplate(QDir::tempPath() + "/writehand-undo-XXXXXX");
+  document->setUndoRedoEnabled(false);
+  m_shadowTimer.setInterval(0);
+  connect(&m_shadowTimer, &QTimer::timeout, this, &UndoHistory::buildShadow);
+  resetShadow();
+  m_lastEdit.start();
+  connect(document, &QTextDocument::contentsChange, this, &UndoHistory::onContentsChange);
+}
+
+void UndoHistory::setMemoryBudget(qint64 bytes)
+{
+  m_budget = bytes;
+  trim();
+}
+
+void UndoHistory::setSpillToDisk(bool enabled)
+{
+  m_spillToDisk = enabled;
+  trim();
+}
+
+void UndoHistory::clear()
+{
+  m_recent.clear();
+  m_chunks.clear();
+  m_redo.clear();
+  m_recentBytes = 0;
+  m_redoBytes = 0;
+  m_chunkBytes = 0;
+  m_spilledBytes = 0;
+  if (m_spillFile.isOpen())
+    m_spillFile.resize(0);
+}
+
+qint64 UndoHistory::memoryUsage() const
+{
+  qint64 shadow = qint64(m_shadowLength) * qint64(sizeof(QChar)) +
+                  qint64(m_shadowBlocks.size()) * qint64(sizeof(QString) + 16);
+  // Formats are shared with the document, so a block only holds references
+  if (m_isRichText)
+    shadow += qint64(m_shadowFormats.size()) * qint64(sizeof(BlockFormats) + 2 * sizeof(QTextLayout::FormatRange));
+  return m_recentBytes + m_redoBytes + m_chunkBytes + shadow;
+}
+
+void UndoHistory::resetShadow()
+{
+  m_shadowBlocks.clear();
+  m_shadowFormats.clear();
+  m_shadowLength = 0;
+  m_shadowComplete = false;
+  // Small documents are done in the first slice
+  buildShadow();
+}
+
+void UndoHistory::buildShadow()
+{
+  QElapsedTimer timer;
+  timer.start();
+  QTextBlock block = m_document->findBlockByNumber(int(m_shadowBlocks.size()));
+  for (int i = 0; block.isValid(); ++i, block = block.next())
+  {
+    if (i % 256 == 255 && timer.elapsed() >= ShadowSliceMs)
+      break;
+    m_shadowBlocks.append(block.text());
+    if (m_isRichText)
+      m_shadowFormats.append(formatsOf(block));
+    m_shadowLength += block.length();
+  }
+
+  m_shadowComplete = !block.isValid();
+  if (m_shadowComplete)
+    m_shadowTimer.stop();
+  else if (!m_shadowTimer.isActive())
+    m_shadowTimer.start();
+}
+
+UndoHistory::BlockFormats UndoHistory::formatsOf(const QTextBlock &block)
+{
+  return BlockFormats{block.blockFormat(), block.charFormat(), block.textFormats()};
+}
+
+void UndoHistory::truncateShadow(int blocks)
+{
+  while (m_shadowBlocks.size() > blocks)
+  {
+    m_shadowLength -= int(m_shadowBlocks.takeLast().size()) + 1;
+    if (m_isRichText)
+      m_shadowFormats.removeLast();
+  }
+  m_shadowComplete = false;
+  if (!m_shadowTimer.isActive())
+    m_shadowTimer.start();
+}
+
+void UndoHistory::resync()
+{
+  qWarning() << "Undo history lost track of its document, clearing it";
+  clear();
+  resetShadow();
+}
+
+QByteArray UndoHistory::content(int position, int length, bool fromShadow, int *separators) const
+{
+  // Text before an edit is the same in the document and the shadow, so
+  // the document finds the block it starts in
+  QTextBlock block = m_document->findBlock(position);
+  int index = block.blockNumber();
+  int offset = position - block.position();
+  QString text;
+  QList<Run> runs;
+  int count = 0;
+  bool first = true;
+  while (length > 0)
+  {
+    QString line;
+    BlockFormats formats;
+    if (fromShadow)
+    {
+      if (index >= m_shadowBlocks.size())
+        break;
+      line = m_shadowBlocks.at(index);
+      if (m_isRichText)
+        formats = m_shadowFormats.at(index);
+    }
+    else
+    {
+      if (!block.isValid())
+        break;
+      line = block.text();
+      if (m_isRichText)
+        formats = formatsOf(block);
+      block = block.next();
+    }
+
+    // The separator that ended the block before
+    if (!first)
+    {
+      if (m_isRichText)
+        appendRun(runs, Run{QString(QChar::ParagraphSeparator), formats.character, formats.block});
+      else
+        text += QChar::ParagraphSeparator;
+      count++;
+      if (--length == 0)
+        break;
+    }
+    first = false;
+
+    int take = qMin(length, int(line.size()) - offset);
+    if (m_isRichText)
+      appendBlockRuns(runs, line, formats.character, formats.ranges, offset, take);
+    else
+      text += QStringView(line).mid(offset, take);
+    length -= take;
+    ++index;
+    offset = 0;
+  }
+
+  if (separators)
+    *separators = count;
+  return m_isRichText ? fromRuns(runs) : fromText(text);
+}
+
+int UndoHistory::payloadLength(const QByteArray &payload) const
+{
+  if (!m_isRichText)
+    return int(payload.size() / qsizetype(sizeof(QChar)));
+  int length = 0;
+  for (const Run &run : toRuns(payload))
+    length += int(run.text.size());
+  return length;
+}
+
+QByteArray UndoHistory::payloadMid(const QByteArray &payload, int from, int length) const
+{
+  if (!m_isRichText)
+    return fromText(toText(payload).mid(from, length));
+
+  QList<Run> runs;
+  int position = 0;
+  for (const Run &run : toRuns(payload))
+  {
+    int start = qMax(from, position);
+    int end = int(position + run.text.size());
+    if (length >= 0)
+      end = qMin(end, from + length);
+    if (start < end)
+      appendRun(runs, Run{run.text.mid(start - position, end - start), run.format, run.blockFormat});
+    position += int(run.text.size());
+  }
+  return fromRuns(runs);
+}
+
+QByteArray UndoHistory::joinPayloads(const QByteArray &first, const QByteArray &second) const
+{
+  if (!m_isRichText || first.isEmpty() || second.isEmpty())
+    return first + second;
+  QList<Run> runs = toRuns(first);
+  for (const Run &run : toRuns(second))
+    appendRun(runs, run);
+  return fromRuns(runs);
+}
+
+void UndoHistory::onContentsChange(int position, int charsRemoved, int charsAdded)
+{
+  // The document always ends in an implicit block separator that no step covers
+  int documentLength = m_document->characterCount() - 1;
+  // Installing a document layout reports everything as just inserted
+  if (position == 0 && charsRemoved == 0 && charsAdded == documentLength + 1 &&
+      (!m_shadowComplete || shadowLength() == documentLength))
+    return;
+  int added = qBound(0, charsAdded, documentLength - position);
+  int removed = 0;
+  bool pastShadow = false;
+  if (m_shadowComplete)
+  {
+    removed = qBound(0, charsRemoved, shadowLength() - position);
+    if (shadowLength() - removed + added != documentLength)
+    {
+      resync();
+      return;
+    }
+  }
+  else
+  {
+    // An edit that reaches the final separator counts it in both
+    removed = qMax(0, charsRemoved - (charsAdded - added));
+    pastShadow = position > shadowLength();
+    if (!pastShadow && position + removed > shadowLength())
+    {
+      // It runs on into blocks not built yet; they are built again from the first it touched
+      truncateShadow(m_document->findBlock(position).blockNumber());
+      pastShadow = true;
+    }
+    if (pastShadow && removed > 0 && !m_applying)
+    {
+      qDebug() << "Undo history: an edit came before the text it removed was read, clearing history";
+      clear();
+      return;
+    }
+  }
+  if (removed == 0 && added == 0)
+    return;
+
+  QString text = select(m_document, position, added).selectedText();
+  QByteArray before;
+  if (!pastShadow)
+  {
+    int separators = 0;
+    before = content(position, removed, true, &separators);
+    // Formatting a plain document, or reapplying the same format, changes nothing worth undoing
+    if (removed == added && before == content(position, added, false))
+      return;
+
+    // Swap in the blocks the edit touched, as the document now has them
+    QTextBlock block = m_document->findBlock(position);
+    int first = block.blockNumber();
+    int oldCount = qMin(separators + 1, int(m_shadowBlocks.size()) - first);
+    int newCount = m_document->findBlock(position + added).blockNumber() - first + 1;
+    m_shadowBlocks.remove(first, oldCount);
+    if (m_isRichText)
+      m_shadowFormats.remove(first, oldCount);
+    for (int i = 0; i < newCount; ++i, block = block.next())
+    {
+      m_shadowBlocks.insert(first + i, block.text());
+      if (m_isRichText)
+        m_shadowFormats.insert(first + i, formatsOf(block));
+    }
+    m_shadowLength += added - removed;
+    if (m_shadowComplete && m_shadowBlocks.size() != m_document->blockCount())
+    {
+      resync();
+      return;
+    }
+  }
+  if (m_applying)
+    return;
+
+  if (m_lastEdit.restart() > GroupPauseMs && !m_recent.isEmpty())
+    m_recent.last().open = false;
+  record(position, removed, added, before, text.contains(QChar::ParagraphSeparator));
+}
+
+void UndoHistory::record(int position, int charsRemoved, int charsAdded, const QByteArray &removed, bool breaksGroup)
+{
+  m_redo.clear();
+  m_redoBytes = 0;
+
+  if (!m_recent.isEmpty() && m_recent.last().open && !breaksGroup)
+  {
+    Step &last = m_recent.last();
+    qint64 bytes = stepBytes(last);
+    bool merged = true;
+    if (removed.isEmpty() && charsAdded == 1 && position == last.position + last.length)
+    {
+      // Typing on at the end of the step
+      last.length += charsAdded;
+    }
+    else if (charsAdded == 0 && charsRemoved == 1 && position >= last.position &&
+             position + charsRemoved <= last.position + last.length)
+    {
+      // Erasing what the step typed
+      last.length -= charsRemoved;
+    }
+    else if (charsAdded == 0 && charsRemoved == 1 && last.length == 0 && position + charsRemoved == last.position)
+    {
+      // Backspacing further
+      last.payload = joinPayloads(removed, last.payload);
+      last.position = position;
+    }
+    else if (charsAdded == 0 && charsRemoved == 1 && last.length == 0 && position == last.position)
+    {
+      // Deleting forwards
+      last.payload = joinPayloads(last.payload, removed);
+    }
+    else
+    {
+      merged = false;
+    }
+
+    if (merged)
+    {
+      m_recentBytes += stepBytes(last) - bytes;
+      // Everything typed was erased again
+      if (last.length == 0 && last.payload.isEmpty())
+      {
+        m_recentBytes -= stepBytes(last);
+        m_recent.removeLast();
+      }
+      trim();
+      return;
+    }
+  }
+
+  Step step;
+  step.position = position;
+  step.length = charsAdded;
+  step.payload = removed;
+  step.open = !breaksGroup;
+  m_recent.append(step);
+  m_recentBytes += stepBytes(step);
+  trim();
+}
+
+int UndoHistory::undo()
+{
+  if (m_recent.isEmpty() && !unpackChunk())
+    return -1;
+
+  Step step = m_recent.takeLast();
+  m_recentBytes -= stepBytes(step);
+  Step inverse = apply(step);
+  m_redo.append(inverse);
+  m_redoBytes += stepBytes(inverse);
+  trim();
+  // Typing after an undo starts a step of its own
+  if (!m_recent.isEmpty())
+    m_recent.last().open = false;
+  return inverse.position + inverse.length;
+}
+
+int UndoHistory::redo()
+{
+  if (m_redo.isEmpty())
+    return -1;
+
+  Step step = m_redo.takeLast();
+  m_redoBytes -= stepBytes(step);
+  Step inverse = apply(step);
+  m_recent.append(inverse);
+  m_recentBytes += stepBytes(inverse);
+  trim();
+  return inverse.position + inverse.length;
+}
+
+UndoHistory::Step UndoHistory::apply(const Step &step)
+{
+  int length = qMin(step.length, m_document->characterCount() - 1 - step.position);
+  Step inverse;
+  inverse.position = step.position;
+  inverse.payload = content(step.position, length, false);
+  inverse.open = false;
+
+  QTextCursor cursor = select(m_document, step.position, length);
+  m_applying = true;
+  cursor.beginEditBlock();
+  if (step.payload.isEmpty())
+  {
+    cursor.removeSelectedText();
+  }
+  else if (m_isRichText)
+  {
+    cursor.removeSelectedText();
+    insertRuns(cursor, toRuns(step.payload));
+  }
+  else
+    cursor.insertText(toText(step.payload));
+  cursor.endEditBlock();
+  m_applying = false;
+
+  inverse.length = cursor.position() - step.position;
+  return inverse;
+}
+
+bool UndoHistory::unpackChunk()
+{
+  if (m_chunks.isEmpty())
+    return false;
+
+  Chunk chunk = m_chunks.takeLast();
+  QByteArray data = chunk.data;
+  if (chunk.fileOffset >= 0)
+  {
+    m_spillFile.seek(chunk.fileOffset);
+    data = m_spillFile.read(chunk.fileSize);
+    // Chunks are spilled oldest first, so this one ends the file
+    m_spillFile.resize(chunk.fileOffset);
+    m_spilledBytes -= chunk.fileSize;
+  }
+  else
+  {
+    m_chunkBytes -= chunk.data.size();
+  }
+
+  QByteArray raw = qUncompress(data);
+  QDataStream in(raw);
+  in.setVersion(QDataStream::Qt_6_0);
+  QList<Step> steps;
+  for (int i = 0; i < chunk.count; ++i)
+  {
+    Step step;
+    in >> step.position >> step.length >> step.payload;
+    step.open = false;
+    steps.append(step);
+  }
+  if (raw.isEmpty() || in.status() != QDataStream::Ok)
+  {
+    // Older steps would apply to the wrong text without this one
+    qWarning() << "Could not read back undo history, dropping the rest of it";
+    m_chunks.clear();
+    m_chunkBytes = 0;
+    m_spilledBytes = 0;
+    m_spillFile.resize(0);
+    return false;
+  }
+
+  for (const Step &step : steps)
+    m_recentBytes += stepBytes(step);
+  m_recent = steps;
+  logUsage("unpacked");
+  return true;
+}
+
+void UndoHistory::trim()
+{
+  bool changed = false;
+  while (m_recent.size() > KeepRecentSteps && m_recentBytes > m_budget / 4)
+  {
+    pack(int(m_recent.size()) - KeepRecentSteps);
+    changed = true;
+  }
+
+  // Everything held in memory counts, the newest steps and redo included
+  while (m_recentBytes + m_redoBytes + m_chunkBytes > m_budget)
+  {
+    changed = true;
+    if (m_chunkBytes == 0)
+    {
+      // Only the newest steps and redo are left: pack the steps, oldest
+      // first, so they can spill too, then drop the furthest redo
+      if (!m_recent.isEmpty())
+      {
+        pack(int(m_recent.size()));
+        continue;
+      }
+      if (m_redo.isEmpty())
+        break;
+      m_redoBytes -= stepBytes(m_redo.takeFirst());
+      continue;
+    }
+
+    int oldest = 0;
+    while (m_chunks.at(oldest).fileOffset >= 0)
+      ++oldest;
+    Chunk &chunk = m_chunks[oldest];
+
+    if (m_spillToDisk && (m_spillFile.isOpen() || m_spillFile.open()))
+    {
+      qint64 offset = m_spillFile.size();
+      m_spillFile.seek(offset);
+      if (m_spillFile.write(chunk.data) == chunk.data.size())
+      {
+        chunk.fileOffset = offset;
+        chunk.fileSize = chunk.data.size();
+        m_chunkBytes -= chunk.fileSize;
+        m_spilledBytes += chunk.fileSize;
+        chunk.data = QByteArray();
+        continue;
+      }
+      qWarning() << "Could not spill undo history to" << m_spillFile.fileName() << m_spillFile.errorString();
+      m_spillFile.resize(offset);
+    }
+
+    // Anything spilled is older still and can't be reached past the gap
+    m_chunkBytes -= chunk.data.size();
+    m_chunks.erase(m_chunks.begin(), m_chunks.begin() + oldest + 1);
+    m_spilledBytes = 0;
+    if (m_spillFile.isOpen())
+      m_spillFile.resize(0);
+  }
+
+  if (changed)
+    logUsage("trimmed");
+}
+
+void UndoHistory::pack(int available)
+{
+  int count = 0;
+  qint64 bytes = 0;
+  while (count < available && bytes < ChunkBytes)
+    bytes += stepBytes(m_recent.at(count++));
+
+  // Steps that touch fold into one larger replacement
+  QList<Step> steps;
+  for (int i = 0; i < count; ++i)
+  {
+    if (steps.isEmpty() || !merge(steps.last(), m_recent.at(i)))
+      steps.append(m_recent.at(i));
+  }
+
+  QByteArray raw;
+  QDataStream out(&raw, QIODevice::WriteOnly);
+  out.setVersion(QDataStream::Qt_6_0);
+  for (const Step &step : steps)
+    out << step.position << step.length << step.payload;
+
+  Chunk chunk;
+  chunk.count = int(steps.size());
+  chunk.rawBytes = raw.size();
+  chunk.data = qCompress(raw);
+  m_chunkBytes += chunk.data.size();
+  m_chunks.append(chunk);
+
+  m_recentBytes -= bytes;
+  m_recent.erase(m_recent.begin(), m_recent.begin() + count);
+}
+
+bool UndoHistory::merge(Step &older, const Step &newer) const
+{
+  // Only overlapping or adjacent steps compose without the text between them
+  int newerRemoved = payloadLength(newer.payload);
+  if (newer.position > older.position + older.length || older.position > newer.position + newerRemoved)
+    return false;
+
+  // Whatever newer replaced outside older's text was there before older too
+  int start = qMin(older.position, newer.position);
+  int end = qMax(older.position + older.length, newer.position + newerRemoved);
+  QByteArray payload = joinPayloads(payloadMid(newer.payload, 0, qMax(0, older.position - newer.position)), older.payload);
+  if (older.position + older.length < end)
+    payload = joinPayloads(payload, payloadMid(newer.payload, older.position + older.length - newer.position, -1));
+
+  older.position = start;
+  older.length = end - start - newerRemoved + newer.length;
+  older.payload = payload;
+  return true;
+}
+
+qint64 UndoHistory::stepBytes(const Step &step)
+{
+  return qint64(sizeof(Step)) + step.payload.size();
+}
+
+void UndoHistory::logUsage(const char *event) const
+{
+  qint64 compressed = 0;
+  qint64 raw = 0;
+  for (const Chunk &chunk : m_chunks)
+  {
+    compressed += chunk.fileOffset >= 0 ? chunk.fileSize : chunk.data.size();
+    raw += chunk.rawBytes;
+  }
+  qDebug().noquote() << "Undo history" << event << "-" << memoryUsage() / 1024 << "KB in memory,"
+                     << m_recent.size() << "recent steps," << m_chunks.size() << "chunks" << raw / 1024 << "KB ->"
+                     << compressed / 1024 << "KB," << m_spilledBytes / 1024 << "KB on disk";
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <QtCore/QObject>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QList>
+#include <QtCore/QPointer>
+#include <QtCore/QTemporaryFile>
+#include <QtCore/QTimer>
+#include <QtGui/QTextDocument>
+#include <QtGui/QTextFormat>
+#include <QtGui/QTextLayout>
+#include <QtGui/QTextObject>
+
+// Undo and redo for one document, in place of QTextDocument's own stack,
+// which keeps every command for as long as the document lives. Each step
+// is a replacement: the text a change put at a position, and what was
+// there before. Since the document only reports what changed after the
+// fact, the history keeps a shadow copy of it to read removed content
+// from: the text of each block, and for rich documents its formats, so
+// their steps store runs of formatted text and formatting comes back too.
+// The shadow is built a slice at a time from the event loop; an edit
+// past what has been built so far can't be undone and clears history.
+//
+// Typing, backspacing and deleting coalesce into one step until a new
+// line or a pause. The steps it holds in memory, redo included, are
+// bounded by a budget; the shadow copy comes on top of it, about the size
+// of the document itself. Older steps are merged where they touch, then
+// packed into zlib-compressed chunks, and once those outgrow the budget
+// the oldest chunks move to a temporary file or, without one, are
+// dropped. Should the newest steps alone outgrow it they are packed
+// too, and then the furthest redo steps go.
+//
+// A child of its document, so it travels with it through DocumentCache.
+class UndoHistory : public QObject
+{
+  Q_OBJECT
+
+public:
+  // The document's history, created on first use, which also turns off
+  // the document's own undo stack
+  static UndoHistory *install(QTextDocument *document, bool isRichText);
+
+  void setMemoryBudget(qint64 bytes);
+  qint64 memoryBudget() const { return m_budget; }
+  // Whether chunks past the budget go to disk rather than away
+  void setSpillToDisk(bool enabled);
+
+  bool canUndo() const { return !m_recent.isEmpty() || !m_chunks.isEmpty(); }
+  bool canRedo() const { return !m_redo.isEmpty(); }
+  // Return the position to put the cursor at, or -1 with nothing to do
+  int undo();
+  int redo();
+  void clear();
+
+  // Steps and the shadow copy in memory, and chunks on disk
+  qint64 memoryUsage() const;
+  qint64 diskUsage() const { return m_spilledBytes; }
+
+private:
+  struct Step
+  {
+    int position = 0;
+    int length = 0;     // Characters the change left at position
+    QByteArray payload; // What was there before: UTF-16 text, or formatted runs
+    bool open = true;   // Typing may still extend it
+  };
+
+  struct BlockFormats
+  {
+    QTextBlockFormat block;
+    QTextCharFormat character;
+    QList<QTextLayout::FormatRange> ranges;
+  };
+
+  struct Chunk
+  {
+    QByteArray data; // Compressed steps, empty once spilled
+    int count = 0;
+    qint64 rawBytes = 0;
+    qint64 fileOffset = -1;
+    qint64 fileSize = 0;
+  };
+
+  UndoHistory(QTextDocument *document, bool isRichText);
+
+  void onContentsChange(int position, int charsRemoved, int charsAdded);
+  void resetShadow();
+  void buildShadow();
+  void truncateShadow(int blocks);
+  static BlockFormats formatsOf(const QTextBlock &block);
+  void resync();
+  int shadowLength() const { return m_shadowLength - 1; }
+  // From the shadow or the document as it is now
+  QByteArray content(int position, int length, bool fromShadow, int *separators = nullptr) const;
+  int payloadLength(const QByteArray &payload) const;
+  QByteArray payloadMid(const QByteArray &payload, int from, int length) const;
+  QByteArray joinPayloads(const QByteArray &first, const QByteArray &second) const;
+  void record(int position, int charsRemoved, int charsAdded, const QByteArray &removed, bool breaksGroup);
+  Step apply(const Step &step);
+  bool unpackChunk();
+  void trim();
+  void pack(int count);
+  bool merge(Step &older, const Step &newer) const;
+  static qint64 stepBytes(const Step &step);
+  void logUsage(const char *event) const;
+
+  QPointer<QTextDocument> m_document;
+  bool m_isRichText;
+  // The content as of the last contentsChange, from the first block on
+  QList<QString> m_shadowBlocks;
+  QList<BlockFormats> m_shadowFormats; // Rich documents only
+  int m_shadowLength; // Characters in those blocks, separators included
+  bool m_shadowComplete;
+  QTimer m_shadowTimer;
+  bool m_applying;
+
+  QList<Step> m_recent; // Oldest first, uncompressed
+  QList<Chunk> m_chunks; // Oldest first; spilled ones come first
+  QList<Step> m_redo;
+  qint64 m_recentBytes;
+  qint64 m_redoBytes;
+  qint64 m_chunkBytes; // Compressed chunks still in memory
+  qint64 m_spilledBytes;
+  QElapsedTimer m_lastEdit;
+
+  qint64 m_budget;
+  bool m_spillToDisk;
+  QTemporaryFile m_spillFile;
+};
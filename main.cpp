@@ -1,51 +1,23 @@
 #include <QApplication>
-#include <QFile>
-#include <QDateTime>
 #include <QStandardPaths>
-#include <QDir>
 #include "MainWindow.h"
-
-void messageHandler(QtMsgType type, const QMessageLogContext &context, const QString &msg)
-{
-    QString txt;
-    switch (type)
-    {
-    case QtDebugMsg:
-        txt = QString("Debug: %1").arg(msg);
-        break;
-    case QtInfoMsg:
-        txt = QString("Info: %1").arg(msg);
-        break;
-    case QtWarningMsg:
-        txt = QString("Warning: %1").arg(msg);
-        break;
-    case QtCriticalMsg:
-        txt = QString("Critical: %1").arg(msg);
-        break;
-    case QtFatalMsg:
-        txt = QString("Fatal: %1").arg(msg);
-        break;
-    }
-
-    QString appDataPath = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
-    QDir().mkpath(appDataPath); // Ensure the directory exists
-    QString logPath = appDataPath + "/debug.log";
-
-    QFile outFile(logPath);
-    outFile.open(QIODevice::WriteOnly | QIODevice::Append);
-    QTextStream ts(&outFile);
-    ts << QDateTime::currentDateTime().toString() << " - " << txt << Qt::endl;
-}
+#include "Logger.h"
+#include "DocumentWriter.h"
 
 int main(int argc, char *argv[])
 {
     QApplication app(argc, argv);
 
-    // Install message handler
-    qInstallMessageHandler(messageHandler);
+    // All qDebug()/qWarning() output goes through the background logger
+    Logger::instance().start(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/writehand.log");
+    qInstallMessageHandler(Logger::messageHandler);
 
     MainWindow window;
     window.show();
 
-    return app.exec();
-}
\ No newline at end of file
+    int result = app.exec();
+    // Saves still queued land before exit; any later ones are written in place
+    DocumentWriter::instance().shutdown();
+    Logger::instance().shutdown();
+    return result;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <QtCore/QRandomGenerator>
+#include <QtCore/QString>
+
+// Deterministic prose for benchmarks: words from a small vocabulary in
+// sentences and paragraphs of varying length, with "lantern" in either
+// case about once in every thousand words to give searches something to find
+inline QString syntheticText(qsizetype characters, quint32 seed = 1)
+{
+  static const char *const words[] = {
+      "the", "of", "and", "a", "to", "in", "was", "he", "she", "it", "that", "her", "his", "with", "for", "as",
+      "had", "on", "at", "by", "not", "but", "from", "they", "were", "which", "house", "river", "morning",
+      "window", "letter", "silence", "garden", "winter", "street", "door", "light", "water", "hands", "voice",
+      "remember", "walked", "looked", "thought", "slowly", "again", "nothing", "always", "evening", "table",
+      "stranger", "mountain", "kitchen", "answered", "forgotten", "whispered", "afterwards", "somewhere"};
+  const int wordCount = int(sizeof(words) / sizeof(words[0]));
+
+  QRandomGenerator random(seed);
+  QString text;
+  text.reserve(characters + 32);
+  int sentence = 0;
+  int paragraph = 0;
+  while (text.size() < characters)
+  {
+    QString word = random.bounded(1000) == 0 ? QString(random.bounded(2) ? "Lantern" : "lantern")
+                                             : QString::fromLatin1(words[random.bounded(wordCount)]);
+    if (sentence == 0)
+      word[0] = word.at(0).toUpper();
+    text += word;
+
+    if (++sentence < 8 + random.bounded(12))
+    {
+      text += u' ';
+      continue;
+    }
+    text += u'.';
+    sentence = 0;
+    if (++paragraph < 3 + random.bounded(5))
+    {
+      text += u' ';
+      continue;
+    }
+    text += u'\n';
+    paragraph = 0;
+  }
+  text.truncate(characters);
+  return text;
+}
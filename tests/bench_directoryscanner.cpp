@@ -0,0 +1,101 @@
+#include <QtTest/QtTest>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QTemporaryDir>
+#include "DirectoryScanner.h"
+
+namespace
+{
+  // 10 projects of 10 parts of 10 chapters, each with 100 documents and
+  // 10 files the scan should pass over: 100,000 documents in 1,111 folders
+  const int Fanout = 10;
+  const int DocumentsPerFolder = 100;
+  const int OthersPerFolder = 10;
+  const int ExpectedDocuments = Fanout * Fanout * Fanout * DocumentsPerFolder;
+
+  const QStringList &documentFilters()
+  {
+    static const QStringList filters = {"*.txt", "*.md", "*.rtf", "*.html", "*.markdown", "*.text"};
+    return filters;
+  }
+
+  bool touch(const QString &path)
+  {
+    QFile file(path);
+    return file.open(QIODevice::WriteOnly);
+  }
+}
+
+// Scan throughput of DirectoryScanner over a synthetic 100k-document
+// tree, for a growing number of walkers
+class BenchDirectoryScanner : public QObject
+{
+  Q_OBJECT
+
+private slots:
+  void initTestCase();
+  void scan_data();
+  void scan();
+
+private:
+  QTemporaryDir m_root;
+};
+
+void BenchDirectoryScanner::initTestCase()
+{
+  QVERIFY(m_root.isValid());
+  QDir root(m_root.path());
+  for (int project = 0; project < Fanout; ++project)
+  {
+    for (int part = 0; part < Fanout; ++part)
+    {
+      for (int chapter = 0; chapter < Fanout; ++chapter)
+      {
+        QString folder = QString("project %1/part %2/chapter %3").arg(project).arg(part).arg(chapter);
+        QVERIFY(root.mkpath(folder));
+        folder = root.filePath(folder);
+        for (int i = 0; i < DocumentsPerFolder; ++i)
+          QVERIFY(touch(QString("%1/scene %2.%3").arg(folder).arg(i).arg(i % 2 ? "md" : "txt")));
+        for (int i = 0; i < OthersPerFolder; ++i)
+          QVERIFY(touch(QString("%1/image %2.png").arg(folder).arg(i)));
+      }
+    }
+  }
+}
+
+void BenchDirectoryScanner::scan_data()
+{
+  QTest::addColumn<int>("walkers");
+  for (int walkers : {1, 2, 4, 8})
+    QTest::newRow(QByteArray::number(walkers).append(walkers == 1 ? " walker" : " walkers").constData()) << walkers;
+}
+
+void BenchDirectoryScanner::scan()
+{
+  QFETCH(int, walkers);
+
+  DirectoryScanner scanner;
+  scanner.setWorkerCount(walkers);
+  int found = 0;
+  connect(&scanner, &DirectoryScanner::filesFound, this,
+          [&found](const QString &, const QVector<FileMetadata> &files) { found += int(files.size()); });
+  QSignalSpy finished(&scanner, &DirectoryScanner::finished);
+
+  QBENCHMARK
+  {
+    found = 0;
+    finished.clear();
+    scanner.scan(m_root.path(), documentFilters(), QStringList());
+    QVERIFY(finished.wait(5 * 60 * 1000));
+  }
+
+  QCOMPARE(found, ExpectedDocuments);
+  QList<QVariant> arguments = finished.takeFirst();
+  int files = arguments.at(2).toInt();
+  qint64 elapsed = qMax<qint64>(1, arguments.at(3).toLongLong());
+  QCOMPARE(files, ExpectedDocuments);
+  qInfo().noquote() << QString("%1 files in %2 ms, %3 files/s").arg(files).arg(elapsed).arg(files * 1000 / elapsed);
+}
+
+QTEST_GUILESS_MAIN(BenchDirectoryScanner)
+#include "bench_directoryscanner.moc"
@@ -0,0 +1,92 @@
+#include <QtTest/QtTest>
+#include <QtCore/QRandomGenerator>
+#include <QtGui/QTextBlock>
+#include <QtGui/QTextCursor>
+#include <QtGui/QTextDocument>
+#include <algorithm>
+#include "DocumentStats.h"
+#include "SyntheticText.h"
+
+namespace
+{
+  // About 1.1 million words
+  const qsizetype Characters = 6500 * 1000;
+  const qint64 MinimumWords = 1000 * 1000;
+  const qint64 TargetNs = 100 * 1000;
+  const int Keystrokes = 201;
+}
+
+// DocumentStats on a 1M-word document: counting it whole, and what
+// keeping the counts up to date adds to each keystroke
+class BenchDocumentStats : public QObject
+{
+  Q_OBJECT
+
+private slots:
+  void initTestCase();
+  void countText();
+  void recountDocument();
+  void keystroke();
+
+private:
+  QString m_text;
+  QTextDocument m_document;
+};
+
+void BenchDocumentStats::initTestCase()
+{
+  m_text = syntheticText(Characters);
+  m_document.setPlainText(m_text);
+  m_document.setUndoRedoEnabled(false);
+
+  DocumentStats stats;
+  stats.setDocument(&m_document);
+  QVERIFY2(stats.counts().words >= MinimumWords, qPrintable(QString("Only %1 words").arg(stats.counts().words)));
+}
+
+void BenchDocumentStats::countText()
+{
+  DocumentStats::Counts counts;
+  QBENCHMARK { counts = DocumentStats::count(m_text); }
+  QVERIFY(counts.words >= MinimumWords);
+}
+
+void BenchDocumentStats::recountDocument()
+{
+  DocumentStats stats;
+  QBENCHMARK { stats.setDocument(&m_document); }
+  QVERIFY(stats.counts().words >= MinimumWords);
+}
+
+void BenchDocumentStats::keystroke()
+{
+  // Slots run in the order they were connected, so these two bracket the
+  // one DocumentStats makes and time only its share of each edit
+  QElapsedTimer timer;
+  QVector<qint64> times;
+  connect(&m_document, &QTextDocument::contentsChange, this, [&timer]() { timer.start(); });
+  DocumentStats stats;
+  stats.setDocument(&m_document);
+  connect(&m_document, &QTextDocument::contentsChange, this, [&timer, &times]() { times.append(timer.nsecsElapsed()); });
+  const DocumentStats::Counts before = stats.counts();
+
+  QRandomGenerator random(1);
+  QTextCursor cursor(&m_document);
+  for (int i = 0; i < Keystrokes; ++i)
+  {
+    cursor.setPosition(random.bounded(m_document.characterCount() - 1));
+    cursor.insertText(i % 2 ? " " : "x");
+    cursor.deletePreviousChar();
+  }
+  disconnect(&m_document, &QTextDocument::contentsChange, this, nullptr);
+  QCOMPARE(stats.counts().words, before.words);
+  QCOMPARE(stats.counts().sentences, before.sentences);
+
+  std::sort(times.begin(), times.end());
+  qint64 median = times.at(times.size() / 2);
+  qDebug("Median %.1f us, slowest %.1f us over %d edits", median / 1e3, times.last() / 1e3, int(times.size()));
+  QVERIFY2(median < TargetNs, qPrintable(QString("%1 us is over the 100 us target").arg(median / 1e3)));
+}
+
+QTEST_MAIN(BenchDocumentStats)
+#include "bench_documentstats.moc"
@@ -0,0 +1,80 @@
+#include <QtTest/QtTest>
+#include <QtCore/QDateTime>
+#include <QtCore/QRandomGenerator>
+#include <algorithm>
+#include "FuzzyMatcher.h"
+
+namespace
+{
+  const int Candidates = 100 * 1000;
+  const int MaxResults = 50; // As QuickOpenPalette asks for
+  const qint64 TargetNs = 5 * 1000 * 1000;
+  const int Runs = 11;
+}
+
+// FuzzyMatcher over 100k file paths, one query per keystroke
+class BenchFuzzyMatcher : public QObject
+{
+  Q_OBJECT
+
+private slots:
+  void initTestCase();
+  void keystroke_data();
+  void keystroke();
+
+private:
+  FuzzyMatcher m_matcher;
+};
+
+void BenchFuzzyMatcher::initTestCase()
+{
+  const QStringList words = {"chapter", "notes", "draft", "outline", "scene", "research", "letters",
+                             "journal", "ideas", "revision", "final", "character", "setting", "plot",
+                             "timeline", "archive", "summer", "winter", "harbour", "northern"};
+  const int wordCount = int(words.size());
+
+  QRandomGenerator random(1);
+  const qint64 now = QDateTime::currentMSecsSinceEpoch();
+  m_matcher.reserve(Candidates, Candidates * 48);
+  for (int i = 0; i < Candidates; ++i)
+  {
+    QString path = QString("Location %1/%2 %3/%4 %5 %6.md")
+                       .arg(random.bounded(8))
+                       .arg(words.at(random.bounded(wordCount)), words.at(random.bounded(wordCount)),
+                            words.at(random.bounded(wordCount)), words.at(random.bounded(wordCount)))
+                       .arg(i);
+    // Spread over the last year, so recency boosting has work to do
+    qint64 modified = now - qint64(random.bounded(365 * 24)) * 60 * 60 * 1000;
+    m_matcher.addCandidate(path, int(path.lastIndexOf('/')) + 1, modified);
+  }
+}
+
+void BenchFuzzyMatcher::keystroke_data()
+{
+  QTest::addColumn<QString>("query");
+  const QString typed = "chap notes 42";
+  for (int i = 0; i <= typed.size(); ++i)
+    QTest::newRow(QByteArray("\"").append(typed.left(i).toUtf8()).append('"').constData()) << typed.left(i);
+}
+
+void BenchFuzzyMatcher::keystroke()
+{
+  QFETCH(QString, query);
+
+  QBENCHMARK { m_matcher.match(query, MaxResults); }
+
+  QVector<qint64> times;
+  QElapsedTimer timer;
+  for (int i = 0; i < Runs; ++i)
+  {
+    timer.start();
+    m_matcher.match(query, MaxResults);
+    times.append(timer.nsecsElapsed());
+  }
+  std::sort(times.begin(), times.end());
+  qint64 median = times.at(times.size() / 2);
+  QVERIFY2(median < TargetNs, qPrintable(QString("%1 ms is over the 5 ms target").arg(median / 1e6)));
+}
+
+QTEST_GUILESS_MAIN(BenchFuzzyMatcher)
+#include "bench_fuzzymatcher.moc"
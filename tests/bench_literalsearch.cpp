@@ -0,0 +1,142 @@
+#include <QtTest/QtTest>
+#include <QtGui/QTextCursor>
+#include <QtGui/QTextDocument>
+#include "LiteralSearcher.h"
+#include "SyntheticText.h"
+
+namespace
+{
+  const QString Needle = QStringLiteral("lantern");
+}
+
+// LiteralSearcher against the two ways the editor searched before it,
+// QTextDocument::find and QString::indexOf, from a chapter to a corpus
+class BenchLiteralSearch : public QObject
+{
+  Q_OBJECT
+
+private slots:
+  void initTestCase();
+  void cleanupTestCase();
+
+  void agrees_data() { addRows(); }
+  void agrees();
+  void literalSearcher_data() { addRows(); }
+  void literalSearcher();
+  void stringIndexOf_data() { addRows(); }
+  void stringIndexOf();
+  void documentFind_data() { addRows(); }
+  void documentFind();
+
+private:
+  void addRows();
+  int countLiteralSearcher(const QString &text, bool caseInsensitive) const;
+  int countIndexOf(const QString &text, bool caseInsensitive) const;
+  int countDocumentFind(QTextDocument *document, bool caseInsensitive) const;
+
+  QList<qsizetype> m_sizes;
+  QHash<qsizetype, QString> m_texts;
+  QHash<qsizetype, QTextDocument *> m_documents;
+};
+
+void BenchLiteralSearch::initTestCase()
+{
+  m_sizes << 100 * 1000 << 1000 * 1000 << 10 * 1000 * 1000;
+  for (qsizetype size : m_sizes)
+  {
+    m_texts.insert(size, syntheticText(size));
+    QTextDocument *document = new QTextDocument(this);
+    document->setPlainText(m_texts.value(size));
+    m_documents.insert(size, document);
+  }
+}
+
+void BenchLiteralSearch::cleanupTestCase()
+{
+  qDeleteAll(m_documents);
+  m_documents.clear();
+}
+
+void BenchLiteralSearch::addRows()
+{
+  QTest::addColumn<qsizetype>("size");
+  QTest::addColumn<bool>("caseInsensitive");
+  for (qsizetype size : m_sizes)
+  {
+    QByteArray label = QByteArray::number(size / 1000) + " KB";
+    QTest::newRow((label + ", match case").constData()) << size << false;
+    QTest::newRow((label + ", ignore case").constData()) << size << true;
+  }
+}
+
+int BenchLiteralSearch::countLiteralSearcher(const QString &text, bool caseInsensitive) const
+{
+  LiteralSearcher searcher(Needle, caseInsensitive ? LiteralSearcher::CaseInsensitive : LiteralSearcher::Options());
+  QVector<int> matches;
+  searcher.findAll(text, 0, -1, 0, matches);
+  return int(matches.size());
+}
+
+int BenchLiteralSearch::countIndexOf(const QString &text, bool caseInsensitive) const
+{
+  Qt::CaseSensitivity sensitivity = caseInsensitive ? Qt::CaseInsensitive : Qt::CaseSensitive;
+  int count = 0;
+  for (qsizetype pos = text.indexOf(Needle, 0, sensitivity); pos >= 0;
+       pos = text.indexOf(Needle, pos + Needle.size(), sensitivity))
+    ++count;
+  return count;
+}
+
+int BenchLiteralSearch::countDocumentFind(QTextDocument *document, bool caseInsensitive) const
+{
+  QTextDocument::FindFlags flags = caseInsensitive ? QTextDocument::FindFlags() : QTextDocument::FindCaseSensitively;
+  int count = 0;
+  for (QTextCursor cursor = document->find(Needle, 0, flags); !cursor.isNull();
+       cursor = document->find(Needle, cursor, flags))
+    ++count;
+  return count;
+}
+
+void BenchLiteralSearch::agrees()
+{
+  QFETCH(qsizetype, size);
+  QFETCH(bool, caseInsensitive);
+
+  int expected = countIndexOf(m_texts.value(size), caseInsensitive);
+  QVERIFY(expected > 0);
+  QCOMPARE(countLiteralSearcher(m_texts.value(size), caseInsensitive), expected);
+  QCOMPARE(countDocumentFind(m_documents.value(size), caseInsensitive), expected);
+}
+
+void BenchLiteralSearch::literalSearcher()
+{
+  QFETCH(qsizetype, size);
+  QFETCH(bool, caseInsensitive);
+  const QString &text = m_texts.value(size);
+  int count = 0;
+  QBENCHMARK { count = countLiteralSearcher(text, caseInsensitive); }
+  QVERIFY(count > 0);
+}
+
+void BenchLiteralSearch::stringIndexOf()
+{
+  QFETCH(qsizetype, size);
+  QFETCH(bool, caseInsensitive);
+  const QString &text = m_texts.value(size);
+  int count = 0;
+  QBENCHMARK { count = countIndexOf(text, caseInsensitive); }
+  QVERIFY(count > 0);
+}
+
+void BenchLiteralSearch::documentFind()
+{
+  QFETCH(qsizetype, size);
+  QFETCH(bool, caseInsensitive);
+  QTextDocument *document = m_documents.value(size);
+  int count = 0;
+  QBENCHMARK { count = countDocumentFind(document, caseInsensitive); }
+  QVERIFY(count > 0);
+}
+
+QTEST_MAIN(BenchLiteralSearch)
+#include "bench_literalsearch.moc"
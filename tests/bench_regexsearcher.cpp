@@ -0,0 +1,154 @@
+#include <QtTest/QtTest>
+#include <QtGui/QTextBlock>
+#include <QtGui/QTextCursor>
+#include <QtGui/QTextDocument>
+#include "RegexSearcher.h"
+#include "SyntheticText.h"
+
+// RegexSearcher against running the regex block by block, the way
+// QTextDocument::find does, on large documents. The first two patterns
+// have a literal to prefilter on; the last runs the regex over all of it.
+class BenchRegexSearcher : public QObject
+{
+  Q_OBJECT
+
+private slots:
+  void initTestCase();
+  void cleanupTestCase();
+
+  void agrees_data() { addRows(); }
+  void agrees();
+  void regexSearcher_data() { addRows(); }
+  void regexSearcher();
+  void blockRegex_data() { addRows(); }
+  void blockRegex();
+  void documentFind_data() { addRows(); }
+  void documentFind();
+
+private:
+  void addRows();
+  int countRegexSearcher(const QString &text, const QString &pattern) const;
+  int countBlockRegex(QTextDocument *document, const QString &pattern) const;
+  int countDocumentFind(QTextDocument *document, const QString &pattern) const;
+
+  QList<qsizetype> m_sizes;
+  QHash<qsizetype, QString> m_texts;
+  QHash<qsizetype, QTextDocument *> m_documents;
+};
+
+void BenchRegexSearcher::initTestCase()
+{
+  m_sizes << 1000 * 1000 << 10 * 1000 * 1000;
+  for (qsizetype size : m_sizes)
+  {
+    m_texts.insert(size, syntheticText(size));
+    QTextDocument *document = new QTextDocument;
+    document->setPlainText(m_texts.value(size));
+    m_documents.insert(size, document);
+  }
+}
+
+void BenchRegexSearcher::cleanupTestCase()
+{
+  qDeleteAll(m_documents);
+  m_documents.clear();
+}
+
+void BenchRegexSearcher::addRows()
+{
+  QTest::addColumn<qsizetype>("size");
+  QTest::addColumn<QString>("pattern");
+  const QStringList patterns = {"lantern \\w+", "(?:the|a) stranger", "[Ww]\\w+"};
+  for (qsizetype size : m_sizes)
+  {
+    for (const QString &pattern : patterns)
+    {
+      QByteArray label = QByteArray::number(size / 1000) + " KB, " + pattern.toUtf8();
+      QTest::newRow(label.constData()) << size << pattern;
+    }
+  }
+}
+
+int BenchRegexSearcher::countRegexSearcher(const QString &text, const QString &pattern) const
+{
+  int count = 0;
+  RegexSearcher searcher(pattern, LiteralSearcher::Options());
+  searcher.forEachMatch(text, [&count](const QRegularExpressionMatch &, qsizetype)
+                        {
+    ++count;
+    return true; });
+  return count;
+}
+
+int BenchRegexSearcher::countBlockRegex(QTextDocument *document, const QString &pattern) const
+{
+  QRegularExpression regex(pattern);
+  regex.optimize();
+  int count = 0;
+  for (QTextBlock block = document->begin(); block.isValid(); block = block.next())
+  {
+    QRegularExpressionMatchIterator it = regex.globalMatch(block.text());
+    while (it.hasNext())
+    {
+      it.next();
+      ++count;
+    }
+  }
+  return count;
+}
+
+int BenchRegexSearcher::countDocumentFind(QTextDocument *document, const QString &pattern) const
+{
+  QRegularExpression regex(pattern);
+  int count = 0;
+  for (QTextCursor cursor = document->find(regex, 0, QTextDocument::FindCaseSensitively); !cursor.isNull();
+       cursor = document->find(regex, cursor, QTextDocument::FindCaseSensitively))
+    ++count;
+  return count;
+}
+
+void BenchRegexSearcher::agrees()
+{
+  QFETCH(qsizetype, size);
+  QFETCH(QString, pattern);
+
+  RegexSearcher searcher(pattern, LiteralSearcher::Options());
+  qInfo().noquote() << "Prefilter:" << (searcher.requiredLiteral().isEmpty() ? "none" : searcher.requiredLiteral());
+  int expected = countBlockRegex(m_documents.value(size), pattern);
+  QVERIFY(expected > 0);
+  QCOMPARE(countRegexSearcher(m_texts.value(size), pattern), expected);
+  QCOMPARE(countDocumentFind(m_documents.value(size), pattern), expected);
+}
+
+void BenchRegexSearcher::regexSearcher()
+{
+  QFETCH(qsizetype, size);
+  QFETCH(QString, pattern);
+  const QString &text = m_texts.value(size);
+  int count = 0;
+  QBENCHMARK { count = countRegexSearcher(text, pattern); }
+  QVERIFY(count > 0);
+}
+
+void BenchRegexSearcher::blockRegex()
+{
+  QFETCH(qsizetype, size);
+  QFETCH(QString, pattern);
+  QTextDocument *document = m_documents.value(size);
+  int count = 0;
+  QBENCHMARK { count = countBlockRegex(document, pattern); }
+  QVERIFY(count > 0);
+}
+
+void BenchRegexSearcher::documentFind()
+{
+  QFETCH(qsizetype, size);
+  QFETCH(QString, pattern);
+  QTextDocument *document = m_documents.value(size);
+  int count = 0;
+  QBENCHMARK { count = countDocumentFind(document, pattern); }
+  QVERIFY(count > 0);
+}
+
+QTEST_MAIN(BenchRegexSearcher)
+#include "bench_regexsearcher.moc"
@@ -0,0 +1,104 @@
+#include <QtTest/QtTest>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QStandardPaths>
+#include <QtCore/QTemporaryDir>
+#include <algorithm>
+#include "MetadataIndex.h"
+#include "SearchIndex.h"
+#include "SyntheticText.h"
+
+namespace
+{
+  // The latency target holds for a 1 GB corpus; building one takes a
+  // while, so by default a smaller one is indexed. Set
+  // WRITEHAND_BENCH_CORPUS_MB=1024 for the full size.
+  const int DefaultCorpusMegabytes = 128;
+  const int DocumentBytes = 64 * 1024;
+  const qint64 TargetUs = 50 * 1000;
+  const int Runs = 21;
+}
+
+// Query latency of SearchIndex once a synthetic corpus is indexed
+class BenchSearchIndex : public QObject
+{
+  Q_OBJECT
+
+private slots:
+  void initTestCase();
+  void query_data();
+  void query();
+
+private:
+  QTemporaryDir m_directory;
+  QScopedPointer<MetadataIndex> m_metadata;
+  QScopedPointer<SearchIndex> m_index;
+};
+
+void BenchSearchIndex::initTestCase()
+{
+  QStandardPaths::setTestModeEnabled(true);
+  QDir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)).removeRecursively();
+  QVERIFY(m_directory.isValid());
+
+  int megabytes = qEnvironmentVariableIntValue("WRITEHAND_BENCH_CORPUS_MB");
+  if (megabytes <= 0)
+    megabytes = DefaultCorpusMegabytes;
+  const int documents = int(qint64(megabytes) * 1024 * 1024 / DocumentBytes);
+
+  // Each document also gets a word of its own, for the rarest query
+  for (int i = 0; i < documents; ++i)
+  {
+    QFile file(QString("%1/document %2.txt").arg(m_directory.path()).arg(i));
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    QString text = QString("Chapter%1\n").arg(i) + syntheticText(DocumentBytes, quint32(i + 1));
+    QVERIFY(file.write(text.toUtf8()) > 0);
+  }
+
+  QElapsedTimer timer;
+  timer.start();
+  m_metadata.reset(new MetadataIndex(m_directory.path(), QStringList() << "*.txt"));
+  m_metadata->load();
+  m_index.reset(new SearchIndex);
+  m_index->addSource(m_metadata.data());
+  QTRY_VERIFY_WITH_TIMEOUT(!m_index->isIndexing() && m_index->documentCount() == documents, 60 * 60 * 1000);
+  qInfo().noquote() << QString("Indexed %1 MB in %2 documents in %3 s").arg(megabytes).arg(documents).arg(timer.elapsed() / 1000.0);
+}
+
+void BenchSearchIndex::query_data()
+{
+  QTest::addColumn<QString>("query");
+  QTest::newRow("one document") << QString("chapter7");
+  QTest::newRow("uncommon word") << QString("lantern");
+  QTest::newRow("common word") << QString("river");
+  QTest::newRow("two words") << QString("river morning");
+  QTest::newRow("uncommon and common") << QString("lantern silence");
+  QTest::newRow("phrase") << QString("\"the river\"");
+}
+
+void BenchSearchIndex::query()
+{
+  QFETCH(QString, query);
+
+  // The median of a few runs, so one page fault doesn't decide it
+  QVector<qint64> times;
+  int matches = 0;
+  for (int i = 0; i < Runs; ++i)
+  {
+    SearchIndex::Result result = m_index->search(query);
+    times.append(result.elapsedUs);
+    matches = result.matches;
+  }
+  std::sort(times.begin(), times.end());
+  qint64 median = times.at(times.size() / 2);
+
+  qInfo().noquote() << QString("%1 matches, median %2 ms, worst %3 ms")
+                           .arg(matches)
+                           .arg(median / 1000.0)
+                           .arg(times.last() / 1000.0);
+  QVERIFY(matches > 0);
+  QVERIFY2(median < TargetUs, qPrintable(QString("%1 ms is over the 50 ms target").arg(median / 1000.0)));
+}
+
+QTEST_GUILESS_MAIN(BenchSearchIndex)
+#include "bench_searchindex.moc"
@@ -0,0 +1,241 @@
+#include <QtTest/QtTest>
+#include <QtCore/QRandomGenerator>
+#include <QtGui/QTextBlock>
+#include <QtGui/QTextCursor>
+#include <QtGui/QTextDocument>
+#include <iterator>
+#include "DocumentStats.h"
+
+namespace
+{
+  // A character at a time, straight from the rules in DocumentStats.h
+  DocumentStats::Counts reference(QStringView text)
+  {
+    DocumentStats::Counts counts;
+    bool inWord = false;
+    bool wordSinceEnd = false;
+    for (qsizetype i = 0; i < text.size(); ++i)
+    {
+      QChar c = text.at(i);
+      if (!c.isSpace())
+      {
+        if (!inWord)
+        {
+          ++counts.words;
+          wordSinceEnd = true;
+        }
+        inWord = true;
+        continue;
+      }
+      inWord = false;
+      QChar previous = i > 0 ? text.at(i - 1) : QChar(u' ');
+      if ((previous == u'.' || previous == u'!' || previous == u'?') && wordSinceEnd)
+      {
+        ++counts.sentences;
+        wordSinceEnd = false;
+      }
+    }
+    if (wordSinceEnd)
+      ++counts.sentences;
+    counts.characters = text.size();
+    counts.paragraphs = counts.words > 0 ? 1 : 0;
+    return counts;
+  }
+
+  // Weighted towards the characters the counter cares about, with the
+  // control characters either side of the ASCII whitespace range and a few
+  // non-ASCII spaces and letters so chunks fall back to the QChar path
+  QString randomText(QRandomGenerator &random, int length)
+  {
+    static const char16_t alphabet[] = u"  \t\v\f\r\x1f\x08..!?abcdefghijklmnopABC\x7f\u00e9\u00a0\u3000\u4e2d";
+    const int size = int(std::size(alphabet)) - 1;
+    QString text;
+    text.reserve(length);
+    for (int i = 0; i < length; ++i)
+      text += QChar(alphabet[random.bounded(size)]);
+    return text;
+  }
+
+  QString describe(const DocumentStats::Counts &counts)
+  {
+    return QString("%1 words, %2 characters, %3 sentences, %4 paragraphs")
+        .arg(counts.words)
+        .arg(counts.characters)
+        .arg(counts.sentences)
+        .arg(counts.paragraphs);
+  }
+
+  bool operator==(const DocumentStats::Counts &a, const DocumentStats::Counts &b)
+  {
+    return a.words == b.words && a.characters == b.characters && a.sentences == b.sentences &&
+           a.paragraphs == b.paragraphs;
+  }
+}
+
+// Built twice: once as the platform builds it, and once with
+// WRITEHAND_NO_SIMD so the scalar path is held to the same results
+class TestDocumentStats : public QObject
+{
+  Q_OBJECT
+
+private slots:
+  void initTestCase();
+
+  void countsParagraphs_data();
+  void countsParagraphs();
+  void sentencesEndAcrossChunks_data();
+  void sentencesEndAcrossChunks();
+  void matchesReferenceOnRandomText();
+  void followsDocumentEdits();
+  void notifiesOncePerPass();
+};
+
+void TestDocumentStats::initTestCase()
+{
+#if (defined(__SSE2__) || defined(_M_X64)) && !defined(WRITEHAND_NO_SIMD)
+  qDebug("Counting with SSE2");
+#else
+  qDebug("Counting with the scalar path");
+#endif
+}
+
+void TestDocumentStats::countsParagraphs_data()
+{
+  QTest::addColumn<QString>("text");
+  QTest::addColumn<int>("words");
+  QTest::addColumn<int>("sentences");
+
+  QTest::newRow("empty") << QString() << 0 << 0;
+  QTest::newRow("spaces only") << QString("   \t  ") << 0 << 0;
+  QTest::newRow("one sentence") << QString("One two three.") << 3 << 1;
+  QTest::newRow("no terminator") << QString("no full stop here") << 4 << 1;
+  QTest::newRow("every terminator") << QString("Hi. There! Ok? yes") << 4 << 4;
+  QTest::newRow("ellipsis") << QString("Wait... and then") << 3 << 2;
+  QTest::newRow("inside a word") << QString("version 2.5 of it") << 4 << 1;
+  QTest::newRow("abbreviation") << QString("e.g. this") << 2 << 2;
+  QTest::newRow("space runs") << QString("end.  \t next") << 2 << 2;
+  QTest::newRow("leading terminator") << QString(". b! c") << 3 << 3;
+  QTest::newRow("non-ASCII") << QString(u"\u00c7a va. Tr\u00e8s bien") << 4 << 2;
+  QTest::newRow("no-break space") << QString(u"a\u00a0b. c\u3000d") << 4 << 2;
+  QTest::newRow("control characters") << QString("a\x1f" "b\vc\fd") << 3 << 1;
+}
+
+void TestDocumentStats::countsParagraphs()
+{
+  QFETCH(QString, text);
+  QFETCH(int, words);
+  QFETCH(int, sentences);
+
+  DocumentStats::Counts counts = DocumentStats::count(text);
+  QCOMPARE(counts.words, qint64(words));
+  QCOMPARE(counts.sentences, qint64(sentences));
+  QCOMPARE(counts.characters, qint64(text.size()));
+  QCOMPARE(counts.paragraphs, qint64(words > 0 ? 1 : 0));
+}
+
+void TestDocumentStats::sentencesEndAcrossChunks_data()
+{
+  QTest::addColumn<QString>("text");
+
+  // Put the terminator, the space after it and the next word at every
+  // position of an 8-character chunk, in ASCII chunks and mixed ones
+  for (int offset = 0; offset < 24; ++offset)
+  {
+    QString padding(offset, u'a');
+    QTest::newRow(qPrintable(QString("ascii %1").arg(offset))) << padding + ". b! c";
+    QTest::newRow(qPrintable(QString("mixed %1").arg(offset))) << padding + QString(u"\u00e9? \u00e9. \u00e9");
+    QTest::newRow(qPrintable(QString("spaces %1").arg(offset))) << padding + "!" + QString(offset, u' ') + "z";
+  }
+}
+
+void TestDocumentStats::sentencesEndAcrossChunks()
+{
+  QFETCH(QString, text);
+
+  DocumentStats::Counts counts = DocumentStats::count(text);
+  DocumentStats::Counts expected = reference(text);
+  QVERIFY2(counts == expected, qPrintable(describe(counts) + " instead of " + describe(expected)));
+}
+
+void TestDocumentStats::matchesReferenceOnRandomText()
+{
+  QRandomGenerator random(5);
+  for (int i = 0; i < 20000; ++i)
+  {
+    QString text = randomText(random, random.bounded(80));
+    DocumentStats::Counts counts = DocumentStats::count(text);
+    DocumentStats::Counts expected = reference(text);
+    QVERIFY2(counts == expected, qPrintable(QString("\"%1\": %2 instead of %3")
+                                                .arg(text, describe(counts), describe(expected))));
+  }
+}
+
+void TestDocumentStats::followsDocumentEdits()
+{
+  QTextDocument document;
+  document.setPlainText("First paragraph. With two sentences.\n\nThird one\nlast");
+  DocumentStats stats;
+  stats.setDocument(&document);
+
+  QRandomGenerator random(9);
+  for (int step = 0; step < 500; ++step)
+  {
+    QTextCursor cursor(&document);
+    int length = document.characterCount() - 1;
+    cursor.setPosition(random.bounded(length + 1));
+    switch (random.bounded(4))
+    {
+    case 0:
+      cursor.setPosition(qMin(length, cursor.position() + random.bounded(40)), QTextCursor::KeepAnchor);
+      cursor.removeSelectedText();
+      break;
+    case 1:
+      // Pasting, with new paragraphs in it
+      cursor.insertText(randomText(random, 30) + "\n" + randomText(random, 10) + "\n");
+      break;
+    default:
+      // Typing
+      cursor.insertText(randomText(random, 1 + random.bounded(3)));
+      break;
+    }
+
+    DocumentStats::Counts expected;
+    for (QTextBlock block = document.begin(); block.isValid(); block = block.next())
+    {
+      DocumentStats::Counts counts = reference(block.text());
+      expected.words += counts.words;
+      expected.characters += counts.characters;
+      expected.sentences += counts.sentences;
+      expected.paragraphs += counts.paragraphs;
+    }
+    QVERIFY2(stats.counts() == expected, qPrintable(QString("After step %1: %2 instead of %3")
+                                                        .arg(step)
+                                                        .arg(describe(stats.counts()), describe(expected))));
+  }
+
+  stats.setDocument(nullptr);
+  QVERIFY(stats.counts() == DocumentStats::Counts());
+}
+
+void TestDocumentStats::notifiesOncePerPass()
+{
+  QTextDocument document;
+  DocumentStats stats;
+  stats.setDocument(&document);
+  QSignalSpy changed(&stats, &DocumentStats::changed);
+  QTRY_COMPARE(changed.count(), 1);
+
+  QTextCursor cursor(&document);
+  cursor.insertText("one ");
+  cursor.insertText("two.");
+  cursor.insertText("\nthree");
+  QCOMPARE(changed.count(), 1);
+  QTRY_COMPARE(changed.count(), 2);
+  QTest::qWait(20);
+  QCOMPARE(changed.count(), 2);
+  QCOMPARE(stats.counts().words, qint64(3));
+  QCOMPARE(stats.counts().paragraphs, qint64(2));
+}
+
+QTEST_MAIN(TestDocumentStats)
+#include "tst_documentstats.moc"
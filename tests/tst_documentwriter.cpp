@@ -0,0 +1,217 @@
+#include <QtTest/QtTest>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QTemporaryDir>
+#include "DocumentWriter.h"
+
+namespace
+{
+  QByteArray readAll(const QString &path)
+  {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+      return QByteArray("<missing>");
+    return file.readAll();
+  }
+
+  bool writeFile(const QString &path, const QByteArray &data)
+  {
+    QFile file(path);
+    return file.open(QIODevice::WriteOnly) && file.write(data) == data.size();
+  }
+
+  // Writes half of its data, then fails the way a full disk would
+  DocumentWriter::Producer failingProducer(const QByteArray &data)
+  {
+    return [data](QFileDevice &file, QString *error)
+    {
+      file.write(data.left(data.size() / 2));
+      *error = "No space left on device";
+      return false;
+    };
+  }
+}
+
+class TestDocumentWriter : public QObject
+{
+  Q_OBJECT
+
+private slots:
+  void init();
+
+  void replacesContents();
+  void streamsFromProducer();
+  void failedWriteLeavesOriginal();
+  void unopenableFileFails();
+  void groupIsAllOrNothing();
+  void groupWritesEveryFile();
+  void laterSaveWins();
+  void largeGroupGoesInRounds();
+  // Last, as it stops the writer thread for the rest of the process
+  void writesInlineAfterShutdown();
+
+private:
+  QString path(const QString &name) const { return m_dir->filePath(name); }
+  QStringList entries() const;
+
+  QScopedPointer<QTemporaryDir> m_dir;
+};
+
+void TestDocumentWriter::init()
+{
+  m_dir.reset(new QTemporaryDir());
+  QVERIFY(m_dir->isValid());
+}
+
+// Everything in the directory, temporaries included
+QStringList TestDocumentWriter::entries() const
+{
+  return QDir(m_dir->path()).entryList(QDir::Files | QDir::Hidden | QDir::System, QDir::Name);
+}
+
+void TestDocumentWriter::replacesContents()
+{
+  QVERIFY(writeFile(path("a.md"), "old contents, and longer than the new ones"));
+
+  DocumentWriter::Result result = DocumentWriter::instance().write(path("a.md"), "new").result();
+  QVERIFY2(result.ok, qPrintable(result.error));
+  QCOMPARE(result.written, QStringList() << path("a.md"));
+  QCOMPARE(readAll(path("a.md")), QByteArray("new"));
+  QCOMPARE(entries(), QStringList() << "a.md");
+
+  // A file that did not exist yet is created
+  result = DocumentWriter::instance().write(path("b.md"), "fresh").result();
+  QVERIFY(result.ok);
+  QCOMPARE(readAll(path("b.md")), QByteArray("fresh"));
+  QCOMPARE(entries(), QStringList() << "a.md" << "b.md");
+}
+
+void TestDocumentWriter::streamsFromProducer()
+{
+  QByteArray data(3 * 1024 * 1024 + 17, 'x');
+  DocumentWriter::Producer producer = [&data](QFileDevice &file, QString *)
+  {
+    for (qsizetype at = 0; at < data.size(); at += 64 * 1024)
+    {
+      QByteArray part = data.mid(at, 64 * 1024);
+      if (file.write(part) != part.size())
+        return false;
+    }
+    return true;
+  };
+
+  DocumentWriter::Result result = DocumentWriter::instance().write(path("big.txt"), producer).result();
+  QVERIFY2(result.ok, qPrintable(result.error));
+  QCOMPARE(readAll(path("big.txt")), data);
+  QCOMPARE(entries(), QStringList() << "big.txt");
+}
+
+void TestDocumentWriter::failedWriteLeavesOriginal()
+{
+  QVERIFY(writeFile(path("a.md"), "original"));
+
+  DocumentWriter::Result result =
+      DocumentWriter::instance().write(path("a.md"), failingProducer("replacement that never lands")).result();
+  QVERIFY(!result.ok);
+  QVERIFY2(result.error.contains("No space left on device"), qPrintable(result.error));
+  QVERIFY(result.written.isEmpty());
+  QCOMPARE(readAll(path("a.md")), QByteArray("original"));
+  QCOMPARE(entries(), QStringList() << "a.md");
+}
+
+void TestDocumentWriter::unopenableFileFails()
+{
+  DocumentWriter::Result result = DocumentWriter::instance().write(path("missing/a.md"), "text").result();
+  QVERIFY(!result.ok);
+  QVERIFY(!result.error.isEmpty());
+  QVERIFY(result.written.isEmpty());
+  QVERIFY(entries().isEmpty());
+}
+
+void TestDocumentWriter::groupIsAllOrNothing()
+{
+  QVERIFY(writeFile(path("a.md"), "a before"));
+  QVERIFY(writeFile(path("b.md"), "b before"));
+  QVERIFY(writeFile(path("c.md"), "c before"));
+
+  // The middle file fails after the first is already written out
+  QList<DocumentWriter::File> group;
+  group << DocumentWriter::File(path("a.md"), QByteArray("a after"))
+        << DocumentWriter::File(path("b.md"), failingProducer("b after"))
+        << DocumentWriter::File(path("c.md"), QByteArray("c after"));
+  DocumentWriter::Result result = DocumentWriter::instance().write(group).result();
+  QVERIFY(!result.ok);
+  QVERIFY(result.written.isEmpty());
+  QCOMPARE(readAll(path("a.md")), QByteArray("a before"));
+  QCOMPARE(readAll(path("b.md")), QByteArray("b before"));
+  QCOMPARE(readAll(path("c.md")), QByteArray("c before"));
+  QCOMPARE(entries(), QStringList() << "a.md" << "b.md" << "c.md");
+
+  // And the same with a file that cannot be opened at all
+  group.clear();
+  group << DocumentWriter::File(path("a.md"), QByteArray("a after"))
+        << DocumentWriter::File(path("missing/b.md"), QByteArray("b after"));
+  result = DocumentWriter::instance().write(group).result();
+  QVERIFY(!result.ok);
+  QCOMPARE(readAll(path("a.md")), QByteArray("a before"));
+  QCOMPARE(entries(), QStringList() << "a.md" << "b.md" << "c.md");
+}
+
+void TestDocumentWriter::groupWritesEveryFile()
+{
+  QList<DocumentWriter::File> group;
+  QStringList names;
+  for (int i = 0; i < 10; ++i)
+  {
+    names << QString("file%1.md").arg(i);
+    group << DocumentWriter::File(path(names.last()), QByteArray::number(i));
+  }
+
+  DocumentWriter::Result result = DocumentWriter::instance().write(group).result();
+  QVERIFY2(result.ok, qPrintable(result.error));
+  QCOMPARE(result.written.size(), qsizetype(10));
+  for (int i = 0; i < 10; ++i)
+    QCOMPARE(readAll(path(names.at(i))), QByteArray::number(i));
+  QCOMPARE(entries(), names);
+}
+
+void TestDocumentWriter::laterSaveWins()
+{
+  // Queued faster than they can be written, so some are folded together
+  QList<QFuture<DocumentWriter::Result>> saves;
+  for (int i = 0; i < 50; ++i)
+    saves << DocumentWriter::instance().write(path("a.md"), QByteArray("save ") + QByteArray::number(i));
+  for (QFuture<DocumentWriter::Result> &save : saves)
+    QVERIFY(save.result().ok);
+
+  QCOMPARE(readAll(path("a.md")), QByteArray("save 49"));
+  QCOMPARE(entries(), QStringList() << "a.md");
+}
+
+void TestDocumentWriter::largeGroupGoesInRounds()
+{
+  // More files than are kept open at once
+  QList<DocumentWriter::File> group;
+  for (int i = 0; i < 150; ++i)
+    group << DocumentWriter::File(path(QString("file%1.md").arg(i, 3, 10, QChar(u'0'))), QByteArray::number(i));
+
+  DocumentWriter::Result result = DocumentWriter::instance().write(group).result();
+  QVERIFY2(result.ok, qPrintable(result.error));
+  QCOMPARE(result.written.size(), qsizetype(150));
+  QCOMPARE(entries().size(), qsizetype(150));
+  QCOMPARE(readAll(path("file149.md")), QByteArray("149"));
+}
+
+void TestDocumentWriter::writesInlineAfterShutdown()
+{
+  DocumentWriter::instance().shutdown();
+
+  QFuture<DocumentWriter::Result> save = DocumentWriter::instance().write(path("a.md"), "after shutdown");
+  QVERIFY(save.isFinished());
+  QVERIFY(save.result().ok);
+  QCOMPARE(readAll(path("a.md")), QByteArray("after shutdown"));
+  QCOMPARE(entries(), QStringList() << "a.md");
+}
+
+QTEST_GUILESS_MAIN(TestDocumentWriter)
+#include "tst_documentwriter.moc"
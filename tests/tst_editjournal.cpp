@@ -0,0 +1,294 @@
+#include <QtTest/QtTest>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QStandardPaths>
+#include <QtCore/QTemporaryDir>
+#include <QtGui/QFont>
+#include <QtGui/QTextCursor>
+#include <QtGui/QTextDocument>
+#include "EditJournal.h"
+
+namespace
+{
+  // Longer than the journal's batch interval, so every record is on disk
+  const int SettleMs = 600;
+
+  QByteArray readAll(const QString &path)
+  {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+      return QByteArray("<missing>");
+    return file.readAll();
+  }
+
+  bool writeFile(const QString &path, const QByteArray &data)
+  {
+    QFile file(path);
+    return file.open(QIODevice::WriteOnly) && file.write(data) == data.size();
+  }
+
+  void insertAt(QTextDocument &document, int position, const QString &text,
+                const QTextCharFormat &format = QTextCharFormat())
+  {
+    QTextCursor cursor(&document);
+    cursor.setPosition(position);
+    cursor.insertText(text, format);
+  }
+
+  void removeAt(QTextDocument &document, int position, int length)
+  {
+    QTextCursor cursor(&document);
+    cursor.setPosition(position);
+    cursor.setPosition(position + length, QTextCursor::KeepAnchor);
+    cursor.removeSelectedText();
+  }
+}
+
+class TestEditJournal : public QObject
+{
+  Q_OBJECT
+
+private slots:
+  void initTestCase();
+  void init();
+
+  void replaysPlainEdits();
+  void replaysRichEdits();
+  void stopsAtDamagedRecord_data();
+  void stopsAtDamagedRecord();
+  void keepsMismatchedJournalAside();
+  void discardRemovesJournal();
+  void compactionMovesBase();
+  void followsRename();
+
+private:
+  QString journalDirectory() const;
+  QStringList journals(const QString &pattern = "*.wal") const;
+  // Starts journaling a document holding the file's contents
+  EditJournal *attach(QTextDocument &document, const QString &path, const QByteArray &contents, bool isRichText);
+  // Lets the journal reach the disk, then drops it without discarding,
+  // which leaves the file as a crash would
+  void crash(EditJournal *journal);
+
+  QScopedPointer<QTemporaryDir> m_dir;
+};
+
+void TestEditJournal::initTestCase()
+{
+  QStandardPaths::setTestModeEnabled(true);
+}
+
+void TestEditJournal::init()
+{
+  m_dir.reset(new QTemporaryDir());
+  QVERIFY(m_dir->isValid());
+  QDir journalDir(journalDirectory());
+  for (const QString &name : journalDir.entryList(QDir::Files))
+    QVERIFY(journalDir.remove(name));
+}
+
+QString TestEditJournal::journalDirectory() const
+{
+  return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/journal";
+}
+
+QStringList TestEditJournal::journals(const QString &pattern) const
+{
+  return QDir(journalDirectory()).entryList(QStringList() << pattern, QDir::Files);
+}
+
+EditJournal *TestEditJournal::attach(QTextDocument &document, const QString &path, const QByteArray &contents,
+                                     bool isRichText)
+{
+  if (!writeFile(path, contents))
+    return nullptr;
+  if (isRichText)
+    document.setHtml(QString::fromUtf8(contents));
+  else
+    document.setPlainText(QString::fromUtf8(contents));
+  EditJournal *journal = new EditJournal();
+  journal->attach(&document, path, isRichText, EditJournal::checksum(contents));
+  return journal;
+}
+
+void TestEditJournal::crash(EditJournal *journal)
+{
+  QTest::qWait(SettleMs);
+  delete journal;
+}
+
+void TestEditJournal::replaysPlainEdits()
+{
+  const QString path = m_dir->filePath("notes.md");
+  QTextDocument document;
+  EditJournal *journal = attach(document, path, "line one\nline two\n", false);
+  QVERIFY(journal);
+
+  insertAt(document, 0, "# ");
+  removeAt(document, 7, 3);
+  insertAt(document, 7, "first");
+  insertAt(document, document.characterCount() - 1, "pasted\nacross\nlines");
+  for (QChar c : QString(" typed"))
+    insertAt(document, document.characterCount() - 1, c);
+  const QString expected = document.toPlainText();
+  crash(journal);
+
+  QCOMPARE(journals().size(), qsizetype(1));
+  QCOMPARE(readAll(path), QByteArray("line one\nline two\n"));
+  QCOMPARE(EditJournal::recover(), QStringList() << path);
+  QCOMPARE(QString::fromUtf8(readAll(path)), expected);
+  QVERIFY(journals().isEmpty());
+}
+
+void TestEditJournal::replaysRichEdits()
+{
+  const QString path = m_dir->filePath("notes.rtf");
+  QTextDocument base;
+  base.setPlainText("plain text to format");
+  QTextDocument document;
+  EditJournal *journal = attach(document, path, base.toHtml().toUtf8(), true);
+  QVERIFY(journal);
+
+  QTextCharFormat bold;
+  bold.setFontWeight(QFont::Bold);
+  insertAt(document, 6, "bold ", bold);
+  QTextCursor cursor(&document);
+  cursor.setPosition(0);
+  cursor.setPosition(5, QTextCursor::KeepAnchor);
+  QTextCharFormat italic;
+  italic.setFontItalic(true);
+  cursor.mergeCharFormat(italic);
+  const QString expected = document.toPlainText();
+  crash(journal);
+
+  QCOMPARE(EditJournal::recover(), QStringList() << path);
+  QTextDocument recovered;
+  recovered.setHtml(QString::fromUtf8(readAll(path)));
+  QCOMPARE(recovered.toPlainText(), expected);
+  QCOMPARE(expected, QString("plain bold text to format"));
+
+  // Formats are those of the character before each position
+  QTextCursor check(&recovered);
+  check.setPosition(3);
+  QVERIFY(check.charFormat().fontItalic());
+  check.setPosition(8);
+  QCOMPARE(check.charFormat().fontWeight(), int(QFont::Bold));
+  QVERIFY(!check.charFormat().fontItalic());
+  check.setPosition(14);
+  QCOMPARE(check.charFormat().fontWeight(), int(QFont::Normal));
+}
+
+void TestEditJournal::stopsAtDamagedRecord_data()
+{
+  QTest::addColumn<bool>("truncate");
+  QTest::newRow("torn write") << true;
+  QTest::newRow("corrupt record") << false;
+}
+
+void TestEditJournal::stopsAtDamagedRecord()
+{
+  QFETCH(bool, truncate);
+
+  const QString path = m_dir->filePath("notes.md");
+  QTextDocument document;
+  EditJournal *journal = attach(document, path, "start", false);
+  QVERIFY(journal);
+  insertAt(document, 5, " middle");
+  insertAt(document, 0, "> ");
+  const QString beforeLast = document.toPlainText();
+  insertAt(document, document.characterCount() - 1, " TAIL");
+  crash(journal);
+
+  QCOMPARE(journals().size(), qsizetype(1));
+  const QString journalPath = journalDirectory() + "/" + journals().first();
+  QByteArray data = readAll(journalPath);
+  // The record ends with its UTF-16 text and a 16-bit checksum
+  if (truncate)
+    data.chop(3);
+  else
+    data[data.size() - 4] = char(data.at(data.size() - 4) ^ 0x20);
+  QVERIFY(writeFile(journalPath, data));
+
+  QCOMPARE(EditJournal::recover(), QStringList() << path);
+  QCOMPARE(QString::fromUtf8(readAll(path)), beforeLast);
+}
+
+void TestEditJournal::keepsMismatchedJournalAside()
+{
+  const QString path = m_dir->filePath("notes.md");
+  QTextDocument document;
+  EditJournal *journal = attach(document, path, "original", false);
+  QVERIFY(journal);
+  insertAt(document, 0, "edited ");
+  crash(journal);
+
+  // Changed by something else since the journal started
+  QVERIFY(writeFile(path, "rewritten elsewhere"));
+  QVERIFY(EditJournal::recover().isEmpty());
+  QCOMPARE(readAll(path), QByteArray("rewritten elsewhere"));
+  QVERIFY(journals().isEmpty());
+  QCOMPARE(journals("*.orphan").size(), qsizetype(1));
+}
+
+void TestEditJournal::discardRemovesJournal()
+{
+  const QString path = m_dir->filePath("notes.md");
+  QTextDocument document;
+  EditJournal *journal = attach(document, path, "text", false);
+  QVERIFY(journal);
+  insertAt(document, 4, " more");
+  QTRY_COMPARE(journals().size(), qsizetype(1));
+
+  journal->discard();
+  QTRY_VERIFY(journals().isEmpty());
+  delete journal;
+  QVERIFY(EditJournal::recover().isEmpty());
+  QCOMPARE(readAll(path), QByteArray("text"));
+}
+
+void TestEditJournal::compactionMovesBase()
+{
+  const QString path = m_dir->filePath("notes.md");
+  QTextDocument document;
+  EditJournal *journal = attach(document, path, "one", false);
+  QVERIFY(journal);
+  insertAt(document, 3, " two");
+
+  // An autosave: the snapshot is taken, written, then the journal compacted
+  journal->checkpoint();
+  QByteArray saved = document.toPlainText().toUtf8();
+  QVERIFY(writeFile(path, saved));
+  journal->compact(true, EditJournal::checksum(saved));
+  QTRY_VERIFY(journals().isEmpty());
+
+  insertAt(document, 7, " three");
+  const QString expected = document.toPlainText();
+  crash(journal);
+
+  QCOMPARE(EditJournal::recover(), QStringList() << path);
+  QCOMPARE(QString::fromUtf8(readAll(path)), expected);
+}
+
+void TestEditJournal::followsRename()
+{
+  const QString path = m_dir->filePath("draft.md");
+  const QString renamed = m_dir->filePath("final.md");
+  QTextDocument document;
+  EditJournal *journal = attach(document, path, "draft", false);
+  QVERIFY(journal);
+  insertAt(document, 5, " one");
+
+  // Save As wrote the same base to the new name
+  QVERIFY(QFile::rename(path, renamed));
+  journal->setFilePath(renamed);
+  insertAt(document, 0, "a ");
+  const QString expected = document.toPlainText();
+  crash(journal);
+
+  QCOMPARE(EditJournal::recover(), QStringList() << renamed);
+  QCOMPARE(QString::fromUtf8(readAll(renamed)), expected);
+  QVERIFY(!QFile::exists(path));
+}
+
+QTEST_MAIN(TestEditJournal)
+#include "tst_editjournal.moc"
@@ -0,0 +1,165 @@
+#include <QtTest/QtTest>
+#include <QtCore/QDateTime>
+#include "FuzzyMatcher.h"
+
+// Candidates are "directory/name" with the name starting after the last slash
+class TestFuzzyMatcher : public QObject
+{
+  Q_OBJECT
+
+private slots:
+  void init();
+
+  void matchesSubsequencesOnly();
+  void ignoresCaseAndSpaces();
+  void nameOutranksDirectory();
+  void consecutiveOutranksScattered();
+  void wordBoundariesOutrankMidWord();
+  void camelCaseHumpsCount();
+  void recentFilesBreakTies();
+  void emptyQueryListsMostRecent();
+  void limitsResults();
+  void findsCharactersAtEveryOffset();
+  void matchesNonAsciiNames();
+
+private:
+  void add(const QString &path, qint64 modified = 0);
+  QStringList best(const QString &query, int limit = 10) const;
+
+  FuzzyMatcher m_matcher;
+  QStringList m_paths;
+};
+
+void TestFuzzyMatcher::init()
+{
+  m_matcher.clear();
+  m_paths.clear();
+}
+
+void TestFuzzyMatcher::add(const QString &path, qint64 modified)
+{
+  m_matcher.addCandidate(path, int(path.lastIndexOf('/')) + 1, modified);
+  m_paths.append(path);
+}
+
+QStringList TestFuzzyMatcher::best(const QString &query, int limit) const
+{
+  QStringList paths;
+  for (const FuzzyMatcher::Match &match : m_matcher.match(query, limit))
+    paths.append(m_paths.at(match.candidate));
+  return paths;
+}
+
+void TestFuzzyMatcher::matchesSubsequencesOnly()
+{
+  add("notes/draft.md");
+  add("notes/outline.md");
+
+  QCOMPARE(best("drft"), QStringList() << "notes/draft.md");
+  QCOMPARE(best("otl"), QStringList() << "notes/outline.md");
+  QCOMPARE(best("notes").size(), 2);
+  // All the characters are there, but not in this order
+  QVERIFY(best("tfard").isEmpty());
+  QVERIFY(best("xyz").isEmpty());
+}
+
+void TestFuzzyMatcher::ignoresCaseAndSpaces()
+{
+  add("Novel/Chapter One.md");
+
+  QCOMPARE(best("CHAPTER"), QStringList() << "Novel/Chapter One.md");
+  QCOMPARE(best("chap one"), QStringList() << "Novel/Chapter One.md");
+  QCOMPARE(best("nOvEl"), QStringList() << "Novel/Chapter One.md");
+}
+
+void TestFuzzyMatcher::nameOutranksDirectory()
+{
+  add("draft/notes.md");
+  add("notes/draft.md");
+
+  QCOMPARE(best("draft"), QStringList() << "notes/draft.md" << "draft/notes.md");
+  QCOMPARE(best("notes"), QStringList() << "draft/notes.md" << "notes/draft.md");
+}
+
+void TestFuzzyMatcher::consecutiveOutranksScattered()
+{
+  add("a/tiny old doc.md");
+  add("a/todo.md");
+
+  QCOMPARE(best("todo").first(), QString("a/todo.md"));
+}
+
+void TestFuzzyMatcher::wordBoundariesOutrankMidWord()
+{
+  add("a/fabric.md");
+  add("a/foo_bar.md");
+
+  QCOMPARE(best("fb").first(), QString("a/foo_bar.md"));
+}
+
+void TestFuzzyMatcher::camelCaseHumpsCount()
+{
+  add("a/nebula.md");
+  add("a/NoteBook.md");
+
+  QCOMPARE(best("nb").first(), QString("a/NoteBook.md"));
+}
+
+void TestFuzzyMatcher::recentFilesBreakTies()
+{
+  qint64 now = QDateTime::currentMSecsSinceEpoch();
+  add("old/notes.md", now - 365LL * 24 * 60 * 60 * 1000);
+  add("new/notes.md", now - 60 * 1000);
+
+  FuzzyMatcher::Match older = m_matcher.match("notes", 10).last();
+  FuzzyMatcher::Match newer = m_matcher.match("notes", 10).first();
+  QCOMPARE(m_paths.at(newer.candidate), QString("new/notes.md"));
+  QCOMPARE(m_paths.at(older.candidate), QString("old/notes.md"));
+  QVERIFY(newer.score > older.score);
+}
+
+void TestFuzzyMatcher::emptyQueryListsMostRecent()
+{
+  add("a/one.md", 100);
+  add("a/three.md", 300);
+  add("a/two.md", 200);
+
+  QCOMPARE(best(""), QStringList() << "a/three.md" << "a/two.md" << "a/one.md");
+  QCOMPARE(best("  "), QStringList() << "a/three.md" << "a/two.md" << "a/one.md");
+}
+
+void TestFuzzyMatcher::limitsResults()
+{
+  for (int i = 0; i < 100; ++i)
+    add(QString("scenes/scene %1.md").arg(i), i);
+
+  QCOMPARE(best("scene", 7).size(), 7);
+  QCOMPARE(best("scene", 1000).size(), 100);
+  QCOMPARE(best("scene 42"), QStringList() << "scenes/scene 42.md");
+}
+
+void TestFuzzyMatcher::findsCharactersAtEveryOffset()
+{
+  // The character scan takes eight at a time and finishes one by one, so
+  // the only match lands in every lane of the first chunks and in the tail
+  for (int length = 0; length < 40; ++length)
+    add("d/" + QString(length, u'x') + "q.md");
+
+  QStringList found = best("xq", 1000);
+  QCOMPARE(found.size(), 39);
+  for (int length = 1; length < 40; ++length)
+    QVERIFY2(found.contains("d/" + QString(length, u'x') + "q.md"), qPrintable(QString::number(length)));
+  QCOMPARE(best("q", 1000).size(), 40);
+}
+
+void TestFuzzyMatcher::matchesNonAsciiNames()
+{
+  add("Reise/Café Müller.md");
+  add("Reise/Cafe.md");
+
+  QCOMPARE(best("MÜLLER"), QStringList() << "Reise/Café Müller.md");
+  QCOMPARE(best("café").first(), QString("Reise/Café Müller.md"));
+}
+
+QTEST_GUILESS_MAIN(TestFuzzyMatcher)
+#include "tst_fuzzymatcher.moc"
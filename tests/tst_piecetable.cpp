@@ -0,0 +1,319 @@
+#include <QtTest/QtTest>
+#include <QtCore/QRandomGenerator>
+#include <QtCore/QTemporaryFile>
+#include "PieceTable.h"
+
+// PieceTable against a plain QByteArray doing the same edits
+class TestPieceTable : public QObject
+{
+  Q_OBJECT
+
+private slots:
+  void opensWithoutCopying();
+  void insertsAndRemoves();
+  void matchesModelUnderRandomEdits();
+  void undoesAndRedoesEverything();
+  void typingIsOneUndoStep();
+  void newEditClearsRedo();
+  void indexesLinesLazily();
+  void linesFollowEdits();
+  void snapshotKeepsItsText();
+  void tracksModification();
+
+private:
+  bool open(PieceTable &table, const QByteArray &contents);
+  static QByteArray randomText(QRandomGenerator &random, int length);
+  static void compareLines(PieceTable &table, const QByteArray &model, qint64 position);
+
+  QList<QSharedPointer<QTemporaryFile>> m_files;
+};
+
+bool TestPieceTable::open(PieceTable &table, const QByteArray &contents)
+{
+  QSharedPointer<QTemporaryFile> file(new QTemporaryFile);
+  if (!file->open() || file->write(contents) != contents.size() || !file->flush())
+    return false;
+  m_files.append(file);
+  QString error;
+  return table.open(file->fileName(), &error);
+}
+
+QByteArray TestPieceTable::randomText(QRandomGenerator &random, int length)
+{
+  QByteArray text;
+  for (int i = 0; i < length; ++i)
+    text.append(random.bounded(8) == 0 ? '\n' : char('a' + random.bounded(26)));
+  return text;
+}
+
+void TestPieceTable::compareLines(PieceTable &table, const QByteArray &model, qint64 position)
+{
+  qint64 start = position == 0 ? 0 : model.lastIndexOf('\n', position - 1) + 1;
+  qint64 next = model.indexOf('\n', position);
+  QCOMPARE(table.lineStart(position), start);
+  QCOMPARE(table.nextLineStart(position), next < 0 ? qint64(model.size()) : next + 1);
+  int line = int(model.left(position).count('\n'));
+  QCOMPARE(table.lineAt(position), line);
+  QCOMPARE(table.lineStartOf(line), start);
+}
+
+void TestPieceTable::opensWithoutCopying()
+{
+  QRandomGenerator random(1);
+  QByteArray contents = randomText(random, 4 * 1024 * 1024);
+  PieceTable table;
+  QVERIFY(open(table, contents));
+
+  QVERIFY(table.isOpen());
+  QCOMPARE(table.size(), qint64(contents.size()));
+  QCOMPARE(table.bytes(0, table.size()), contents);
+  QCOMPARE(table.bytes(1000, 50), contents.mid(1000, 50));
+  QCOMPARE(table.at(12345), contents.at(12345));
+  QVERIFY(!table.isModified());
+  QVERIFY(!table.isLineCountKnown());
+
+  // The file stays mapped, so the table itself is only bookkeeping
+  QVERIFY2(table.memoryUsage() < 4096, qPrintable(QString::number(table.memoryUsage())));
+}
+
+void TestPieceTable::insertsAndRemoves()
+{
+  PieceTable table;
+  QVERIFY(open(table, "hello world"));
+
+  table.insert(5, ",");
+  QCOMPARE(table.bytes(0, table.size()), QByteArray("hello, world"));
+  table.insert(table.size(), "!");
+  table.insert(0, ">> ");
+  QCOMPARE(table.bytes(0, table.size()), QByteArray(">> hello, world!"));
+  table.remove(3, 7);
+  QCOMPARE(table.bytes(0, table.size()), QByteArray(">>  world!"));
+  table.remove(0, 1000);
+  QCOMPARE(table.size(), qint64(0));
+  QCOMPARE(table.bytes(0, 10), QByteArray());
+
+  // Out of range positions are clamped rather than refused
+  table.insert(100, "tail");
+  QCOMPARE(table.bytes(0, table.size()), QByteArray("tail"));
+  QCOMPARE(table.text(0, 4), QString("tail"));
+}
+
+void TestPieceTable::matchesModelUnderRandomEdits()
+{
+  QRandomGenerator random(7);
+  QByteArray model = randomText(random, 20000);
+  PieceTable table;
+  QVERIFY(open(table, model));
+
+  for (int step = 0; step < 3000; ++step)
+  {
+    qint64 position = random.bounded(int(model.size()) + 1);
+    if (random.bounded(3) == 0 && !model.isEmpty())
+    {
+      qint64 length = random.bounded(1, 200);
+      table.remove(position, length);
+      model.remove(position, length);
+    }
+    else
+    {
+      QByteArray text = randomText(random, random.bounded(1, 20));
+      table.insert(position, text);
+      model.insert(position, text);
+    }
+
+    QCOMPARE(table.size(), qint64(model.size()));
+    if (step % 50 == 0)
+      QCOMPARE(table.bytes(0, table.size()), model);
+    qint64 probe = random.bounded(int(model.size()) + 1);
+    QCOMPARE(table.bytes(probe, 64), model.mid(probe, 64));
+  }
+  QCOMPARE(table.bytes(0, table.size()), model);
+}
+
+void TestPieceTable::undoesAndRedoesEverything()
+{
+  QRandomGenerator random(11);
+  const QByteArray original = randomText(random, 5000);
+  QByteArray model = original;
+  PieceTable table;
+  QVERIFY(open(table, original));
+
+  for (int step = 0; step < 300; ++step)
+  {
+    qint64 position = random.bounded(int(model.size()) + 1);
+    if (random.bounded(2) == 0 && !model.isEmpty())
+    {
+      qint64 length = random.bounded(1, 50);
+      table.remove(position, length);
+      model.remove(position, length);
+    }
+    else
+    {
+      QByteArray text = randomText(random, random.bounded(1, 10));
+      table.insert(position, text);
+      model.insert(position, text);
+    }
+  }
+  const QByteArray edited = model;
+  QCOMPARE(table.bytes(0, table.size()), edited);
+
+  int steps = 0;
+  while (table.canUndo())
+  {
+    QVERIFY(table.undo() >= 0);
+    ++steps;
+  }
+  QVERIFY(steps > 0);
+  QCOMPARE(table.bytes(0, table.size()), original);
+  QCOMPARE(table.undo(), qint64(-1));
+
+  while (table.canRedo())
+  {
+    QVERIFY(table.redo() >= 0);
+    --steps;
+  }
+  QCOMPARE(steps, 0);
+  QCOMPARE(table.bytes(0, table.size()), edited);
+}
+
+void TestPieceTable::typingIsOneUndoStep()
+{
+  PieceTable table;
+  QVERIFY(open(table, "start\n"));
+
+  table.insert(6, "a");
+  table.insert(7, "b");
+  table.insert(8, "c");
+  QCOMPARE(table.bytes(0, table.size()), QByteArray("start\nabc"));
+  // A new line ends the step, and so does typing somewhere else
+  table.insert(9, "\n");
+  table.insert(10, "d");
+  table.insert(11, "e");
+  table.insert(0, "x");
+
+  QCOMPARE(table.undo(), qint64(0));
+  QCOMPARE(table.bytes(0, table.size()), QByteArray("start\nabc\nde"));
+  // The line typed after the new line is a step of its own
+  QCOMPARE(table.undo(), qint64(10));
+  QCOMPARE(table.bytes(0, table.size()), QByteArray("start\nabc\n"));
+  QCOMPARE(table.undo(), qint64(9));
+  QCOMPARE(table.bytes(0, table.size()), QByteArray("start\nabc"));
+  QCOMPARE(table.undo(), qint64(6));
+  QCOMPARE(table.bytes(0, table.size()), QByteArray("start\n"));
+  QVERIFY(!table.canUndo());
+
+  QCOMPARE(table.redo(), qint64(6));
+  QCOMPARE(table.bytes(0, table.size()), QByteArray("start\nabc"));
+}
+
+void TestPieceTable::newEditClearsRedo()
+{
+  PieceTable table;
+  QVERIFY(open(table, "one two"));
+
+  table.remove(3, 4);
+  table.undo();
+  QVERIFY(table.canRedo());
+  table.insert(0, "zero ");
+  QVERIFY(!table.canRedo());
+  QCOMPARE(table.bytes(0, table.size()), QByteArray("zero one two"));
+}
+
+void TestPieceTable::indexesLinesLazily()
+{
+  // Several index chunks' worth of lines, so catching up takes more than one
+  QRandomGenerator random(3);
+  QByteArray model = randomText(random, 3 * 1024 * 1024 + 123);
+  PieceTable table;
+  QVERIFY(open(table, model));
+
+  compareLines(table, model, 10);
+  QVERIFY(!table.isLineCountKnown());
+  int estimate = table.estimatedLineCount();
+  int lines = int(model.count('\n')) + 1;
+  QVERIFY2(qAbs(estimate - lines) < lines / 10, qPrintable(QString("%1 vs %2").arg(estimate).arg(lines)));
+
+  compareLines(table, model, model.size() / 2);
+  compareLines(table, model, model.size());
+  QVERIFY(table.isLineCountKnown());
+  QCOMPARE(table.estimatedLineCount(), lines);
+  QCOMPARE(table.lineStartOf(lines + 100), table.lineStartOf(lines - 1));
+
+  for (int i = 0; i < 200; ++i)
+    compareLines(table, model, random.bounded(int(model.size()) + 1));
+}
+
+void TestPieceTable::linesFollowEdits()
+{
+  QRandomGenerator random(5);
+  QByteArray model = randomText(random, 50000);
+  PieceTable table;
+  QVERIFY(open(table, model));
+
+  for (int step = 0; step < 500; ++step)
+  {
+    qint64 position = random.bounded(int(model.size()) + 1);
+    if (random.bounded(3) == 0 && !model.isEmpty())
+    {
+      qint64 length = random.bounded(1, 100);
+      table.remove(position, length);
+      model.remove(position, length);
+    }
+    else
+    {
+      QByteArray text = randomText(random, random.bounded(1, 30));
+      table.insert(position, text);
+      model.insert(position, text);
+    }
+    // Before and after the edit, and past what has been indexed
+    compareLines(table, model, random.bounded(int(model.size()) + 1));
+    compareLines(table, model, qMin<qint64>(position, model.size()));
+  }
+
+  while (table.canUndo())
+    table.undo();
+  QByteArray original = table.bytes(0, table.size());
+  for (int i = 0; i < 50; ++i)
+    compareLines(table, original, random.bounded(int(original.size()) + 1));
+}
+
+void TestPieceTable::snapshotKeepsItsText()
+{
+  PieceTable table;
+  QVERIFY(open(table, "the original text"));
+  table.insert(4, "whole ");
+  const QByteArray expected = table.bytes(0, table.size());
+  DocumentWriter::Producer snapshot = table.snapshot();
+
+  table.remove(0, 10);
+  table.insert(0, "changed ");
+  table.close();
+
+  QTemporaryFile out;
+  QVERIFY(out.open());
+  QString error;
+  QVERIFY(snapshot(out, &error));
+  QVERIFY(out.flush());
+  QVERIFY(out.seek(0));
+  QCOMPARE(out.readAll(), expected);
+}
+
+void TestPieceTable::tracksModification()
+{
+  PieceTable table;
+  QVERIFY(open(table, "text"));
+  quint64 revision = table.revision();
+
+  table.insert(0, "more ");
+  QVERIFY(table.isModified());
+  QVERIFY(table.revision() > revision);
+  table.setModified(false);
+
+  revision = table.revision();
+  table.undo();
+  QVERIFY(table.isModified());
+  QVERIFY(table.revision() > revision);
+}
+
+QTEST_GUILESS_MAIN(TestPieceTable)
+#include "tst_piecetable.moc"
@@ -0,0 +1,172 @@
+#include <QtTest/QtTest>
+#include "RegexSearcher.h"
+#include "SyntheticText.h"
+
+class TestRegexSearcher : public QObject
+{
+  Q_OBJECT
+
+private slots:
+  void requiredLiteral_data();
+  void requiredLiteral();
+  void lineBound_data();
+  void lineBound();
+  void matchesLikeTheRegex_data();
+  void matchesLikeTheRegex();
+  void skipsEmptyMatches();
+  void stopsWhenAsked();
+
+private:
+  static QVector<QPair<int, int>> regexMatches(const QString &pattern, LiteralSearcher::Options options,
+                                               const QString &text);
+  static QVector<QPair<int, int>> searcherMatches(const QString &pattern, LiteralSearcher::Options options,
+                                                  const QString &text);
+};
+
+void TestRegexSearcher::requiredLiteral_data()
+{
+  QTest::addColumn<QString>("pattern");
+  QTest::addColumn<QString>("literal");
+
+  QTest::newRow("plain") << QString("hello") << QString("hello");
+  QTest::newRow("escaped punctuation") << QString("todo\\(\\w+\\):") << QString("todo(");
+  QTest::newRow("escaped dot") << QString("\\.txt") << QString(".txt");
+  QTest::newRow("optional character") << QString("colou?r") << QString("colo");
+  QTest::newRow("starred character") << QString("ab*cdef") << QString("cdef");
+  QTest::newRow("dot splits runs") << QString("abc.de") << QString("abc");
+  QTest::newRow("anchors") << QString("^start end$") << QString("start end");
+  QTest::newRow("character class") << QString("a[xyz]bcd") << QString("bcd");
+  QTest::newRow("negated class with bracket") << QString("ab[^]x]cdef") << QString("cdef");
+  QTest::newRow("group skipped") << QString("(optional)?required") << QString("required");
+  QTest::newRow("nested group") << QString("x(a(b)c)*longest") << QString("longest");
+  QTest::newRow("top-level alternative") << QString("foo|bar") << QString("");
+  QTest::newRow("alternative in group") << QString("(foo|bar)baz") << QString("baz");
+  QTest::newRow("exact count") << QString("abc{2}de") << QString("abc");
+  QTest::newRow("lower bound") << QString("abc{2,}de") << QString("abc");
+  QTest::newRow("range") << QString("abc{1,3}de") << QString("abc");
+  QTest::newRow("zero lower bound") << QString("abc{0,2}de") << QString("ab");
+  QTest::newRow("no lower bound") << QString("abc{,2}de") << QString("ab");
+  QTest::newRow("spaces in braces") << QString("abc{ 0 , 2 }de") << QString("ab");
+  QTest::newRow("spaces and no lower bound") << QString("abc{ ,2}de") << QString("ab");
+  QTest::newRow("literal brace") << QString("abc{x}de") << QString("abc{x}de");
+  QTest::newRow("empty braces") << QString("abc{}de") << QString("abc{}de");
+  QTest::newRow("brace with comma only") << QString("abc{,}de") << QString("abc{,}de");
+  QTest::newRow("unterminated brace") << QString("abc{2") << QString("abc{2");
+  QTest::newRow("hex escape") << QString("\\x41bcdef") << QString("");
+  QTest::newRow("property escape") << QString("\\p{L}bcdef") << QString("");
+  QTest::newRow("trailing backslash") << QString("abc\\") << QString("abc");
+}
+
+void TestRegexSearcher::requiredLiteral()
+{
+  QFETCH(QString, pattern);
+  QFETCH(QString, literal);
+  QCOMPARE(RegexSearcher::extractRequiredLiteral(pattern), literal);
+}
+
+void TestRegexSearcher::lineBound_data()
+{
+  QTest::addColumn<QString>("pattern");
+  QTest::addColumn<bool>("lineBound");
+  QTest::addColumn<QString>("literal");
+
+  QTest::newRow("word run") << QString("todo\\(\\w+\\):") << true << QString("todo(");
+  QTest::newRow("whitespace") << QString("end\\s+start") << false << QString("");
+  QTest::newRow("negated class") << QString("ab[^x]cd") << false << QString("");
+  QTest::newRow("dotall") << QString("(?s)a.b") << false << QString("");
+  QTest::newRow("inline option") << QString("(?i)hello") << false << QString("");
+  QTest::newRow("non-capturing group") << QString("(?:the|a) stranger") << true << QString(" stranger");
+  QTest::newRow("short literal") << QString("a\\d+") << true << QString("");
+}
+
+void TestRegexSearcher::lineBound()
+{
+  QFETCH(QString, pattern);
+  QFETCH(bool, lineBound);
+  QFETCH(QString, literal);
+
+  RegexSearcher searcher(pattern);
+  QVERIFY(searcher.isValid());
+  QCOMPARE(searcher.isLineBound(), lineBound);
+  QCOMPARE(searcher.requiredLiteral(), literal);
+}
+
+QVector<QPair<int, int>> TestRegexSearcher::regexMatches(const QString &pattern, LiteralSearcher::Options options,
+                                                         const QString &text)
+{
+  QString expression = options & LiteralSearcher::WholeWords ? "\\b(?:" + pattern + ")\\b" : pattern;
+  QRegularExpression::PatternOptions patternOptions = QRegularExpression::MultilineOption;
+  if (options & LiteralSearcher::CaseInsensitive)
+    patternOptions |= QRegularExpression::CaseInsensitiveOption;
+
+  QVector<QPair<int, int>> matches;
+  QRegularExpressionMatchIterator it = QRegularExpression(expression, patternOptions).globalMatch(text);
+  while (it.hasNext())
+  {
+    QRegularExpressionMatch match = it.next();
+    if (match.capturedLength() > 0)
+      matches.append(qMakePair(int(match.capturedStart()), int(match.capturedLength())));
+  }
+  return matches;
+}
+
+QVector<QPair<int, int>> TestRegexSearcher::searcherMatches(const QString &pattern, LiteralSearcher::Options options,
+                                                            const QString &text)
+{
+  QVector<QPair<int, int>> matches;
+  RegexSearcher(pattern, options).forEachMatch(text, [&matches](const QRegularExpressionMatch &match, qsizetype base)
+                                               {
+    matches.append(qMakePair(int(base + match.capturedStart()), int(match.capturedLength())));
+    return true; });
+  return matches;
+}
+
+void TestRegexSearcher::matchesLikeTheRegex_data()
+{
+  QTest::addColumn<QString>("pattern");
+  QTest::addColumn<int>("options");
+
+  const int ignoreCase = int(LiteralSearcher::CaseInsensitive);
+  const int wholeWords = int(LiteralSearcher::WholeWords);
+  QTest::newRow("literal") << QString("lantern") << 0;
+  QTest::newRow("literal, ignore case") << QString("lantern") << ignoreCase;
+  QTest::newRow("literal, whole words") << QString("the") << wholeWords;
+  QTest::newRow("word after") << QString("lantern \\w+") << ignoreCase;
+  QTest::newRow("alternatives") << QString("(?:the|a) stranger") << 0;
+  QTest::newRow("optional") << QString("colou?r") << ignoreCase;
+  QTest::newRow("no lower bound") << QString("colou{,1}r") << ignoreCase;
+  QTest::newRow("counted") << QString("whis{1,2}pered") << 0;
+  QTest::newRow("line anchors") << QString("^The \\w+") << 0;
+  QTest::newRow("todo") << QString("todo\\(\\w+\\):") << ignoreCase;
+  QTest::newRow("no literal") << QString("\\d+") << 0;
+  QTest::newRow("crosses lines") << QString("door\\.\\s+\\w+") << 0;
+}
+
+void TestRegexSearcher::matchesLikeTheRegex()
+{
+  QFETCH(QString, pattern);
+  QFETCH(int, options);
+
+  QString text = syntheticText(200 * 1000) +
+                 "\nColor and colour, COLOUR, colou{,1}r.\nTODO(ann): check. todo(bob): also.\nNumber 42 and 7.\nThe end.";
+  LiteralSearcher::Options searchOptions = LiteralSearcher::Options(options);
+  QVector<QPair<int, int>> expected = regexMatches(pattern, searchOptions, text);
+  QVERIFY(!expected.isEmpty());
+  QCOMPARE(searcherMatches(pattern, searchOptions, text), expected);
+}
+
+void TestRegexSearcher::skipsEmptyMatches()
+{
+  QCOMPARE(searcherMatches("x*", {}, "aaxxaa"), (QVector<QPair<int, int>>() << qMakePair(2, 2)));
+}
+
+void TestRegexSearcher::stopsWhenAsked()
+{
+  int visits = 0;
+  RegexSearcher("ab\\d").forEachMatch(u"ab1\nab2\nab3", [&visits](const QRegularExpressionMatch &, qsizetype)
+                                      { return ++visits < 2; });
+  QCOMPARE(visits, 2);
+}
+
+QTEST_GUILESS_MAIN(TestRegexSearcher)
+#include "tst_regexsearcher.moc"
@@ -0,0 +1,202 @@
+#include <QtTest/QtTest>
+#include <QtCore/QRandomGenerator>
+#include <QtGui/QTextDocument>
+#include <iterator>
+#include "ReplaceEngine.h"
+
+namespace
+{
+  QString randomText(QRandomGenerator &random, int length)
+  {
+    static const char16_t alphabet[] = u"aabbcAB \n\u00e9";
+    const int size = int(std::size(alphabet)) - 1;
+    QString text;
+    text.reserve(length);
+    for (int i = 0; i < length; ++i)
+      text += QChar(alphabet[random.bounded(size)]);
+    return text;
+  }
+
+  // Applies edits to a string the way apply() does to a document
+  QString applied(QString text, const QVector<ReplaceEngine::Edit> &edits)
+  {
+    for (int i = int(edits.size()) - 1; i >= 0; --i)
+      text.replace(edits.at(i).position, edits.at(i).length, edits.at(i).replacement);
+    return text;
+  }
+
+  bool inOrder(const QVector<ReplaceEngine::Edit> &edits)
+  {
+    for (int i = 1; i < edits.size(); ++i)
+    {
+      if (edits.at(i).position < edits.at(i - 1).position + edits.at(i - 1).length)
+        return false;
+    }
+    return true;
+  }
+}
+
+// ReplaceEngine held to QString::replace(), which does the same job in one
+// call and is taken as the reference
+class TestReplaceEngine : public QObject
+{
+  Q_OBJECT
+
+private slots:
+  void expandsReferences_data();
+  void expandsReferences();
+  void regexMatchesQString_data();
+  void regexMatchesQString();
+  void literalMatchesQString();
+  void appliesAsOneUndoStep();
+  void reportsInvalidPattern();
+};
+
+void TestReplaceEngine::expandsReferences_data()
+{
+  QTest::addColumn<QString>("replacement");
+  QTest::addColumn<QString>("expected");
+
+  // Matched against "abcdefghijk" with eleven groups, one per letter
+  QTest::newRow("plain") << QString("text") << QString("text");
+  QTest::newRow("backslash group") << QString("<\\1>") << QString("<a>");
+  QTest::newRow("dollar group") << QString("<$2>") << QString("<b>");
+  QTest::newRow("whole match") << QString("[$&]") << QString("[abcdefghijk]");
+  QTest::newRow("group zero") << QString("[\\0]") << QString("[abcdefghijk]");
+  QTest::newRow("two digits") << QString("\\11|$10") << QString("k|j");
+  QTest::newRow("no such group") << QString("\\12") << QString("a2");
+  QTest::newRow("newline") << QString("a\\nb") << QString("a\nb");
+  QTest::newRow("tab") << QString("a\\tb") << QString("a\tb");
+  QTest::newRow("escaped backslash") << QString("\\\\1") << QString("\\1");
+  QTest::newRow("escaped dollar") << QString("$$1 $$&") << QString("$1 $&");
+  QTest::newRow("trailing backslash") << QString("end\\") << QString("end\\");
+  QTest::newRow("trailing dollar") << QString("end$") << QString("end$");
+  QTest::newRow("unknown escape") << QString("\\q$x") << QString("\\q$x");
+}
+
+void TestReplaceEngine::expandsReferences()
+{
+  QFETCH(QString, replacement);
+  QFETCH(QString, expected);
+
+  QRegularExpressionMatch match = QRegularExpression("(a)(b)(c)(d)(e)(f)(g)(h)(i)(j)(k)").match("abcdefghijk");
+  QVERIFY(match.hasMatch());
+  QCOMPARE(ReplaceEngine::expand(replacement, match), expected);
+}
+
+void TestReplaceEngine::regexMatchesQString_data()
+{
+  QTest::addColumn<QString>("pattern");
+  QTest::addColumn<int>("groups");
+
+  // None of these can match empty, which both sides treat differently
+  QTest::newRow("run") << QString("a+") << 0;
+  QTest::newRow("two groups") << QString("(a)(b)") << 2;
+  QTest::newRow("repeated group") << QString("(ab|c)+") << 1;
+  QTest::newRow("optional group") << QString("b(c)?a") << 1;
+  QTest::newRow("class") << QString("[ab]c") << 0;
+  QTest::newRow("alternatives") << QString("(a|b)(c|a)(b)") << 3;
+  QTest::newRow("word") << QString("(\\w+) (\\w+)") << 2;
+  QTest::newRow("line") << QString("^(b.*)$") << 1;
+}
+
+void TestReplaceEngine::regexMatchesQString()
+{
+  QFETCH(QString, pattern);
+  QFETCH(int, groups);
+
+  // QString::replace() only knows \N, so that is all the replacements use
+  QStringList pieces = {"x", "\u00e9", "-"};
+  for (int group = 1; group <= groups; ++group)
+    pieces << QString("\\%1").arg(group);
+
+  QRandomGenerator random(3);
+  for (int i = 0; i < 3000; ++i)
+  {
+    const bool caseInsensitive = random.bounded(2);
+    QString text = randomText(random, random.bounded(60));
+    QString replacement;
+    for (int n = random.bounded(4); n > 0; --n)
+      replacement += pieces.at(random.bounded(int(pieces.size())));
+
+    ReplaceEngine::Result result = ReplaceEngine::computeEdits(
+        text, pattern, replacement, ReplaceEngine::Regex,
+        caseInsensitive ? LiteralSearcher::CaseInsensitive : LiteralSearcher::Options());
+    QVERIFY2(result.error.isEmpty(), qPrintable(result.error));
+    QVERIFY(inOrder(result.edits));
+
+    QRegularExpression::PatternOptions options = QRegularExpression::MultilineOption;
+    if (caseInsensitive)
+      options |= QRegularExpression::CaseInsensitiveOption;
+    QString expected = text;
+    expected.replace(QRegularExpression(pattern, options), replacement);
+    QVERIFY2(applied(text, result.edits) == expected,
+             qPrintable(QString("\"%1\" with \"%2\"").arg(text, replacement)));
+  }
+}
+
+void TestReplaceEngine::literalMatchesQString()
+{
+  // Longer patterns and ones with repeats, where matches could overlap
+  const QStringList patterns = {"a", "ab", "aa", "aba", "b\na", "\u00e9a", "AbAb"};
+
+  QRandomGenerator random(4);
+  for (int i = 0; i < 5000; ++i)
+  {
+    const bool caseInsensitive = random.bounded(2);
+    const QString pattern = patterns.at(random.bounded(int(patterns.size())));
+    QString text = randomText(random, random.bounded(80));
+    // Literal mode takes the replacement as it is, references and all
+    QString replacement = random.bounded(2) ? QString("\\1$&") : QString("[z]");
+
+    ReplaceEngine::Result result = ReplaceEngine::computeEdits(
+        text, pattern, replacement, ReplaceEngine::Literal,
+        caseInsensitive ? LiteralSearcher::CaseInsensitive : LiteralSearcher::Options());
+    QVERIFY(result.error.isEmpty());
+    QVERIFY(inOrder(result.edits));
+
+    QString expected = text;
+    expected.replace(pattern, replacement, caseInsensitive ? Qt::CaseInsensitive : Qt::CaseSensitive);
+    QVERIFY2(applied(text, result.edits) == expected, qPrintable(QString("\"%1\" in \"%2\"").arg(pattern, text)));
+  }
+}
+
+void TestReplaceEngine::appliesAsOneUndoStep()
+{
+  QRandomGenerator random(6);
+  QString text;
+  for (int i = 0; i < 200; ++i)
+    text += randomText(random, 50) + "\n";
+
+  QTextDocument document;
+  document.setPlainText(text);
+  QCOMPARE(document.availableUndoSteps(), 0);
+
+  // Many edits, some growing the text and some shrinking it
+  ReplaceEngine::Result result =
+      ReplaceEngine::computeEdits(text, "(a+)(b?)", "$2<\\1>", ReplaceEngine::Regex, LiteralSearcher::Options());
+  QVERIFY(result.edits.size() > 500);
+  ReplaceEngine::apply(&document, result.edits);
+
+  QString expected = text;
+  expected.replace(QRegularExpression("(a+)(b?)"), "\\2<\\1>");
+  QCOMPARE(document.toPlainText(), expected);
+  QCOMPARE(document.availableUndoSteps(), 1);
+
+  document.undo();
+  QCOMPARE(document.toPlainText(), text);
+}
+
+void TestReplaceEngine::reportsInvalidPattern()
+{
+  ReplaceEngine::Result result = ReplaceEngine::computeEdits("text", "(a", "b", ReplaceEngine::Regex);
+  QVERIFY(!result.error.isEmpty());
+  QVERIFY(result.edits.isEmpty());
+
+  // An empty pattern finds nothing rather than everything
+  result = ReplaceEngine::computeEdits("text", "", "b", ReplaceEngine::Regex);
+  QVERIFY(result.edits.isEmpty());
+}
+
+QTEST_MAIN(TestReplaceEngine)
+#include "tst_replaceengine.moc"
@@ -0,0 +1,250 @@
+#include <QtTest/QtTest>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QStandardPaths>
+#include <QtCore/QTemporaryDir>
+#include <cmath>
+#include "MetadataIndex.h"
+#include "SearchIndex.h"
+
+namespace
+{
+  const int Timeout = 15000;
+
+  const QStringList &documentFilters()
+  {
+    static const QStringList filters = {"*.txt"};
+    return filters;
+  }
+
+  // BM25 idf as SearchIndex computes it
+  double idf(double documents, double documentFrequency)
+  {
+    return std::log(1.0 + (documents - documentFrequency + 0.5) / (documentFrequency + 0.5));
+  }
+}
+
+class TestSearchIndex : public QObject
+{
+  Q_OBJECT
+
+private slots:
+  void initTestCase();
+  void init();
+
+  void everyWordMustMatch();
+  void phrasesMatchAdjacentWords();
+  void moreOccurrencesRankHigher();
+  void shorterDocumentsRankHigher();
+  void scoresAreBm25();
+  void updatedDocumentsAreReindexed();
+  void removedDocumentsDropOut();
+  void indexSurvivesRestart();
+  void snippetShowsFirstTerm();
+
+private:
+  QString documentPath(const QString &name) const { return m_directory->path() + "/" + name; }
+  bool writeDocument(const QString &name, const QString &text);
+  QStringList names(const SearchIndex::Result &result) const;
+
+  QScopedPointer<QTemporaryDir> m_directory;
+};
+
+void TestSearchIndex::initTestCase()
+{
+  // Keeps the index and its segments away from the real ones
+  QStandardPaths::setTestModeEnabled(true);
+}
+
+void TestSearchIndex::init()
+{
+  QDir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)).removeRecursively();
+  m_directory.reset(new QTemporaryDir);
+  QVERIFY(m_directory->isValid());
+}
+
+bool TestSearchIndex::writeDocument(const QString &name, const QString &text)
+{
+  QFile file(documentPath(name));
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    return false;
+  return file.write(text.toUtf8()) == text.toUtf8().size();
+}
+
+QStringList TestSearchIndex::names(const SearchIndex::Result &result) const
+{
+  QStringList names;
+  for (const SearchIndex::Hit &hit : result.hits)
+    names.append(QFileInfo(hit.path).fileName());
+  return names;
+}
+
+void TestSearchIndex::everyWordMustMatch()
+{
+  QVERIFY(writeDocument("a.txt", "Apple banana."));
+  QVERIFY(writeDocument("b.txt", "Apple cherry."));
+  QVERIFY(writeDocument("c.txt", "Banana cherry."));
+
+  MetadataIndex metadata(m_directory->path(), documentFilters());
+  metadata.load();
+  SearchIndex index;
+  index.addSource(&metadata);
+  QTRY_VERIFY_WITH_TIMEOUT(!index.isIndexing() && index.documentCount() == 3, Timeout);
+
+  SearchIndex::Result result = index.search("apple BANANA");
+  QCOMPARE(result.terms, QStringList() << "apple" << "banana");
+  QCOMPARE(names(result), QStringList() << "a.txt");
+  QCOMPARE(result.matches, 1);
+
+  QCOMPARE(index.search("cherry").matches, 2);
+  QCOMPARE(index.search("apple durian").matches, 0);
+}
+
+void TestSearchIndex::phrasesMatchAdjacentWords()
+{
+  QVERIFY(writeDocument("a.txt", "A red apple pie."));
+  QVERIFY(writeDocument("b.txt", "An apple pie, red."));
+
+  MetadataIndex metadata(m_directory->path(), documentFilters());
+  metadata.load();
+  SearchIndex index;
+  index.addSource(&metadata);
+  QTRY_VERIFY_WITH_TIMEOUT(!index.isIndexing() && index.documentCount() == 2, Timeout);
+
+  QCOMPARE(index.search("red apple").matches, 2);
+  QCOMPARE(names(index.search("\"red apple\"")), QStringList() << "a.txt");
+  QCOMPARE(names(index.search("\"pie red\"")), QStringList() << "b.txt");
+  QCOMPARE(index.search("\"apple red\"").matches, 0);
+}
+
+void TestSearchIndex::moreOccurrencesRankHigher()
+{
+  QVERIFY(writeDocument("few.txt", "whale sea sea sea"));
+  QVERIFY(writeDocument("many.txt", "whale whale whale sea"));
+  QVERIFY(writeDocument("none.txt", "sea sea sea sea"));
+
+  MetadataIndex metadata(m_directory->path(), documentFilters());
+  metadata.load();
+  SearchIndex index;
+  index.addSource(&metadata);
+  QTRY_VERIFY_WITH_TIMEOUT(!index.isIndexing() && index.documentCount() == 3, Timeout);
+
+  SearchIndex::Result result = index.search("whale");
+  QCOMPARE(names(result), QStringList() << "many.txt" << "few.txt");
+  QVERIFY(result.hits.at(0).score > result.hits.at(1).score);
+}
+
+void TestSearchIndex::shorterDocumentsRankHigher()
+{
+  QVERIFY(writeDocument("long.txt", "whale " + QString("filler ").repeated(50)));
+  QVERIFY(writeDocument("short.txt", "whale filler"));
+  QVERIFY(writeDocument("other.txt", "nothing here"));
+
+  MetadataIndex metadata(m_directory->path(), documentFilters());
+  metadata.load();
+  SearchIndex index;
+  index.addSource(&metadata);
+  QTRY_VERIFY_WITH_TIMEOUT(!index.isIndexing() && index.documentCount() == 3, Timeout);
+
+  QCOMPARE(names(index.search("whale")), QStringList() << "short.txt" << "long.txt");
+}
+
+void TestSearchIndex::scoresAreBm25()
+{
+  // Every document two words long, so only idf tells the terms apart
+  QVERIFY(writeDocument("a.txt", "rare common"));
+  QVERIFY(writeDocument("b.txt", "common other"));
+  QVERIFY(writeDocument("c.txt", "plain words"));
+
+  MetadataIndex metadata(m_directory->path(), documentFilters());
+  metadata.load();
+  SearchIndex index;
+  index.addSource(&metadata);
+  QTRY_VERIFY_WITH_TIMEOUT(!index.isIndexing() && index.documentCount() == 3, Timeout);
+
+  // With the average length and one occurrence each, the term frequency
+  // part is exactly 1. "common" is in two documents even though only one
+  // of them also has "rare".
+  SearchIndex::Result result = index.search("rare common");
+  QCOMPARE(result.hits.size(), 1);
+  QVERIFY(qFuzzyCompare(result.hits.at(0).score, idf(3, 1) + idf(3, 2)));
+
+  result = index.search("common");
+  QCOMPARE(result.hits.size(), 2);
+  QVERIFY(qFuzzyCompare(result.hits.at(0).score, idf(3, 2)));
+  QVERIFY(qFuzzyCompare(result.hits.at(1).score, idf(3, 2)));
+}
+
+void TestSearchIndex::updatedDocumentsAreReindexed()
+{
+  QVERIFY(writeDocument("a.txt", "first draft"));
+  QVERIFY(writeDocument("b.txt", "another draft"));
+
+  MetadataIndex metadata(m_directory->path(), documentFilters());
+  metadata.load();
+  SearchIndex index;
+  index.addSource(&metadata);
+  QTRY_VERIFY_WITH_TIMEOUT(!index.isIndexing() && index.documentCount() == 2, Timeout);
+  QCOMPARE(index.search("first").matches, 1);
+
+  QVERIFY(writeDocument("a.txt", "second and final draft"));
+  metadata.update(documentPath("a.txt"));
+  QTRY_COMPARE_WITH_TIMEOUT(index.search("final").matches, 1, Timeout);
+  QCOMPARE(index.search("first").matches, 0);
+  QCOMPARE(index.search("draft").matches, 2);
+  QCOMPARE(index.documentCount(), 2);
+}
+
+void TestSearchIndex::removedDocumentsDropOut()
+{
+  QVERIFY(writeDocument("a.txt", "kept notes"));
+  QVERIFY(writeDocument("b.txt", "deleted notes"));
+
+  MetadataIndex metadata(m_directory->path(), documentFilters());
+  metadata.load();
+  SearchIndex index;
+  index.addSource(&metadata);
+  QTRY_VERIFY_WITH_TIMEOUT(!index.isIndexing() && index.documentCount() == 2, Timeout);
+
+  QVERIFY(QFile::remove(documentPath("b.txt")));
+  metadata.remove(documentPath("b.txt"));
+  QTRY_COMPARE_WITH_TIMEOUT(index.documentCount(), 1, Timeout);
+  QCOMPARE(index.search("deleted").matches, 0);
+  QCOMPARE(names(index.search("notes")), QStringList() << "a.txt");
+}
+
+void TestSearchIndex::indexSurvivesRestart()
+{
+  QVERIFY(writeDocument("a.txt", "lighthouse keeper"));
+  QVERIFY(writeDocument("b.txt", "keeper of bees"));
+
+  MetadataIndex metadata(m_directory->path(), documentFilters());
+  metadata.load();
+  {
+    SearchIndex index;
+    index.addSource(&metadata);
+    QTRY_VERIFY_WITH_TIMEOUT(!index.isIndexing() && index.documentCount() == 2, Timeout);
+  }
+
+  // The manifest and segments are read back without indexing anything
+  SearchIndex index;
+  QCOMPARE(index.documentCount(), 2);
+  index.addSource(&metadata);
+  QVERIFY(!index.isIndexing());
+  QCOMPARE(names(index.search("lighthouse")), QStringList() << "a.txt");
+  QCOMPARE(index.search("keeper").matches, 2);
+}
+
+void TestSearchIndex::snippetShowsFirstTerm()
+{
+  QVERIFY(writeDocument("a.txt", "Nothing to see.\nThen the\nlighthouse came into view, far off."));
+
+  QString snippet = SearchIndex::snippet(documentPath("a.txt"), QStringList() << "lighthouse", 10);
+  QVERIFY2(snippet.contains("lighthouse"), qPrintable(snippet));
+  QVERIFY(snippet.startsWith("..."));
+  QVERIFY(snippet.endsWith("..."));
+  QVERIFY(!snippet.contains('\n'));
+}
+
+QTEST_GUILESS_MAIN(TestSearchIndex)
+#include "tst_searchindex.moc"
@@ -0,0 +1,382 @@
+#include <QtTest/QtTest>
+#include <QtCore/QRandomGenerator>
+#include <QtGui/QFont>
+#include <QtGui/QTextBlock>
+#include <QtGui/QTextCursor>
+#include <QtGui/QTextDocument>
+#include "UndoHistory.h"
+
+namespace
+{
+  QString randomText(QRandomGenerator &random, int length)
+  {
+    QString text;
+    for (int i = 0; i < length; ++i)
+    {
+      int pick = random.bounded(32);
+      text += pick == 0 ? QChar(u'\n') : pick < 6 ? QChar(u' ') : QChar(u'a' + random.bounded(26));
+    }
+    return text;
+  }
+
+  // Replaces up to 40 characters somewhere with up to 40 others, so most
+  // steps both remove text and add it
+  void randomEdit(QTextDocument &document, QRandomGenerator &random)
+  {
+    int length = document.characterCount() - 1;
+    QTextCursor cursor(&document);
+    cursor.setPosition(random.bounded(length + 1));
+    cursor.setPosition(qMin(length, cursor.position() + random.bounded(41)), QTextCursor::KeepAnchor);
+    cursor.insertText(randomText(random, cursor.hasSelection() ? random.bounded(41) : 1 + random.bounded(40)));
+  }
+
+  // Text with the formatting the history has to bring back, with runs of
+  // the same format joined however the document split them
+  QString describe(const QTextDocument &document)
+  {
+    QString description;
+    for (QTextBlock block = document.begin(); block.isValid(); block = block.next())
+    {
+      description += QString("\n[align %1]").arg(int(block.blockFormat().alignment()));
+      QString last;
+      for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it)
+      {
+        QTextCharFormat format = it.fragment().charFormat();
+        QString key = QString("{%1%2}").arg(format.fontWeight()).arg(format.fontItalic() ? " italic" : "");
+        if (key != last)
+          description += key;
+        description += it.fragment().text();
+        last = key;
+      }
+    }
+    return description;
+  }
+
+  // The shadow copy the history keeps, which counts towards its memory use
+  qint64 shadowBytes(const QTextDocument &document)
+  {
+    return qint64(document.characterCount()) * 2 + qint64(document.blockCount()) * 64;
+  }
+}
+
+class TestUndoHistory : public QObject
+{
+  Q_OBJECT
+
+private slots:
+  void replacesDocumentStack();
+  void typingIsOneStep();
+  void newLinesAndPausesBreakSteps();
+  void backspacingIsOneStep();
+  void newEditClearsRedo();
+  void undoesAndRedoesRandomEdits();
+  void restoresFormatting();
+  void restoresBlockFormats();
+  void undoesRandomRichEdits();
+  void mergesTouchingSteps();
+  void spillsPastBudget();
+  void dropsPastBudgetWithoutDisk();
+};
+
+void TestUndoHistory::replacesDocumentStack()
+{
+  QTextDocument document;
+  UndoHistory *history = UndoHistory::install(&document, false);
+  QVERIFY(history);
+  QCOMPARE(UndoHistory::install(&document, false), history);
+  QVERIFY(!document.isUndoRedoEnabled());
+  QVERIFY(!history->canUndo());
+  QCOMPARE(history->undo(), -1);
+  QCOMPARE(history->redo(), -1);
+}
+
+void TestUndoHistory::typingIsOneStep()
+{
+  QTextDocument document;
+  UndoHistory *history = UndoHistory::install(&document, false);
+  QTextCursor cursor(&document);
+  for (QChar c : QString("typing on"))
+    cursor.insertText(c);
+
+  QCOMPARE(history->undo(), 0);
+  QCOMPARE(document.toPlainText(), QString());
+  QVERIFY(!history->canUndo());
+  QCOMPARE(history->redo(), 9);
+  QCOMPARE(document.toPlainText(), QString("typing on"));
+}
+
+void TestUndoHistory::newLinesAndPausesBreakSteps()
+{
+  QTextDocument document;
+  UndoHistory *history = UndoHistory::install(&document, false);
+  QTextCursor cursor(&document);
+  cursor.insertText("a");
+  cursor.insertText("b");
+  cursor.insertText("\n");
+  cursor.insertText("c");
+  QTest::qWait(2100);
+  cursor.insertText("d");
+
+  const QStringList expected = {"ab\nc", "ab\n", "ab", ""};
+  for (const QString &text : expected)
+  {
+    QVERIFY(history->undo() >= 0);
+    QCOMPARE(document.toPlainText(), text);
+  }
+  QVERIFY(!history->canUndo());
+}
+
+void TestUndoHistory::backspacingIsOneStep()
+{
+  QTextDocument document;
+  document.setPlainText("hello world");
+  UndoHistory *history = UndoHistory::install(&document, false);
+  QTextCursor cursor(&document);
+  cursor.movePosition(QTextCursor::End);
+  for (int i = 0; i < 5; ++i)
+    cursor.deletePreviousChar();
+  cursor.setPosition(0);
+  cursor.deleteChar();
+  QCOMPARE(document.toPlainText(), QString("ello "));
+
+  // Deleting forwards elsewhere is a step of its own
+  QCOMPARE(history->undo(), 1);
+  QCOMPARE(document.toPlainText(), QString("hello "));
+  QCOMPARE(history->undo(), 11);
+  QCOMPARE(document.toPlainText(), QString("hello world"));
+  QVERIFY(!history->canUndo());
+}
+
+void TestUndoHistory::newEditClearsRedo()
+{
+  QTextDocument document;
+  document.setPlainText("one");
+  UndoHistory *history = UndoHistory::install(&document, false);
+  QTextCursor cursor(&document);
+  cursor.movePosition(QTextCursor::End);
+  cursor.insertText(" two");
+  history->undo();
+  QVERIFY(history->canRedo());
+
+  cursor.movePosition(QTextCursor::End);
+  cursor.insertText("!");
+  QVERIFY(!history->canRedo());
+  QCOMPARE(history->redo(), -1);
+  history->undo();
+  QCOMPARE(document.toPlainText(), QString("one"));
+}
+
+void TestUndoHistory::undoesAndRedoesRandomEdits()
+{
+  QRandomGenerator random(3);
+  QTextDocument document;
+  document.setPlainText(randomText(random, 2000));
+  UndoHistory *history = UndoHistory::install(&document, false);
+
+  QStringList states = {document.toPlainText()};
+  for (int i = 0; i < 400; ++i)
+  {
+    randomEdit(document, random);
+    states.append(document.toPlainText());
+  }
+
+  // Every undo lands on a state the document was in, going back in time
+  qsizetype state = states.size() - 1;
+  while (history->canUndo())
+  {
+    QVERIFY(history->undo() >= 0);
+    qsizetype found = states.lastIndexOf(document.toPlainText(), state - 1);
+    QVERIFY2(found >= 0, qPrintable(QString("Undo %1 reached a state the document was never in").arg(state)));
+    state = found;
+  }
+  QCOMPARE(state, qsizetype(0));
+
+  while (history->canRedo())
+  {
+    QVERIFY(history->redo() >= 0);
+    qsizetype found = states.indexOf(document.toPlainText(), state + 1);
+    QVERIFY2(found >= 0, qPrintable(QString("Redo %1 reached a state the document was never in").arg(state)));
+    state = found;
+  }
+  QCOMPARE(state, states.size() - 1);
+}
+
+void TestUndoHistory::restoresFormatting()
+{
+  QTextDocument document;
+  QTextCursor cursor(&document);
+  QTextCharFormat bold;
+  bold.setFontWeight(QFont::Bold);
+  cursor.insertText("plain ");
+  cursor.insertText("bold", bold);
+  cursor.insertText(" tail", QTextCharFormat());
+  const QString original = describe(document);
+  UndoHistory *history = UndoHistory::install(&document, true);
+
+  cursor.setPosition(6);
+  cursor.setPosition(10, QTextCursor::KeepAnchor);
+  cursor.insertText("x", QTextCharFormat());
+  cursor.setPosition(0);
+  cursor.setPosition(5, QTextCursor::KeepAnchor);
+  QTextCharFormat italic;
+  italic.setFontItalic(true);
+  cursor.mergeCharFormat(italic);
+  QVERIFY(describe(document) != original);
+
+  while (history->canUndo())
+    history->undo();
+  QCOMPARE(document.toPlainText(), QString("plain bold tail"));
+  QCOMPARE(describe(document), original);
+}
+
+void TestUndoHistory::restoresBlockFormats()
+{
+  QTextDocument document;
+  QTextCursor cursor(&document);
+  QTextBlockFormat centered;
+  centered.setAlignment(Qt::AlignHCenter);
+  cursor.insertText("first");
+  cursor.insertBlock(centered);
+  cursor.insertText("second");
+  const QString original = describe(document);
+  UndoHistory *history = UndoHistory::install(&document, true);
+
+  // Joins the two blocks, so the centred one goes
+  cursor.setPosition(2);
+  cursor.setPosition(9, QTextCursor::KeepAnchor);
+  cursor.removeSelectedText();
+  QCOMPARE(document.blockCount(), 1);
+
+  history->undo();
+  QCOMPARE(document.blockCount(), 2);
+  QCOMPARE(describe(document), original);
+  QVERIFY(document.lastBlock().blockFormat().alignment() == Qt::AlignHCenter);
+}
+
+void TestUndoHistory::undoesRandomRichEdits()
+{
+  QRandomGenerator random(5);
+  QTextDocument document;
+  QTextCursor cursor(&document);
+  cursor.insertText(randomText(random, 1500));
+  const QString original = describe(document);
+  UndoHistory *history = UndoHistory::install(&document, true);
+
+  for (int i = 0; i < 300; ++i)
+  {
+    if (random.bounded(3) > 0)
+    {
+      randomEdit(document, random);
+      continue;
+    }
+    int length = document.characterCount() - 1;
+    cursor.setPosition(random.bounded(length + 1));
+    cursor.setPosition(qMin(length, cursor.position() + random.bounded(60)), QTextCursor::KeepAnchor);
+    QTextCharFormat format;
+    if (random.bounded(2))
+      format.setFontWeight(random.bounded(2) ? QFont::Bold : QFont::Normal);
+    else
+      format.setFontItalic(random.bounded(2));
+    cursor.mergeCharFormat(format);
+  }
+  const QString edited = describe(document);
+
+  // Packing merges the older steps' formatted runs too; the budget goes
+  // back up so redo keeps every step
+  history->setMemoryBudget(32 * 1024);
+  history->setMemoryBudget(16 * 1024 * 1024);
+  while (history->canUndo())
+    QVERIFY(history->undo() >= 0);
+  QCOMPARE(describe(document), original);
+  while (history->canRedo())
+    QVERIFY(history->redo() >= 0);
+  QCOMPARE(describe(document), edited);
+}
+
+void TestUndoHistory::mergesTouchingSteps()
+{
+  const int Edits = 300;
+  QTextDocument document;
+  document.setPlainText(QString(200, u'-'));
+  const QString original = document.toPlainText();
+  UndoHistory *history = UndoHistory::install(&document, false);
+
+  // Each replaces what the one before it put there
+  QTextCursor cursor(&document);
+  for (int i = 0; i < Edits; ++i)
+  {
+    cursor.setPosition(100);
+    cursor.setPosition(110, QTextCursor::KeepAnchor);
+    cursor.insertText(QString("%1").arg(i, 10, 10, QChar(u'0')));
+  }
+
+  // Too tight to keep every step as it is, so the older ones are packed
+  history->setMemoryBudget(16 * 1024);
+  int undos = 0;
+  while (history->canUndo())
+  {
+    QVERIFY(history->undo() >= 0);
+    ++undos;
+  }
+  QCOMPARE(document.toPlainText(), original);
+  QVERIFY2(undos < Edits, qPrintable(QString("%1 undos for %2 edits").arg(undos).arg(Edits)));
+}
+
+void TestUndoHistory::spillsPastBudget()
+{
+  const qint64 Budget = 64 * 1024;
+  QRandomGenerator random(7);
+  QTextDocument document;
+  document.setPlainText(randomText(random, 20000));
+  const QString original = document.toPlainText();
+  UndoHistory *history = UndoHistory::install(&document, false);
+  history->setMemoryBudget(Budget);
+  history->setSpillToDisk(true);
+
+  for (int i = 0; i < 5000; ++i)
+  {
+    randomEdit(document, random);
+    QVERIFY2(history->memoryUsage() <= Budget + shadowBytes(document),
+             qPrintable(QString("%1 KB in memory after edit %2").arg(history->memoryUsage() / 1024).arg(i)));
+  }
+  QVERIFY(history->diskUsage() > 0);
+
+  while (history->canUndo())
+  {
+    QVERIFY(history->undo() >= 0);
+    QVERIFY(history->memoryUsage() <= Budget + shadowBytes(document));
+  }
+  QCOMPARE(document.toPlainText(), original);
+  QCOMPARE(history->diskUsage(), qint64(0));
+}
+
+void TestUndoHistory::dropsPastBudgetWithoutDisk()
+{
+  const qint64 Budget = 64 * 1024;
+  QRandomGenerator random(7);
+  QTextDocument document;
+  document.setPlainText(randomText(random, 20000));
+  const QString original = document.toPlainText();
+  UndoHistory *history = UndoHistory::install(&document, false);
+  history->setMemoryBudget(Budget);
+  history->setSpillToDisk(false);
+
+  // Hashes, as 5000 copies of the text would take a while to compare
+  QList<size_t> states = {qHash(original)};
+  for (int i = 0; i < 5000; ++i)
+  {
+    randomEdit(document, random);
+    states.append(qHash(document.toPlainText()));
+    QVERIFY(history->memoryUsage() <= Budget + shadowBytes(document));
+  }
+  QCOMPARE(history->diskUsage(), qint64(0));
+
+  // The oldest steps are gone, so undoing stops at a later state
+  while (history->canUndo())
+    QVERIFY(history->undo() >= 0);
+  qsizetype state = states.indexOf(qHash(document.toPlainText()));
+  QVERIFY(state > 0);
+}
+
+QTEST_MAIN(TestUndoHistory)
+#include "tst_undohistory.moc"